@@ -21,17 +21,22 @@
 #include "conf-files.h"
 #include "copy.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "glob-util.h"
 #include "hashmap.h"
 #include "locale-util.h"
 #include "log.h"
+#include "logs-show.h"
 #include "pager.h"
 #include "parse-util.h"
 #include "path-util.h"
+#include "process-util.h"
 #if HAVE_SECCOMP
 #include "seccomp-util.h"
 #endif
+#include "set.h"
 #include "special.h"
+#include "stdio-util.h"
 #include "strv.h"
 #include "strxcpyx.h"
 #include "terminal-util.h"
@@ -344,6 +349,133 @@ static void free_host_info(struct host_info *hi) {
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct host_info*, free_host_info);
 
+/* After= dependencies of all units, as returned by ListUnitTimes(). Only set if the manager supports it. */
+static Hashmap *unit_after_hashmap;
+
+static bool unit_times_fill(struct unit_times *t, const struct boot_times *boot_times) {
+        assert(t);
+        assert(boot_times);
+
+        subtract_timestamp(&t->activating, boot_times->reverse_offset);
+        subtract_timestamp(&t->activated, boot_times->reverse_offset);
+        subtract_timestamp(&t->deactivating, boot_times->reverse_offset);
+        subtract_timestamp(&t->deactivated, boot_times->reverse_offset);
+
+        if (t->activated >= t->activating)
+                t->time = t->activated - t->activating;
+        else if (t->deactivated >= t->activating)
+                t->time = t->deactivated - t->activating;
+        else
+                t->time = 0;
+
+        return t->activating != 0;
+}
+
+static int acquire_time_data_bulk(sd_bus *bus, const struct boot_times *boot_times, struct unit_times **out) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(unit_times_freep) struct unit_times *unit_times = NULL;
+        size_t size = 0;
+        int r, c = 0;
+
+        /* Fetches the timestamps and After= dependencies of all units in one go. Returns -EOPNOTSUPP if the
+         * manager is too old to know ListUnitTimes(), so that the caller can fall back to per-unit queries. */
+
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "ListUnitTimes",
+                        &error, &reply,
+                        NULL);
+        if (r < 0) {
+                if (sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_METHOD) ||
+                    sd_bus_error_has_name(&error, SD_BUS_ERROR_ACCESS_DENIED)) {
+                        log_debug("Manager does not support ListUnitTimes(), falling back to per-unit queries: %s",
+                                  bus_error_message(&error, r));
+                        return -EOPNOTSUPP;
+                }
+
+                return log_error_errno(r, "Failed to list unit times: %s", bus_error_message(&error, r));
+        }
+
+        unit_after_hashmap = hashmap_free_free_free(unit_after_hashmap);
+        unit_after_hashmap = hashmap_new(&string_hash_ops);
+        if (!unit_after_hashmap)
+                return log_oom();
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(sttttas)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        for (;;) {
+                _cleanup_strv_free_ char **after = NULL;
+                _cleanup_free_ char *name = NULL, *nulstr = NULL;
+                struct unit_times *t;
+                const char *id;
+                size_t n;
+
+                if (!GREEDY_REALLOC(unit_times, size, c+2))
+                        return log_oom();
+
+                unit_times[c+1].has_data = false;
+                t = &unit_times[c];
+                t->has_data = false;
+                t->name = NULL;
+
+                r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_STRUCT, "sttttas");
+                if (r < 0)
+                        return bus_log_parse_error(r);
+                if (r == 0)
+                        break;
+
+                r = sd_bus_message_read(reply, "stttt", &id,
+                                        &t->activating, &t->activated, &t->deactivating, &t->deactivated);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                r = sd_bus_message_read_strv(reply, &after);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                r = sd_bus_message_exit_container(reply);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                name = strdup(id);
+                if (!name)
+                        return log_oom();
+
+                /* Stored as nulstr, so that the hashmap can be freed with hashmap_free_free_free() */
+                r = strv_make_nulstr(after, &nulstr, &n);
+                if (r < 0)
+                        return log_oom();
+
+                r = hashmap_put(unit_after_hashmap, name, nulstr);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to add entry to hashmap: %m");
+                name = nulstr = NULL;
+
+                if (!unit_times_fill(t, boot_times))
+                        continue;
+
+                t->name = strdup(id);
+                if (!t->name)
+                        return log_oom();
+
+                t->has_data = true;
+                c++;
+        }
+
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        *out = TAKE_PTR(unit_times);
+        return c;
+}
+
 static int acquire_time_data(sd_bus *bus, struct unit_times **out) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
@@ -357,6 +489,10 @@ static int acquire_time_data(sd_bus *bus, struct unit_times **out) {
         if (r < 0)
                 return r;
 
+        r = acquire_time_data_bulk(bus, boot_times, out);
+        if (r != -EOPNOTSUPP)
+                return r;
+
         r = sd_bus_call_method(
                         bus,
                         "org.freedesktop.systemd1",
@@ -380,6 +516,7 @@ static int acquire_time_data(sd_bus *bus, struct unit_times **out) {
 
                 unit_times[c+1].has_data = false;
                 t = &unit_times[c];
+                t->has_data = false;
                 t->name = NULL;
 
                 assert_cc(sizeof(usec_t) == sizeof(uint64_t));
@@ -402,19 +539,7 @@ static int acquire_time_data(sd_bus *bus, struct unit_times **out) {
                                             &t->deactivated) < 0)
                         return -EIO;
 
-                subtract_timestamp(&t->activating, boot_times->reverse_offset);
-                subtract_timestamp(&t->activated, boot_times->reverse_offset);
-                subtract_timestamp(&t->deactivating, boot_times->reverse_offset);
-                subtract_timestamp(&t->deactivated, boot_times->reverse_offset);
-
-                if (t->activated >= t->activating)
-                        t->time = t->activated - t->activating;
-                else if (t->deactivated >= t->activating)
-                        t->time = t->deactivated - t->activating;
-                else
-                        t->time = 0;
-
-                if (t->activating == 0)
+                if (!unit_times_fill(t, boot_times))
                         continue;
 
                 t->name = strdup(u.id);
@@ -797,6 +922,317 @@ static int analyze_plot(int argc, char *argv[], void *userdata) {
         return 0;
 }
 
+/* "Processes" the trace events are grouped by, so that intervals of different kinds don't overlap on one row */
+enum {
+        TRACE_PID_BOOT = 1,
+        TRACE_PID_UNITS,
+        TRACE_PID_JOBS,
+        TRACE_PID_CGROUPS,
+        TRACE_PID_SPAWN,
+        TRACE_PID_UDEV,
+};
+
+struct trace_unit {
+        char *name;
+        usec_t activating;
+        usec_t activated;
+        usec_t deactivating;
+        usec_t deactivated;
+        usec_t job_begin;
+        usec_t job_running;
+        usec_t realize_begin;
+        usec_t realize_end;
+        usec_t spawn_begin;
+        usec_t spawn_end;
+};
+
+static void trace_separator(FILE *f, bool *first) {
+        assert(f);
+        assert(first);
+
+        fputs(*first ? "\n" : ",\n", f);
+        *first = false;
+}
+
+static void trace_print_name(FILE *f, bool *first, const char *kind, unsigned pid, uint64_t tid, const char *name) {
+        trace_separator(f, first);
+
+        fprintf(f, "{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%u,\"tid\":%" PRIu64 ",\"args\":{\"name\":", kind, pid, tid);
+        json_escape(f, name, strlen(name), OUTPUT_SHOW_ALL);
+        fputs("}}", f);
+}
+
+static void trace_print_interval(FILE *f, bool *first, const char *cat, const char *name,
+                                 unsigned pid, uint64_t tid, usec_t begin, usec_t end) {
+
+        if (end == 0 || end < begin)
+                return;
+
+        trace_separator(f, first);
+
+        fputs("{\"name\":", f);
+        json_escape(f, name, strlen(name), OUTPUT_SHOW_ALL);
+        fprintf(f, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%u,\"tid\":%" PRIu64 ",\"ts\":" USEC_FMT ",\"dur\":" USEC_FMT "}",
+                cat, pid, tid, begin, end - begin);
+}
+
+static usec_t trace_subtract(usec_t t, usec_t offset) {
+        /* Timestamps taken before a user manager was started can't be relevant, drop them */
+        return t > offset ? t - offset : 0;
+}
+
+static void trace_unit_free_many(struct trace_unit *t, size_t n) {
+        size_t i;
+
+        for (i = 0; i < n; i++)
+                free(t[i].name);
+        free(t);
+}
+
+static int acquire_trace_data(sd_bus *bus, const struct boot_times *boot, struct trace_unit **ret, size_t *ret_n) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        struct trace_unit *units = NULL;
+        size_t n = 0, allocated = 0;
+        const char *id;
+        int r;
+
+        assert(bus);
+        assert(boot);
+        assert(ret);
+        assert(ret_n);
+
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "ListUnitTrace",
+                        &error, &reply,
+                        NULL);
+        if (r < 0) {
+                if (sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_METHOD) ||
+                    sd_bus_error_has_name(&error, SD_BUS_ERROR_ACCESS_DENIED))
+                        return -EOPNOTSUPP;
+
+                return log_error_errno(r, "Failed to get unit trace data: %s", bus_error_message(&error, r));
+        }
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(stttttttttt)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        for (;;) {
+                struct trace_unit t = {};
+
+                r = sd_bus_message_read(reply, "(stttttttttt)", &id,
+                                        &t.activating, &t.activated, &t.deactivating, &t.deactivated,
+                                        &t.job_begin, &t.job_running,
+                                        &t.realize_begin, &t.realize_end,
+                                        &t.spawn_begin, &t.spawn_end);
+                if (r < 0) {
+                        trace_unit_free_many(units, n);
+                        return bus_log_parse_error(r);
+                }
+                if (r == 0)
+                        break;
+
+                /* Drop units which never did anything, so that they don't show up as empty rows */
+                if (t.activating == 0 && t.job_begin == 0 && t.realize_begin == 0 && t.spawn_begin == 0)
+                        continue;
+
+                t.activating = trace_subtract(t.activating, boot->reverse_offset);
+                t.activated = trace_subtract(t.activated, boot->reverse_offset);
+                t.deactivating = trace_subtract(t.deactivating, boot->reverse_offset);
+                t.deactivated = trace_subtract(t.deactivated, boot->reverse_offset);
+                t.job_begin = trace_subtract(t.job_begin, boot->reverse_offset);
+                t.job_running = trace_subtract(t.job_running, boot->reverse_offset);
+                t.realize_begin = trace_subtract(t.realize_begin, boot->reverse_offset);
+                t.realize_end = trace_subtract(t.realize_end, boot->reverse_offset);
+                t.spawn_begin = trace_subtract(t.spawn_begin, boot->reverse_offset);
+                t.spawn_end = trace_subtract(t.spawn_end, boot->reverse_offset);
+
+                t.name = strdup(id);
+                if (!t.name || !GREEDY_REALLOC(units, allocated, n + 1)) {
+                        free(t.name);
+                        trace_unit_free_many(units, n);
+                        return log_oom();
+                }
+
+                units[n++] = t;
+        }
+
+        *ret = units;
+        *ret_n = n;
+        return 0;
+}
+
+static int trace_print_udev(FILE *f, bool *first) {
+        _cleanup_fclose_ FILE *t = NULL;
+        _cleanup_set_free_ Set *workers = NULL;
+        unsigned line = 0;
+        int r;
+
+        /* Picks up the event processing times systemd-udevd records if started with --trace or udev.trace */
+
+        t = fopen("/run/udev/trace", "re");
+        if (!t) {
+                if (errno != ENOENT)
+                        log_warning_errno(errno, "Failed to open /run/udev/trace, ignoring: %m");
+                else
+                        log_debug("No udev trace data found, boot with udev.trace=1 to record it.");
+                return 0;
+        }
+
+        workers = set_new(NULL);
+        if (!workers)
+                return log_oom();
+
+        for (;;) {
+                _cleanup_free_ char *l = NULL, *name = NULL;
+                unsigned long long seqnum;
+                usec_t queued, started, finished;
+                char action[16];
+                int devpath;
+                pid_t pid;
+
+                r = read_line(t, LONG_LINE_MAX, &l);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to read /run/udev/trace: %m");
+                if (r == 0)
+                        break;
+
+                line++;
+
+                if (sscanf(l, "%llu " USEC_FMT " " USEC_FMT " " USEC_FMT " " PID_FMT " %15s %n",
+                           &seqnum, &queued, &started, &finished, &pid, action, &devpath) != 6 ||
+                    pid <= 0) {
+                        log_debug("Failed to parse /run/udev/trace:%u, ignoring.", line);
+                        continue;
+                }
+
+                if (set_put(workers, PID_TO_PTR(pid)) > 0) {
+                        char buf[DECIMAL_STR_MAX(pid_t) + STRLEN("worker ")];
+
+                        xsprintf(buf, "worker " PID_FMT, pid);
+                        trace_print_name(f, first, "thread_name", TRACE_PID_UDEV, pid, buf);
+                }
+
+                if (asprintf(&name, "%s %s", action, l + devpath) < 0)
+                        return log_oom();
+
+                trace_print_interval(f, first, "udev-queue", name, TRACE_PID_UDEV, 0, queued, started);
+                trace_print_interval(f, first, "udev", name, TRACE_PID_UDEV, pid, started, finished);
+        }
+
+        return 0;
+}
+
+static int analyze_trace(int argc, char *argv[], void *userdata) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        struct trace_unit *units = NULL;
+        struct boot_times *boot;
+        bool first = true;
+        size_t n = 0, i;
+        int r;
+
+        r = acquire_bus(&bus, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to create bus connection: %m");
+
+        r = acquire_boot_times(bus, &boot);
+        if (r < 0)
+                return r;
+
+        r = acquire_trace_data(bus, boot, &units, &n);
+        if (r == -EOPNOTSUPP) {
+                _cleanup_(unit_times_freep) struct unit_times *times = NULL;
+                struct unit_times *u;
+
+                /* Older managers only know about the activation timestamps, so show just those */
+                log_notice("Manager does not provide job, cgroup and spawn timing, showing unit activation only.");
+
+                r = acquire_time_data(bus, &times);
+                if (r < 0)
+                        return r;
+
+                units = new0(struct trace_unit, r);
+                if (!units && r > 0)
+                        return log_oom();
+
+                for (u = times; r > 0 && u->has_data; u++) {
+                        units[n] = (struct trace_unit) {
+                                .name = TAKE_PTR(u->name),
+                                .activating = u->activating,
+                                .activated = u->activated,
+                                .deactivating = u->deactivating,
+                                .deactivated = u->deactivated,
+                        };
+                        n++;
+                }
+        } else if (r < 0)
+                return r;
+
+        fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", stdout);
+
+        trace_print_name(stdout, &first, "process_name", TRACE_PID_BOOT, 0, "boot");
+        trace_print_name(stdout, &first, "process_name", TRACE_PID_UNITS, 0, "units");
+        trace_print_name(stdout, &first, "process_name", TRACE_PID_JOBS, 0, "job queue");
+        trace_print_name(stdout, &first, "process_name", TRACE_PID_CGROUPS, 0, "cgroup realization");
+        trace_print_name(stdout, &first, "process_name", TRACE_PID_SPAWN, 0, "process spawning");
+
+        if (boot->initrd_time > 0) {
+                trace_print_interval(stdout, &first, "boot", "kernel", TRACE_PID_BOOT, 0, 0, boot->initrd_time);
+                trace_print_interval(stdout, &first, "boot", "initrd", TRACE_PID_BOOT, 0, boot->initrd_time, boot->userspace_time);
+        } else if (boot->userspace_time > 0)
+                trace_print_interval(stdout, &first, "boot", "kernel", TRACE_PID_BOOT, 0, 0, boot->userspace_time);
+
+        trace_print_interval(stdout, &first, "boot", "userspace", TRACE_PID_BOOT, 0, boot->userspace_time, boot->finish_time);
+        trace_print_interval(stdout, &first, "boot", "security", TRACE_PID_BOOT, 1,
+                             boot->security_start_time, boot->security_finish_time);
+        trace_print_interval(stdout, &first, "boot", "generators", TRACE_PID_BOOT, 1,
+                             boot->generators_start_time, boot->generators_finish_time);
+        trace_print_interval(stdout, &first, "boot", "loading units", TRACE_PID_BOOT, 1,
+                             boot->unitsload_start_time, boot->unitsload_finish_time);
+
+        for (i = 0; i < n; i++) {
+                struct trace_unit *t = units + i;
+                unsigned pid;
+
+                for (pid = TRACE_PID_UNITS; pid <= TRACE_PID_SPAWN; pid++)
+                        trace_print_name(stdout, &first, "thread_name", pid, i + 1, t->name);
+
+                /* Failed units never become active, show them up to the point they became inactive again */
+                if (t->activating > 0)
+                        trace_print_interval(stdout, &first, "unit", "activating", TRACE_PID_UNITS, i + 1, t->activating,
+                                             t->activated >= t->activating ? t->activated : t->deactivated);
+                if (t->deactivating > 0 && t->deactivating >= t->activated)
+                        trace_print_interval(stdout, &first, "unit", "deactivating", TRACE_PID_UNITS, i + 1,
+                                             t->deactivating, t->deactivated);
+
+                trace_print_interval(stdout, &first, "job", "waiting", TRACE_PID_JOBS, i + 1, t->job_begin, t->job_running);
+                trace_print_interval(stdout, &first, "cgroup", "realize", TRACE_PID_CGROUPS, i + 1,
+                                     t->realize_begin, t->realize_end);
+                trace_print_interval(stdout, &first, "spawn", "fork", TRACE_PID_SPAWN, i + 1,
+                                     t->spawn_begin, t->spawn_end);
+        }
+
+        trace_unit_free_many(units, n);
+
+        if (arg_scope == UNIT_FILE_SYSTEM && arg_transport == BUS_TRANSPORT_LOCAL) {
+                trace_print_name(stdout, &first, "process_name", TRACE_PID_UDEV, 0, "udev");
+                trace_print_name(stdout, &first, "thread_name", TRACE_PID_UDEV, 0, "event queue");
+
+                r = trace_print_udev(stdout, &first);
+                if (r < 0)
+                        return r;
+        }
+
+        fputs("\n]}\n", stdout);
+
+        return fflush_and_check(stdout);
+}
+
 static int list_dependencies_print(const char *name, unsigned int level, unsigned int branches,
                                    bool last, struct unit_times *times, struct boot_times *boot) {
         unsigned int i;
@@ -830,6 +1266,23 @@ static int list_dependencies_get_dependencies(sd_bus *bus, const char *name, cha
         assert(name);
         assert(deps);
 
+        if (unit_after_hashmap) {
+                const char *after;
+
+                /* Use the dependencies we got along with the timestamps, if the unit is known by that name */
+                after = hashmap_get(unit_after_hashmap, name);
+                if (after) {
+                        char **l;
+
+                        l = strv_split_nulstr(after);
+                        if (!l)
+                                return -ENOMEM;
+
+                        *deps = l;
+                        return 0;
+                }
+        }
+
         path = unit_dbus_path_from_name(name);
         if (!path)
                 return -ENOMEM;
@@ -1058,6 +1511,88 @@ static int analyze_blame(int argc, char *argv[], void *userdata) {
         return 0;
 }
 
+struct generator_time {
+        const char *name;
+        usec_t runtime;
+        bool cached;
+};
+
+static int compare_generator_time(const void *a, const void *b) {
+        const struct generator_time *x = a, *y = b;
+
+        /* Generators which were never actually run go last */
+        return compare(y->runtime == USEC_INFINITY ? 0 : y->runtime,
+                       x->runtime == USEC_INFINITY ? 0 : x->runtime);
+}
+
+static int analyze_generators(int argc, char *argv[], void *userdata) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_free_ struct generator_time *times = NULL;
+        size_t n = 0, allocated = 0, i;
+        int r;
+
+        r = acquire_bus(&bus, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to create bus connection: %m");
+
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "ListGenerators",
+                        &error, &reply,
+                        NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to list generators: %s", bus_error_message(&error, r));
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(stb)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        for (;;) {
+                const char *name;
+                uint64_t runtime;
+                int cached;
+
+                r = sd_bus_message_read(reply, "(stb)", &name, &runtime, &cached);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+                if (r == 0)
+                        break;
+
+                if (!GREEDY_REALLOC(times, allocated, n + 1))
+                        return log_oom();
+
+                times[n++] = (struct generator_time) {
+                        .name = name,
+                        .runtime = runtime,
+                        .cached = cached,
+                };
+        }
+
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        qsort_safe(times, n, sizeof(struct generator_time), compare_generator_time);
+
+        (void) pager_open(arg_no_pager, false);
+
+        for (i = 0; i < n; i++) {
+                char ts[FORMAT_TIMESPAN_MAX];
+
+                printf("%16s %s%s\n",
+                       times[i].runtime == USEC_INFINITY ? "-" : format_timespan(ts, sizeof(ts), times[i].runtime, USEC_PER_MSEC),
+                       times[i].name,
+                       times[i].cached ? " (output reused)" : "");
+        }
+
+        return 0;
+}
+
 static int analyze_time(int argc, char *argv[], void *userdata) {
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         _cleanup_free_ char *buf = NULL;
@@ -1698,8 +2233,10 @@ static int help(int argc, char *argv[], void *userdata) {
                "Commands:\n"
                "  time                     Print time spent in the kernel\n"
                "  blame                    Print list of running units ordered by time to init\n"
+               "  generators               Print list of unit generators ordered by runtime\n"
                "  critical-chain [UNIT...] Print a tree of the time critical chain of units\n"
                "  plot                     Output SVG graphic showing service initialization\n"
+               "  trace                    Output boot trace in Chrome trace event JSON format\n"
                "  dot [UNIT...]            Output dependency graph in man:dot(1) format\n"
                "  log-level [LEVEL]        Get/set logging threshold for manager\n"
                "  log-target [TARGET]      Get/set logging target for manager\n"
@@ -1882,8 +2419,10 @@ int main(int argc, char *argv[]) {
                 { "help",              VERB_ANY, VERB_ANY, 0,            help                   },
                 { "time",              VERB_ANY, 1,        VERB_DEFAULT, analyze_time           },
                 { "blame",             VERB_ANY, 1,        0,            analyze_blame          },
+                { "generators",        VERB_ANY, 1,        0,            analyze_generators     },
                 { "critical-chain",    VERB_ANY, VERB_ANY, 0,            analyze_critical_chain },
                 { "plot",              VERB_ANY, 1,        0,            analyze_plot           },
+                { "trace",             VERB_ANY, 1,        0,            analyze_trace          },
                 { "dot",               VERB_ANY, VERB_ANY, 0,            dot                    },
                 { "log-level",         VERB_ANY, 2,        0,            get_or_set_log_level   },
                 { "log-target",        VERB_ANY, 2,        0,            get_or_set_log_target  },
@@ -1922,6 +2461,7 @@ finish:
 
         strv_free(arg_dot_from_patterns);
         strv_free(arg_dot_to_patterns);
+        hashmap_free_free_free(unit_after_hashmap);
 
         return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -4,6 +4,7 @@
 #include <errno.h>
 #include <sys/prctl.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <stdio.h>
 
@@ -14,6 +15,7 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "hashmap.h"
+#include "io-util.h"
 #include "macro.h"
 #include "process-util.h"
 #include "set.h"
@@ -66,16 +68,17 @@ static int do_spawn(const char *path, char *argv[], int stdout_fd, pid_t *pid) {
 }
 
 static int do_execute(
-                char **directories,
+                char **paths,
                 usec_t timeout,
                 gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
                 void* const callback_args[_STDOUT_CONSUME_MAX],
                 int output_fd,
-                char *argv[]) {
+                char **argvs[],
+                ExecutorResult *results) {
 
-        _cleanup_hashmap_free_free_ Hashmap *pids = NULL;
-        _cleanup_strv_free_ char **paths = NULL;
-        char **path;
+        _cleanup_hashmap_free_ Hashmap *pids = NULL;
+        _cleanup_free_ usec_t *started = NULL;
+        size_t i, n;
         int r;
 
         /* We fork this all off from a child process so that we can somewhat cleanly make
@@ -84,9 +87,7 @@ static int do_execute(
          * If callbacks is nonnull, execution is serial. Otherwise, we default to parallel.
          */
 
-        r = conf_files_list_strv(&paths, NULL, NULL, CONF_FILES_EXECUTABLE|CONF_FILES_REGULAR|CONF_FILES_FILTER_MASKED, (const char* const*) directories);
-        if (r < 0)
-                return r;
+        n = strv_length(paths);
 
         if (!callbacks) {
                 pids = hashmap_new(NULL);
@@ -94,38 +95,58 @@ static int do_execute(
                         return log_oom();
         }
 
+        if (results) {
+                started = new(usec_t, n);
+                if (!started)
+                        return log_oom();
+
+                for (i = 0; i < n; i++)
+                        results[i] = (ExecutorResult) { .duration = USEC_INFINITY };
+        }
+
         /* Abort execution of this process after the timout. We simply rely on SIGALRM as
          * default action terminating the process, and turn on alarm(). */
 
         if (timeout != USEC_INFINITY)
                 alarm(DIV_ROUND_UP(timeout, USEC_PER_SEC));
 
-        STRV_FOREACH(path, paths) {
+        for (i = 0; i < n; i++) {
                 _cleanup_free_ char *t = NULL;
                 _cleanup_close_ int fd = -1;
                 pid_t pid;
 
-                t = strdup(*path);
+                t = strdup(paths[i]);
                 if (!t)
                         return log_oom();
 
                 if (callbacks) {
-                        fd = open_serialization_fd(basename(*path));
+                        fd = open_serialization_fd(basename(paths[i]));
                         if (fd < 0)
                                 return log_error_errno(fd, "Failed to open serialization file: %m");
                 }
 
-                r = do_spawn(t, argv, fd, &pid);
+                if (started)
+                        started[i] = now(CLOCK_MONOTONIC);
+
+                r = do_spawn(t, argvs ? argvs[i] : NULL, fd, &pid);
+                if (r < 0 && results)
+                        results[i].status = r;
                 if (r <= 0)
                         continue;
 
                 if (pids) {
-                        r = hashmap_put(pids, PID_TO_PTR(pid), t);
+                        /* The index into paths[] is the position of the path in the list, store it
+                         * offset by one, so that the first entry isn't confused with a missing one */
+                        r = hashmap_put(pids, PID_TO_PTR(pid), SIZE_TO_PTR(i + 1));
                         if (r < 0)
                                 return log_oom();
-                        t = NULL;
                 } else {
                         r = wait_for_terminate_and_check(t, pid, WAIT_LOG);
+                        if (results)
+                                results[i] = (ExecutorResult) {
+                                        .duration = now(CLOCK_MONOTONIC) - started[i],
+                                        .status = r,
+                                };
                         if (r < 0)
                                 continue;
 
@@ -135,7 +156,7 @@ static int do_execute(
                         r = callbacks[STDOUT_GENERATE](fd, callback_args[STDOUT_GENERATE]);
                         fd = -1;
                         if (r < 0)
-                                return log_error_errno(r, "Failed to process output from %s: %m", *path);
+                                return log_error_errno(r, "Failed to process output from %s: %m", paths[i]);
                 }
         }
 
@@ -146,36 +167,50 @@ static int do_execute(
         }
 
         while (!hashmap_isempty(pids)) {
-                _cleanup_free_ char *t = NULL;
+                siginfo_t si = {};
                 pid_t pid;
 
-                pid = PTR_TO_PID(hashmap_first_key(pids));
-                assert(pid > 0);
+                /* Reap the children in the order they finish, so that the time each one took is
+                 * known precisely, and not only once all those started before it are done. */
+                if (waitid(P_ALL, 0, &si, WEXITED|WNOWAIT) < 0) {
+                        if (errno == EINTR)
+                                continue;
 
-                t = hashmap_remove(pids, PID_TO_PTR(pid));
-                assert(t);
+                        return log_error_errno(errno, "Failed to wait for children: %m");
+                }
 
-                (void) wait_for_terminate_and_check(t, pid, WAIT_LOG);
+                pid = si.si_pid;
+                i = PTR_TO_SIZE(hashmap_remove(pids, PID_TO_PTR(pid)));
+                if (i == 0) {
+                        /* Not ours, let's just reap it */
+                        (void) waitpid(pid, NULL, 0);
+                        continue;
+                }
+                i--;
+
+                r = wait_for_terminate_and_check(paths[i], pid, WAIT_LOG);
+                if (results)
+                        results[i] = (ExecutorResult) {
+                                .duration = now(CLOCK_MONOTONIC) - started[i],
+                                .status = r,
+                        };
         }
 
         return 0;
 }
 
-int execute_directories(
-                const char* const* directories,
+int execute_strv(
+                const char *name,
+                char* const* paths,
                 usec_t timeout,
                 gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
                 void* const callback_args[_STDOUT_CONSUME_MAX],
-                char *argv[]) {
+                char **argvs[],
+                ExecutorResult *results) {
 
-        char **dirs = (char**) directories;
-        _cleanup_close_ int fd = -1;
-        char *name;
+        _cleanup_close_ int fd = -1, results_fd = -1;
         int r;
 
-        assert(!strv_isempty(dirs));
-
-        name = basename(dirs[0]);
         assert(!isempty(name));
 
         if (callbacks) {
@@ -189,18 +224,61 @@ int execute_directories(
                         return log_error_errno(fd, "Failed to open serialization file: %m");
         }
 
-        /* Executes all binaries in the directories serially or in parallel and waits for
-         * them to finish. Optionally a timeout is applied. If a file with the same name
-         * exists in more than one directory, the earliest one wins. */
+        /* The executor runs in a separate process, hence let it pass back the results through a
+         * file, too. */
+        if (results) {
+                results_fd = open_serialization_fd(name);
+                if (results_fd < 0)
+                        return log_error_errno(results_fd, "Failed to open serialization file: %m");
+        }
+
+        /* Executes all binaries in the list serially or in parallel and waits for them to finish.
+         * Optionally a timeout is applied. If argvs is non-NULL, argvs[i] is the argument vector to
+         * pass to paths[i] (argv[0] is filled in with the path). If results is non-NULL, the wall
+         * clock time each binary took and how it exited is stored in results[i]. */
 
         r = safe_fork("(sd-executor)", FORK_RESET_SIGNALS|FORK_DEATHSIG|FORK_LOG|FORK_WAIT, NULL);
         if (r < 0)
                 return r;
         if (r == 0) {
-                r = do_execute(dirs, timeout, callbacks, callback_args, fd, argv);
+                _cleanup_free_ ExecutorResult *d = NULL;
+
+                if (results) {
+                        d = new(ExecutorResult, strv_length((char**) paths));
+                        if (!d) {
+                                log_oom();
+                                _exit(EXIT_FAILURE);
+                        }
+                }
+
+                r = do_execute((char**) paths, timeout, callbacks, callback_args, fd, argvs, d);
+                if (r >= 0 && d) {
+                        r = loop_write(results_fd, d, strv_length((char**) paths) * sizeof(ExecutorResult), false);
+                        if (r < 0)
+                                log_error_errno(r, "Failed to pass back results: %m");
+                }
+
                 _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
         }
 
+        if (results) {
+                size_t i, n = strv_length((char**) paths);
+                ssize_t l;
+
+                if (lseek(results_fd, 0, SEEK_SET) < 0)
+                        return log_error_errno(errno, "Failed to rewind serialization fd: %m");
+
+                l = loop_read(results_fd, results, n * sizeof(ExecutorResult), true);
+                if (l < 0)
+                        return log_error_errno((int) l, "Failed to read back results: %m");
+                if ((size_t) l != n * sizeof(ExecutorResult))
+                        for (i = 0; i < n; i++)
+                                results[i] = (ExecutorResult) {
+                                        .duration = USEC_INFINITY,
+                                        .status = -EPROTO,
+                                };
+        }
+
         if (!callbacks)
                 return 0;
 
@@ -214,6 +292,41 @@ int execute_directories(
         return 0;
 }
 
+int execute_directories(
+                const char* const* directories,
+                usec_t timeout,
+                gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
+                void* const callback_args[_STDOUT_CONSUME_MAX],
+                char *argv[]) {
+
+        char **dirs = (char**) directories;
+        _cleanup_strv_free_ char **paths = NULL;
+        char ***argvs;
+        size_t i, n;
+        char *name;
+        int r;
+
+        assert(!strv_isempty(dirs));
+
+        name = basename(dirs[0]);
+        assert(!isempty(name));
+
+        /* Executes all binaries in the directories serially or in parallel and waits for
+         * them to finish. Optionally a timeout is applied. If a file with the same name
+         * exists in more than one directory, the earliest one wins. */
+
+        r = conf_files_list_strv(&paths, NULL, NULL, CONF_FILES_EXECUTABLE|CONF_FILES_REGULAR|CONF_FILES_FILTER_MASKED, directories);
+        if (r < 0)
+                return log_error_errno(r, "Failed to enumerate executables: %m");
+
+        n = strv_length(paths);
+        argvs = newa(char**, n + 1);
+        for (i = 0; i < n; i++)
+                argvs[i] = argv;
+
+        return execute_strv(name, paths, timeout, callbacks, callback_args, argvs, NULL);
+}
+
 static int gather_environment_generate(int fd, void *arg) {
         char ***env = arg, **x, **y;
         _cleanup_fclose_ FILE *f = NULL;
@@ -13,6 +13,20 @@ enum {
         _STDOUT_CONSUME_MAX,
 };
 
+typedef struct ExecutorResult {
+        usec_t duration; /* wall clock runtime, USEC_INFINITY if the binary wasn't run */
+        int status;      /* exit status, or negative errno if it couldn't be run or was killed */
+} ExecutorResult;
+
+int execute_strv(
+                const char *name,
+                char* const* paths,
+                usec_t timeout,
+                gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
+                void* const callback_args[_STDOUT_CONSUME_MAX],
+                char **argvs[],
+                ExecutorResult *results);
+
 int execute_directories(
                 const char* const* directories,
                 usec_t timeout,
@@ -41,6 +41,22 @@
 
 #define SNDBUF_SIZE (8*1024*1024)
 
+/* Size of the buffer messages for the journal are queued in when logging asynchronously, the largest message
+ * that is queued rather than sent synchronously, and how many messages are sent with a single syscall */
+#define LOG_ASYNC_BUFFER_SIZE (1024U*1024U)
+#define LOG_ASYNC_ENTRY_MAX (LOG_ASYNC_BUFFER_SIZE / 16U)
+#define LOG_ASYNC_BATCH 64U
+
+/* Marks the end of the used part of the buffer, when the next entry is placed at its beginning */
+#define LOG_ASYNC_WRAP ((size_t) -1)
+
+typedef struct LogAsyncEntry {
+        size_t size;           /* size of the datagram following this header, or LOG_ASYNC_WRAP */
+        size_t message_offset; /* the MESSAGE= payload within the datagram, for the kmsg fallback */
+        size_t message_size;
+        int level;
+} LogAsyncEntry;
+
 static LogTarget log_target = LOG_TARGET_CONSOLE;
 static int log_max_level[] = {LOG_INFO, LOG_INFO};
 assert_cc(ELEMENTSOF(log_max_level) == _LOG_REALM_MAX);
@@ -61,6 +77,14 @@ static bool always_reopen_console = false;
 static bool open_when_needed = false;
 static bool prohibit_ipc = false;
 
+/* The ring buffer of messages queued for the journal, see log_set_async() */
+static bool log_async = false;
+static bool log_async_busy = false;
+static pid_t log_async_pid = 0;
+static uint8_t *log_async_buffer = NULL;
+static size_t log_async_head = 0, log_async_tail = 0, log_async_used = 0, log_async_n = 0;
+static uint64_t log_async_n_dropped = 0, log_async_n_dropped_reported = 0;
+
 /* Akin to glibc's __abort_msg; which is private and we hence cannot
  * use here. */
 static char *log_abort_msg = NULL;
@@ -186,7 +210,13 @@ fail:
         return r;
 }
 
+static void log_async_drain_to_kmsg(void);
+
 static void log_close_journal(void) {
+        /* Don't lose whatever is still queued for the journal */
+        if (log_async_flush(true) < 0)
+                log_async_drain_to_kmsg();
+
         journal_fd = safe_close(journal_fd);
 }
 
@@ -445,13 +475,7 @@ static int write_to_syslog(
         return 1;
 }
 
-static int write_to_kmsg(
-                int level,
-                int error,
-                const char *file,
-                int line,
-                const char *func,
-                const char *buffer) {
+static int write_to_kmsg_raw(int level, const char *message, size_t size) {
 
         char header_priority[2 + DECIMAL_STR_MAX(int) + 1],
              header_pid[4 + DECIMAL_STR_MAX(pid_t) + 1];
@@ -466,7 +490,7 @@ static int write_to_kmsg(
         iovec[0] = IOVEC_MAKE_STRING(header_priority);
         iovec[1] = IOVEC_MAKE_STRING(program_invocation_short_name);
         iovec[2] = IOVEC_MAKE_STRING(header_pid);
-        iovec[3] = IOVEC_MAKE_STRING(buffer);
+        iovec[3] = IOVEC_MAKE((char*) message, size);
         iovec[4] = IOVEC_MAKE_STRING("\n");
 
         if (writev(kmsg_fd, iovec, ELEMENTSOF(iovec)) < 0)
@@ -475,6 +499,290 @@ static int write_to_kmsg(
         return 1;
 }
 
+static int write_to_kmsg(
+                int level,
+                int error,
+                const char *file,
+                int line,
+                const char *func,
+                const char *buffer) {
+
+        return write_to_kmsg_raw(level, buffer, strlen(buffer));
+}
+
+static bool log_async_active(void) {
+        /* Forked off children inherit the buffer, but must neither use nor flush it */
+        return log_async && log_async_pid == getpid_cached();
+}
+
+static LogAsyncEntry* log_async_entry(size_t *p) {
+        LogAsyncEntry *e;
+
+        assert_raw(p);
+
+        if (LOG_ASYNC_BUFFER_SIZE - *p < sizeof(LogAsyncEntry))
+                *p = 0;
+        else {
+                e = (LogAsyncEntry*) (log_async_buffer + *p);
+                if (e->size == LOG_ASYNC_WRAP)
+                        *p = 0;
+        }
+
+        return (LogAsyncEntry*) (log_async_buffer + *p);
+}
+
+static LogAsyncEntry* log_async_alloc(size_t size) {
+        LogAsyncEntry *e;
+        size_t p;
+
+        /* The used part of the buffer is [head, tail) if tail > head, and [head, end) + [0, tail)
+         * otherwise. tail is never moved onto head, so that the two cases are never ambiguous. */
+
+        if (log_async_n == 0)
+                log_async_head = log_async_tail = 0;
+
+        if (log_async_tail >= log_async_head) {
+                if (LOG_ASYNC_BUFFER_SIZE - log_async_tail >= size)
+                        p = log_async_tail;
+                else if (log_async_head > size) {
+                        if (LOG_ASYNC_BUFFER_SIZE - log_async_tail >= sizeof(LogAsyncEntry)) {
+                                e = (LogAsyncEntry*) (log_async_buffer + log_async_tail);
+                                e->size = LOG_ASYNC_WRAP;
+                        }
+
+                        p = 0;
+                } else
+                        return NULL;
+        } else if (log_async_head - log_async_tail > size)
+                p = log_async_tail;
+        else
+                return NULL;
+
+        log_async_tail = p + size;
+        log_async_used += size;
+        log_async_n++;
+
+        return (LogAsyncEntry*) (log_async_buffer + p);
+}
+
+static void log_async_pop(void) {
+        LogAsyncEntry *e;
+        size_t size;
+
+        assert_raw(log_async_n > 0);
+
+        e = log_async_entry(&log_async_head);
+        size = ALIGN(sizeof(LogAsyncEntry) + e->size);
+
+        log_async_head += size;
+        log_async_used -= size;
+        log_async_n--;
+}
+
+static void log_async_drain_to_kmsg(void) {
+        LogAsyncEntry *e;
+
+        if (log_async_n > 0)
+                (void) log_open_kmsg();
+
+        while (log_async_n > 0) {
+                e = log_async_entry(&log_async_head);
+                (void) write_to_kmsg_raw(e->level, (const char*) (e + 1) + e->message_offset, e->message_size);
+                log_async_pop();
+        }
+}
+
+int log_async_flush(bool wait) {
+        uint64_t n_dropped;
+        int r = 0;
+
+        if (!log_async_active() || log_async_n == 0 || log_async_busy)
+                return 0;
+
+        log_async_busy = true;
+
+        while (log_async_n > 0) {
+                struct mmsghdr mmsg[LOG_ASYNC_BATCH] = {};
+                struct iovec iovec[LOG_ASYNC_BATCH];
+                size_t n, p = log_async_head;
+                LogAsyncEntry *e;
+                int k;
+
+                if (journal_fd < 0) {
+                        r = -ENOTCONN;
+                        break;
+                }
+
+                for (n = 0; n < MIN(log_async_n, LOG_ASYNC_BATCH); n++) {
+                        e = log_async_entry(&p);
+
+                        iovec[n] = IOVEC_MAKE(e + 1, e->size);
+                        mmsg[n].msg_hdr.msg_iov = iovec + n;
+                        mmsg[n].msg_hdr.msg_iovlen = 1;
+
+                        p += ALIGN(sizeof(LogAsyncEntry) + e->size);
+                }
+
+                /* Unless asked to, never block here: if journald is busy the caller is supposed to try again
+                 * once the socket becomes writable, see manager_flush_log(). */
+                k = sendmmsg(journal_fd, mmsg, n, MSG_NOSIGNAL|(wait ? 0 : MSG_DONTWAIT));
+                if (k < 0) {
+                        r = -errno;
+                        break;
+                }
+
+                while (k-- > 0)
+                        log_async_pop();
+        }
+
+        if (r == -EAGAIN) {
+                /* journald is busy. When waiting, this means it didn't take anything within the send timeout,
+                 * which is only 10ms for PID 1. That's no reason to give up on the journal, hence keep the
+                 * queue, and let the caller decide what to do with the message it wants to send. */
+                log_async_busy = false;
+                return wait ? -EAGAIN : 1;
+        }
+
+        if (r < 0) {
+                /* journald is gone, or we cannot talk to it anymore. The kernel log buffer is the best we
+                 * can do then. */
+                log_async_drain_to_kmsg();
+
+                if (r != -ENOTCONN)
+                        journal_fd = safe_close(journal_fd);
+        }
+
+        log_async_busy = false;
+
+        n_dropped = log_async_n_dropped - log_async_n_dropped_reported;
+        if (n_dropped > 0 && r >= 0) {
+                log_async_n_dropped_reported = log_async_n_dropped;
+                log_warning("Log buffer was full, %" PRIu64 " messages were only written to the kernel log buffer.", n_dropped);
+        }
+
+        return 0;
+}
+
+static const char* log_find_message(const struct iovec *iovec, size_t n_iovec, size_t *ret_offset, size_t *ret_size) {
+        size_t offset = 0, i;
+
+        for (i = 0; i < n_iovec; offset += iovec[i].iov_len, i++) {
+                if (!memory_startswith(iovec[i].iov_base, iovec[i].iov_len, "MESSAGE="))
+                        continue;
+
+                /* Either the payload follows in the same iovec, or it is the next one */
+                if (iovec[i].iov_len == STRLEN("MESSAGE=") && i + 1 < n_iovec) {
+                        *ret_offset = offset + iovec[i].iov_len;
+                        *ret_size = iovec[i+1].iov_len;
+                        return iovec[i+1].iov_base;
+                }
+
+                *ret_offset = offset + STRLEN("MESSAGE=");
+                *ret_size = iovec[i].iov_len - STRLEN("MESSAGE=");
+                return (const char*) iovec[i].iov_base + STRLEN("MESSAGE=");
+        }
+
+        *ret_offset = *ret_size = 0;
+        return "";
+}
+
+static int log_async_push(int level, const struct iovec *iovec, size_t n_iovec) {
+        size_t size = 0, message_offset, message_size, i;
+        const char *message;
+        LogAsyncEntry *e;
+        uint8_t *p;
+
+        for (i = 0; i < n_iovec; i++)
+                size += iovec[i].iov_len;
+
+        if (size > LOG_ASYNC_ENTRY_MAX)
+                return -E2BIG;
+
+        if (!log_async_buffer) {
+                log_async_buffer = malloc(LOG_ASYNC_BUFFER_SIZE);
+                if (!log_async_buffer)
+                        return -ENOMEM;
+        }
+
+        message = log_find_message(iovec, n_iovec, &message_offset, &message_size);
+
+        e = log_async_alloc(ALIGN(sizeof(LogAsyncEntry) + size));
+        if (!e) {
+                /* Queueing this after what is already queued is not possible, and sending it right away
+                 * would reorder it. Hence only put it in the kernel log buffer, and remember that we did
+                 * so, to tell about it later. */
+                log_async_n_dropped++;
+
+                (void) log_open_kmsg();
+                (void) write_to_kmsg_raw(level, message, message_size);
+                return 1;
+        }
+
+        *e = (LogAsyncEntry) {
+                .size = size,
+                .message_offset = message_offset,
+                .message_size = message_size,
+                .level = level,
+        };
+
+        for (i = 0, p = (uint8_t*) (e + 1); i < n_iovec; i++)
+                p = mempcpy(p, iovec[i].iov_base, iovec[i].iov_len);
+
+        /* Don't wait for the event loop if the buffer is filling up quickly */
+        if (log_async_used > LOG_ASYNC_BUFFER_SIZE / 2)
+                (void) log_async_flush(false);
+
+        return 1;
+}
+
+static int log_send_journal(int level, struct iovec *iovec, size_t n_iovec) {
+        struct msghdr mh = {
+                .msg_iov = iovec,
+                .msg_iovlen = n_iovec,
+        };
+
+        assert_raw(journal_fd >= 0);
+
+        /* Anything critical is sent right away, in case we are about to die */
+        if (log_async_active() && LOG_PRI(level) > LOG_CRIT &&
+            log_async_push(level, iovec, n_iovec) > 0)
+                return 1;
+
+        /* Whatever was queued before goes first. If journald doesn't take that in time, sending this right
+         * away would reorder it, hence let the caller put it in the kernel log buffer instead. */
+        if (log_async_flush(true) < 0)
+                return -EAGAIN;
+        if (journal_fd < 0)
+                return -ENOTCONN;
+
+        if (sendmsg(journal_fd, &mh, MSG_NOSIGNAL) < 0)
+                return -errno;
+
+        return 1;
+}
+
+void log_set_async(bool b) {
+        if (!b) {
+                if (log_async_flush(true) < 0)
+                        log_async_drain_to_kmsg();
+
+                log_async_buffer = mfree(log_async_buffer);
+                log_async_head = log_async_tail = log_async_used = log_async_n = 0;
+        }
+
+        log_async = b;
+        log_async_pid = b ? getpid_cached() : 0;
+}
+
+int log_async_fd(void) {
+        return journal_fd;
+}
+
+void log_set_journal_fd(int fd) {
+        log_close_journal();
+        journal_fd = fd;
+}
+
 static int log_do_header(
                 char *header,
                 size_t size,
@@ -535,7 +843,6 @@ static int write_to_journal(
 
         char header[LINE_MAX];
         struct iovec iovec[4] = {};
-        struct msghdr mh = {};
 
         if (journal_fd < 0)
                 return 0;
@@ -547,13 +854,7 @@ static int write_to_journal(
         iovec[2] = IOVEC_MAKE_STRING(buffer);
         iovec[3] = IOVEC_MAKE_STRING("\n");
 
-        mh.msg_iov = iovec;
-        mh.msg_iovlen = ELEMENTSOF(iovec);
-
-        if (sendmsg(journal_fd, &mh, MSG_NOSIGNAL) < 0)
-                return -errno;
-
-        return 1;
+        return log_send_journal(level, iovec, ELEMENTSOF(iovec));
 }
 
 int log_dispatch_internal(
@@ -918,9 +1219,6 @@ int log_struct_internal(
                         struct iovec iovec[17] = {};
                         size_t n = 0, i;
                         int r;
-                        struct msghdr mh = {
-                                .msg_iov = iovec,
-                        };
                         bool fallback = false;
 
                         /* If the journal is available do structured logging */
@@ -931,10 +1229,8 @@ int log_struct_internal(
                         r = log_format_iovec(iovec, ELEMENTSOF(iovec), &n, true, error, format, ap);
                         if (r < 0)
                                 fallback = true;
-                        else {
-                                mh.msg_iovlen = n;
-                                (void) sendmsg(journal_fd, &mh, MSG_NOSIGNAL);
-                        }
+                        else
+                                (void) log_send_journal(level, iovec, n);
 
                         va_end(ap);
                         for (i = 1; i < n; i += 2)
@@ -1015,10 +1311,6 @@ int log_struct_iovec_internal(
 
                 struct iovec iovec[1 + n_input_iovec*2];
                 char header[LINE_MAX];
-                struct msghdr mh = {
-                        .msg_iov = iovec,
-                        .msg_iovlen = 1 + n_input_iovec*2,
-                };
 
                 log_do_header(header, sizeof(header), level, error, file, line, func, NULL, NULL, NULL, NULL);
                 iovec[0] = IOVEC_MAKE_STRING(header);
@@ -1028,7 +1320,7 @@ int log_struct_iovec_internal(
                         iovec[1+i*2+1] = IOVEC_MAKE_STRING("\n");
                 }
 
-                if (sendmsg(journal_fd, &mh, MSG_NOSIGNAL) >= 0)
+                if (log_send_journal(level, iovec, 1 + n_input_iovec*2) >= 0)
                         return -error;
         }
 
@@ -278,6 +278,19 @@ void log_set_open_when_needed(bool b);
  * stderr, the console or kmsg */
 void log_set_prohibit_ipc(bool b);
 
+/* If turned on, messages for the journal are queued in a bounded buffer instead of being sent right away, and need
+ * to be sent with log_async_flush() whenever log_async_fd() is writable. Only messages of LOG_CRIT and above are
+ * still sent synchronously, after everything queued before them. If journald doesn't take the queue within the
+ * send timeout, they are written to kmsg instead, and the queue is kept. If the buffer overflows, messages are only
+ * written to kmsg. Only affects the calling process, not its children. */
+void log_set_async(bool b);
+int log_async_flush(bool wait);
+int log_async_fd(void);
+
+/* Use the specified socket for the journal instead of connecting to journald, and take possession of it. For
+ * tests. */
+void log_set_journal_fd(int fd);
+
 int log_dup_console(void);
 
 int log_syntax_internal(
@@ -1710,6 +1710,8 @@ static int unit_realize_cgroup_now(Unit *u, ManagerState state) {
          * this will trickle down properly to cgroupfs. */
         apply_bpf = needs_bpf || u->cgroup_bpf_state != UNIT_CGROUP_BPF_OFF;
 
+        u->trace_realize_begin = now(CLOCK_MONOTONIC);
+
         /* First, realize parents */
         if (UNIT_ISSET(u->slice)) {
                 r = unit_realize_cgroup_now(UNIT_DEREF(u->slice), state);
@@ -1726,6 +1728,8 @@ static int unit_realize_cgroup_now(Unit *u, ManagerState state) {
         cgroup_context_apply(u, target_mask, apply_bpf, state);
         cgroup_xattr_apply(u);
 
+        u->trace_realize_end = now(CLOCK_MONOTONIC);
+
         return 0;
 }
 
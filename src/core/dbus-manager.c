@@ -19,6 +19,7 @@
 #include "fileio.h"
 #include "format-util.h"
 #include "fs-util.h"
+#include "generator-cache.h"
 #include "install.h"
 #include "log.h"
 #include "os-util.h"
@@ -1110,6 +1111,172 @@ static int method_list_units_by_patterns(sd_bus_message *message, void *userdata
         return list_units_filtered(message, userdata, error, states, patterns);
 }
 
+static int method_list_unit_times(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        Manager *m = userdata;
+        const char *k;
+        Iterator i;
+        Unit *u;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method. This returns the activation timestamps and After= dependencies of all
+         * loaded units in a single reply, so that systemd-analyze doesn't have to query each unit
+         * separately. */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(sttttas)");
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+                Iterator j;
+                Unit *other;
+                void *v;
+
+                if (k != u->id)
+                        continue;
+
+                r = sd_bus_message_open_container(reply, 'r', "sttttas");
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_append(reply, "stttt",
+                                          u->id,
+                                          u->inactive_exit_timestamp.monotonic,
+                                          u->active_enter_timestamp.monotonic,
+                                          u->active_exit_timestamp.monotonic,
+                                          u->inactive_enter_timestamp.monotonic);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_open_container(reply, 'a', "s");
+                if (r < 0)
+                        return r;
+
+                HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_AFTER], j) {
+                        r = sd_bus_message_append(reply, "s", other->id);
+                        if (r < 0)
+                                return r;
+                }
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
+static int method_list_unit_trace(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        Manager *m = userdata;
+        const char *k;
+        Iterator i;
+        Unit *u;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method. Returns the activation timestamps of all loaded units, together with
+         * when their last job was queued and started running, and when their cgroup was last realized and
+         * their last process spawned. */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(stttttttttt)");
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+                if (k != u->id)
+                        continue;
+
+                r = sd_bus_message_append(reply, "(stttttttttt)",
+                                          u->id,
+                                          u->inactive_exit_timestamp.monotonic,
+                                          u->active_enter_timestamp.monotonic,
+                                          u->active_exit_timestamp.monotonic,
+                                          u->inactive_enter_timestamp.monotonic,
+                                          u->trace_job_begin,
+                                          u->trace_job_running,
+                                          u->trace_realize_begin,
+                                          u->trace_realize_end,
+                                          u->trace_spawn_begin,
+                                          u->trace_spawn_end);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
+static int method_list_generators(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        Manager *m = userdata;
+        Generator *g;
+        Iterator i;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method. Returns the unit generators invoked on the last reload, how long
+         * each took when it was last actually run, and whether its earlier output was reused instead. */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(stb)");
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH(g, m->generators, i) {
+                r = sd_bus_message_append(reply, "(stb)", g->name, g->runtime, g->cached);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
 static int method_list_jobs(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         Manager *m = userdata;
@@ -2517,6 +2684,9 @@ const sd_bus_vtable bus_manager_vtable[] = {
         SD_BUS_METHOD("ListUnitsFiltered", "as", "a(ssssssouso)", method_list_units_filtered, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ListUnitsByPatterns", "asas", "a(ssssssouso)", method_list_units_by_patterns, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ListUnitsByNames", "as", "a(ssssssouso)", method_list_units_by_names, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ListUnitTimes", NULL, "a(sttttas)", method_list_unit_times, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ListUnitTrace", NULL, "a(stttttttttt)", method_list_unit_trace, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ListGenerators", NULL, "a(stb)", method_list_generators, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ListJobs", NULL, "a(usssoo)", method_list_jobs, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Subscribe", NULL, NULL, method_subscribe, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Unsubscribe", NULL, NULL, method_unsubscribe, SD_BUS_VTABLE_UNPRIVILEGED),
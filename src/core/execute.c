@@ -3520,6 +3520,8 @@ int exec_spawn(Unit *unit,
         assert(params);
         assert(params->fds || (params->n_socket_fds + params->n_storage_fds <= 0));
 
+        unit->trace_spawn_begin = now(CLOCK_MONOTONIC);
+
         if (context->std_input == EXEC_INPUT_SOCKET ||
             context->std_output == EXEC_OUTPUT_SOCKET ||
             context->std_error == EXEC_OUTPUT_SOCKET) {
@@ -3608,6 +3610,7 @@ int exec_spawn(Unit *unit,
                 (void) cg_attach(SYSTEMD_CGROUP_CONTROLLER, params->cgroup_path, pid);
 
         exec_status_start(&command->exec_status, pid);
+        unit->trace_spawn_end = command->exec_status.start_timestamp.monotonic;
 
         *ret = pid;
         return 0;
@@ -0,0 +1,545 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdio_ext.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include "sd-id128.h"
+
+#include "alloc-util.h"
+#include "conf-parser.h"
+#include "copy.h"
+#include "dirent-util.h"
+#include "exec-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "generator-cache.h"
+#include "log.h"
+#include "mkdir.h"
+#include "path-util.h"
+#include "proc-cmdline.h"
+#include "rm-rf.h"
+#include "siphash24.h"
+#include "string-util.h"
+#include "strv.h"
+#include "umask-util.h"
+#include "user-util.h"
+
+/* Unit generators may opt in to having their output reused across daemon reloads, by installing a file
+ * "<generator>.inputs" next to the binary that declares everything the output depends on:
+ *
+ *     [Inputs]
+ *     Paths=/etc/fstab /etc/crypttab
+ *     KernelCommandLine=yes
+ *     Environment=SYSTEMD_SYSVINIT_PATH
+ *
+ * Such generators are passed private output directories below "<generator dir>.cache/<name>/", and what
+ * they place there is merged into the real output directories afterwards. If on the next reload neither
+ * the binary nor any of the declared inputs changed, the generator is not run again, and its earlier
+ * output is merged instead. */
+
+#define GENERATOR_INPUTS_HASH_KEY SD_ID128_MAKE(f3,92,4f,05,01,06,53,79,18,10,29,da,83,e0,b1,e9)
+
+static const char* const output_dir_names[] = { "normal", "early", "late" };
+
+typedef struct GeneratorJob {
+        Generator *generator;
+        char *inputs; /* state of the declared inputs right now */
+        char *dir;    /* the private output directory, NULL if the output isn't cacheable */
+        char **argv;  /* argument vector pointing to the private output directories, NULL if not run */
+} GeneratorJob;
+
+Generator* generator_free(Generator *g) {
+        if (!g)
+                return NULL;
+
+        free(g->name);
+        free(g->inputs);
+        return mfree(g);
+}
+
+Hashmap* generators_free(Hashmap *h) {
+        return hashmap_free_with_destructor(h, generator_free);
+}
+
+void generators_flush_cache(const LookupPaths *lp) {
+        const char *cache;
+
+        assert(lp);
+
+        if (!lp->generator)
+                return;
+
+        cache = strjoina(lp->generator, ".cache");
+        (void) rm_rf(cache, REMOVE_ROOT|REMOVE_PHYSICAL);
+}
+
+static int serialize_input_path(FILE *f, const char *path) {
+        struct stat st;
+        int r;
+
+        /* Files and directory listings are compared by contents rather than by timestamps, since the
+         * latter are too coarse to catch a file that is modified right after the generator read it. */
+
+        if (stat(path, &st) < 0) {
+                fprintf(f, "path %s errno %i\n", path, errno);
+                return 0;
+        }
+
+        if (S_ISREG(st.st_mode)) {
+                _cleanup_free_ char *data = NULL;
+                size_t size;
+
+                r = read_full_file(path, &data, &size);
+                if (r < 0)
+                        return r;
+
+                fprintf(f, "path %s file %zu %016" PRIx64 "\n",
+                        path, size, siphash24(data, size, GENERATOR_INPUTS_HASH_KEY.bytes));
+
+        } else if (S_ISDIR(st.st_mode)) {
+                _cleanup_strv_free_ char **l = NULL;
+                _cleanup_free_ char *j = NULL;
+
+                r = get_files_in_directory(path, &l);
+                if (r < 0)
+                        return r;
+
+                strv_sort(l);
+
+                j = strv_join(l, "/");
+                if (!j)
+                        return -ENOMEM;
+
+                fprintf(f, "path %s directory %016" PRIx64 "\n",
+                        path, siphash24(j, strlen(j), GENERATOR_INPUTS_HASH_KEY.bytes));
+        } else
+                fprintf(f, "path %s mode %o device %u:%u\n",
+                        path, st.st_mode, major(st.st_rdev), minor(st.st_rdev));
+
+        return 0;
+}
+
+int generator_read_inputs(const char *binary, char **ret) {
+        _cleanup_strv_free_ char **paths = NULL, **environment = NULL;
+        _cleanup_free_ char *fn = NULL, *buf = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        bool cmdline = false;
+        struct stat st;
+        size_t size;
+        char **i;
+        int r;
+
+        const ConfigTableItem items[] = {
+                { "Inputs", "Paths",             config_parse_strv, 0, &paths       },
+                { "Inputs", "KernelCommandLine", config_parse_bool, 0, &cmdline     },
+                { "Inputs", "Environment",       config_parse_strv, 0, &environment },
+                {}
+        };
+
+        assert(binary);
+        assert(ret);
+
+        /* Returns a description of the current state of everything the output of the generator depends
+         * on, or NULL if it doesn't declare its inputs. */
+
+        fn = strappend(binary, ".inputs");
+        if (!fn)
+                return -ENOMEM;
+
+        if (access(fn, F_OK) < 0) {
+                if (errno != ENOENT)
+                        return -errno;
+
+                *ret = NULL;
+                return 0;
+        }
+
+        r = config_parse(NULL, fn, NULL, "Inputs\0", config_item_table_lookup, items, CONFIG_PARSE_WARN, NULL);
+        if (r < 0)
+                return r;
+
+        if (stat(binary, &st) < 0)
+                return -errno;
+
+        f = open_memstream(&buf, &size);
+        if (!f)
+                return -ENOMEM;
+
+        (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
+
+        /* The binary itself is an input too, so that updates of it take effect */
+        fprintf(f, "binary %s %u:%u %" PRIu64 " %" PRIu64 " " NSEC_FMT "\n",
+                binary, major(st.st_dev), minor(st.st_dev),
+                (uint64_t) st.st_ino, (uint64_t) st.st_size, timespec_load_nsec(&st.st_mtim));
+
+        STRV_FOREACH(i, paths) {
+                if (!path_is_absolute(*i)) {
+                        log_warning("Input path \"%s\" declared in %s is not absolute, ignoring.", *i, fn);
+                        continue;
+                }
+
+                r = serialize_input_path(f, *i);
+                if (r < 0)
+                        return r;
+        }
+
+        if (cmdline) {
+                _cleanup_free_ char *line = NULL;
+
+                r = proc_cmdline(&line);
+                if (r < 0)
+                        return r;
+
+                fprintf(f, "cmdline %s\n", line);
+        }
+
+        STRV_FOREACH(i, environment) {
+                const char *e;
+
+                e = getenv(*i);
+                if (e)
+                        fprintf(f, "environment %s=%s\n", *i, e);
+                else
+                        fprintf(f, "environment %s\n", *i);
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return r;
+
+        f = safe_fclose(f);
+
+        *ret = TAKE_PTR(buf);
+        return 1;
+}
+
+static int generator_job_prepare(GeneratorJob *j, const char *cache) {
+        const char *name;
+        size_t k;
+        int r;
+
+        assert(j);
+        assert(j->inputs);
+        assert(cache);
+
+        name = j->generator->name;
+
+        j->dir = path_join(NULL, cache, name);
+        if (!j->dir)
+                return -ENOMEM;
+
+        if (streq_ptr(j->generator->inputs, j->inputs) && access(j->dir, F_OK) >= 0) {
+                log_debug("Inputs of generator %s unchanged, reusing its earlier output.", name);
+                j->generator->cached = true;
+                return 0;
+        }
+
+        j->generator->inputs = mfree(j->generator->inputs);
+
+        (void) rm_rf(j->dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        j->argv = strv_new("", NULL);
+        if (!j->argv)
+                return -ENOMEM;
+
+        for (k = 0; k < ELEMENTSOF(output_dir_names); k++) {
+                _cleanup_free_ char *p = NULL;
+
+                p = path_join(NULL, j->dir, output_dir_names[k]);
+                if (!p)
+                        return -ENOMEM;
+
+                r = mkdir_p(p, 0755);
+                if (r < 0)
+                        return r;
+
+                r = strv_consume(&j->argv, TAKE_PTR(p));
+                if (r < 0)
+                        return r;
+        }
+
+        return 1;
+}
+
+static int generator_job_fix_symlinks(GeneratorJob *j, const char *from, const char *to, const char *const *targets) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        int r;
+
+        assert(j);
+        assert(from);
+        assert(to);
+        assert(targets);
+
+        /* Generators often create absolute symlinks to other files in their output directories, e.g. to
+         * hook units into targets. With private output directories these point into the cache, which the
+         * copies in the real output directories must not. Hence redirect them to the same place in the real
+         * output directories. Links an uncached generator created in the same spot are left alone. */
+
+        d = opendir(from);
+        if (!d)
+                return -errno;
+
+        FOREACH_DIRENT(de, d, return -errno) {
+                _cleanup_free_ char *src = NULL, *dst = NULL, *target = NULL, *copied = NULL, *fixed = NULL;
+                size_t k;
+
+                dirent_ensure_type(d, de);
+
+                src = path_join(NULL, from, de->d_name);
+                dst = path_join(NULL, to, de->d_name);
+                if (!src || !dst)
+                        return -ENOMEM;
+
+                if (de->d_type == DT_DIR) {
+                        r = generator_job_fix_symlinks(j, src, dst, targets);
+                        if (r < 0)
+                                return r;
+
+                        continue;
+                }
+
+                if (de->d_type != DT_LNK)
+                        continue;
+
+                r = readlink_malloc(src, &target);
+                if (r < 0)
+                        return r;
+
+                for (k = 0; k < ELEMENTSOF(output_dir_names); k++) {
+                        const char *p, *e;
+
+                        p = strjoina(j->dir, "/", output_dir_names[k]);
+
+                        e = path_startswith(target, p);
+                        if (!e)
+                                continue;
+
+                        fixed = isempty(e) ? strdup(targets[k]) : path_join(NULL, targets[k], e);
+                        if (!fixed)
+                                return -ENOMEM;
+
+                        break;
+                }
+                if (!fixed)
+                        continue;
+
+                if (readlink_malloc(dst, &copied) < 0 || !streq(copied, target))
+                        continue;
+
+                r = symlink_atomic(fixed, dst);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int generator_job_merge(GeneratorJob *j, const LookupPaths *lp) {
+        const char *targets[ELEMENTSOF(output_dir_names)] = {
+                lp->generator,
+                lp->generator_early,
+                lp->generator_late,
+        };
+        size_t k;
+        int r;
+
+        assert(j);
+        assert(j->dir);
+
+        for (k = 0; k < ELEMENTSOF(output_dir_names); k++) {
+                const char *p;
+
+                p = strjoina(j->dir, "/", output_dir_names[k]);
+
+                r = copy_tree(p, targets[k], UID_INVALID, GID_INVALID, COPY_MERGE);
+                if (r < 0)
+                        return r;
+
+                r = generator_job_fix_symlinks(j, p, targets[k], targets);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+int generators_run(Hashmap **generators, char **binaries, const LookupPaths *lp, usec_t timeout) {
+        _cleanup_(generators_freep) Hashmap *old = NULL;
+        _cleanup_free_ ExecutorResult *results = NULL;
+        _cleanup_free_ GeneratorJob *jobs = NULL;
+        _cleanup_free_ size_t *run_jobs = NULL;
+        _cleanup_free_ char ***run_argvs = NULL;
+        _cleanup_free_ char **run = NULL;
+        size_t n, n_jobs = 0, n_run = 0, i;
+        const char *argv[5], *cache;
+        Iterator it;
+        Generator *g;
+        char **b;
+        int r;
+
+        assert(generators);
+        assert(lp);
+
+        /* Runs the specified generators in parallel, except for those which declare their inputs and
+         * whose inputs didn't change since the last invocation. The output of those is reused
+         * instead. Output of generators that don't declare their inputs takes precedence over cached
+         * output, if both contain the same file. */
+
+        cache = strjoina(lp->generator, ".cache");
+
+        old = TAKE_PTR(*generators);
+
+        /* Without any record of earlier runs, i.e. on boot or after re-execution, nothing in the
+         * cache can be trusted. */
+        if (hashmap_isempty(old))
+                (void) rm_rf(cache, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        *generators = hashmap_new(&string_hash_ops);
+        if (!*generators)
+                return -ENOMEM;
+
+        n = strv_length(binaries);
+
+        jobs = new0(GeneratorJob, n + 1);
+        run = new0(char*, n + 1);
+        run_argvs = new0(char**, n + 1);
+        run_jobs = new(size_t, n + 1);
+        results = new(ExecutorResult, n + 1);
+        if (!jobs || !run || !run_argvs || !run_jobs || !results)
+                return -ENOMEM;
+
+        argv[0] = NULL; /* Leave this empty, execute_strv() will fill something in */
+        argv[1] = lp->generator;
+        argv[2] = lp->generator_early;
+        argv[3] = lp->generator_late;
+        argv[4] = NULL;
+
+        STRV_FOREACH(b, binaries) {
+                GeneratorJob *j;
+                const char *name;
+
+                name = basename(*b);
+
+                /* The input declarations might carry the executable bit by accident */
+                if (endswith(name, ".inputs"))
+                        continue;
+
+                g = hashmap_remove(old, name);
+                if (!g) {
+                        _cleanup_(generator_freep) Generator *ng = NULL;
+
+                        ng = new0(Generator, 1);
+                        if (!ng) {
+                                r = -ENOMEM;
+                                goto finish;
+                        }
+
+                        ng->name = strdup(name);
+                        if (!ng->name) {
+                                r = -ENOMEM;
+                                goto finish;
+                        }
+
+                        ng->runtime = USEC_INFINITY;
+                        g = TAKE_PTR(ng);
+                }
+
+                r = hashmap_put(*generators, g->name, g);
+                if (r < 0) {
+                        generator_free(g);
+                        goto finish;
+                }
+
+                g->cached = false;
+
+                j = jobs + n_jobs++;
+                j->generator = g;
+
+                r = generator_read_inputs(*b, &j->inputs);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to determine inputs of generator %s, not reusing its output: %m", *b);
+
+                if (j->inputs) {
+                        r = generator_job_prepare(j, cache);
+                        if (r == -ENOMEM)
+                                goto finish;
+                        if (r < 0) {
+                                log_warning_errno(r, "Failed to set up private output directories of generator %s, not reusing its output: %m", *b);
+                                j->dir = mfree(j->dir);
+                                j->argv = strv_free(j->argv);
+                        }
+                        if (r == 0)
+                                continue;
+                } else
+                        g->inputs = mfree(g->inputs);
+
+                run[n_run] = *b;
+                run_argvs[n_run] = j->argv ?: (char**) argv;
+                run_jobs[n_run] = n_jobs - 1;
+                n_run++;
+        }
+
+        for (i = 0; i < n_run; i++)
+                results[i] = (ExecutorResult) {
+                        .duration = USEC_INFINITY,
+                        .status = -EPROTO,
+                };
+
+        if (n_run > 0)
+                RUN_WITH_UMASK(0022)
+                        (void) execute_strv("generators", run, timeout, NULL, NULL, run_argvs, results);
+
+        for (i = 0; i < n_run; i++) {
+                GeneratorJob *j = jobs + run_jobs[i];
+                char ts[FORMAT_TIMESPAN_MAX];
+
+                j->generator->runtime = results[i].duration;
+
+                if (results[i].duration != USEC_INFINITY)
+                        log_debug("Generator %s finished after %s.", j->generator->name,
+                                  format_timespan(ts, sizeof(ts), results[i].duration, USEC_PER_MSEC));
+
+                /* Only remember the inputs if the generator succeeded, so that the output of a failed
+                 * run is not reused */
+                if (j->dir && results[i].status == 0)
+                        j->generator->inputs = TAKE_PTR(j->inputs);
+        }
+
+        for (i = 0; i < n_jobs; i++) {
+                if (!jobs[i].dir)
+                        continue;
+
+                r = generator_job_merge(jobs + i, lp);
+                if (r < 0) {
+                        log_warning_errno(r, "Failed to merge output of generator %s: %m", jobs[i].generator->name);
+                        jobs[i].generator->inputs = mfree(jobs[i].generator->inputs);
+                }
+        }
+
+        /* Forget about generators that are gone */
+        HASHMAP_FOREACH(g, old, it) {
+                _cleanup_free_ char *p = NULL;
+
+                p = path_join(NULL, cache, g->name);
+                if (p)
+                        (void) rm_rf(p, REMOVE_ROOT|REMOVE_PHYSICAL);
+        }
+
+        r = 0;
+
+finish:
+        for (i = 0; i < n_jobs; i++) {
+                free(jobs[i].inputs);
+                free(jobs[i].dir);
+                strv_free(jobs[i].argv);
+        }
+
+        return r;
+}
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdbool.h>
+
+#include "hashmap.h"
+#include "macro.h"
+#include "path-lookup.h"
+#include "time-util.h"
+
+/* What we remember about a unit generator across daemon reloads */
+typedef struct Generator {
+        char *name;
+        char *inputs;   /* state of the declared inputs when the output was last generated, NULL if not cacheable */
+        usec_t runtime; /* how long the last actual run took, USEC_INFINITY if never run */
+        bool cached;    /* whether the last reload reused the earlier output instead of running it */
+} Generator;
+
+Generator* generator_free(Generator *g);
+DEFINE_TRIVIAL_CLEANUP_FUNC(Generator*, generator_free);
+
+Hashmap* generators_free(Hashmap *h);
+DEFINE_TRIVIAL_CLEANUP_FUNC(Hashmap*, generators_free);
+
+int generator_read_inputs(const char *binary, char **ret);
+
+void generators_flush_cache(const LookupPaths *lp);
+
+int generators_run(Hashmap **generators, char **binaries, const LookupPaths *lp, usec_t timeout);
@@ -575,6 +575,7 @@ int job_run_and_invalidate(Job *j) {
                 return -EAGAIN;
 
         job_start_timer(j, true);
+        j->unit->trace_job_running = j->begin_running_usec;
         job_set_state(j, JOB_RUNNING);
         job_add_to_dbus_queue(j);
 
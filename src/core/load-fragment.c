@@ -1617,7 +1617,6 @@ int config_parse_path_spec(const char *unit,
         s->unit = UNIT(p);
         s->path = TAKE_PTR(k);
         s->type = b;
-        s->inotify_fd = -1;
 
         LIST_PREPEND(spec, p->specs, s);
 
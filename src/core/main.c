@@ -2414,6 +2414,11 @@ int main(int argc, char *argv[]) {
                 goto finish;
         }
 
+        /* From now on what we log is queued for the journal and sent from the event loop whenever journald can
+         * take it, instead of stalling on a busy journald */
+        if (getpid_cached() == 1)
+                log_set_async(true);
+
         (void) invoke_main_loop(m,
                                 &reexecute,
                                 &retval,
@@ -2425,6 +2430,7 @@ int main(int argc, char *argv[]) {
 
 finish:
         pager_close();
+        log_set_async(false);
 
         if (m) {
                 arg_shutdown_watchdog = m->shutdown_watchdog;
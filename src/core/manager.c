@@ -32,6 +32,7 @@
 #include "bus-util.h"
 #include "clean-ipc.h"
 #include "clock-util.h"
+#include "conf-files.h"
 #include "dbus-job.h"
 #include "dbus-manager.h"
 #include "dbus-unit.h"
@@ -45,6 +46,7 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
+#include "generator-cache.h"
 #include "hashmap.h"
 #include "io-util.h"
 #include "label.h"
@@ -102,6 +104,7 @@ static int manager_dispatch_time_change_fd(sd_event_source *source, int fd, uint
 static int manager_dispatch_idle_pipe_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_user_lookup_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_jobs_in_progress(sd_event_source *source, usec_t usec, void *userdata);
+static int manager_dispatch_log_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_run_queue(sd_event_source *source, void *userdata);
 static int manager_dispatch_sigchld(sd_event_source *source, void *userdata);
 static int manager_dispatch_timezone_change(sd_event_source *source, const struct inotify_event *event, void *userdata);
@@ -1253,6 +1256,8 @@ Manager* manager_free(Manager *m) {
         manager_shutdown_cgroup(m, m->exit_code != MANAGER_REEXECUTE);
 
         lookup_paths_flush_generator(&m->lookup_paths);
+        generators_flush_cache(&m->lookup_paths);
+        generators_free(m->generators);
 
         bus_done(m);
 
@@ -1281,6 +1286,7 @@ Manager* manager_free(Manager *m) {
         sd_event_source_unref(m->run_queue_event_source);
         sd_event_source_unref(m->user_lookup_event_source);
         sd_event_source_unref(m->sync_bus_names_event_source);
+        sd_event_source_unref(m->log_event_source);
 
         safe_close(m->signal_fd);
         safe_close(m->notify_fd);
@@ -2769,6 +2775,45 @@ static int manager_dispatch_jobs_in_progress(sd_event_source *source, usec_t use
         return sd_event_source_set_enabled(source, SD_EVENT_ONESHOT);
 }
 
+static int manager_dispatch_log_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        /* The journal socket became writable, send what we can. manager_flush_log() decides whether we need to
+         * wait again. */
+        (void) log_async_flush(false);
+
+        return 0;
+}
+
+static void manager_flush_log(Manager *m) {
+        int r, fd;
+
+        assert(m);
+
+        /* The journal socket might have been reopened in the meantime, hence always start from scratch */
+        m->log_event_source = sd_event_source_unref(m->log_event_source);
+
+        r = log_async_flush(false);
+        if (r <= 0)
+                return;
+
+        /* journald can't take more right now, continue once it can */
+        fd = log_async_fd();
+        if (fd >= 0) {
+                r = sd_event_add_io(m->event, &m->log_event_source, fd, EPOLLOUT, manager_dispatch_log_fd, m);
+                if (r >= 0) {
+                        (void) sd_event_source_set_description(m->log_event_source, "manager-log");
+                        return;
+                }
+
+                log_debug_errno(r, "Failed to watch journal socket, flushing log messages synchronously: %m");
+        }
+
+        (void) log_async_flush(true);
+}
+
 int manager_loop(Manager *m) {
         int r;
 
@@ -2825,6 +2870,9 @@ int manager_loop(Manager *m) {
                 } else
                         wait_usec = USEC_INFINITY;
 
+                /* Send what was logged so far, before we go to sleep */
+                manager_flush_log(m);
+
                 r = sd_event_run(m->event, wait_usec);
                 if (r < 0)
                         return log_error_errno(r, "Failed to run event loop: %m");
@@ -3747,8 +3795,7 @@ static int manager_run_environment_generators(Manager *m) {
 }
 
 static int manager_run_generators(Manager *m) {
-        _cleanup_strv_free_ char **paths = NULL;
-        const char *argv[5];
+        _cleanup_strv_free_ char **paths = NULL, **binaries = NULL;
         int r;
 
         assert(m);
@@ -3767,15 +3814,15 @@ static int manager_run_generators(Manager *m) {
         if (r < 0)
                 goto finish;
 
-        argv[0] = NULL; /* Leave this empty, execute_directory() will fill something in */
-        argv[1] = m->lookup_paths.generator;
-        argv[2] = m->lookup_paths.generator_early;
-        argv[3] = m->lookup_paths.generator_late;
-        argv[4] = NULL;
+        r = conf_files_list_strv(&binaries, NULL, NULL, CONF_FILES_EXECUTABLE|CONF_FILES_REGULAR|CONF_FILES_FILTER_MASKED, (const char* const*) paths);
+        if (r < 0) {
+                log_error_errno(r, "Failed to enumerate generators: %m");
+                goto finish;
+        }
 
-        RUN_WITH_UMASK(0022)
-                execute_directories((const char* const*) paths, DEFAULT_TIMEOUT_USEC,
-                                    NULL, NULL, (char**) argv);
+        r = generators_run(&m->generators, binaries, &m->lookup_paths, DEFAULT_TIMEOUT_USEC);
+        if (r < 0)
+                log_error_errno(r, "Failed to run generators: %m");
 
 finish:
         lookup_paths_trim_generator(&m->lookup_paths);
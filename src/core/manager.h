@@ -173,6 +173,9 @@ struct Manager {
 
         sd_event_source *sync_bus_names_event_source;
 
+        /* Watches the journal socket while log messages are queued, see log_set_async() */
+        sd_event_source *log_event_source;
+
         UnitFileScope unit_file_scope;
         LookupPaths lookup_paths;
         Set *unit_path_cache;
@@ -340,6 +343,9 @@ struct Manager {
         /* Dynamic users/groups, indexed by their name */
         Hashmap *dynamic_users;
 
+        /* Unit generators run at the last reload, indexed by their name */
+        Hashmap *generators;
+
         /* Keep track of all UIDs and GIDs any of our services currently use. This is useful for the RemoveIPC= logic. */
         Hashmap *uid_refs;
         Hashmap *gid_refs;
@@ -1,14 +1,12 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
-#include <sys/epoll.h>
 #include <sys/inotify.h>
 #include <unistd.h>
 
 #include "bus-error.h"
 #include "bus-util.h"
 #include "dbus-path.h"
-#include "fd-util.h"
 #include "fs-util.h"
 #include "glob-util.h"
 #include "macro.h"
@@ -28,9 +26,9 @@ static const UnitActiveState state_translation_table[_PATH_STATE_MAX] = {
         [PATH_FAILED] = UNIT_FAILED
 };
 
-static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata);
+static int path_dispatch_inotify(sd_event_source *source, const struct inotify_event *event, void *userdata);
 
-int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
+int path_spec_watch(PathSpec *s, sd_event_inotify_handler_t handler) {
 
         static const int flags_table[_PATH_TYPE_MAX] = {
                 [PATH_EXISTS] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB,
@@ -40,7 +38,7 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
                 [PATH_DIRECTORY_NOT_EMPTY] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB|IN_CREATE|IN_MOVED_TO
         };
 
-        bool exists = false;
+        bool exists = false, parent_narrow = false;
         char *slash, *oldslash = NULL;
         int r;
 
@@ -50,63 +48,98 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
 
         path_spec_unwatch(s);
 
-        s->inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
-        if (s->inotify_fd < 0) {
-                r = -errno;
-                goto fail;
-        }
+        /* This function assumes the path was passed through path_simplify()! */
+        assert(!strstr(s->path, "//"));
 
-        r = sd_event_add_io(s->unit->manager->event, &s->event_source, s->inotify_fd, EPOLLIN, handler, s);
-        if (r < 0)
-                goto fail;
+        /* We need at most one watch per directory on the way, plus one for the path itself. The watches are
+         * inotify event sources, hence all path specs of all units share the event loop's inotify object, and
+         * watches on the same inode are merged. */
+        if (!s->event_sources) {
+                const char *c;
+                size_t n = 1;
 
-        (void) sd_event_source_set_description(s->event_source, "path");
+                for (c = s->path; *c; c++)
+                        if (*c == '/')
+                                n++;
 
-        /* This function assumes the path was passed through path_simplify()! */
-        assert(!strstr(s->path, "//"));
+                s->event_sources = new0(sd_event_source*, n);
+                if (!s->event_sources)
+                        return -ENOMEM;
+        }
 
         for (slash = strchr(s->path, '/'); ; slash = strchr(slash+1, '/')) {
+                sd_event_source *source = NULL;
+                bool child_exists = false;
                 char *cut = NULL;
                 int flags;
                 char tmp;
 
                 if (slash) {
+                        char *next;
+
+                        /* A directory on the way only needs to be watched for new entries as long as the next
+                         * component of our path doesn't exist. Check that before adding the watch: sd-event
+                         * merges the masks of all sources on an inode and never takes bits away again while
+                         * any of them is left, so a broad watch on a directory shared by many paths (/run, for
+                         * example) would stick and wake us up for everything created in there. */
+                        next = strchr(slash+1, '/');
+                        if (next) {
+                                *next = '\0';
+                                child_exists = access(s->path, F_OK) >= 0;
+                                *next = '/';
+                        } else
+                                child_exists = access(s->path, F_OK) >= 0;
+
                         cut = slash + (slash == s->path);
                         tmp = *cut;
                         *cut = '\0';
 
-                        flags = IN_MOVE_SELF | IN_DELETE_SELF | IN_ATTRIB | IN_CREATE | IN_MOVED_TO;
+                        flags = child_exists ? IN_MOVE_SELF : IN_MOVE_SELF | IN_DELETE_SELF | IN_ATTRIB | IN_CREATE | IN_MOVED_TO;
                 } else
                         flags = flags_table[s->type];
 
-                r = inotify_add_watch(s->inotify_fd, s->path, flags);
+                r = sd_event_add_inotify(s->unit->manager->event, &source, s->path, flags, handler, s);
                 if (r < 0) {
-                        if (IN_SET(errno, EACCES, ENOENT)) {
+                        if (IN_SET(r, -EACCES, -ENOENT)) {
                                 if (cut)
                                         *cut = tmp;
+
+                                /* The component went away after we checked for it, hence its parent needs the
+                                 * broad watch after all. */
+                                if (r == -ENOENT && parent_narrow) {
+                                        char *cut2 = oldslash + (oldslash == s->path);
+                                        char tmp2 = *cut2;
+                                        *cut2 = '\0';
+
+                                        assert(s->n_event_sources > 0);
+                                        s->event_sources[s->n_event_sources - 1] = sd_event_source_unref(s->event_sources[s->n_event_sources - 1]);
+
+                                        r = sd_event_add_inotify(s->unit->manager->event, &s->event_sources[s->n_event_sources - 1], s->path,
+                                                                 IN_MOVE_SELF | IN_DELETE_SELF | IN_ATTRIB | IN_CREATE | IN_MOVED_TO, handler, s);
+                                        if (r < 0)
+                                                s->n_event_sources--;
+
+                                        *cut2 = tmp2;
+
+                                        if (r < 0 && !IN_SET(r, -EACCES, -ENOENT)) {
+                                                r = log_warning_errno(r, "Failed to add watch on parent of %s: %m", s->path);
+                                                goto fail;
+                                        }
+                                }
+
                                 break;
                         }
 
-                        r = log_warning_errno(errno, "Failed to add watch on %s: %s", s->path, errno == ENOSPC ? "too many watches" : strerror(-r));
+                        r = log_warning_errno(r, "Failed to add watch on %s: %s", s->path, r == -ENOSPC ? "too many watches" : strerror(-r));
                         if (cut)
                                 *cut = tmp;
                         goto fail;
-                } else {
-                        exists = true;
-
-                        /* Path exists, we don't need to watch parent too closely. */
-                        if (oldslash) {
-                                char *cut2 = oldslash + (oldslash == s->path);
-                                char tmp2 = *cut2;
-                                *cut2 = '\0';
-
-                                (void) inotify_add_watch(s->inotify_fd, s->path, IN_MOVE_SELF);
-                                /* Error is ignored, the worst can happen is we get spurious events. */
-
-                                *cut2 = tmp2;
-                        }
                 }
 
+                exists = true;
+                s->event_sources[s->n_event_sources++] = source;
+                parent_narrow = slash && child_exists;
+
                 if (cut)
                         *cut = tmp;
 
@@ -114,13 +147,13 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
                         oldslash = slash;
                 else {
                         /* whole path has been iterated over */
-                        s->primary_wd = r;
+                        s->primary_event_source = source;
                         break;
                 }
         }
 
         if (!exists) {
-                r = log_error_errno(errno, "Failed to add watch on any of the components of %s: %m", s->path);
+                r = log_error_errno(r, "Failed to add watch on any of the components of %s: %m", s->path);
                 /* either EACCESS or ENOENT */
                 goto fail;
         }
@@ -135,36 +168,26 @@ fail:
 void path_spec_unwatch(PathSpec *s) {
         assert(s);
 
-        s->event_source = sd_event_source_unref(s->event_source);
-        s->inotify_fd = safe_close(s->inotify_fd);
-}
-
-int path_spec_fd_event(PathSpec *s, uint32_t revents) {
-        union inotify_event_buffer buffer;
-        struct inotify_event *e;
-        ssize_t l;
-        int r = 0;
-
-        if (revents != EPOLLIN) {
-                log_error("Got invalid poll event on inotify.");
-                return -EINVAL;
+        while (s->n_event_sources > 0) {
+                s->n_event_sources--;
+                s->event_sources[s->n_event_sources] = sd_event_source_unref(s->event_sources[s->n_event_sources]);
         }
 
-        l = read(s->inotify_fd, &buffer, sizeof(buffer));
-        if (l < 0) {
-                if (IN_SET(errno, EAGAIN, EINTR))
-                        return 0;
+        s->primary_event_source = NULL;
+}
 
-                return log_error_errno(errno, "Failed to read inotify event: %m");
-        }
+bool path_spec_inotify_event(PathSpec *s, sd_event_source *source, const struct inotify_event *event) {
+        assert(s);
+        assert(source);
+        assert(event);
 
-        FOREACH_INOTIFY_EVENT(e, buffer, l) {
-                if (IN_SET(s->type, PATH_CHANGED, PATH_MODIFIED) &&
-                    s->primary_wd == e->wd)
-                        r = 1;
-        }
+        /* Returns true if the path itself changed, false if the paths need to be checked again */
 
-        return r;
+        if (event->mask & IN_Q_OVERFLOW)
+                return false;
+
+        return IN_SET(s->type, PATH_CHANGED, PATH_MODIFIED) &&
+                source == s->primary_event_source;
 }
 
 static bool path_spec_check_good(PathSpec *s, bool initial) {
@@ -226,8 +249,9 @@ static void path_spec_dump(PathSpec *s, FILE *f, const char *prefix) {
 
 void path_spec_done(PathSpec *s) {
         assert(s);
-        assert(s->inotify_fd == -1);
+        assert(s->n_event_sources == 0);
 
+        free(s->event_sources);
         free(s->path);
 }
 
@@ -398,7 +422,7 @@ static int path_watch(Path *p) {
         assert(p);
 
         LIST_FOREACH(spec, s, p->specs) {
-                r = path_spec_watch(s, path_dispatch_io);
+                r = path_spec_watch(s, path_dispatch_inotify);
                 if (r < 0)
                         return r;
         }
@@ -650,14 +674,14 @@ _pure_ static const char *path_sub_state_to_string(Unit *u) {
         return path_state_to_string(PATH(u)->state);
 }
 
-static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+static int path_dispatch_inotify(sd_event_source *source, const struct inotify_event *event, void *userdata) {
         PathSpec *s = userdata;
         Path *p;
-        int changed;
+        bool changed;
 
         assert(s);
         assert(s->unit);
-        assert(fd >= 0);
+        assert(event);
 
         p = PATH(s->unit);
 
@@ -666,18 +690,7 @@ static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, v
 
         /* log_debug("inotify wakeup on %s.", u->id); */
 
-        LIST_FOREACH(spec, s, p->specs)
-                if (path_spec_owns_inotify_fd(s, fd))
-                        break;
-
-        if (!s) {
-                log_error("Got event on unknown fd.");
-                goto fail;
-        }
-
-        changed = path_spec_fd_event(s, revents);
-        if (changed < 0)
-                goto fail;
+        changed = path_spec_inotify_event(s, source, event);
 
         /* If we are already running, then remember that one event was
          * dispatched so that we restart the service only if something
@@ -690,10 +703,6 @@ static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, v
                 path_enter_waiting(p, false, true);
 
         return 0;
-
-fail:
-        path_enter_dead(p, PATH_FAILURE_RESOURCES);
-        return 0;
 }
 
 static void path_trigger_notify(Unit *u, Unit *other) {
@@ -79,7 +79,7 @@ static const UnitActiveState state_translation_table_idle[_SERVICE_STATE_MAX] =
         [SERVICE_AUTO_RESTART] = UNIT_ACTIVATING
 };
 
-static int service_dispatch_inotify_io(sd_event_source *source, int fd, uint32_t events, void *userdata);
+static int service_dispatch_inotify(sd_event_source *source, const struct inotify_event *event, void *userdata);
 static int service_dispatch_timer(sd_event_source *source, usec_t usec, void *userdata);
 static int service_dispatch_watchdog(sd_event_source *source, usec_t usec, void *userdata);
 static int service_dispatch_exec_io(sd_event_source *source, int fd, uint32_t events, void *userdata);
@@ -2953,7 +2953,7 @@ static int service_watch_pid_file(Service *s) {
 
         log_unit_debug(UNIT(s), "Setting watch for PID file %s", s->pid_file_pathspec->path);
 
-        r = path_spec_watch(s->pid_file_pathspec, service_dispatch_inotify_io);
+        r = path_spec_watch(s->pid_file_pathspec, service_dispatch_inotify);
         if (r < 0)
                 goto fail;
 
@@ -2990,14 +2990,13 @@ static int service_demand_pid_file(Service *s) {
         /* PATH_CHANGED would not be enough. There are daemons (sendmail) that
          * keep their PID file open all the time. */
         ps->type = PATH_MODIFIED;
-        ps->inotify_fd = -1;
 
         s->pid_file_pathspec = ps;
 
         return service_watch_pid_file(s);
 }
 
-static int service_dispatch_inotify_io(sd_event_source *source, int fd, uint32_t events, void *userdata) {
+static int service_dispatch_inotify(sd_event_source *source, const struct inotify_event *event, void *userdata) {
         PathSpec *p = userdata;
         Service *s;
 
@@ -3006,16 +3005,13 @@ static int service_dispatch_inotify_io(sd_event_source *source, int fd, uint32_t
         s = SERVICE(p->unit);
 
         assert(s);
-        assert(fd >= 0);
+        assert(event);
         assert(IN_SET(s->state, SERVICE_START, SERVICE_START_POST));
         assert(s->pid_file_pathspec);
-        assert(path_spec_owns_inotify_fd(s->pid_file_pathspec, fd));
+        assert(path_spec_owns_event_source(s->pid_file_pathspec, source));
 
         log_unit_debug(UNIT(s), "inotify event");
 
-        if (path_spec_fd_event(p, events) < 0)
-                goto fail;
-
         if (service_retry_pid_file(s) == 0)
                 return 0;
 
@@ -641,6 +641,7 @@ static int transaction_apply(Transaction *tr, Manager *m, JobMode mode) {
                 job_add_to_run_queue(j);
                 job_add_to_dbus_queue(j);
                 job_start_timer(j, false);
+                j->unit->trace_job_begin = j->begin_usec;
                 job_shutdown_magic(j);
         }
 
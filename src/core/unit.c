@@ -3204,8 +3204,21 @@ static const char *ip_accounting_metric_field[_CGROUP_IP_ACCOUNTING_METRIC_MAX]
         [CGROUP_IP_EGRESS_PACKETS] = "ip-accounting-egress-packets",
 };
 
+static const struct {
+        const char *field;
+        size_t offset;
+} trace_timestamp_fields[] = {
+        { "trace-job-begin",     offsetof(Unit, trace_job_begin)     },
+        { "trace-job-running",   offsetof(Unit, trace_job_running)   },
+        { "trace-realize-begin", offsetof(Unit, trace_realize_begin) },
+        { "trace-realize-end",   offsetof(Unit, trace_realize_end)   },
+        { "trace-spawn-begin",   offsetof(Unit, trace_spawn_begin)   },
+        { "trace-spawn-end",     offsetof(Unit, trace_spawn_end)     },
+};
+
 int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
         CGroupIPAccountingMetric m;
+        size_t i;
         int r;
 
         assert(u);
@@ -3228,6 +3241,13 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
         dual_timestamp_serialize(f, "condition-timestamp", &u->condition_timestamp);
         dual_timestamp_serialize(f, "assert-timestamp", &u->assert_timestamp);
 
+        for (i = 0; i < ELEMENTSOF(trace_timestamp_fields); i++) {
+                usec_t *t = (usec_t*) ((uint8_t*) u + trace_timestamp_fields[i].offset);
+
+                if (*t > 0)
+                        unit_serialize_item_format(u, f, trace_timestamp_fields[i].field, USEC_FMT, *t);
+        }
+
         if (dual_timestamp_is_set(&u->condition_timestamp))
                 unit_serialize_item(u, f, "condition-result", yes_no(u->condition_result));
 
@@ -3371,7 +3391,7 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
                 _cleanup_free_ char *line = NULL;
                 CGroupIPAccountingMetric m;
                 char *l, *v;
-                size_t k;
+                size_t k, t;
 
                 r = read_line(f, LONG_LINE_MAX, &line);
                 if (r < 0)
@@ -3623,6 +3643,17 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
                         continue;
                 }
 
+                /* Check if this is one of the timestamps for "systemd-analyze trace" */
+                for (t = 0; t < ELEMENTSOF(trace_timestamp_fields); t++)
+                        if (streq(l, trace_timestamp_fields[t].field))
+                                break;
+                if (t < ELEMENTSOF(trace_timestamp_fields)) {
+                        r = safe_atou64(v, (usec_t*) ((uint8_t*) u + trace_timestamp_fields[t].offset));
+                        if (r < 0)
+                                log_unit_debug(u, "Failed to parse %s value %s, ignoring.", l, v);
+                        continue;
+                }
+
                 if (unit_can_serialize(u)) {
                         r = exec_runtime_deserialize_compat(u, l, v, fds);
                         if (r < 0) {
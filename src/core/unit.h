@@ -183,6 +183,15 @@ typedef struct Unit {
         dual_timestamp active_exit_timestamp;
         dual_timestamp inactive_enter_timestamp;
 
+        /* Timing of the most recent job, cgroup realization and process spawn, for "systemd-analyze trace". All
+         * CLOCK_MONOTONIC, which keeps counting across daemon-reload and switch-root, hence serialized as is. */
+        usec_t trace_job_begin;
+        usec_t trace_job_running;
+        usec_t trace_realize_begin;
+        usec_t trace_realize_end;
+        usec_t trace_spawn_begin;
+        usec_t trace_spawn_end;
+
         UnitRef slice;
 
         /* Per type list */
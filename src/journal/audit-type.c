@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <errno.h>
 #include <stdio.h>
 #include <linux/audit.h>
 #if HAVE_AUDIT
@@ -10,3 +11,34 @@
 #include "audit-type.h"
 #include "audit_type-to-name.h"
 #include "macro.h"
+#include "parse-util.h"
+#include "string-util.h"
+
+int audit_type_from_string(const char *s) {
+        const char *p;
+        uint16_t u;
+        int type, r;
+
+        if (isempty(s))
+                return -EINVAL;
+
+        /* Accept the names as generated by audit_type_name_alloca(), i.e. the symbolic name if we know one and
+         * "AUDITnnnn" otherwise, as well as plain numbers. */
+
+        p = startswith(s, "AUDIT");
+        r = safe_atou16_full(p ?: s, 10, &u);
+        if (r >= 0)
+                return (int) u;
+        if (r == -ERANGE)
+                return r;
+
+        for (type = 0; type <= AUDIT_LAST_USER_MSG2; type++) {
+                const char *n;
+
+                n = audit_type_to_string(type);
+                if (n && streq(n, s))
+                        return type;
+        }
+
+        return -EINVAL;
+}
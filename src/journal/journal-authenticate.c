@@ -11,6 +11,49 @@
 #include "journal-def.h"
 #include "journal-file.h"
 
+/* Most objects are small, and gcry_md_write() has a noticeable per-call overhead, hence we collect the
+ * authenticated parts of the objects and pass them on in chunks of this size */
+#define HMAC_BUFFER_SIZE (16U*1024U)
+
+static void journal_file_hmac_write(JournalFile *f, const void *p, size_t l) {
+        assert(f);
+        assert(p || l == 0);
+
+        if (f->hmac_buffer_used + l > HMAC_BUFFER_SIZE && f->hmac_buffer_used > 0) {
+                gcry_md_write(f->hmac, f->hmac_buffer, f->hmac_buffer_used);
+                f->hmac_buffer_used = 0;
+        }
+
+        if (l >= HMAC_BUFFER_SIZE) {
+                gcry_md_write(f->hmac, p, l);
+                return;
+        }
+
+        if (!f->hmac_buffer) {
+                f->hmac_buffer = malloc(HMAC_BUFFER_SIZE);
+                if (!f->hmac_buffer) {
+                        /* Not a problem, just slower */
+                        gcry_md_write(f->hmac, p, l);
+                        return;
+                }
+        }
+
+        memcpy((uint8_t*) f->hmac_buffer + f->hmac_buffer_used, p, l);
+        f->hmac_buffer_used += l;
+}
+
+const uint8_t* journal_file_hmac_read(JournalFile *f) {
+        assert(f);
+        assert(f->hmac_running);
+
+        if (f->hmac_buffer_used > 0) {
+                gcry_md_write(f->hmac, f->hmac_buffer, f->hmac_buffer_used);
+                f->hmac_buffer_used = 0;
+        }
+
+        return gcry_md_read(f->hmac, 0);
+}
+
 static uint64_t journal_file_tag_seqnum(JournalFile *f) {
         uint64_t r;
 
@@ -55,7 +98,7 @@ int journal_file_append_tag(JournalFile *f) {
                 return r;
 
         /* Get the HMAC tag and store it in the object */
-        memcpy(o->tag.tag, gcry_md_read(f->hmac, 0), TAG_LENGTH);
+        memcpy(o->tag.tag, journal_file_hmac_read(f), TAG_LENGTH);
         f->hmac_running = false;
 
         return 0;
@@ -73,6 +116,7 @@ int journal_file_hmac_start(JournalFile *f) {
 
         /* Prepare HMAC for next cycle */
         gcry_md_reset(f->hmac);
+        f->hmac_buffer_used = 0;
         FSPRG_GetKey(f->fsprg_state, key, sizeof(key), 0);
         gcry_md_setkey(f->hmac, key, sizeof(key));
 
@@ -234,25 +278,25 @@ int journal_file_hmac_put_object(JournalFile *f, ObjectType type, Object *o, uin
                         return -EBADMSG;
         }
 
-        gcry_md_write(f->hmac, o, offsetof(ObjectHeader, payload));
+        journal_file_hmac_write(f, o, offsetof(ObjectHeader, payload));
 
         switch (o->object.type) {
 
         case OBJECT_DATA:
                 /* All but hash and payload are mutable */
-                gcry_md_write(f->hmac, &o->data.hash, sizeof(o->data.hash));
-                gcry_md_write(f->hmac, o->data.payload, le64toh(o->object.size) - offsetof(DataObject, payload));
+                journal_file_hmac_write(f, &o->data.hash, sizeof(o->data.hash));
+                journal_file_hmac_write(f, o->data.payload, le64toh(o->object.size) - offsetof(DataObject, payload));
                 break;
 
         case OBJECT_FIELD:
                 /* Same here */
-                gcry_md_write(f->hmac, &o->field.hash, sizeof(o->field.hash));
-                gcry_md_write(f->hmac, o->field.payload, le64toh(o->object.size) - offsetof(FieldObject, payload));
+                journal_file_hmac_write(f, &o->field.hash, sizeof(o->field.hash));
+                journal_file_hmac_write(f, o->field.payload, le64toh(o->object.size) - offsetof(FieldObject, payload));
                 break;
 
         case OBJECT_ENTRY:
                 /* All */
-                gcry_md_write(f->hmac, &o->entry.seqnum, le64toh(o->object.size) - offsetof(EntryObject, seqnum));
+                journal_file_hmac_write(f, &o->entry.seqnum, le64toh(o->object.size) - offsetof(EntryObject, seqnum));
                 break;
 
         case OBJECT_FIELD_HASH_TABLE:
@@ -263,8 +307,8 @@ int journal_file_hmac_put_object(JournalFile *f, ObjectType type, Object *o, uin
 
         case OBJECT_TAG:
                 /* All but the tag itself */
-                gcry_md_write(f->hmac, &o->tag.seqnum, sizeof(o->tag.seqnum));
-                gcry_md_write(f->hmac, &o->tag.epoch, sizeof(o->tag.epoch));
+                journal_file_hmac_write(f, &o->tag.seqnum, sizeof(o->tag.seqnum));
+                journal_file_hmac_write(f, &o->tag.epoch, sizeof(o->tag.epoch));
                 break;
         default:
                 return -EINVAL;
@@ -292,10 +336,10 @@ int journal_file_hmac_put_header(JournalFile *f) {
          * tail_entry_monotonic, n_data, n_fields, n_tags,
          * n_entry_arrays. */
 
-        gcry_md_write(f->hmac, f->header->signature, offsetof(Header, state) - offsetof(Header, signature));
-        gcry_md_write(f->hmac, &f->header->file_id, offsetof(Header, boot_id) - offsetof(Header, file_id));
-        gcry_md_write(f->hmac, &f->header->seqnum_id, offsetof(Header, arena_size) - offsetof(Header, seqnum_id));
-        gcry_md_write(f->hmac, &f->header->data_hash_table_offset, offsetof(Header, tail_object_offset) - offsetof(Header, data_hash_table_offset));
+        journal_file_hmac_write(f, f->header->signature, offsetof(Header, state) - offsetof(Header, signature));
+        journal_file_hmac_write(f, &f->header->file_id, offsetof(Header, boot_id) - offsetof(Header, file_id));
+        journal_file_hmac_write(f, &f->header->seqnum_id, offsetof(Header, arena_size) - offsetof(Header, seqnum_id));
+        journal_file_hmac_write(f, &f->header->data_hash_table_offset, offsetof(Header, tail_object_offset) - offsetof(Header, data_hash_table_offset));
 
         return 0;
 }
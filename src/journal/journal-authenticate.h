@@ -13,6 +13,7 @@ int journal_file_hmac_setup(JournalFile *f);
 int journal_file_hmac_start(JournalFile *f);
 int journal_file_hmac_put_header(JournalFile *f);
 int journal_file_hmac_put_object(JournalFile *f, ObjectType type, Object *o, uint64_t p);
+const uint8_t* journal_file_hmac_read(JournalFile *f);
 
 int journal_file_fss_load(JournalFile *f);
 int journal_file_parse_verification_key(JournalFile *f, const char *key);
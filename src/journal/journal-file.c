@@ -398,6 +398,8 @@ JournalFile* journal_file_close(JournalFile *f) {
 
         if (f->hmac)
                 gcry_md_close(f->hmac);
+
+        free(f->hmac_buffer);
 #endif
 
         return mfree(f);
@@ -3839,6 +3841,81 @@ int journal_file_get_cutoff_monotonic_usec(JournalFile *f, sd_id128_t boot_id, u
         return 1;
 }
 
+int journal_file_get_boots(JournalFile *f, JournalBoot **ret, size_t *ret_n) {
+        _cleanup_free_ JournalBoot *boots = NULL;
+        size_t n_boots = 0, n_allocated = 0;
+        uint64_t p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(ret);
+        assert(ret_n);
+
+        /* Find the boots via the _BOOT_ID= data objects: the first and last entry referencing each of them
+         * are the first and last entry of that boot in this file. That's a couple of lookups per boot, not a
+         * walk over all entries. If a boot's entries are interleaved with those of others, it simply spans
+         * them. */
+
+        r = journal_file_find_field_object(f, "_BOOT_ID", STRLEN("_BOOT_ID"), &o, NULL);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                *ret = NULL;
+                *ret_n = 0;
+                return 0;
+        }
+
+        for (p = le64toh(o->field.head_data_offset); p > 0; ) {
+                uint64_t entry_offset, entry_array_offset, n_entries;
+                JournalBoot *b;
+
+                r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                if (r < 0)
+                        return r;
+
+                p = le64toh(o->data.next_field_offset);
+                entry_offset = le64toh(o->data.entry_offset);
+                entry_array_offset = le64toh(o->data.entry_array_offset);
+                n_entries = le64toh(o->data.n_entries);
+
+                if (n_entries <= 0)
+                        continue;
+
+                if (!GREEDY_REALLOC(boots, n_allocated, n_boots + 1))
+                        return -ENOMEM;
+
+                r = journal_file_move_to_object(f, OBJECT_ENTRY, entry_offset, &o);
+                if (r < 0)
+                        return r;
+
+                b = boots + n_boots;
+                *b = (JournalBoot) {
+                        .boot_id = o->entry.boot_id,
+                        .head_seqnum = le64toh(o->entry.seqnum),
+                        .head_realtime = le64toh(o->entry.realtime),
+                        .head_monotonic = le64toh(o->entry.monotonic),
+                };
+
+                r = generic_array_get_plus_one(f, entry_offset, entry_array_offset, n_entries - 1, &o, NULL);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return -EBADMSG;
+
+                b->tail_seqnum = le64toh(o->entry.seqnum);
+                b->tail_realtime = le64toh(o->entry.realtime);
+                b->tail_monotonic = le64toh(o->entry.monotonic);
+
+                n_boots++;
+        }
+
+        *ret = TAKE_PTR(boots);
+        *ret_n = n_boots;
+
+        return 0;
+}
 bool journal_file_rotate_suggested(JournalFile *f, usec_t max_file_usec) {
         assert(f);
         assert(f->header);
@@ -26,6 +26,17 @@ typedef struct JournalMetrics {
         uint64_t n_max_files;  /* how many files to keep around at max */
 } JournalMetrics;
 
+/* The first and last entry a journal file (or a set of them) has for one boot */
+typedef struct JournalBoot {
+        sd_id128_t boot_id;
+        uint64_t head_seqnum;
+        uint64_t tail_seqnum;
+        usec_t head_realtime;
+        usec_t tail_realtime;
+        usec_t head_monotonic;
+        usec_t tail_monotonic;
+} JournalBoot;
+
 typedef enum direction {
         DIRECTION_UP,
         DIRECTION_DOWN
@@ -113,6 +124,10 @@ typedef struct JournalFile {
         gcry_md_hd_t hmac;
         bool hmac_running;
 
+        /* The parts of the objects to authenticate are collected here and fed to the HMAC in one go */
+        void *hmac_buffer;
+        size_t hmac_buffer_used;
+
         FSSHeader *fss_file;
         size_t fss_file_size;
 
@@ -248,6 +263,7 @@ void journal_default_metrics(JournalMetrics *m, int fd);
 
 int journal_file_get_cutoff_realtime_usec(JournalFile *f, usec_t *from, usec_t *to);
 int journal_file_get_cutoff_monotonic_usec(JournalFile *f, sd_id128_t boot, usec_t *from, usec_t *to);
+int journal_file_get_boots(JournalFile *f, JournalBoot **ret, size_t *ret_n);
 
 bool journal_file_rotate_suggested(JournalFile *f, usec_t max_file_usec);
 
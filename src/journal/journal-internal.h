@@ -17,6 +17,7 @@
 typedef struct Match Match;
 typedef struct Location Location;
 typedef struct Directory Directory;
+typedef struct DataCacheEntry DataCacheEntry;
 
 typedef enum MatchType {
         MATCH_DISCRETE,
@@ -115,6 +116,13 @@ struct sd_journal {
 
         size_t data_threshold;
 
+        /* Recently decompressed DATA objects, most recently used first */
+        Hashmap *data_cache;
+        LIST_HEAD(DataCacheEntry, data_cache_lru);
+        DataCacheEntry *data_cache_lru_tail;
+        size_t data_cache_size;
+        unsigned data_cache_hit, data_cache_missed;
+
         Hashmap *directories_by_path;
         Hashmap *directories_by_wd;
 
@@ -123,6 +131,7 @@ struct sd_journal {
 
 char *journal_make_match_string(sd_journal *j);
 void journal_print_header(sd_journal *j);
+int journal_get_boots(sd_journal *j, JournalBoot **ret, size_t *ret_n);
 
 #define JOURNAL_FOREACH_DATA_RETVAL(j, data, l, retval)                     \
         for (sd_journal_restart_data(j); ((retval) = sd_journal_enumerate_data((j), &(data), &(l))) > 0; )
@@ -50,9 +50,11 @@
 #include "pager.h"
 #include "parse-util.h"
 #include "path-util.h"
+#include "process-util.h"
 #include "rlimit-util.h"
 #include "set.h"
 #include "sigbus.h"
+#include "signal-util.h"
 #include "string-table.h"
 #include "strv.h"
 #include "syslog-util.h"
@@ -164,6 +166,7 @@ static enum {
         ACTION_FLUSH,
         ACTION_SYNC,
         ACTION_ROTATE,
+        ACTION_STATS,
         ACTION_VACUUM,
         ACTION_LIST_FIELDS,
         ACTION_LIST_FIELD_NAMES,
@@ -360,6 +363,7 @@ static void help(void) {
                "     --sync                  Synchronize unwritten journal messages to disk\n"
                "     --flush                 Flush all journal data from /run into /var\n"
                "     --rotate                Request immediate rotation of the journal files\n"
+               "     --stats                 Show statistics of the journal service\n"
                "     --header                Show journal header information\n"
                "     --list-catalog          Show all message IDs in the catalog\n"
                "     --dump-catalog          Show entries in the message catalog\n"
@@ -403,6 +407,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_SYNC,
                 ARG_FLUSH,
                 ARG_ROTATE,
+                ARG_STATS,
                 ARG_VACUUM_SIZE,
                 ARG_VACUUM_FILES,
                 ARG_VACUUM_TIME,
@@ -464,6 +469,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "flush",          no_argument,       NULL, ARG_FLUSH          },
                 { "sync",           no_argument,       NULL, ARG_SYNC           },
                 { "rotate",         no_argument,       NULL, ARG_ROTATE         },
+                { "stats",          no_argument,       NULL, ARG_STATS          },
                 { "vacuum-size",    required_argument, NULL, ARG_VACUUM_SIZE    },
                 { "vacuum-files",   required_argument, NULL, ARG_VACUUM_FILES   },
                 { "vacuum-time",    required_argument, NULL, ARG_VACUUM_TIME    },
@@ -901,6 +907,10 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_action = ACTION_SYNC;
                         break;
 
+                case ARG_STATS:
+                        arg_action = ACTION_STATS;
+                        break;
+
                 case ARG_OUTPUT_FIELDS: {
                         _cleanup_strv_free_ char **v = NULL;
 
@@ -1219,7 +1229,7 @@ static int discover_next_boot(sd_journal *j,
         return 0;
 }
 
-static int get_boots(
+static int get_boots_by_seeking(
                 sd_journal *j,
                 BootId **boots,
                 sd_id128_t *boot_id,
@@ -1340,6 +1350,92 @@ finish:
         return count;
 }
 
+static int get_boots_from_data_objects(
+                sd_journal *j,
+                BootId **boots,
+                sd_id128_t *boot_id,
+                int offset) {
+
+        _cleanup_free_ JournalBoot *all = NULL;
+        BootId *head = NULL, *tail = NULL;
+        ssize_t idx;
+        size_t n, k;
+        int r;
+
+        assert(j);
+
+        /* Same as get_boots_by_seeking(), but finds the boots via the _BOOT_ID= data objects of the journal
+         * files, which is a lot cheaper than seeking through all entries of large journals. */
+
+        r = journal_get_boots(j, &all, &n);
+        if (r < 0)
+                return r;
+        if (n > INT_MAX)
+                return -E2BIG;
+
+        if (boot_id) {
+                if (sd_id128_is_null(*boot_id))
+                        /* Offset 0 is the last boot, while 1 is the first one */
+                        idx = offset <= 0 ? (ssize_t) n - 1 + offset : offset - 1;
+                else {
+                        for (k = 0; k < n; k++)
+                                if (sd_id128_equal(all[k].boot_id, *boot_id))
+                                        break;
+                        if (k >= n)
+                                return 0;
+
+                        idx = (ssize_t) k + offset;
+                }
+
+                if (idx < 0 || (size_t) idx >= n)
+                        return 0;
+
+                *boot_id = all[idx].boot_id;
+                return 1;
+        }
+
+        for (k = 0; k < n; k++) {
+                BootId *id;
+
+                id = new0(BootId, 1);
+                if (!id) {
+                        boot_id_free_all(head);
+                        return -ENOMEM;
+                }
+
+                id->id = all[k].boot_id;
+                id->first = all[k].head_realtime;
+                id->last = all[k].tail_realtime;
+
+                LIST_INSERT_AFTER(boot_list, head, tail, id);
+                tail = id;
+        }
+
+        if (boots)
+                *boots = head;
+        else
+                boot_id_free_all(head);
+
+        return (int) n;
+}
+
+static int get_boots(
+                sd_journal *j,
+                BootId **boots,
+                sd_id128_t *boot_id,
+                int offset) {
+
+        int r;
+
+        r = get_boots_from_data_objects(j, boots, boot_id, offset);
+        if (r >= 0)
+                return r;
+
+        log_debug_errno(r, "Failed to determine boots from _BOOT_ID= data objects, seeking through entries instead: %m");
+
+        return get_boots_by_seeking(j, boots, boot_id, offset);
+}
+
 static int list_boots(sd_journal *j) {
         int w, i, count;
         BootId *id, *all_ids;
@@ -1973,14 +2069,57 @@ static int flush_to_var(void) {
         return 0;
 }
 
-static int send_signal_and_wait(int sig, const char *watch_path) {
+static int journald_handles_signal(sd_bus *bus, int sig) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_free_ char *mask = NULL;
+        unsigned long long blocked;
+        uint32_t pid;
+        char *e;
+        int r;
+
+        assert(bus);
+        assert(SIGNAL_VALID(sig));
+
+        r = sd_bus_get_property_trivial(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1/unit/systemd_2djournald_2eservice",
+                        "org.freedesktop.systemd1.Service",
+                        "MainPID",
+                        &error,
+                        'u', &pid);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get main PID of journal service: %s", bus_error_message(&error, r));
+        if (pid == 0) {
+                log_error("The journal service is not running.");
+                return -ESRCH;
+        }
+
+        /* journald blocks all signals it handles and reads them from a signalfd. A journal daemon that
+         * predates a signal has no handler for it, and the default action of most signals is to terminate
+         * the process. */
+        r = get_proc_field(procfs_file_alloca(pid, "status"), "SigBlk", WHITESPACE, &mask);
+        if (r < 0)
+                return log_error_errno(r, "Failed to read signal mask of journal service: %m");
+
+        errno = 0;
+        blocked = strtoull(mask, &e, 16);
+        if (errno > 0 || *e != 0) {
+                log_error("Failed to parse signal mask of journal service: %s", mask);
+                return -EINVAL;
+        }
+
+        return !!(blocked & (1ULL << (sig - 1)));
+}
+
+static int send_signal_and_wait(int sig, const char *watch_path, bool check_handled) {
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         _cleanup_close_ int watch_fd = -1;
         usec_t start;
         int r;
 
         if (arg_machine) {
-                log_error("--sync and --rotate are not supported in conjunction with --machine=.");
+                log_error("--sync, --rotate and --stats are not supported in conjunction with --machine=.");
                 return -EOPNOTSUPP;
         }
 
@@ -2009,6 +2148,16 @@ static int send_signal_and_wait(int sig, const char *watch_path) {
                         if (r < 0)
                                 return log_error_errno(r, "Failed to get D-Bus connection: %m");
 
+                        if (check_handled) {
+                                r = journald_handles_signal(bus, sig);
+                                if (r < 0)
+                                        return r;
+                                if (r == 0) {
+                                        log_error("The running journal service does not support this operation.");
+                                        return -EOPNOTSUPP;
+                                }
+                        }
+
                         r = sd_bus_call_method(
                                         bus,
                                         "org.freedesktop.systemd1",
@@ -2057,11 +2206,28 @@ static int send_signal_and_wait(int sig, const char *watch_path) {
 }
 
 static int rotate(void) {
-        return send_signal_and_wait(SIGUSR2, "/run/systemd/journal/rotated");
+        return send_signal_and_wait(SIGUSR2, "/run/systemd/journal/rotated", false);
 }
 
 static int sync_journal(void) {
-        return send_signal_and_wait(SIGRTMIN+1, "/run/systemd/journal/synced");
+        return send_signal_and_wait(SIGRTMIN+1, "/run/systemd/journal/synced", false);
+}
+
+static int show_stats(void) {
+        _cleanup_free_ char *stats = NULL;
+        int r;
+
+        /* Older journal daemons would be killed by this signal, hence check first */
+        r = send_signal_and_wait(SIGRTMIN+2, "/run/systemd/journal/stats-updated", true);
+        if (r < 0)
+                return r;
+
+        r = read_full_file("/run/systemd/journal/stats", &stats, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to read /run/systemd/journal/stats: %m");
+
+        fputs(stats, stdout);
+        return 0;
 }
 
 int main(int argc, char *argv[]) {
@@ -2142,6 +2308,10 @@ int main(int argc, char *argv[]) {
                 r = rotate();
                 goto finish;
 
+        case ACTION_STATS:
+                r = show_stats();
+                goto finish;
+
         case ACTION_SHOW:
         case ACTION_PRINT_HEADER:
         case ACTION_VERIFY:
@@ -2237,6 +2407,7 @@ int main(int argc, char *argv[]) {
         case ACTION_FLUSH:
         case ACTION_SYNC:
         case ACTION_ROTATE:
+        case ACTION_STATS:
                 assert_not_reached("Unexpected action.");
 
         case ACTION_PRINT_HEADER:
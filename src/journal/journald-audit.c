@@ -2,65 +2,54 @@
 
 #include "alloc-util.h"
 #include "audit-type.h"
+#include "extract-word.h"
 #include "fd-util.h"
 #include "hexdecoct.h"
 #include "io-util.h"
 #include "journald-audit.h"
 #include "missing.h"
+#include "set.h"
 #include "string-util.h"
 
-typedef struct MapField {
-        const char *audit_field;
-        const char *journal_field;
-        int (*map)(const char *field, const char **p, struct iovec **iov, size_t *n_iov_allocated, size_t *n_iov);
-} MapField;
+/* Every field takes up at least two bytes of the audit string ("a="), and the journal field name we map it
+ * to is never longer than this. Together with the length of the audit string this gives an upper bound for
+ * the number of fields and the total size of a mapped record. */
+#define AUDIT_FIELD_NAME_MAX 32
 
-static int map_simple_field(const char *field, const char **p, struct iovec **iov, size_t *n_iov_allocated, size_t *n_iov) {
-        _cleanup_free_ char *c = NULL;
-        size_t l = 0, allocated = 0;
+/* Room for the fixed fields every record gets, without the copy of the record in MESSAGE= */
+#define AUDIT_RECORD_FIELDS_MAX 256
+
+static int map_simple_field(const char *field, const char **p, struct iovec *iov, size_t *n_iov, char **buffer) {
         const char *e;
+        char *t;
 
         assert(field);
         assert(p);
         assert(iov);
         assert(n_iov);
+        assert(buffer);
 
-        l = strlen(field);
-        allocated = l + 1;
-        c = malloc(allocated);
-        if (!c)
-                return -ENOMEM;
-
-        memcpy(c, field, l);
-        for (e = *p; !IN_SET(*e, 0, ' '); e++) {
-                if (!GREEDY_REALLOC(c, allocated, l+2))
-                        return -ENOMEM;
-
-                c[l++] = *e;
-        }
-
-        c[l] = 0;
-
-        if (!GREEDY_REALLOC(*iov, *n_iov_allocated, *n_iov + 1))
-                return -ENOMEM;
+        t = stpcpy(*buffer, field);
+        for (e = *p; !IN_SET(*e, 0, ' '); e++)
+                *(t++) = *e;
 
-        (*iov)[(*n_iov)++] = IOVEC_MAKE(c, l);
+        iov[(*n_iov)++] = IOVEC_MAKE(*buffer, t - *buffer);
 
+        *buffer = t;
         *p = e;
-        c = NULL;
 
         return 1;
 }
 
-static int map_string_field_internal(const char *field, const char **p, struct iovec **iov, size_t *n_iov_allocated, size_t *n_iov, bool filter_printable) {
-        _cleanup_free_ char *c = NULL;
+static int map_string_field(const char *field, const char **p, struct iovec *iov, size_t *n_iov, char **buffer, bool filter_printable) {
         const char *s, *e;
-        size_t l;
+        char *t;
 
         assert(field);
         assert(p);
         assert(iov);
         assert(n_iov);
+        assert(buffer);
 
         /* The kernel formats string fields in one of two formats. */
 
@@ -71,26 +60,13 @@ static int map_string_field_internal(const char *field, const char **p, struct i
                 if (!e)
                         return 0;
 
-                l = strlen(field) + (e - s);
-                c = malloc(l+1);
-                if (!c)
-                        return -ENOMEM;
-
-                *((char*) mempcpy(stpcpy(c, field), s, e - s)) = 0;
+                t = mempcpy(stpcpy(*buffer, field), s, e - s);
 
                 e += 1;
 
         } else if (unhexchar(**p) >= 0) {
                 /* Hexadecimal escaping */
-                size_t allocated = 0;
-
-                l = strlen(field);
-                allocated = l + 2;
-                c = malloc(allocated);
-                if (!c)
-                        return -ENOMEM;
-
-                memcpy(c, field, l);
+                t = stpcpy(*buffer, field);
                 for (e = *p; !IN_SET(*e, 0, ' '); e += 2) {
                         int a, b;
                         uint8_t x;
@@ -108,39 +84,22 @@ static int map_string_field_internal(const char *field, const char **p, struct i
                         if (filter_printable && x < (uint8_t) ' ')
                                 x = (uint8_t) ' ';
 
-                        if (!GREEDY_REALLOC(c, allocated, l+2))
-                                return -ENOMEM;
-
-                        c[l++] = (char) x;
+                        *(t++) = (char) x;
                 }
-
-                c[l] = 0;
         } else
                 return 0;
 
-        if (!GREEDY_REALLOC(*iov, *n_iov_allocated, *n_iov + 1))
-                return -ENOMEM;
-
-        (*iov)[(*n_iov)++] = IOVEC_MAKE(c, l);
+        iov[(*n_iov)++] = IOVEC_MAKE(*buffer, t - *buffer);
 
+        *buffer = t;
         *p = e;
-        c = NULL;
 
         return 1;
 }
 
-static int map_string_field(const char *field, const char **p, struct iovec **iov, size_t *n_iov_allocated, size_t *n_iov) {
-        return map_string_field_internal(field, p, iov, n_iov_allocated, n_iov, false);
-}
-
-static int map_string_field_printable(const char *field, const char **p, struct iovec **iov, size_t *n_iov_allocated, size_t *n_iov) {
-        return map_string_field_internal(field, p, iov, n_iov_allocated, n_iov, true);
-}
-
-static int map_generic_field(const char *prefix, const char **p, struct iovec **iov, size_t *n_iov_allocated, size_t *n_iov) {
+static int map_generic_field(const char *prefix, const char **p, struct iovec *iov, size_t *n_iov, char **buffer) {
         const char *e, *f;
-        char *c, *t;
-        int r;
+        char *t;
 
         /* Implements fallback mappings for all fields we don't know */
 
@@ -162,9 +121,7 @@ static int map_generic_field(const char *prefix, const char **p, struct iovec **
         if (e <= *p || e >= *p + 16)
                 return 0;
 
-        c = alloca(strlen(prefix) + (e - *p) + 2);
-
-        t = stpcpy(c, prefix);
+        t = stpcpy(*buffer, prefix);
         for (f = *p; f < e; f++) {
                 char x;
 
@@ -177,94 +134,67 @@ static int map_generic_field(const char *prefix, const char **p, struct iovec **
 
                 *(t++) = x;
         }
-        strcpy(t, "=");
 
-        e++;
+        *(t++) = '=';
 
-        r = map_simple_field(c, &e, iov, n_iov_allocated, n_iov);
-        if (r < 0)
-                return r;
+        for (e++; !IN_SET(*e, 0, ' '); e++)
+                *(t++) = *e;
 
+        iov[(*n_iov)++] = IOVEC_MAKE(*buffer, t - *buffer);
+
+        *buffer = t;
         *p = e;
-        return r;
+
+        return 1;
 }
 
-/* Kernel fields are those occurring in the audit string before
- * msg='. All of these fields are trusted, hence carry the "_" prefix.
- * We try to translate the fields we know into our native names. The
- * other's are generically mapped to _AUDIT_FIELD_XYZ= */
-static const MapField map_fields_kernel[] = {
-
-        /* First, we map certain well-known audit fields into native
-         * well-known fields */
-        { "pid=",       "_PID=",              map_simple_field },
-        { "ppid=",      "_PPID=",             map_simple_field },
-        { "uid=",       "_UID=",              map_simple_field },
-        { "euid=",      "_EUID=",             map_simple_field },
-        { "fsuid=",     "_FSUID=",            map_simple_field },
-        { "gid=",       "_GID=",              map_simple_field },
-        { "egid=",      "_EGID=",             map_simple_field },
-        { "fsgid=",     "_FSGID=",            map_simple_field },
-        { "tty=",       "_TTY=",              map_simple_field },
-        { "ses=",       "_AUDIT_SESSION=",    map_simple_field },
-        { "auid=",      "_AUDIT_LOGINUID=",   map_simple_field },
-        { "subj=",      "_SELINUX_CONTEXT=",  map_simple_field },
-        { "comm=",      "_COMM=",             map_string_field },
-        { "exe=",       "_EXE=",              map_string_field },
-        { "proctitle=", "_CMDLINE=",          map_string_field_printable },
-
-        /* Some fields don't map to native well-known fields. However,
-         * we know that they are string fields, hence let's undo
-         * string field escaping for them, though we stick to the
-         * generic field names. */
-        { "path=",      "_AUDIT_FIELD_PATH=", map_string_field },
-        { "dev=",       "_AUDIT_FIELD_DEV=",  map_string_field },
-        { "name=",      "_AUDIT_FIELD_NAME=", map_string_field },
-        {}
-};
-
-/* Userspace fields are those occurring in the audit string after
- * msg='. All of these fields are untrusted, hence carry no "_"
- * prefix. We map the fields we don't know to AUDIT_FIELD_XYZ= */
-static const MapField map_fields_userspace[] = {
-        { "cwd=",       "AUDIT_FIELD_CWD=",   map_string_field },
-        { "cmd=",       "AUDIT_FIELD_CMD=",   map_string_field },
-        { "acct=",      "AUDIT_FIELD_ACCT=",  map_string_field },
-        { "exe=",       "AUDIT_FIELD_EXE=",   map_string_field },
-        { "comm=",      "AUDIT_FIELD_COMM=",  map_string_field },
-        {}
-};
-
-static int map_all_fields(
-                const char *p,
-                const MapField map_fields[],
-                const char *prefix,
-                bool handle_msg,
-                struct iovec **iov,
-                size_t *n_iov_allocated,
-                size_t *n_iov) {
+static int map_known_field(const struct AuditFieldMapping *m, bool userspace, const char **p, struct iovec *iov, size_t *n_iov, char **buffer) {
+        assert(m);
 
-        int r;
+        switch (userspace ? m->userspace_map : m->kernel_map) {
+
+        case AUDIT_FIELD_MAP_SIMPLE:
+                return map_simple_field(userspace ? m->userspace_field : m->kernel_field, p, iov, n_iov, buffer);
+
+        case AUDIT_FIELD_MAP_STRING:
+                return map_string_field(userspace ? m->userspace_field : m->kernel_field, p, iov, n_iov, buffer, false);
+
+        case AUDIT_FIELD_MAP_STRING_PRINTABLE:
+                return map_string_field(userspace ? m->userspace_field : m->kernel_field, p, iov, n_iov, buffer, true);
+
+        default:
+                return 0;
+        }
+}
+
+static void map_all_fields(
+                const char *p,
+                bool userspace,
+                struct iovec *iov,
+                size_t *n_iov,
+                char **buffer) {
 
         assert(p);
         assert(iov);
-        assert(n_iov_allocated);
         assert(n_iov);
+        assert(buffer);
+
+        /* The caller has to make sure that iov and buffer have room for everything that might be mapped from p,
+         * see AUDIT_FIELD_NAME_MAX. Kernel fields (i.e. everything before msg=') are trusted and get the "_"
+         * prefix, userspace fields don't. */
 
         for (;;) {
-                bool mapped = false;
-                const MapField *m;
-                const char *v;
+                const struct AuditFieldMapping *m = NULL;
+                const char *e, *v;
 
                 p += strspn(p, WHITESPACE);
 
                 if (*p == 0)
-                        return 0;
+                        return;
 
-                if (handle_msg) {
+                if (!userspace) {
                         v = startswith(p, "msg='");
                         if (v) {
-                                const char *e;
                                 char *c;
 
                                 /* Userspace message. It's enclosed in
@@ -277,131 +207,131 @@ static int map_all_fields(
 
                                 e = endswith(v, "'");
                                 if (!e)
-                                        return 0; /* don't continue splitting up if the final quotation mark is missing */
+                                        return; /* don't continue splitting up if the final quotation mark is missing */
 
                                 c = strndupa(v, e - v);
-                                return map_all_fields(c, map_fields_userspace, "AUDIT_FIELD_", false, iov, n_iov_allocated, n_iov);
+                                map_all_fields(c, true, iov, n_iov, buffer);
+                                return;
                         }
                 }
 
-                /* Try to map the kernel fields to our own names */
-                for (m = map_fields; m->audit_field; m++) {
-                        v = startswith(p, m->audit_field);
-                        if (!v)
-                                continue;
-
-                        r = m->map(m->journal_field, &v, iov, n_iov_allocated, n_iov);
-                        if (r < 0)
-                                return log_debug_errno(r, "Failed to parse audit array: %m");
-
-                        if (r > 0) {
-                                mapped = true;
+                /* Try to map the fields we know to our own names */
+                e = p + strcspn(p, "=" WHITESPACE);
+                if (*e == '=')
+                        m = journald_audit_field_lookup(p, e - p);
+                if (m) {
+                        v = e + 1;
+                        if (map_known_field(m, userspace, &v, iov, n_iov, buffer) > 0) {
                                 p = v;
-                                break;
+                                continue;
                         }
                 }
 
-                if (!mapped) {
-                        r = map_generic_field(prefix, &p, iov, n_iov_allocated, n_iov);
-                        if (r < 0)
-                                return log_debug_errno(r, "Failed to parse audit array: %m");
-
-                        if (r == 0)
-                                /* Couldn't process as generic field, let's just skip over it */
-                                p += strcspn(p, WHITESPACE);
-                }
+                if (map_generic_field(userspace ? "AUDIT_FIELD_" : "_AUDIT_FIELD_", &p, iov, n_iov, buffer) == 0)
+                        /* Couldn't process as generic field, let's just skip over it */
+                        p += strcspn(p, WHITESPACE);
         }
 }
 
-static void process_audit_string(Server *s, int type, const char *data, size_t size) {
-        size_t n_iov_allocated = 0, n_iov = 0, z;
-        _cleanup_free_ struct iovec *iov = NULL;
+int audit_map_record(Server *s, int type, const char *data, size_t size, size_t *ret_n_iovec) {
+        size_t n_iov = 0, n_fields;
         uint64_t seconds, msec, id;
         const char *p, *type_name;
-        char id_field[sizeof("_AUDIT_ID=") + DECIMAL_STR_MAX(uint64_t)],
-             type_field[sizeof("_AUDIT_TYPE=") + DECIMAL_STR_MAX(int)],
-             source_time_field[sizeof("_SOURCE_REALTIME_TIMESTAMP=") + DECIMAL_STR_MAX(usec_t)];
-        char *m, *type_field_name;
+        char *buffer, *t;
         int k;
 
         assert(s);
+        assert(ret_n_iovec);
 
         if (size <= 0)
-                return;
+                return 0;
 
         if (!data)
-                return;
+                return 0;
 
         /* Note that the input buffer is NUL terminated, but let's
          * check whether there is a spurious NUL byte */
         if (memchr(data, 0, size))
-                return;
+                return 0;
 
         p = startswith(data, "audit");
         if (!p)
-                return;
+                return 0;
 
         if (sscanf(p, "(%" PRIu64 ".%" PRIu64 ":%" PRIu64 "):%n",
                    &seconds,
                    &msec,
                    &id,
                    &k) != 3)
-                return;
+                return 0;
 
         p += k;
         p += strspn(p, WHITESPACE);
 
         if (isempty(p))
-                return;
+                return 0;
 
-        n_iov_allocated = N_IOVEC_META_FIELDS + 8;
-        iov = new(struct iovec, n_iov_allocated);
-        if (!iov) {
-                log_oom();
-                return;
-        }
+        /* Size the iovec array and the field buffer for the worst case once, so that mapping the fields needs
+         * no further allocations. Both are kept around for the next record. Besides the mapped fields, the
+         * buffer holds the fixed fields and the record itself in MESSAGE=. */
+        n_fields = strlen(p) / 2 + 1;
+
+        if (!GREEDY_REALLOC(s->audit_iovec, s->audit_iovec_allocated, 8 + n_fields + N_IOVEC_META_FIELDS) ||
+            !GREEDY_REALLOC(s->audit_buffer, s->audit_buffer_allocated, AUDIT_RECORD_FIELDS_MAX + n_fields * AUDIT_FIELD_NAME_MAX + 2 * size))
+                return -ENOMEM;
 
-        iov[n_iov++] = IOVEC_MAKE_STRING("_TRANSPORT=audit");
+        buffer = s->audit_buffer;
 
-        sprintf(source_time_field, "_SOURCE_REALTIME_TIMESTAMP=%" PRIu64,
-                (usec_t) seconds * USEC_PER_SEC + (usec_t) msec * USEC_PER_MSEC);
-        iov[n_iov++] = IOVEC_MAKE_STRING(source_time_field);
+        s->audit_iovec[n_iov++] = IOVEC_MAKE_STRING("_TRANSPORT=audit");
 
-        sprintf(type_field, "_AUDIT_TYPE=%i", type);
-        iov[n_iov++] = IOVEC_MAKE_STRING(type_field);
+        t = buffer + sprintf(buffer, "_SOURCE_REALTIME_TIMESTAMP=%" PRIu64,
+                             (usec_t) seconds * USEC_PER_SEC + (usec_t) msec * USEC_PER_MSEC);
+        s->audit_iovec[n_iov++] = IOVEC_MAKE(buffer, t - buffer);
+        buffer = t;
 
-        sprintf(id_field, "_AUDIT_ID=%" PRIu64, id);
-        iov[n_iov++] = IOVEC_MAKE_STRING(id_field);
+        t = buffer + sprintf(buffer, "_AUDIT_TYPE=%i", type);
+        s->audit_iovec[n_iov++] = IOVEC_MAKE(buffer, t - buffer);
+        buffer = t;
+
+        t = buffer + sprintf(buffer, "_AUDIT_ID=%" PRIu64, id);
+        s->audit_iovec[n_iov++] = IOVEC_MAKE(buffer, t - buffer);
+        buffer = t;
 
         assert_cc(4 == LOG_FAC(LOG_AUTH));
-        iov[n_iov++] = IOVEC_MAKE_STRING("SYSLOG_FACILITY=4");
-        iov[n_iov++] = IOVEC_MAKE_STRING("SYSLOG_IDENTIFIER=audit");
+        s->audit_iovec[n_iov++] = IOVEC_MAKE_STRING("SYSLOG_FACILITY=4");
+        s->audit_iovec[n_iov++] = IOVEC_MAKE_STRING("SYSLOG_IDENTIFIER=audit");
 
         type_name = audit_type_name_alloca(type);
 
-        type_field_name = strjoina("_AUDIT_TYPE_NAME=", type_name);
-        iov[n_iov++] = IOVEC_MAKE_STRING(type_field_name);
+        t = stpcpy(stpcpy(buffer, "_AUDIT_TYPE_NAME="), type_name);
+        s->audit_iovec[n_iov++] = IOVEC_MAKE(buffer, t - buffer);
+        buffer = t;
 
-        m = strjoina("MESSAGE=", type_name, " ", p);
-        iov[n_iov++] = IOVEC_MAKE_STRING(m);
+        t = stpcpy(stpcpy(stpcpy(stpcpy(buffer, "MESSAGE="), type_name), " "), p);
+        s->audit_iovec[n_iov++] = IOVEC_MAKE(buffer, t - buffer);
+        buffer = t;
 
-        z = n_iov;
+        map_all_fields(p, false, s->audit_iovec, &n_iov, &buffer);
 
-        map_all_fields(p, map_fields_kernel, "_AUDIT_FIELD_", true, &iov, &n_iov_allocated, &n_iov);
+        *ret_n_iovec = n_iov;
+        return 1;
+}
 
-        if (!GREEDY_REALLOC(iov, n_iov_allocated, n_iov + N_IOVEC_META_FIELDS)) {
-                log_oom();
-                goto finish;
-        }
+static void process_audit_string(Server *s, int type, const char *data, size_t size) {
+        size_t n_iov;
+        int r;
+
+        assert(s);
 
-        server_dispatch_message(s, iov, n_iov, n_iov_allocated, NULL, NULL, LOG_NOTICE, 0);
+        r = audit_map_record(s, type, data, size, &n_iov);
+        if (r == -ENOMEM)
+                log_oom();
+        if (r <= 0)
+                return;
 
-finish:
-        /* free() all entries that map_all_fields() added. All others
-         * are allocated on the stack or are constant. */
+        server_metrics_received(&s->metrics, SERVER_TRANSPORT_AUDIT, size);
 
-        for (; z < n_iov; z++)
-                free(iov[z].iov_base);
+        server_dispatch_message(s, s->audit_iovec, n_iov, s->audit_iovec_allocated, NULL, NULL, LOG_NOTICE, 0);
 }
 
 void server_process_audit_message(
@@ -448,6 +378,9 @@ void server_process_audit_message(
         if (nl->nlmsg_type < AUDIT_FIRST_USER_MSG && nl->nlmsg_type != AUDIT_USER)
                 return;
 
+        if (set_contains(s->audit_ignore_types, INT_TO_PTR(nl->nlmsg_type)))
+                return;
+
         process_audit_string(s, nl->nlmsg_type, NLMSG_DATA(nl), nl->nlmsg_len - ALIGN(sizeof(struct nlmsghdr)));
 }
 
@@ -543,3 +476,59 @@ int server_open_audit(Server *s) {
 
         return 0;
 }
+
+int config_parse_audit_ignore_types(
+                const char *unit,
+                const char *filename,
+                unsigned line,
+                const char *section,
+                unsigned section_line,
+                const char *lvalue,
+                int ltype,
+                const char *rvalue,
+                void *data,
+                void *userdata) {
+
+        Set **types = data;
+        const char *p;
+        int r;
+
+        assert(filename);
+        assert(lvalue);
+        assert(rvalue);
+        assert(types);
+
+        if (isempty(rvalue)) {
+                *types = set_free(*types);
+                return 0;
+        }
+
+        for (p = rvalue;;) {
+                _cleanup_free_ char *word = NULL;
+                int type;
+
+                r = extract_first_word(&p, &word, NULL, 0);
+                if (r == 0)
+                        return 0;
+                if (r == -ENOMEM)
+                        return log_oom();
+                if (r < 0) {
+                        log_syntax(unit, LOG_ERR, filename, line, r, "Invalid syntax, ignoring: %s", rvalue);
+                        return 0;
+                }
+
+                type = audit_type_from_string(word);
+                if (type < 0) {
+                        log_syntax(unit, LOG_ERR, filename, line, type, "Failed to parse audit record type, ignoring: %s", word);
+                        continue;
+                }
+
+                r = set_ensure_allocated(types, NULL);
+                if (r < 0)
+                        return log_oom();
+
+                r = set_put(*types, INT_TO_PTR(type));
+                if (r < 0)
+                        return log_oom();
+        }
+}
@@ -1,9 +1,33 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 #pragma once
 
+#include "conf-parser.h"
 #include "journald-server.h"
 #include "socket-util.h"
 
+typedef enum AuditFieldMap {
+        AUDIT_FIELD_MAP_GENERIC,          /* fall back to _AUDIT_FIELD_XYZ= */
+        AUDIT_FIELD_MAP_SIMPLE,           /* copy the value verbatim */
+        AUDIT_FIELD_MAP_STRING,           /* undo the kernel's string field escaping */
+        AUDIT_FIELD_MAP_STRING_PRINTABLE, /* same, but replace control characters by spaces */
+} AuditFieldMap;
+
+/* How a known audit field is mapped, depending on whether it occurs in the kernel or userspace part of the
+ * audit record */
+struct AuditFieldMapping {
+        const char *name;
+        const char *kernel_field;
+        AuditFieldMap kernel_map;
+        const char *userspace_field;
+        AuditFieldMap userspace_map;
+};
+
+/* gperf lookup function */
+const struct AuditFieldMapping* journald_audit_field_lookup(const char *key, GPERF_LEN_TYPE length);
+
+int audit_map_record(Server *s, int type, const char *data, size_t size, size_t *ret_n_iovec);
 void server_process_audit_message(Server *s, const void *buffer, size_t buffer_size, const struct ucred *ucred, const union sockaddr_union *sa, socklen_t salen);
 
 int server_open_audit(Server*s);
+
+CONFIG_PARSER_PROTOTYPE(config_parse_audit_ignore_types);
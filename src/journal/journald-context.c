@@ -18,6 +18,7 @@
 #include "process-util.h"
 #include "procfs-util.h"
 #include "string-util.h"
+#include "strv.h"
 #include "syslog-util.h"
 #include "unaligned.h"
 #include "user-util.h"
@@ -47,6 +48,18 @@
  *    stream connection. This should improve cases where a service process logs immediately before exiting and we
  *    previously had trouble associating the log message with the service.
  *
+ * Short-lived processes are a special case: by the time we get to process their log messages they have often exited
+ * already, and all attempts to read their metadata from /proc fail. When we notice that, the entry is marked as
+ * "vanished", and all we fill in is what we can learn from the unit the message was associated with. Vanished entries
+ * are not refreshed from /proc anymore, unless the PID shows up again, i.e. got reused.
+ *
+ * Moreover, for each unit we remember the context that most recently read the unit-level metadata (i.e. everything
+ * derived from the cgroup path, the invocation ID, the maximum log level and the extra fields). Other processes in
+ * the same cgroup inherit this data from it, instead of reading it again. For units listed in InheritMetadataUnits=
+ * the command name, executable and command line are inherited too, so that for their processes only the cgroup and
+ * the audit session and login UID have to be read from /proc. This is useful for units forking lots of short-lived
+ * helpers of the same kind.
+ *
  * NB: With and without the metadata cache: the implicitly added entry metadata in the journal (with the exception of
  *     UID/PID/GID and SELinux label) must be understood as possibly slightly out of sync (i.e. sometimes slighly older
  *     and sometimes slightly newer than what was current at the log event).
@@ -151,10 +164,36 @@ static int client_context_new(Server *s, pid_t pid, ClientContext **ret) {
         return 0;
 }
 
+static void client_context_unlink_unit(Server *s, ClientContext *c) {
+        assert(s);
+        assert(c);
+
+        /* Make sure we are not used as source for inheriting unit metadata anymore. This needs to be called
+         * before c->unit is changed or freed, as it is used as key in the hashmap. */
+
+        if (c->unit)
+                (void) hashmap_remove_value(s->client_context_units, c->unit, c);
+}
+
+static void client_context_link_unit(Server *s, ClientContext *c) {
+        assert(s);
+        assert(c);
+
+        if (!c->unit)
+                return;
+
+        if (hashmap_ensure_allocated(&s->client_context_units, &string_hash_ops) < 0)
+                return;
+
+        /* Replaces any previous entry for the unit, including its key, which belongs to the entry */
+        (void) hashmap_replace(s->client_context_units, c->unit, c);
+}
+
 static void client_context_reset(ClientContext *c) {
         assert(c);
 
         c->timestamp = USEC_INFINITY;
+        c->vanished = false;
 
         c->uid = UID_INVALID;
         c->gid = GID_INVALID;
@@ -199,6 +238,7 @@ static ClientContext* client_context_free(Server *s, ClientContext *c) {
         if (c->in_lru)
                 assert_se(prioq_remove(s->client_contexts_lru, c, &c->lru_index) >= 0);
 
+        client_context_unlink_unit(s, c);
         client_context_reset(c);
 
         return mfree(c);
@@ -284,16 +324,18 @@ static int client_context_read_cgroup(Server *s, ClientContext *c, const char *u
         /* Try to acquire the current cgroup path */
         r = cg_pid_get_path_shifted(c->pid, s->cgroup_root, &t);
         if (r < 0 || empty_or_root(t)) {
+                t = mfree(t);
 
                 /* We use the unit ID passed in as fallback if we have nothing cached yet and cg_pid_get_path_shifted()
                  * failed or process is running in a root cgroup. Zombie processes are automatically migrated to root cgroup
                  * on cgroupsv1 and we want to be able to map log messages from them too. */
                 if (unit_id && !c->unit) {
                         c->unit = strdup(unit_id);
-                        if (c->unit)
-                                return 0;
+                        if (!c->unit)
+                                return -ENOMEM;
                 }
 
+                /* Propagate -ESRCH, so that the caller learns that the process is gone */
                 return r;
         }
 
@@ -305,6 +347,8 @@ static int client_context_read_cgroup(Server *s, ClientContext *c, const char *u
 
         free_and_replace(c->cgroup, t);
 
+        client_context_unlink_unit(s, c);
+
         (void) cg_path_get_session(c->cgroup, &t);
         free_and_replace(c->session, t);
 
@@ -464,6 +508,104 @@ static int client_context_read_extra_fields(
         return 0;
 }
 
+static ClientContext* client_context_find_unit(Server *s, ClientContext *c, usec_t timestamp) {
+        ClientContext *t;
+
+        assert(s);
+        assert(c);
+
+        /* Look for another context of the same unit whose unit metadata is recent enough to be reused. If we know
+         * our cgroup it needs to match too, as different processes of the same unit might live in different
+         * cgroups, and hence belong to different user units, for example. */
+
+        if (!c->unit)
+                return NULL;
+
+        t = hashmap_get(s->client_context_units, c->unit);
+        if (!t || t == c)
+                return NULL;
+
+        if (c->cgroup && !streq_ptr(c->cgroup, t->cgroup))
+                return NULL;
+
+        if (t->timestamp == USEC_INFINITY || t->timestamp + REFRESH_USEC < timestamp)
+                return NULL;
+
+        return t;
+}
+
+static int client_context_copy_extra_fields(ClientContext *c, const ClientContext *t) {
+        _cleanup_free_ struct iovec *iovec = NULL;
+        _cleanup_free_ void *data = NULL;
+        size_t i;
+
+        assert(c);
+        assert(t);
+
+        if (t->extra_fields_n_iovec > 0) {
+                const struct iovec *last = t->extra_fields_iovec + t->extra_fields_n_iovec - 1;
+                size_t size;
+
+                /* The iovecs point into the data blob, hence copy both and rebase the former */
+                size = (const uint8_t*) last->iov_base + last->iov_len - (const uint8_t*) t->extra_fields_data;
+
+                data = memdup(t->extra_fields_data, size);
+                iovec = newdup(struct iovec, t->extra_fields_iovec, t->extra_fields_n_iovec);
+                if (!data || !iovec)
+                        return -ENOMEM;
+
+                for (i = 0; i < t->extra_fields_n_iovec; i++)
+                        iovec[i].iov_base = (uint8_t*) data +
+                                ((const uint8_t*) t->extra_fields_iovec[i].iov_base - (const uint8_t*) t->extra_fields_data);
+        }
+
+        free_and_replace(c->extra_fields_iovec, iovec);
+        free_and_replace(c->extra_fields_data, data);
+        c->extra_fields_n_iovec = t->extra_fields_n_iovec;
+        c->extra_fields_mtime = t->extra_fields_mtime;
+
+        return 0;
+}
+
+static int client_context_inherit_unit(Server *s, ClientContext *c, const ClientContext *t) {
+        assert(s);
+        assert(c);
+        assert(t);
+        assert(c != t);
+
+        client_context_unlink_unit(s, c);
+
+        if (free_and_strdup(&c->cgroup, t->cgroup) < 0 ||
+            free_and_strdup(&c->session, t->session) < 0 ||
+            free_and_strdup(&c->unit, t->unit) < 0 ||
+            free_and_strdup(&c->user_unit, t->user_unit) < 0 ||
+            free_and_strdup(&c->slice, t->slice) < 0 ||
+            free_and_strdup(&c->user_slice, t->user_slice) < 0)
+                return -ENOMEM;
+
+        c->owner_uid = t->owner_uid;
+        c->invocation_id = t->invocation_id;
+        c->log_level_max = t->log_level_max;
+
+        return client_context_copy_extra_fields(c, t);
+}
+
+static int client_context_inherit_process(ClientContext *c, const ClientContext *t) {
+        assert(c);
+        assert(t);
+        assert(c != t);
+
+        /* Only what describes the program that runs is copied. The identity of the process (its audit session and
+         * login UID, its capabilities, its security label) may well differ between siblings, e.g. for cron jobs of
+         * different users, hence it is never taken from another process. */
+        if (free_and_strdup(&c->comm, t->comm) < 0 ||
+            free_and_strdup(&c->exe, t->exe) < 0 ||
+            free_and_strdup(&c->cmdline, t->cmdline) < 0)
+                return -ENOMEM;
+
+        return 0;
+}
+
 static void client_context_really_refresh(
                 Server *s,
                 ClientContext *c,
@@ -472,24 +614,65 @@ static void client_context_really_refresh(
                 const char *unit_id,
                 usec_t timestamp) {
 
+        ClientContext *t;
+        usec_t begin;
+        int r;
+
         assert(s);
         assert(c);
         assert(pid_is_valid(c->pid));
 
+        begin = now(CLOCK_MONOTONIC);
         if (timestamp == USEC_INFINITY)
-                timestamp = now(CLOCK_MONOTONIC);
+                timestamp = begin;
 
         client_context_read_uid_gid(c, ucred);
-        client_context_read_basic(c);
-        (void) client_context_read_label(c, label, label_size);
 
-        (void) audit_session_from_pid(c->pid, &c->auditid);
-        (void) audit_loginuid_from_pid(c->pid, &c->loginuid);
+        /* Read the cgroup first: it tells us which unit the process belongs to, and whether it is still around */
+        r = client_context_read_cgroup(s, c, unit_id);
+        c->vanished = r == -ESRCH;
+
+        t = client_context_find_unit(s, c, timestamp);
+
+        if (c->vanished) {
+                /* The process exited already, hence everything else we could read from /proc is gone too. Don't
+                 * bother, and make do with the unit metadata and what was passed in. */
+                s->metrics.n_context_vanished++;
+
+                if (label_size > 0)
+                        (void) client_context_read_label(c, label, label_size);
+
+        } else if (t && strv_fnmatch(s->inherit_metadata_units, c->unit, 0)) {
+                s->metrics.n_context_inherited_process++;
+
+                (void) client_context_inherit_process(c, t);
+                (void) client_context_read_label(c, label, label_size);
+
+                /* These are a single small read each, unlike the capabilities, which are left unset */
+                (void) audit_session_from_pid(c->pid, &c->auditid);
+                (void) audit_loginuid_from_pid(c->pid, &c->loginuid);
+
+        } else {
+                client_context_read_basic(c);
+                (void) client_context_read_label(c, label, label_size);
+
+                (void) audit_session_from_pid(c->pid, &c->auditid);
+                (void) audit_loginuid_from_pid(c->pid, &c->loginuid);
+        }
+
+        if (t) {
+                s->metrics.n_context_inherited_unit++;
 
-        (void) client_context_read_cgroup(s, c, unit_id);
-        (void) client_context_read_invocation_id(s, c);
-        (void) client_context_read_log_level_max(s, c);
-        (void) client_context_read_extra_fields(s, c);
+                (void) client_context_inherit_unit(s, c, t);
+        } else {
+                (void) client_context_read_invocation_id(s, c);
+                (void) client_context_read_log_level_max(s, c);
+                (void) client_context_read_extra_fields(s, c);
+
+                /* Only contexts of live processes have complete data, hence only those are used as source */
+                if (!c->vanished)
+                        client_context_link_unit(s, c);
+        }
 
         c->timestamp = timestamp;
 
@@ -497,6 +680,8 @@ static void client_context_really_refresh(
                 assert(c->n_ref == 0);
                 assert_se(prioq_reshuffle(s->client_contexts_lru, c, &c->lru_index) >= 0);
         }
+
+        latency_histogram_add(&s->metrics.context_refresh_latency, now(CLOCK_MONOTONIC) - begin);
 }
 
 void client_context_maybe_refresh(
@@ -520,13 +705,27 @@ void client_context_maybe_refresh(
         /* If the data isn't pinned and if the cashed data is older than the upper limit, we flush it out
          * entirely. This follows the logic that as long as an entry is pinned the PID reuse is unlikely. */
         if (c->n_ref == 0 && c->timestamp + MAX_USEC < timestamp) {
+                client_context_unlink_unit(s, c);
                 client_context_reset(c);
                 goto refresh;
         }
 
         /* If the data is older than the lower limit, we refresh, but keep the old data for all we can't update */
-        if (c->timestamp + REFRESH_USEC < timestamp)
+        if (c->timestamp + REFRESH_USEC < timestamp) {
+
+                /* If we already know the process is gone there's nothing to refresh. Checking whether the PID
+                 * got reused in the meantime is much cheaper than failing to read all of /proc again. If it
+                 * did, none of the cached data applies anymore. */
+                if (c->vanished) {
+                        if (!pid_is_unwaited(c->pid))
+                                return;
+
+                        client_context_unlink_unit(s, c);
+                        client_context_reset(c);
+                }
+
                 goto refresh;
+        }
 
         /* If the data passed along doesn't match the cached data we also do a refresh */
         if (ucred && uid_is_valid(ucred->uid) && c->uid != ucred->uid)
@@ -604,8 +803,11 @@ void client_context_flush_all(Server *s) {
         assert(prioq_size(s->client_contexts_lru) == 0);
         assert(hashmap_size(s->client_contexts) == 0);
 
+        assert(hashmap_size(s->client_context_units) == 0);
+
         s->client_contexts_lru = prioq_free(s->client_contexts_lru);
         s->client_contexts = hashmap_free(s->client_contexts);
+        s->client_context_units = hashmap_free(s->client_context_units);
 }
 
 static int client_context_get_internal(
@@ -628,6 +830,7 @@ static int client_context_get_internal(
 
         c = hashmap_get(s->client_contexts, PID_TO_PTR(pid));
         if (c) {
+                s->metrics.n_context_hit++;
 
                 if (add_ref) {
                         if (c->in_lru) {
@@ -646,6 +849,8 @@ static int client_context_get_internal(
                 return 0;
         }
 
+        s->metrics.n_context_miss++;
+
         client_context_try_shrink_to(s, cache_max()-1);
 
         r = client_context_new(s, pid, &c);
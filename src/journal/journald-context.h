@@ -15,6 +15,7 @@ struct ClientContext {
         unsigned lru_index;
         usec_t timestamp;
         bool in_lru;
+        bool vanished;
 
         pid_t pid;
         uid_t uid;
@@ -76,8 +76,13 @@ void server_forward_kmsg(
         iovec[n++] = IOVEC_MAKE_STRING(message);
         iovec[n++] = IOVEC_MAKE_STRING("\n");
 
-        if (writev(s->dev_kmsg_fd, iovec, n) < 0)
+        /* Each write() is one record for the kernel, hence there's nothing to batch here. Writes are never
+         * blocked by slow readers either, the kernel ring buffer simply overwrites old records. */
+        if (writev(s->dev_kmsg_fd, iovec, n) < 0) {
+                s->n_forward_kmsg_dropped++;
                 log_debug_errno(errno, "Failed to write to /dev/kmsg for logging: %m");
+        } else
+                s->n_forward_kmsg_sent++;
 }
 
 static bool is_us(const char *identifier, const char *pid) {
@@ -111,6 +116,8 @@ static void dev_kmsg_record(Server *s, char *p, size_t l) {
         if (l <= 0)
                 return;
 
+        server_metrics_received(&s->metrics, SERVER_TRANSPORT_KERNEL, l);
+
         e = memchr(p, ',', l);
         if (!e)
                 return;
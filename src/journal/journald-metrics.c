@@ -0,0 +1,98 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "journald-metrics.h"
+#include "string-table.h"
+#include "string-util.h"
+#include "util.h"
+
+void latency_histogram_add(LatencyHistogram *h, usec_t u) {
+        unsigned i;
+
+        assert(h);
+
+        i = u == 0 ? 0 : MIN(u64log2(u) + 1, LATENCY_HISTOGRAM_BUCKETS - 1U);
+
+        h->buckets[i]++;
+        h->n++;
+        h->sum += u;
+        h->max = MAX(h->max, u);
+}
+
+static void latency_histogram_dump(const LatencyHistogram *h, const char *name, FILE *f) {
+        unsigned i;
+
+        assert(h);
+        assert(name);
+        assert(f);
+
+        fprintf(f,
+                "%1$s_COUNT=%2$" PRIu64 "\n"
+                "%1$s_SUM_USEC=%3$" PRIu64 "\n"
+                "%1$s_MAX_USEC=%4$" PRIu64 "\n"
+                "%1$s_BUCKETS_USEC=",
+                name, h->n, h->sum, h->max);
+
+        /* Upper bound of each bucket and the number of samples in it */
+        for (i = 0; i < LATENCY_HISTOGRAM_BUCKETS - 1; i++)
+                fprintf(f, "%" PRIu64 ":%" PRIu64 " ", UINT64_C(1) << i, h->buckets[i]);
+        fprintf(f, "inf:%" PRIu64 "\n", h->buckets[LATENCY_HISTOGRAM_BUCKETS - 1]);
+}
+
+void server_metrics_dump(const ServerMetrics *m, FILE *f) {
+        ServerTransport t;
+
+        assert(m);
+        assert(f);
+
+        fprintf(f, "UPTIME_USEC=%" PRIu64 "\n", now(CLOCK_MONOTONIC) - m->start_usec);
+
+        for (t = 0; t < _SERVER_TRANSPORT_MAX; t++) {
+                const char *n;
+
+                n = ascii_strupper(strdupa(server_transport_to_string(t)));
+
+                fprintf(f,
+                        "RECEIVED_%1$s=%2$" PRIu64 "\n"
+                        "RECEIVED_%1$s_BYTES=%3$" PRIu64 "\n",
+                        n, m->n_received[t], m->bytes_received[t]);
+        }
+
+        fprintf(f,
+                "RATE_LIMITED=%" PRIu64 "\n"
+                "WRITTEN=%" PRIu64 "\n"
+                "WRITTEN_BYTES=%" PRIu64 "\n"
+                "WRITE_FAILED=%" PRIu64 "\n"
+                "ROTATIONS=%" PRIu64 "\n"
+                "CONTEXT_CACHE_HITS=%" PRIu64 "\n"
+                "CONTEXT_CACHE_MISSES=%" PRIu64 "\n"
+                "CONTEXT_VANISHED=%" PRIu64 "\n"
+                "CONTEXT_INHERITED_UNIT=%" PRIu64 "\n"
+                "CONTEXT_INHERITED_PROCESS=%" PRIu64 "\n",
+                m->n_rate_limited,
+                m->n_written,
+                m->bytes_written,
+                m->n_write_failed,
+                m->n_rotations,
+                m->n_context_hit,
+                m->n_context_miss,
+                m->n_context_vanished,
+                m->n_context_inherited_unit,
+                m->n_context_inherited_process);
+
+        latency_histogram_dump(&m->write_latency, "WRITE_LATENCY", f);
+        latency_histogram_dump(&m->sync_latency, "SYNC_LATENCY", f);
+        latency_histogram_dump(&m->vacuum_latency, "VACUUM_LATENCY", f);
+        latency_histogram_dump(&m->context_refresh_latency, "CONTEXT_REFRESH_LATENCY", f);
+}
+
+/* Named like the _TRANSPORT= field values */
+static const char* const server_transport_table[_SERVER_TRANSPORT_MAX] = {
+        [SERVER_TRANSPORT_DRIVER] = "driver",
+        [SERVER_TRANSPORT_SYSLOG] = "syslog",
+        [SERVER_TRANSPORT_JOURNAL] = "journal",
+        [SERVER_TRANSPORT_STDOUT] = "stdout",
+        [SERVER_TRANSPORT_KERNEL] = "kernel",
+        [SERVER_TRANSPORT_AUDIT] = "audit",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(server_transport, ServerTransport);
@@ -0,0 +1,67 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "macro.h"
+#include "time-util.h"
+
+typedef enum ServerTransport {
+        SERVER_TRANSPORT_DRIVER,
+        SERVER_TRANSPORT_SYSLOG,
+        SERVER_TRANSPORT_JOURNAL,
+        SERVER_TRANSPORT_STDOUT,
+        SERVER_TRANSPORT_KERNEL,
+        SERVER_TRANSPORT_AUDIT,
+        _SERVER_TRANSPORT_MAX,
+        _SERVER_TRANSPORT_INVALID = -1
+} ServerTransport;
+
+/* Bucket 0 counts durations below 1µs, bucket i > 0 those below 2^i µs, and the last one everything that
+ * is longer, i.e. the buckets before that reach up to ~4s. */
+#define LATENCY_HISTOGRAM_BUCKETS 24
+
+typedef struct LatencyHistogram {
+        uint64_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+        uint64_t n;
+        usec_t sum;
+        usec_t max;
+} LatencyHistogram;
+
+/* Counters that are always maintained, hence they need to stay cheap to update */
+typedef struct ServerMetrics {
+        usec_t start_usec;
+
+        uint64_t n_received[_SERVER_TRANSPORT_MAX];
+        uint64_t bytes_received[_SERVER_TRANSPORT_MAX];
+        uint64_t n_rate_limited;
+
+        uint64_t n_written;
+        uint64_t bytes_written;
+        uint64_t n_write_failed;
+        uint64_t n_rotations;
+
+        uint64_t n_context_hit;
+        uint64_t n_context_miss;
+        uint64_t n_context_vanished;
+        uint64_t n_context_inherited_unit;
+        uint64_t n_context_inherited_process;
+
+        LatencyHistogram write_latency;
+        LatencyHistogram sync_latency;
+        LatencyHistogram vacuum_latency;
+        LatencyHistogram context_refresh_latency;
+} ServerMetrics;
+
+static inline void server_metrics_received(ServerMetrics *m, ServerTransport t, size_t size) {
+        m->n_received[t]++;
+        m->bytes_received[t] += size;
+}
+
+void latency_histogram_add(LatencyHistogram *h, usec_t u);
+
+void server_metrics_dump(const ServerMetrics *m, FILE *f);
+
+const char *server_transport_to_string(ServerTransport t) _const_;
+ServerTransport server_transport_from_string(const char *s) _pure_;
@@ -305,6 +305,8 @@ void server_process_native_message(
         assert(s);
         assert(buffer || buffer_size == 0);
 
+        server_metrics_received(&s->metrics, SERVER_TRANSPORT_JOURNAL, buffer_size);
+
         if (ucred && pid_is_valid(ucred->pid)) {
                 r = client_context_get(s, ucred->pid, ucred, label, label_len, NULL, &context);
                 if (r < 0)
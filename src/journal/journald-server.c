@@ -54,6 +54,7 @@
 #include "stdio-util.h"
 #include "string-table.h"
 #include "string-util.h"
+#include "strv.h"
 #include "syslog-util.h"
 #include "user-util.h"
 
@@ -468,6 +469,8 @@ void server_rotate(Server *s) {
 
         log_debug("Rotating...");
 
+        s->metrics.n_rotations++;
+
         (void) do_rotate(s, &s->runtime_journal, "runtime", false, 0);
         (void) do_rotate(s, &s->system_journal, "system", s->seal, 0);
 
@@ -491,8 +494,11 @@ void server_rotate(Server *s) {
 void server_sync(Server *s) {
         JournalFile *f;
         Iterator i;
+        usec_t start;
         int r;
 
+        start = now(CLOCK_MONOTONIC);
+
         if (s->system_journal) {
                 r = journal_file_set_offline(s->system_journal, false);
                 if (r < 0)
@@ -512,6 +518,8 @@ void server_sync(Server *s) {
         }
 
         s->sync_scheduled = false;
+
+        latency_histogram_add(&s->metrics.sync_latency, now(CLOCK_MONOTONIC) - start);
 }
 
 static void do_vacuum(Server *s, JournalStorage *storage, bool verbose) {
@@ -536,10 +544,13 @@ static void do_vacuum(Server *s, JournalStorage *storage, bool verbose) {
 }
 
 int server_vacuum(Server *s, bool verbose) {
+        usec_t start;
+
         assert(s);
 
         log_debug("Vacuuming...");
 
+        start = now(CLOCK_MONOTONIC);
         s->oldest_file_usec = 0;
 
         if (s->system_journal)
@@ -547,6 +558,8 @@ int server_vacuum(Server *s, bool verbose) {
         if (s->runtime_journal)
                 do_vacuum(s, &s->runtime_storage, verbose);
 
+        latency_histogram_add(&s->metrics.vacuum_latency, now(CLOCK_MONOTONIC) - start);
+
         return 0;
 }
 
@@ -639,6 +652,27 @@ static bool shall_try_append_again(JournalFile *f, int r) {
         }
 }
 
+static int append_entry(Server *s, JournalFile *f, const struct dual_timestamp *ts, struct iovec *iovec, size_t n) {
+        usec_t start;
+        int r;
+
+        assert(s);
+        assert(f);
+
+        /* Two clock reads per entry, which is cheap enough to be done unconditionally */
+        start = now(CLOCK_MONOTONIC);
+
+        r = journal_file_append_entry(f, ts, NULL, iovec, n, &s->seqnum, NULL, NULL);
+        if (r >= 0) {
+                s->metrics.n_written++;
+                s->metrics.bytes_written += IOVEC_TOTAL_SIZE(iovec, n);
+        }
+
+        latency_histogram_add(&s->metrics.write_latency, now(CLOCK_MONOTONIC) - start);
+
+        return r;
+}
+
 static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n, int priority) {
         bool vacuumed = false, rotate = false;
         struct dual_timestamp ts;
@@ -687,13 +721,14 @@ static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n
 
         s->last_realtime_clock = ts.realtime;
 
-        r = journal_file_append_entry(f, &ts, NULL, iovec, n, &s->seqnum, NULL, NULL);
+        r = append_entry(s, f, &ts, iovec, n);
         if (r >= 0) {
                 server_schedule_sync(s, priority);
                 return;
         }
 
         if (vacuumed || !shall_try_append_again(f, r)) {
+                s->metrics.n_write_failed++;
                 log_error_errno(r, "Failed to write entry (%zu items, %zu bytes), ignoring: %m", n, IOVEC_TOTAL_SIZE(iovec, n));
                 return;
         }
@@ -706,10 +741,11 @@ static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n
                 return;
 
         log_debug("Retrying write.");
-        r = journal_file_append_entry(f, &ts, NULL, iovec, n, &s->seqnum, NULL, NULL);
-        if (r < 0)
+        r = append_entry(s, f, &ts, iovec, n);
+        if (r < 0) {
+                s->metrics.n_write_failed++;
                 log_error_errno(r, "Failed to write entry (%zu items, %zu bytes) despite vacuuming, ignoring: %m", n, IOVEC_TOTAL_SIZE(iovec, n));
-        else
+        } else
                 server_schedule_sync(s, priority);
 }
 
@@ -896,8 +932,10 @@ void server_driver_message(Server *s, pid_t object_pid, const char *message_id,
         /* Error handling below */
         va_end(ap);
 
-        if (r >= 0)
+        if (r >= 0) {
+                server_metrics_received(&s->metrics, SERVER_TRANSPORT_DRIVER, IOVEC_TOTAL_SIZE(iovec, n));
                 dispatch_message_real(s, iovec, n, m, s->my_context, NULL, LOG_INFO, object_pid);
+        }
 
         while (k < n)
                 free(iovec[k++].iov_base);
@@ -944,8 +982,10 @@ void server_dispatch_message(
                 (void) determine_space(s, &available, NULL);
 
                 rl = journal_rate_limit_test(s->rate_limit, c->unit, priority & LOG_PRIMASK, available);
-                if (rl == 0)
+                if (rl == 0) {
+                        s->metrics.n_rate_limited++;
                         return;
+                }
 
                 /* Write a suppression message if we suppressed something */
                 if (rl > 1)
@@ -1250,12 +1290,79 @@ static int dispatch_sigrtmin1(sd_event_source *es, const struct signalfd_siginfo
         return 0;
 }
 
+static int server_write_stats(Server *s) {
+        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        int r;
+
+        assert(s);
+
+        r = fopen_temporary("/run/systemd/journal/stats", &f, &temp_path);
+        if (r < 0)
+                return r;
+
+        (void) fchmod(fileno(f), 0644);
+
+        server_metrics_dump(&s->metrics, f);
+
+        fprintf(f,
+                "CONTEXT_CACHE_SIZE=%u\n"
+                "STDOUT_STREAMS=%u\n"
+                "FORWARD_SYSLOG_SENT=%" PRIu64 "\n"
+                "FORWARD_SYSLOG_DROPPED=%" PRIu64 "\n"
+                "FORWARD_KMSG_SENT=%" PRIu64 "\n"
+                "FORWARD_KMSG_DROPPED=%" PRIu64 "\n",
+                hashmap_size(s->client_contexts),
+                s->n_stdout_streams,
+                s->n_forward_syslog_sent,
+                s->n_forward_syslog_dropped,
+                s->n_forward_kmsg_sent,
+                s->n_forward_kmsg_dropped);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(temp_path, "/run/systemd/journal/stats") < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        return 0;
+
+fail:
+        (void) unlink(temp_path);
+        return r;
+}
+
+static int dispatch_sigrtmin2(sd_event_source *es, const struct signalfd_siginfo *si, void *userdata) {
+        Server *s = userdata;
+        int r;
+
+        assert(s);
+
+        log_debug("Received request for statistics from PID " PID_FMT, si->ssi_pid);
+
+        r = server_write_stats(s);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to write /run/systemd/journal/stats, ignoring: %m");
+                return 0;
+        }
+
+        /* Let clients know when the statistics were last updated. */
+        r = write_timestamp_file_atomic("/run/systemd/journal/stats-updated", now(CLOCK_MONOTONIC));
+        if (r < 0)
+                log_warning_errno(r, "Failed to write /run/systemd/journal/stats-updated, ignoring: %m");
+
+        return 0;
+}
+
 static int setup_signals(Server *s) {
         int r;
 
         assert(s);
 
-        assert_se(sigprocmask_many(SIG_SETMASK, NULL, SIGINT, SIGTERM, SIGUSR1, SIGUSR2, SIGRTMIN+1, -1) >= 0);
+        assert_se(sigprocmask_many(SIG_SETMASK, NULL, SIGINT, SIGTERM, SIGUSR1, SIGUSR2, SIGRTMIN+1, SIGRTMIN+2, -1) >= 0);
 
         r = sd_event_add_signal(s->event, &s->sigusr1_event_source, SIGUSR1, dispatch_sigusr1, s);
         if (r < 0)
@@ -1298,6 +1405,17 @@ static int setup_signals(Server *s) {
         if (r < 0)
                 return r;
 
+        /* SIGRTMIN+2 makes us write out our statistics to /run/systemd/journal/stats. Processed late too, so
+         * that they include everything queued at this point. Clients can watch
+         * /run/systemd/journal/stats-updated like the synced file above. */
+        r = sd_event_add_signal(s->event, &s->sigrtmin2_event_source, SIGRTMIN+2, dispatch_sigrtmin2, s);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_priority(s->sigrtmin2_event_source, SD_EVENT_PRIORITY_NORMAL+15);
+        if (r < 0)
+                return r;
+
         return 0;
 }
 
@@ -1682,6 +1800,8 @@ int server_init(Server *s) {
 
         zero(*s);
         s->syslog_fd = s->native_fd = s->stdout_fd = s->dev_kmsg_fd = s->audit_fd = s->hostname_fd = s->notify_fd = -1;
+        s->syslog_forward_fd = -1;
+        s->syslog_forward_path = "/run/systemd/journal/syslog";
         s->compress.enabled = true;
         s->compress.threshold_bytes = (uint64_t) -1;
         s->seal = true;
@@ -1707,6 +1827,8 @@ int server_init(Server *s) {
 
         s->line_max = DEFAULT_LINE_MAX;
 
+        s->metrics.start_usec = now(CLOCK_MONOTONIC);
+
         journal_reset_metrics(&s->system_storage.metrics);
         journal_reset_metrics(&s->runtime_storage.metrics);
 
@@ -1913,6 +2035,8 @@ void server_done(Server *s) {
 
         ordered_hashmap_free_with_destructor(s->user_journals, journal_file_close);
 
+        server_close_syslog_forward(s);
+
         sd_event_source_unref(s->syslog_event_source);
         sd_event_source_unref(s->native_event_source);
         sd_event_source_unref(s->stdout_event_source);
@@ -1924,6 +2048,7 @@ void server_done(Server *s) {
         sd_event_source_unref(s->sigterm_event_source);
         sd_event_source_unref(s->sigint_event_source);
         sd_event_source_unref(s->sigrtmin1_event_source);
+        sd_event_source_unref(s->sigrtmin2_event_source);
         sd_event_source_unref(s->hostname_event_source);
         sd_event_source_unref(s->notify_event_source);
         sd_event_source_unref(s->watchdog_event_source);
@@ -1944,6 +2069,10 @@ void server_done(Server *s) {
                 munmap(s->kernel_seqnum, sizeof(uint64_t));
 
         free(s->buffer);
+        free(s->audit_iovec);
+        free(s->audit_buffer);
+        set_free(s->audit_ignore_types);
+        strv_free(s->inherit_metadata_units);
         free(s->tty_path);
         free(s->cgroup_root);
         free(s->hostname_field);
@@ -7,11 +7,13 @@
 #include "sd-event.h"
 
 typedef struct Server Server;
+typedef struct SyslogForwardMessage SyslogForwardMessage;
 
 #include "conf-parser.h"
 #include "hashmap.h"
 #include "journal-file.h"
 #include "journald-context.h"
+#include "journald-metrics.h"
 #include "journald-rate-limit.h"
 #include "journald-stream.h"
 #include "list.h"
@@ -79,6 +81,7 @@ struct Server {
         sd_event_source *sigterm_event_source;
         sd_event_source *sigint_event_source;
         sd_event_source *sigrtmin1_event_source;
+        sd_event_source *sigrtmin2_event_source;
         sd_event_source *hostname_event_source;
         sd_event_source *notify_event_source;
         sd_event_source *watchdog_event_source;
@@ -92,6 +95,13 @@ struct Server {
         char *buffer;
         size_t buffer_size;
 
+        /* Reused for mapping audit records into journal fields */
+        struct iovec *audit_iovec;
+        size_t audit_iovec_allocated;
+        char *audit_buffer;
+        size_t audit_buffer_allocated;
+        Set *audit_ignore_types;
+
         JournalRateLimit *rate_limit;
         usec_t sync_interval_usec;
         usec_t rate_limit_interval;
@@ -112,6 +122,24 @@ struct Server {
         unsigned n_forward_syslog_missed;
         usec_t last_warn_forward_syslog_missed;
 
+        /* The socket of the syslog implementation we forward to */
+        const char *syslog_forward_path;
+
+        /* Messages waiting to be forwarded to syslog, oldest first */
+        int syslog_forward_fd;
+        sd_event_source *syslog_forward_event_source;
+        sd_event_source *syslog_forward_defer_event_source;
+        LIST_HEAD(SyslogForwardMessage, syslog_forward_queue);
+        SyslogForwardMessage *syslog_forward_queue_tail;
+        unsigned n_syslog_forward_queue;
+        bool syslog_forward_connected;
+        bool syslog_forward_blocked;
+
+        uint64_t n_forward_syslog_sent;
+        uint64_t n_forward_syslog_dropped;
+        uint64_t n_forward_kmsg_sent;
+        uint64_t n_forward_kmsg_dropped;
+
         uint64_t var_available_timestamp;
 
         usec_t max_retention_usec;
@@ -162,11 +190,15 @@ struct Server {
         /* Caching of client metadata */
         Hashmap *client_contexts;
         Prioq *client_contexts_lru;
+        Hashmap *client_context_units; /* unit name → context to inherit unit metadata from */
+        char **inherit_metadata_units;
 
         usec_t last_cache_pid_flush;
 
         ClientContext *my_context; /* the context of journald itself */
         ClientContext *pid1_context; /* the context of PID 1 */
+
+        ServerMetrics metrics;
 };
 
 #define SERVER_MACHINE_ID(s) ((s)->machine_id_field + STRLEN("_MACHINE_ID="))
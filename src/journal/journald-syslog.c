@@ -15,6 +15,7 @@
 #include "journald-server.h"
 #include "journald-syslog.h"
 #include "journald-wall.h"
+#include "list.h"
 #include "process-util.h"
 #include "selinux-util.h"
 #include "socket-util.h"
@@ -25,77 +26,345 @@
 /* Warn once every 30s if we missed syslog message */
 #define WARN_FORWARD_SYSLOG_MISSED_USEC (30 * USEC_PER_SEC)
 
-static void forward_syslog_iovec(Server *s, const struct iovec *iovec, unsigned n_iovec, const struct ucred *ucred, const struct timeval *tv) {
+/* How many messages we keep around while the syslog implementation is not reading them fast enough */
+#define FORWARD_SYSLOG_BACKLOG_MAX 1024U
 
-        static const union sockaddr_union sa = {
+/* How many messages we pass to the kernel in one go */
+#define FORWARD_SYSLOG_BATCH_MAX 64U
+
+struct SyslogForwardMessage {
+        LIST_FIELDS(SyslogForwardMessage, queue);
+
+        struct ucred ucred;
+        bool has_ucred;
+
+        size_t size;
+        char data[];
+};
+
+static void forward_syslog_dequeue(Server *s, SyslogForwardMessage *m, bool sent, bool missed) {
+        assert(s);
+        assert(m);
+
+        if (s->syslog_forward_queue_tail == m)
+                s->syslog_forward_queue_tail = m->queue_prev;
+        LIST_REMOVE(queue, s->syslog_forward_queue, m);
+
+        assert(s->n_syslog_forward_queue > 0);
+        s->n_syslog_forward_queue--;
+
+        if (sent)
+                s->n_forward_syslog_sent++;
+        else {
+                s->n_forward_syslog_dropped++;
+
+                if (missed)
+                        s->n_forward_syslog_missed++;
+        }
+
+        free(m);
+}
+
+static void forward_syslog_drop_all(Server *s, bool missed) {
+        assert(s);
+
+        while (s->syslog_forward_queue)
+                forward_syslog_dequeue(s, s->syslog_forward_queue, false, missed);
+}
+
+static int dispatch_forward_syslog_io(sd_event_source *es, int fd, uint32_t revents, void *userdata);
+static int dispatch_forward_syslog_defer(sd_event_source *es, void *userdata);
+
+static int forward_syslog_watch(Server *s, int fd) {
+        int r;
+
+        assert(s);
+        assert(fd >= 0);
+        assert(s->syslog_forward_fd < 0);
+
+        r = sd_event_add_io(s->event, &s->syslog_forward_event_source, fd, EPOLLOUT, dispatch_forward_syslog_io, s);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_enabled(s->syslog_forward_event_source, SD_EVENT_OFF);
+        if (r < 0) {
+                s->syslog_forward_event_source = sd_event_source_unref(s->syslog_forward_event_source);
+                return r;
+        }
+
+        s->syslog_forward_fd = fd;
+        return 0;
+}
+
+int server_open_syslog_forward(Server *s, int fd) {
+        int r;
+
+        assert(s);
+        assert(fd >= 0);
+
+        /* Forward on a datagram socket that is already connected to the receiver, instead of connecting to
+         * syslog_forward_path. Takes possession of the socket. */
+
+        r = forward_syslog_watch(s, fd);
+        if (r < 0)
+                return r;
+
+        s->syslog_forward_connected = true;
+        return 0;
+}
+
+static int forward_syslog_connect(Server *s) {
+        union sockaddr_union sa = {
                 .un.sun_family = AF_UNIX,
-                .un.sun_path = "/run/systemd/journal/syslog",
         };
-        struct msghdr msghdr = {
-                .msg_iov = (struct iovec *) iovec,
-                .msg_iovlen = n_iovec,
-                .msg_name = (struct sockaddr*) &sa.sa,
-                .msg_namelen = SOCKADDR_UN_LEN(sa.un),
-        };
-        struct cmsghdr *cmsg;
-        union {
-                struct cmsghdr cmsghdr;
-                uint8_t buf[CMSG_SPACE(sizeof(struct ucred))];
-        } control;
+        int r;
 
         assert(s);
-        assert(iovec);
-        assert(n_iovec > 0);
+        assert(s->syslog_forward_path);
 
-        if (ucred) {
-                zero(control);
-                msghdr.msg_control = &control;
-                msghdr.msg_controllen = sizeof(control);
-
-                cmsg = CMSG_FIRSTHDR(&msghdr);
-                cmsg->cmsg_level = SOL_SOCKET;
-                cmsg->cmsg_type = SCM_CREDENTIALS;
-                cmsg->cmsg_len = CMSG_LEN(sizeof(struct ucred));
-                memcpy(CMSG_DATA(cmsg), ucred, sizeof(struct ucred));
-                msghdr.msg_controllen = cmsg->cmsg_len;
+        /* We use a socket connected to the syslog implementation, so that we can wait for it to become
+         * writable again when the receiver's queue is full. */
+
+        if (strlen(s->syslog_forward_path) >= sizeof(sa.un.sun_path))
+                return -EINVAL;
+        strncpy(sa.un.sun_path, s->syslog_forward_path, sizeof(sa.un.sun_path));
+
+        if (s->syslog_forward_fd < 0) {
+                _cleanup_close_ int fd = -1;
+
+                fd = socket(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0);
+                if (fd < 0)
+                        return -errno;
+
+                r = forward_syslog_watch(s, fd);
+                if (r < 0)
+                        return r;
+
+                TAKE_FD(fd);
         }
 
+        if (connect(s->syslog_forward_fd, &sa.sa, SOCKADDR_UN_LEN(sa.un)) < 0)
+                return -errno;
+
+        s->syslog_forward_connected = true;
+        return 0;
+}
+
+static void forward_syslog_flush(Server *s) {
+        bool reconnected = false;
+        int r;
+
+        assert(s);
+
+        while (s->syslog_forward_queue) {
+                struct mmsghdr mmsghdr[FORWARD_SYSLOG_BATCH_MAX];
+                struct iovec iovec[FORWARD_SYSLOG_BATCH_MAX];
+                union {
+                        struct cmsghdr cmsghdr;
+                        uint8_t buf[CMSG_SPACE(sizeof(struct ucred))];
+                } control[FORWARD_SYSLOG_BATCH_MAX];
+                SyslogForwardMessage *m;
+                unsigned n = 0;
+                int k;
+
+                if (!s->syslog_forward_connected) {
+                        r = forward_syslog_connect(s);
+                        if (r < 0) {
+                                /* Nobody is listening, so there's nobody to queue things up for either */
+                                if (!IN_SET(r, -ENOENT, -ECONNREFUSED))
+                                        log_debug_errno(r, "Failed to connect to syslog socket: %m");
+
+                                forward_syslog_drop_all(s, false);
+                                return;
+                        }
+
+                        reconnected = true;
+                }
+
+                LIST_FOREACH(queue, m, s->syslog_forward_queue) {
+                        struct msghdr *mh;
+
+                        if (n >= FORWARD_SYSLOG_BATCH_MAX)
+                                break;
+
+                        mh = &mmsghdr[n].msg_hdr;
+
+                        iovec[n] = IOVEC_MAKE(m->data, m->size);
+                        mmsghdr[n] = (struct mmsghdr) {
+                                .msg_hdr.msg_iov = &iovec[n],
+                                .msg_hdr.msg_iovlen = 1,
+                        };
+
+                        if (m->has_ucred) {
+                                struct cmsghdr *cmsg;
+
+                                zero(control[n]);
+                                mh->msg_control = &control[n];
+                                mh->msg_controllen = sizeof(control[n]);
+
+                                cmsg = CMSG_FIRSTHDR(mh);
+                                cmsg->cmsg_level = SOL_SOCKET;
+                                cmsg->cmsg_type = SCM_CREDENTIALS;
+                                cmsg->cmsg_len = CMSG_LEN(sizeof(struct ucred));
+                                memcpy(CMSG_DATA(cmsg), &m->ucred, sizeof(struct ucred));
+                                mh->msg_controllen = cmsg->cmsg_len;
+                        }
+
+                        n++;
+                }
+
+                k = sendmmsg(s->syslog_forward_fd, mmsghdr, n, MSG_NOSIGNAL);
+                if (k >= 0) {
+                        while (k-- > 0)
+                                forward_syslog_dequeue(s, s->syslog_forward_queue, true, false);
+                        continue;
+                }
+
+                /* Only the first message failed, everything before it would have been reported as sent */
+                m = s->syslog_forward_queue;
+
+                if (errno == EAGAIN) {
+                        /* The socket is full? I guess the syslog implementation is too slow, let's keep
+                         * the messages until it catches up, but don't wait for it. */
+                        r = sd_event_source_set_enabled(s->syslog_forward_event_source, SD_EVENT_ONESHOT);
+                        if (r < 0) {
+                                log_debug_errno(r, "Failed to wait for syslog socket: %m");
+                                forward_syslog_drop_all(s, true);
+                                return;
+                        }
+
+                        s->syslog_forward_blocked = true;
+                        return;
+                }
+
+                if (IN_SET(errno, ECONNREFUSED, ENOTCONN)) {
+                        /* The syslog implementation went away, maybe it got restarted and is listening
+                         * again under the same name, hence try once more. */
+                        s->syslog_forward_connected = false;
+
+                        if (reconnected) {
+                                forward_syslog_drop_all(s, false);
+                                return;
+                        }
+
+                        continue;
+                }
+
+                if (m->has_ucred && IN_SET(errno, ESRCH, EPERM) && m->ucred.pid != getpid_cached()) {
+                        /* Hmm, presumably the sender process vanished by now, or we don't have
+                         * CAP_SYS_ADMIN, so let's fix it as good as we can, and retry */
+                        m->ucred.pid = getpid_cached();
+                        continue;
+                }
+
+                log_debug_errno(errno, "Failed to forward syslog message: %m");
+                forward_syslog_dequeue(s, m, false, true);
+        }
+}
+
+static int dispatch_forward_syslog_io(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        Server *s = userdata;
+
+        assert(s);
+
+        s->syslog_forward_blocked = false;
+        forward_syslog_flush(s);
+
+        return 0;
+}
+
+static int dispatch_forward_syslog_defer(sd_event_source *es, void *userdata) {
+        Server *s = userdata;
+
+        assert(s);
+
+        if (!s->syslog_forward_blocked)
+                forward_syslog_flush(s);
+
+        return 0;
+}
+
+static int forward_syslog_schedule(Server *s) {
+        int r;
+
+        assert(s);
+
+        if (!s->syslog_forward_defer_event_source) {
+                r = sd_event_add_defer(s->event, &s->syslog_forward_defer_event_source, dispatch_forward_syslog_defer, s);
+                if (r < 0)
+                        return r;
+
+                /* Process everything that is already waiting to be read first, so that it's sent in one
+                 * batch */
+                r = sd_event_source_set_priority(s->syslog_forward_defer_event_source, SD_EVENT_PRIORITY_NORMAL+10);
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_event_source_set_enabled(s->syslog_forward_defer_event_source, SD_EVENT_ONESHOT);
+}
+
+static void forward_syslog_iovec(Server *s, const struct iovec *iovec, unsigned n_iovec, const struct ucred *ucred, const struct timeval *tv) {
+        SyslogForwardMessage *m;
+        size_t size, offset = 0;
+        unsigned i;
+        int r;
+
+        assert(s);
+        assert(iovec);
+        assert(n_iovec > 0);
+
         /* Forward the syslog message we received via /dev/log to
          * /run/systemd/syslog. Unfortunately we currently can't set
-         * the SO_TIMESTAMP auxiliary data, and hence we don't. */
+         * the SO_TIMESTAMP auxiliary data, and hence we don't.
+         *
+         * Messages are queued and sent in batches from the event loop. */
 
-        if (sendmsg(s->syslog_fd, &msghdr, MSG_NOSIGNAL) >= 0)
+        if (s->n_syslog_forward_queue >= FORWARD_SYSLOG_BACKLOG_MAX) {
+                s->n_forward_syslog_dropped++;
+                s->n_forward_syslog_missed++;
                 return;
+        }
 
-        /* The socket is full? I guess the syslog implementation is
-         * too slow, and we shouldn't wait for that... */
-        if (errno == EAGAIN) {
+        size = IOVEC_TOTAL_SIZE(iovec, n_iovec);
+
+        m = malloc(offsetof(SyslogForwardMessage, data) + size);
+        if (!m) {
+                s->n_forward_syslog_dropped++;
                 s->n_forward_syslog_missed++;
                 return;
         }
 
-        if (ucred && IN_SET(errno, ESRCH, EPERM)) {
-                struct ucred u;
+        *m = (SyslogForwardMessage) {
+                .has_ucred = ucred,
+                .size = size,
+        };
+        if (ucred)
+                m->ucred = *ucred;
 
-                /* Hmm, presumably the sender process vanished
-                 * by now, or we don't have CAP_SYS_AMDIN, so
-                 * let's fix it as good as we can, and retry */
+        for (i = 0; i < n_iovec; i++) {
+                memcpy_safe(m->data + offset, iovec[i].iov_base, iovec[i].iov_len);
+                offset += iovec[i].iov_len;
+        }
 
-                u = *ucred;
-                u.pid = getpid_cached();
-                memcpy(CMSG_DATA(cmsg), &u, sizeof(struct ucred));
+        LIST_INSERT_AFTER(queue, s->syslog_forward_queue, s->syslog_forward_queue_tail, m);
+        s->syslog_forward_queue_tail = m;
+        s->n_syslog_forward_queue++;
 
-                if (sendmsg(s->syslog_fd, &msghdr, MSG_NOSIGNAL) >= 0)
-                        return;
+        if (s->syslog_forward_blocked)
+                return;
 
-                if (errno == EAGAIN) {
-                        s->n_forward_syslog_missed++;
-                        return;
-                }
+        /* Don't let the queue grow unboundedly while we are busy reading messages */
+        if (s->n_syslog_forward_queue >= FORWARD_SYSLOG_BATCH_MAX) {
+                forward_syslog_flush(s);
+                return;
         }
 
-        if (errno != ENOENT)
-                log_debug_errno(errno, "Failed to forward syslog message: %m");
+        r = forward_syslog_schedule(s);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to schedule forwarding to syslog, sending right-away: %m");
+                forward_syslog_flush(s);
+        }
 }
 
 static void forward_syslog_raw(Server *s, int priority, const char *buffer, size_t buffer_len, const struct ucred *ucred, const struct timeval *tv) {
@@ -317,6 +586,8 @@ void server_process_syslog_message(
         assert(s);
         assert(buf);
 
+        server_metrics_received(&s->metrics, SERVER_TRANSPORT_SYSLOG, buf_len);
+
         if (ucred && pid_is_valid(ucred->pid)) {
                 r = client_context_get(s, ucred->pid, ucred, label, label_len, NULL, &context);
                 if (r < 0)
@@ -457,3 +728,22 @@ void server_maybe_warn_forward_syslog_missed(Server *s) {
         s->n_forward_syslog_missed = 0;
         s->last_warn_forward_syslog_missed = n;
 }
+
+void server_close_syslog_forward(Server *s) {
+        assert(s);
+
+        /* Give whatever is still queued one last chance */
+        if (!s->syslog_forward_blocked)
+                forward_syslog_flush(s);
+        forward_syslog_drop_all(s, true);
+
+        log_debug("Forwarded %"PRIu64" messages to syslog, dropped %"PRIu64", "
+                  "forwarded %"PRIu64" messages to kmsg, dropped %"PRIu64".",
+                  s->n_forward_syslog_sent, s->n_forward_syslog_dropped,
+                  s->n_forward_kmsg_sent, s->n_forward_kmsg_dropped);
+
+        s->syslog_forward_event_source = sd_event_source_unref(s->syslog_forward_event_source);
+        s->syslog_forward_defer_event_source = sd_event_source_unref(s->syslog_forward_defer_event_source);
+        s->syslog_forward_fd = safe_close(s->syslog_forward_fd);
+        s->syslog_forward_connected = false;
+}
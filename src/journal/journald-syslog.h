@@ -12,4 +12,6 @@ void server_forward_syslog(Server *s, int priority, const char *identifier, cons
 void server_process_syslog_message(Server *s, const char *buf, size_t buf_len, const struct ucred *ucred, const struct timeval *tv, const char *label, size_t label_len);
 int server_open_syslog_socket(Server *s);
 
+int server_open_syslog_forward(Server *s, int fd);
 void server_maybe_warn_forward_syslog_missed(Server *s);
+void server_close_syslog_forward(Server *s);
@@ -34,6 +34,7 @@
 #include "path-util.h"
 #include "process-util.h"
 #include "replace-var.h"
+#include "siphash24.h"
 #include "stat-util.h"
 #include "stat-util.h"
 #include "stdio-util.h"
@@ -48,6 +49,23 @@
 
 #define DEFAULT_DATA_THRESHOLD (64*1024)
 
+/* Keep at most this many decompressed DATA objects around, and at most this many times the data threshold
+ * worth of them */
+#define DATA_CACHE_ENTRIES_MAX 64U
+#define DATA_CACHE_THRESHOLDS_MAX 16U
+
+typedef struct DataCacheKey {
+        JournalFile *file;
+        uint64_t offset;
+} DataCacheKey;
+
+struct DataCacheEntry {
+        DataCacheKey key;
+        LIST_FIELDS(DataCacheEntry, lru);
+        size_t size;
+        uint8_t payload[];
+};
+
 static void remove_file_real(sd_journal *j, JournalFile *f);
 
 static bool journal_pid_changed(sd_journal *j) {
@@ -1402,6 +1420,129 @@ static void remove_file_by_name(
         remove_file_real(j, f);
 }
 
+static void data_cache_key_hash_func(const void *p, struct siphash *state) {
+        const DataCacheKey *k = p;
+
+        siphash24_compress(&k->file, sizeof(k->file), state);
+        siphash24_compress(&k->offset, sizeof(k->offset), state);
+}
+
+static int data_cache_key_compare_func(const void *a, const void *b) {
+        const DataCacheKey *x = a, *y = b;
+
+        if (x->file != y->file)
+                return x->file < y->file ? -1 : 1;
+
+        return CMP(x->offset, y->offset);
+}
+
+static const struct hash_ops data_cache_key_hash_ops = {
+        .hash = data_cache_key_hash_func,
+        .compare = data_cache_key_compare_func,
+};
+
+static void data_cache_remove(sd_journal *j, DataCacheEntry *e) {
+        assert(j);
+        assert(e);
+
+        (void) hashmap_remove(j->data_cache, &e->key);
+
+        if (j->data_cache_lru_tail == e)
+                j->data_cache_lru_tail = e->lru_prev;
+        LIST_REMOVE(lru, j->data_cache_lru, e);
+
+        j->data_cache_size -= e->size;
+        free(e);
+}
+
+static void data_cache_flush(sd_journal *j) {
+        assert(j);
+
+        while (j->data_cache_lru)
+                data_cache_remove(j, j->data_cache_lru);
+}
+
+static size_t data_cache_size_max(sd_journal *j) {
+        assert(j);
+
+        return DATA_CACHE_THRESHOLDS_MAX * (j->data_threshold > 0 ? j->data_threshold : DEFAULT_DATA_THRESHOLD);
+}
+
+static DataCacheEntry *data_cache_get(sd_journal *j, JournalFile *f, uint64_t offset) {
+        DataCacheKey key = {
+                .file = f,
+                .offset = offset,
+        };
+        DataCacheEntry *e;
+
+        assert(j);
+
+        e = hashmap_get(j->data_cache, &key);
+        if (!e) {
+                j->data_cache_missed++;
+                return NULL;
+        }
+
+        j->data_cache_hit++;
+
+        if (e != j->data_cache_lru) {
+                if (j->data_cache_lru_tail == e)
+                        j->data_cache_lru_tail = e->lru_prev;
+                LIST_REMOVE(lru, j->data_cache_lru, e);
+                LIST_PREPEND(lru, j->data_cache_lru, e);
+        }
+
+        return e;
+}
+
+static int data_cache_put(sd_journal *j, JournalFile *f, uint64_t offset, const void *data, size_t size) {
+        DataCacheEntry *e;
+        int r;
+
+        assert(j);
+        assert(data || size == 0);
+
+        /* Entries are immutable once written, hence the payload of an object stays valid for as long as its
+         * file is open. */
+
+        if (size > data_cache_size_max(j))
+                return 0;
+
+        r = hashmap_ensure_allocated(&j->data_cache, &data_cache_key_hash_ops);
+        if (r < 0)
+                return r;
+
+        while (j->data_cache_lru_tail &&
+               (hashmap_size(j->data_cache) >= DATA_CACHE_ENTRIES_MAX ||
+                j->data_cache_size + size > data_cache_size_max(j)))
+                data_cache_remove(j, j->data_cache_lru_tail);
+
+        e = malloc(offsetof(DataCacheEntry, payload) + size);
+        if (!e)
+                return -ENOMEM;
+
+        e->key = (DataCacheKey) {
+                .file = f,
+                .offset = offset,
+        };
+        e->size = size;
+        memcpy_safe(e->payload, data, size);
+
+        r = hashmap_put(j->data_cache, &e->key, e);
+        if (r < 0) {
+                free(e);
+                return r;
+        }
+
+        LIST_PREPEND(lru, j->data_cache_lru, e);
+        if (!j->data_cache_lru_tail)
+                j->data_cache_lru_tail = e;
+
+        j->data_cache_size += size;
+
+        return 1;
+}
+
 static void remove_file_real(sd_journal *j, JournalFile *f) {
         assert(j);
         assert(f);
@@ -1430,6 +1571,9 @@ static void remove_file_real(sd_journal *j, JournalFile *f) {
                         j->fields_file_lost = true;
         }
 
+        /* The cache is keyed by the file object, which might be reused by a file we open later */
+        data_cache_flush(j);
+
         (void) journal_file_close(f);
 
         j->current_invalidate_counter++;
@@ -2079,6 +2223,10 @@ _public_ void sd_journal_close(sd_journal *j) {
                 mmap_cache_unref(j->mmap);
         }
 
+        log_debug("data cache statistics: %u hit, %u miss", j->data_cache_hit, j->data_cache_missed);
+        data_cache_flush(j);
+        hashmap_free(j->data_cache);
+
         hashmap_free_free(j->errors);
 
         free(j->path);
@@ -2225,28 +2373,47 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
                 compression = o->object.flags & OBJECT_COMPRESSION_MASK;
                 if (compression) {
 #if HAVE_XZ || HAVE_LZ4
-                        r = decompress_startswith(compression,
-                                                  o->data.payload, l,
-                                                  &f->compress_buffer, &f->compress_buffer_size,
-                                                  field, field_length, '=');
-                        if (r < 0)
-                                log_debug_errno(r, "Cannot decompress %s object of length %"PRIu64" at offset "OFSfmt": %m",
-                                                object_compressed_to_string(compression), l, p);
-                        else if (r > 0) {
+                        DataCacheEntry *e;
 
-                                size_t rsize;
+                        e = data_cache_get(j, f, p);
+                        if (e) {
+                                if (e->size >= field_length+1 &&
+                                    memcmp(e->payload, field, field_length) == 0 &&
+                                    e->payload[field_length] == '=') {
 
-                                r = decompress_blob(compression,
-                                                    o->data.payload, l,
-                                                    &f->compress_buffer, &f->compress_buffer_size, &rsize,
-                                                    j->data_threshold);
+                                        *data = e->payload;
+                                        *size = e->size;
+
+                                        return 0;
+                                }
+                        } else {
+                                r = decompress_startswith(compression,
+                                                          o->data.payload, l,
+                                                          &f->compress_buffer, &f->compress_buffer_size,
+                                                          field, field_length, '=');
                                 if (r < 0)
-                                        return r;
+                                        log_debug_errno(r, "Cannot decompress %s object of length %"PRIu64" at offset "OFSfmt": %m",
+                                                        object_compressed_to_string(compression), l, p);
+                                else if (r > 0) {
 
-                                *data = f->compress_buffer;
-                                *size = (size_t) rsize;
+                                        size_t rsize;
 
-                                return 0;
+                                        r = decompress_blob(compression,
+                                                            o->data.payload, l,
+                                                            &f->compress_buffer, &f->compress_buffer_size, &rsize,
+                                                            j->data_threshold);
+                                        if (r < 0)
+                                                return r;
+
+                                        r = data_cache_put(j, f, p, f->compress_buffer, rsize);
+                                        if (r < 0)
+                                                log_debug_errno(r, "Failed to cache decompressed object at offset "OFSfmt", ignoring: %m", p);
+
+                                        *data = f->compress_buffer;
+                                        *size = (size_t) rsize;
+
+                                        return 0;
+                                }
                         }
 #else
                         return -EPROTONOSUPPORT;
@@ -2274,7 +2441,7 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
         return -ENOENT;
 }
 
-static int return_data(sd_journal *j, JournalFile *f, Object *o, const void **data, size_t *size) {
+static int return_data(sd_journal *j, JournalFile *f, Object *o, uint64_t p, const void **data, size_t *size) {
         size_t t;
         uint64_t l;
         int compression;
@@ -2289,15 +2456,28 @@ static int return_data(sd_journal *j, JournalFile *f, Object *o, const void **da
         compression = o->object.flags & OBJECT_COMPRESSION_MASK;
         if (compression) {
 #if HAVE_XZ || HAVE_LZ4
+                DataCacheEntry *e;
                 size_t rsize;
                 int r;
 
+                e = data_cache_get(j, f, p);
+                if (e) {
+                        *data = e->payload;
+                        *size = e->size;
+                        return 0;
+                }
+
                 r = decompress_blob(compression,
                                     o->data.payload, l, &f->compress_buffer,
                                     &f->compress_buffer_size, &rsize, j->data_threshold);
                 if (r < 0)
                         return r;
 
+                /* Large payloads tend to be repeated in many entries, remember it */
+                r = data_cache_put(j, f, p, f->compress_buffer, rsize);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to cache decompressed object at offset "OFSfmt", ignoring: %m", p);
+
                 *data = f->compress_buffer;
                 *size = (size_t) rsize;
 #else
@@ -2347,7 +2527,7 @@ _public_ int sd_journal_enumerate_data(sd_journal *j, const void **data, size_t
         if (le_hash != o->data.hash)
                 return -EBADMSG;
 
-        r = return_data(j, f, o, data, size);
+        r = return_data(j, f, o, p, data, size);
         if (r < 0)
                 return r;
 
@@ -2719,6 +2899,86 @@ void journal_print_header(sd_journal *j) {
         }
 }
 
+static int journal_boot_compare_id(const void *a, const void *b) {
+        const JournalBoot *x = a, *y = b;
+
+        return memcmp(&x->boot_id, &y->boot_id, sizeof(sd_id128_t));
+}
+
+static int journal_boot_compare_realtime(const void *a, const void *b) {
+        const JournalBoot *x = a, *y = b;
+        int r;
+
+        r = CMP(x->head_realtime, y->head_realtime);
+        if (r != 0)
+                return r;
+
+        return journal_boot_compare_id(a, b);
+}
+
+int journal_get_boots(sd_journal *j, JournalBoot **ret, size_t *ret_n) {
+        _cleanup_free_ JournalBoot *boots = NULL;
+        size_t n_boots = 0, n_allocated = 0, k, n;
+        JournalFile *f;
+        Iterator i;
+        int r;
+
+        assert(j);
+        assert(ret);
+        assert(ret_n);
+
+        /* Collects the boots of all files, ordered by the time of their first entry. This only looks at the
+         * _BOOT_ID= data objects of each file and the entries they point to first and last, and ignores
+         * matches. */
+
+        ORDERED_HASHMAP_FOREACH(f, j->files, i) {
+                _cleanup_free_ JournalBoot *fb = NULL;
+
+                r = journal_file_get_boots(f, &fb, &n);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to read boots of %s: %m", f->path);
+
+                if (!GREEDY_REALLOC(boots, n_allocated, n_boots + n))
+                        return -ENOMEM;
+
+                memcpy_safe(boots + n_boots, fb, n * sizeof(JournalBoot));
+                n_boots += n;
+        }
+
+        /* Merge the parts of each boot spread over several files */
+        qsort_safe(boots, n_boots, sizeof(JournalBoot), journal_boot_compare_id);
+
+        for (k = 0, n = 0; k < n_boots; k++) {
+                JournalBoot *b;
+
+                if (n == 0 || !sd_id128_equal(boots[n - 1].boot_id, boots[k].boot_id)) {
+                        boots[n++] = boots[k];
+                        continue;
+                }
+
+                b = boots + n - 1;
+
+                if (boots[k].head_realtime < b->head_realtime) {
+                        b->head_seqnum = boots[k].head_seqnum;
+                        b->head_realtime = boots[k].head_realtime;
+                        b->head_monotonic = boots[k].head_monotonic;
+                }
+
+                if (boots[k].tail_realtime > b->tail_realtime) {
+                        b->tail_seqnum = boots[k].tail_seqnum;
+                        b->tail_realtime = boots[k].tail_realtime;
+                        b->tail_monotonic = boots[k].tail_monotonic;
+                }
+        }
+
+        qsort_safe(boots, n, sizeof(JournalBoot), journal_boot_compare_realtime);
+
+        *ret = TAKE_PTR(boots);
+        *ret_n = n;
+
+        return 0;
+}
+
 _public_ int sd_journal_get_usage(sd_journal *j, uint64_t *bytes) {
         Iterator i;
         JournalFile *f;
@@ -2832,7 +3092,7 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                         return -EBADMSG;
                 }
 
-                r = return_data(j, j->unique_file, o, &odata, &ol);
+                r = return_data(j, j->unique_file, o, j->unique_offset, &odata, &ol);
                 if (r < 0)
                         return r;
 
@@ -2875,7 +3135,7 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                 if (found)
                         continue;
 
-                r = return_data(j, j->unique_file, o, data, l);
+                r = return_data(j, j->unique_file, o, j->unique_offset, data, l);
                 if (r < 0)
                         return r;
 
@@ -3112,6 +3372,10 @@ _public_ int sd_journal_set_data_threshold(sd_journal *j, size_t sz) {
         assert_return(j, -EINVAL);
         assert_return(!journal_pid_changed(j), -ECHILD);
 
+        /* Cached payloads were truncated to the old threshold */
+        if (sz != j->data_threshold)
+                data_cache_flush(j);
+
         j->data_threshold = sz;
         return 0;
 }
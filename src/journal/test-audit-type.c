@@ -1,9 +1,11 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <errno.h>
 #include <stdio.h>
 #include <linux/audit.h>
 
 #include "audit-type.h"
+#include "macro.h"
 
 static void print_audit_label(int i) {
         const char *name;
@@ -11,6 +13,7 @@ static void print_audit_label(int i) {
         name = audit_type_name_alloca(i);
         /* This is a separate function only because of alloca */
         printf("%i → %s → %s\n", i, audit_type_to_string(i), name);
+        assert_se(audit_type_from_string(name) == i);
 }
 
 static void test_audit_type(void) {
@@ -18,6 +21,14 @@ static void test_audit_type(void) {
 
         for (i = 0; i <= AUDIT_KERNEL; i++)
                 print_audit_label(i);
+
+        assert_se(audit_type_from_string("1300") == 1300);
+        assert_se(audit_type_from_string("SYSCALL") == AUDIT_SYSCALL);
+        assert_se(audit_type_from_string("AUDIT") == -EINVAL);
+        assert_se(audit_type_from_string("AUDIT70000") == -ERANGE);
+        assert_se(audit_type_from_string("-1") == -ERANGE);
+        assert_se(audit_type_from_string("FOOBAR") == -EINVAL);
+        assert_se(audit_type_from_string("") == -EINVAL);
 }
 
 int main(int argc, char **argv) {
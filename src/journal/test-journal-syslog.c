@@ -1,9 +1,19 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <sys/socket.h>
+#include <unistd.h>
+
 #include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
 #include "journald-syslog.h"
 #include "macro.h"
+#include "parse-util.h"
+#include "rm-rf.h"
+#include "socket-util.h"
+#include "stdio-util.h"
 #include "string-util.h"
+#include "util.h"
 
 static void test_syslog_parse_identifier(const char *str,
                                          const char *ident, const char *pid, const char *rest, int ret) {
@@ -19,6 +29,150 @@ static void test_syslog_parse_identifier(const char *str,
         assert_se(streq(buf, rest));
 }
 
+static void forward_messages(Server *s, unsigned from, unsigned to) {
+        unsigned i;
+
+        for (i = from; i < to; i++) {
+                char buf[STRLEN("message ") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(buf, "message %u", i);
+                server_forward_syslog(s, LOG_USER|LOG_INFO, "test", buf, NULL, NULL);
+        }
+}
+
+static void run_event_loop(Server *s) {
+        /* Dispatch whatever is ready, without waiting for anything */
+        while (sd_event_run(s->event, 0) > 0)
+                ;
+}
+
+static unsigned receive_messages(Server *s, int fd, unsigned first) {
+        unsigned n = 0;
+
+        /* Reads everything that arrives on the receiving end, while letting the server send the rest of
+         * its backlog. Checks that the messages arrive in order, and returns how many did. */
+        for (;;) {
+                char buf[LINE_MAX], *e;
+                ssize_t l;
+                unsigned k;
+
+                l = recv(fd, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+                if (l < 0) {
+                        assert_se(errno == EAGAIN);
+
+                        if (s->n_syslog_forward_queue == 0)
+                                return n;
+
+                        run_event_loop(s);
+                        continue;
+                }
+
+                buf[l] = 0;
+                assert_se(startswith(buf, "<14>"));
+                e = strstr(buf, " test: message ");
+                assert_se(e);
+                assert_se(safe_atou(e + STRLEN(" test: message "), &k) >= 0);
+                assert_se(k == first + n);
+                n++;
+        }
+}
+
+static void test_forward_syslog(void) {
+        _cleanup_free_ char *tmp = NULL;
+        _cleanup_close_ int receiver = -1;
+        union sockaddr_union sa = {
+                .un.sun_family = AF_UNIX,
+        };
+        uint64_t sent, dropped;
+        unsigned missed, n;
+        int pair[2];
+        Server s = {
+                .syslog_fd = -1,
+                .syslog_forward_fd = -1,
+                .max_level_syslog = LOG_DEBUG,
+        };
+
+        assert_se(sd_event_new(&s.event) >= 0);
+        assert_se(mkdtemp_malloc("/tmp/test-journal-syslog-XXXXXX", &tmp) >= 0);
+        s.syslog_forward_path = strjoina(tmp, "/syslog");
+
+        /* Nobody listening yet: messages are thrown away, but that's not worth a warning */
+        forward_messages(&s, 0, 3);
+        run_event_loop(&s);
+        assert_se(s.n_syslog_forward_queue == 0);
+        assert_se(s.n_forward_syslog_sent == 0);
+        assert_se(s.n_forward_syslog_dropped == 3);
+        assert_se(s.n_forward_syslog_missed == 0);
+        server_close_syslog_forward(&s);
+        s.n_forward_syslog_dropped = 0;
+
+        assert_se(socketpair(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+        receiver = pair[1];
+        assert_se(server_open_syslog_forward(&s, pair[0]) >= 0);
+
+        /* Messages are sent together once the event loop gets to it */
+        forward_messages(&s, 0, 5);
+        assert_se(s.n_syslog_forward_queue == 5);
+        assert_se(s.n_forward_syslog_sent == 0);
+        run_event_loop(&s);
+        assert_se(s.n_syslog_forward_queue == 0);
+        assert_se(s.n_forward_syslog_sent == 5);
+        assert_se(receive_messages(&s, receiver, 0) == 5);
+
+        /* Many more than fit into the receiver's queue: the rest is kept, and sent once the receiver catches
+         * up. */
+        forward_messages(&s, 0, 300);
+        run_event_loop(&s);
+        assert_se(s.syslog_forward_blocked);
+        assert_se(s.n_syslog_forward_queue > 0);
+        assert_se(s.n_forward_syslog_sent + s.n_syslog_forward_queue == 5 + 300);
+        assert_se(receive_messages(&s, receiver, 0) == 300);
+        assert_se(s.n_forward_syslog_sent == 5 + 300);
+        assert_se(s.n_forward_syslog_dropped == 0);
+        assert_se(s.n_forward_syslog_missed == 0);
+
+        /* More than the backlog takes: the newest messages are dropped and counted as missed */
+        forward_messages(&s, 0, 2000);
+        run_event_loop(&s);
+        sent = s.n_forward_syslog_sent - (5 + 300);
+        dropped = s.n_forward_syslog_dropped;
+        missed = s.n_forward_syslog_missed;
+        log_info("Sent %"PRIu64", queued %u, dropped %"PRIu64" of 2000 messages.", sent, s.n_syslog_forward_queue, dropped);
+        assert_se(s.n_syslog_forward_queue == 1024);
+        assert_se(dropped > 0);
+        assert_se(missed == dropped);
+        assert_se(sent + s.n_syslog_forward_queue + dropped == 2000);
+        n = receive_messages(&s, receiver, 0);
+        assert_se(n == sent + 1024);
+        assert_se(s.n_forward_syslog_dropped == dropped);
+
+        /* The receiver goes away and comes back under the configured name: we reconnect */
+        receiver = safe_close(receiver);
+        strncpy(sa.un.sun_path, s.syslog_forward_path, sizeof(sa.un.sun_path));
+        assert_se((receiver = socket(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0)) >= 0);
+        assert_se(bind(receiver, &sa.sa, SOCKADDR_UN_LEN(sa.un)) >= 0);
+
+        forward_messages(&s, 0, 10);
+        run_event_loop(&s);
+        assert_se(receive_messages(&s, receiver, 0) == 10);
+        assert_se(s.n_forward_syslog_dropped == dropped);
+
+        /* And if it's gone for good, we don't keep anything around */
+        receiver = safe_close(receiver);
+        assert_se(unlink(s.syslog_forward_path) >= 0);
+
+        forward_messages(&s, 0, 10);
+        run_event_loop(&s);
+        assert_se(s.n_syslog_forward_queue == 0);
+        assert_se(s.n_forward_syslog_dropped == dropped + 10);
+        assert_se(s.n_forward_syslog_missed == missed);
+
+        server_close_syslog_forward(&s);
+        sd_event_unref(s.event);
+
+        assert_se(rm_rf(tmp, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+}
+
 int main(void) {
         test_syslog_parse_identifier("pidu[111]: xxx", "pidu", "111", "xxx", 11);
         test_syslog_parse_identifier("pidu: xxx", "pidu", NULL, "xxx", 6);
@@ -33,5 +187,7 @@ int main(void) {
         test_syslog_parse_identifier("pidu: ", "pidu", NULL, "", 6);
         test_syslog_parse_identifier("pidu : ", NULL, NULL, "pidu : ", 0);
 
+        test_forward_syslog();
+
         return 0;
 }
@@ -48,9 +48,47 @@ static int raw_verify(const char *fn, const char *verification_key) {
         return r;
 }
 
+static bool generate(const char *fn, bool seal) {
+        char buf[FORMAT_TIMESPAN_MAX];
+        JournalFile *f;
+        usec_t start, elapsed;
+        unsigned n;
+
+        assert_se(journal_file_open(-1, fn, O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, seal, NULL, NULL, NULL, NULL, &f) == 0);
+
+        seal = JOURNAL_HEADER_SEALED(f->header);
+        start = now(CLOCK_MONOTONIC);
+
+        for (n = 0; n < N_ENTRIES; n++) {
+                struct iovec iovec;
+                struct dual_timestamp ts;
+                char *test;
+
+                dual_timestamp_get(&ts);
+
+                assert_se(asprintf(&test, "RANDOM=%lu", random() % RANDOM_RANGE));
+
+                iovec.iov_base = (void*) test;
+                iovec.iov_len = strlen(test);
+
+                assert_se(journal_file_append_entry(f, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+
+                free(test);
+        }
+
+        (void) journal_file_close(f);
+
+        elapsed = now(CLOCK_MONOTONIC) - start;
+        log_info("Wrote %u %s entries in %s (%.0f entries/s).",
+                 N_ENTRIES, seal ? "sealed" : "unsealed",
+                 format_timespan(buf, sizeof(buf), elapsed, USEC_PER_MSEC),
+                 (double) N_ENTRIES * USEC_PER_SEC / MAX(elapsed, 1u));
+
+        return seal;
+}
+
 int main(int argc, char *argv[]) {
         char t[] = "/tmp/journal-XXXXXX";
-        unsigned n;
         JournalFile *f;
         const char *verification_key = argv[1];
         usec_t from = 0, to = 0, total = 0;
@@ -59,6 +97,7 @@ int main(int argc, char *argv[]) {
         char c[FORMAT_TIMESPAN_MAX];
         struct stat st;
         uint64_t p;
+        bool sealed;
 
         /* journal_file_open requires a valid machine id */
         if (access("/etc/machine-id", F_OK) != 0)
@@ -71,26 +110,11 @@ int main(int argc, char *argv[]) {
 
         log_info("Generating...");
 
-        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, !!verification_key, NULL, NULL, NULL, NULL, &f) == 0);
-
-        for (n = 0; n < N_ENTRIES; n++) {
-                struct iovec iovec;
-                struct dual_timestamp ts;
-                char *test;
-
-                dual_timestamp_get(&ts);
+        sealed = generate("test.journal", !!verification_key);
 
-                assert_se(asprintf(&test, "RANDOM=%lu", random() % RANDOM_RANGE));
-
-                iovec.iov_base = (void*) test;
-                iovec.iov_len = strlen(test);
-
-                assert_se(journal_file_append_entry(f, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
-
-                free(test);
-        }
-
-        (void) journal_file_close(f);
+        /* Sealing only happens if the FSS key file could be loaded, compare the throughput in that case */
+        if (sealed)
+                generate("unsealed.journal", false);
 
         log_info("Verifying...");
 
@@ -3,11 +3,15 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include "alloc-util.h"
+#include "io-util.h"
 #include "journal-authenticate.h"
 #include "journal-file.h"
+#include "journal-internal.h"
 #include "journal-vacuum.h"
 #include "log.h"
 #include "rm-rf.h"
+#include "stdio-util.h"
 
 static bool arg_keep = false;
 
@@ -150,6 +154,138 @@ static void test_empty(void) {
         (void) journal_file_close(f4);
 }
 
+static void append_boot_entry(JournalFile *f, sd_id128_t boot_id, usec_t realtime) {
+        char t[STRLEN("_BOOT_ID=") + 32 + 1] = "_BOOT_ID=";
+        dual_timestamp ts = {
+                .realtime = realtime,
+                .monotonic = realtime / 2,
+        };
+        struct iovec iovec[2];
+
+        sd_id128_to_string(boot_id, t + 9);
+
+        iovec[0] = IOVEC_MAKE_STRING("MESSAGE=boot");
+        iovec[1] = IOVEC_MAKE_STRING(t);
+        assert_se(journal_file_append_entry(f, &ts, &boot_id, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+}
+
+static const JournalBoot *find_boot(const JournalBoot *boots, size_t n, sd_id128_t boot_id) {
+        size_t i;
+
+        for (i = 0; i < n; i++)
+                if (sd_id128_equal(boots[i].boot_id, boot_id))
+                        return boots + i;
+
+        return NULL;
+}
+
+static void test_boots(void) {
+        _cleanup_free_ JournalBoot *boots = NULL;
+        JournalFile *f;
+        sd_journal *j;
+        sd_id128_t a, b, c;
+        const JournalBoot *x;
+        size_t n, i;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(sd_id128_randomize(&a) == 0);
+        assert_se(sd_id128_randomize(&b) == 0);
+        assert_se(sd_id128_randomize(&c) == 0);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, false, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        /* An empty file has no boots */
+        assert_se(journal_file_get_boots(f, &boots, &n) >= 0);
+        assert_se(!boots && n == 0);
+
+        append_boot_entry(f, a, 1000);
+        append_boot_entry(f, a, 2000);
+        append_boot_entry(f, b, 3000);
+        append_boot_entry(f, b, 4000);
+        append_boot_entry(f, b, 5000);
+        append_boot_entry(f, c, 6000);
+        append_boot_entry(f, a, 7000);
+
+        assert_se(journal_file_get_boots(f, &boots, &n) >= 0);
+        assert_se(n == 3);
+
+        /* Boot a is interleaved with the others, and spans them */
+        x = find_boot(boots, n, a);
+        assert_se(x);
+        assert_se(x->head_seqnum == 1);
+        assert_se(x->tail_seqnum == 7);
+        assert_se(x->head_realtime == 1000);
+        assert_se(x->tail_realtime == 7000);
+        assert_se(x->head_monotonic == 500);
+        assert_se(x->tail_monotonic == 3500);
+
+        x = find_boot(boots, n, b);
+        assert_se(x);
+        assert_se(x->head_seqnum == 3);
+        assert_se(x->tail_seqnum == 5);
+        assert_se(x->head_realtime == 3000);
+        assert_se(x->tail_realtime == 5000);
+
+        x = find_boot(boots, n, c);
+        assert_se(x);
+        assert_se(x->head_seqnum == 6);
+        assert_se(x->tail_seqnum == 6);
+
+        /* Many boots in one file */
+        for (i = 0; i < 16; i++) {
+                sd_id128_t id;
+
+                assert_se(sd_id128_randomize(&id) == 0);
+                append_boot_entry(f, id, 10000 + i * 1000);
+        }
+
+        boots = mfree(boots);
+        assert_se(journal_file_get_boots(f, &boots, &n) >= 0);
+        assert_se(n == 16 + 3);
+        x = find_boot(boots, n, a);
+        assert_se(x);
+        assert_se(x->head_realtime == 1000);
+        assert_se(x->tail_realtime == 7000);
+
+        (void) journal_file_close(f);
+
+        /* A second file continuing boot a, merged with the first one */
+        assert_se(journal_file_open(-1, "test2.journal", O_RDWR|O_CREAT, 0666, false, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+        append_boot_entry(f, a, 500);
+        append_boot_entry(f, a, 100000);
+        (void) journal_file_close(f);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+
+        boots = mfree(boots);
+        assert_se(journal_get_boots(j, &boots, &n) >= 0);
+        assert_se(n == 16 + 3);
+
+        assert_se(sd_id128_equal(boots[0].boot_id, a));
+        assert_se(boots[0].head_realtime == 500);
+        assert_se(boots[0].tail_realtime == 100000);
+        assert_se(sd_id128_equal(boots[1].boot_id, b));
+        assert_se(sd_id128_equal(boots[2].boot_id, c));
+        for (i = 1; i < n; i++)
+                assert_se(boots[i - 1].head_realtime <= boots[i].head_realtime);
+
+        sd_journal_close(j);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
 #if HAVE_XZ || HAVE_LZ4
 static bool check_compressed(uint64_t compress_threshold, uint64_t data_size) {
         dual_timestamp ts;
@@ -233,6 +369,80 @@ static void test_min_compress_size(void) {
         assert_se(check_compressed(256, 256));
         assert_se(!check_compressed(256, 255));
 }
+
+static void test_data_cache(void) {
+        _cleanup_free_ char *large = NULL;
+        dual_timestamp ts;
+        JournalFile *f;
+        sd_journal *j;
+        const void *data;
+        size_t l;
+        unsigned i, n = 0;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(large = malloc(STRLEN("LARGE=") + 4096 + 1));
+        strcpy(large, "LARGE=");
+        memset(large + STRLEN("LARGE="), 'x', 4096);
+        large[STRLEN("LARGE=") + 4096] = 0;
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, 512, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        for (i = 0; i < 10; i++) {
+                char number[DECIMAL_STR_MAX(unsigned) + STRLEN("NUMBER=")];
+                struct iovec iovec[2];
+
+                xsprintf(number, "NUMBER=%u", i);
+
+                iovec[0] = IOVEC_MAKE_STRING(large);
+                iovec[1] = IOVEC_MAKE_STRING(number);
+
+                assert_se(dual_timestamp_get(&ts));
+                assert_se(journal_file_append_entry(f, &ts, NULL, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+        }
+
+        (void) journal_file_close(f);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+
+        /* The shared payload is decompressed once, and then served from the cache */
+        SD_JOURNAL_FOREACH(j) {
+                assert_se(sd_journal_get_data(j, "LARGE", &data, &l) >= 0);
+                assert_se(l == strlen(large));
+                assert_se(memcmp(data, large, l) == 0);
+                n++;
+        }
+
+        assert_se(n == 10);
+        assert_se(j->data_cache_missed == 1);
+        assert_se(j->data_cache_hit == 9);
+        assert_se(j->data_cache_size == l);
+
+        /* Payloads cached with another threshold may be truncated differently */
+        assert_se(sd_journal_set_data_threshold(j, 100) >= 0);
+        assert_se(j->data_cache_size == 0);
+
+        assert_se(sd_journal_seek_head(j) >= 0);
+        assert_se(sd_journal_next(j) > 0);
+        assert_se(sd_journal_get_data(j, "LARGE", &data, &l) >= 0);
+        assert_se(l == 100);
+        assert_se(memcmp(data, large, l) == 0);
+
+        sd_journal_close(j);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
 #endif
 
 int main(int argc, char *argv[]) {
@@ -244,8 +454,10 @@ int main(int argc, char *argv[]) {
 
         test_non_empty();
         test_empty();
+        test_boots();
 #if HAVE_XZ || HAVE_LZ4
         test_min_compress_size();
+        test_data_cache();
 #endif
 
         return 0;
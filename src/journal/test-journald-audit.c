@@ -0,0 +1,157 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "alloc-util.h"
+#include "journald-audit.h"
+#include "macro.h"
+#include "string-util.h"
+#include "strv.h"
+
+static void test_audit_map_record_one(Server *s, int type, const char *record, char **expected) {
+        _cleanup_strv_free_ char **fields = NULL;
+        size_t n = 0, i;
+        int r;
+
+        log_info("/* %s(%s) */", __func__, record);
+
+        r = audit_map_record(s, type, record, strlen(record), &n);
+        assert_se(r >= 0);
+        assert_se(r == 0 || n > 0);
+
+        for (i = 0; i < n; i++)
+                assert_se(strv_consume(&fields, strndup(s->audit_iovec[i].iov_base, s->audit_iovec[i].iov_len)) >= 0);
+
+        if (!strv_equal(fields, expected)) {
+                char **f;
+
+                log_error("Got:");
+                STRV_FOREACH(f, fields)
+                        log_error("        %s", *f);
+                log_error("Expected:");
+                STRV_FOREACH(f, expected)
+                        log_error("        %s", *f);
+
+                assert_not_reached("unexpected fields");
+        }
+}
+
+static void test_audit_map_record(void) {
+        Server s = {};
+
+        /* Kernel fields: the well-known ones get our own names, everything else the generic mapping. Names of
+         * 16 characters or more are not mapped at all. */
+        test_audit_map_record_one(&s, 1300,
+                                  "audit(1364481363.243:24287): arch=c000003e syscall=2 success=no exit=-2 items=1 "
+                                  "ppid=2686 pid=3538 auid=500 uid=500 gid=500 euid=500 ses=1 tty=pts0 comm=\"cat\" "
+                                  "exe=2F7573722F62696E2F636174 subj=unconfined_u:unconfined_r:unconfined_t:s0 "
+                                  "key=(null) with-dashes=1 fifteencharsxyz=2 sixteencharsxyzw=3 "
+                                  "thisfieldnameislongerthanthirtytwocharacters=4",
+                                  STRV_MAKE("_TRANSPORT=audit",
+                                            "_SOURCE_REALTIME_TIMESTAMP=1364481363243000",
+                                            "_AUDIT_TYPE=1300",
+                                            "_AUDIT_ID=24287",
+                                            "SYSLOG_FACILITY=4",
+                                            "SYSLOG_IDENTIFIER=audit",
+                                            "_AUDIT_TYPE_NAME=SYSCALL",
+                                            "MESSAGE=SYSCALL arch=c000003e syscall=2 success=no exit=-2 items=1 "
+                                            "ppid=2686 pid=3538 auid=500 uid=500 gid=500 euid=500 ses=1 tty=pts0 comm=\"cat\" "
+                                            "exe=2F7573722F62696E2F636174 subj=unconfined_u:unconfined_r:unconfined_t:s0 "
+                                            "key=(null) with-dashes=1 fifteencharsxyz=2 sixteencharsxyzw=3 "
+                                            "thisfieldnameislongerthanthirtytwocharacters=4",
+                                            "_AUDIT_FIELD_ARCH=c000003e",
+                                            "_AUDIT_FIELD_SYSCALL=2",
+                                            "_AUDIT_FIELD_SUCCESS=no",
+                                            "_AUDIT_FIELD_EXIT=-2",
+                                            "_AUDIT_FIELD_ITEMS=1",
+                                            "_PPID=2686",
+                                            "_PID=3538",
+                                            "_AUDIT_LOGINUID=500",
+                                            "_UID=500",
+                                            "_GID=500",
+                                            "_EUID=500",
+                                            "_AUDIT_SESSION=1",
+                                            "_TTY=pts0",
+                                            "_COMM=cat",
+                                            "_EXE=/usr/bin/cat",
+                                            "_SELINUX_CONTEXT=unconfined_u:unconfined_r:unconfined_t:s0",
+                                            "_AUDIT_FIELD_KEY=(null)",
+                                            "_AUDIT_FIELD_WITH_DASHES=1",
+                                            "_AUDIT_FIELD_FIFTEENCHARSXYZ=2"));
+
+        /* The userspace part: untrusted, hence no "_" prefix, and fields only known in the kernel part are
+         * mapped generically */
+        test_audit_map_record_one(&s, 1107,
+                                  "audit(1364481363.243:24288): pid=3538 uid=0 auid=500 ses=1 "
+                                  "msg='op=login acct=\"root\" exe=\"/usr/sbin/sshd\" hostname=? addr=192.168.0.1 "
+                                  "terminal=ssh res=success cwd=2F726F6F74 pid=5 comm=\"x\"'",
+                                  STRV_MAKE("_TRANSPORT=audit",
+                                            "_SOURCE_REALTIME_TIMESTAMP=1364481363243000",
+                                            "_AUDIT_TYPE=1107",
+                                            "_AUDIT_ID=24288",
+                                            "SYSLOG_FACILITY=4",
+                                            "SYSLOG_IDENTIFIER=audit",
+                                            "_AUDIT_TYPE_NAME=USER_AVC",
+                                            "MESSAGE=USER_AVC pid=3538 uid=0 auid=500 ses=1 "
+                                            "msg='op=login acct=\"root\" exe=\"/usr/sbin/sshd\" hostname=? addr=192.168.0.1 "
+                                            "terminal=ssh res=success cwd=2F726F6F74 pid=5 comm=\"x\"'",
+                                            "_PID=3538",
+                                            "_UID=0",
+                                            "_AUDIT_LOGINUID=500",
+                                            "_AUDIT_SESSION=1",
+                                            "AUDIT_FIELD_OP=login",
+                                            "AUDIT_FIELD_ACCT=root",
+                                            "AUDIT_FIELD_EXE=/usr/sbin/sshd",
+                                            "AUDIT_FIELD_HOSTNAME=?",
+                                            "AUDIT_FIELD_ADDR=192.168.0.1",
+                                            "AUDIT_FIELD_TERMINAL=ssh",
+                                            "AUDIT_FIELD_RES=success",
+                                            "AUDIT_FIELD_CWD=/root",
+                                            "AUDIT_FIELD_PID=5",
+                                            "AUDIT_FIELD_COMM=x"));
+
+        /* Control characters in the command line become spaces. Malformed string fields (odd hex, missing
+         * closing quote) are kept as they are, under the generic name. An unknown type is named by number. */
+        test_audit_map_record_one(&s, 9999,
+                                  "audit(1.5:3): proctitle=6C73002D6C comm=\"abc exe=2F7",
+                                  STRV_MAKE("_TRANSPORT=audit",
+                                            "_SOURCE_REALTIME_TIMESTAMP=1005000",
+                                            "_AUDIT_TYPE=9999",
+                                            "_AUDIT_ID=3",
+                                            "SYSLOG_FACILITY=4",
+                                            "SYSLOG_IDENTIFIER=audit",
+                                            "_AUDIT_TYPE_NAME=AUDIT9999",
+                                            "MESSAGE=AUDIT9999 proctitle=6C73002D6C comm=\"abc exe=2F7",
+                                            "_CMDLINE=ls -l",
+                                            "_AUDIT_FIELD_COMM=\"abc",
+                                            "_AUDIT_FIELD_EXE=2F7"));
+
+        /* Without the closing quotation mark the userspace part is not split up */
+        test_audit_map_record_one(&s, 1107,
+                                  "audit(1.0:4): pid=1 msg='op=login",
+                                  STRV_MAKE("_TRANSPORT=audit",
+                                            "_SOURCE_REALTIME_TIMESTAMP=1000000",
+                                            "_AUDIT_TYPE=1107",
+                                            "_AUDIT_ID=4",
+                                            "SYSLOG_FACILITY=4",
+                                            "SYSLOG_IDENTIFIER=audit",
+                                            "_AUDIT_TYPE_NAME=USER_AVC",
+                                            "MESSAGE=USER_AVC pid=1 msg='op=login",
+                                            "_PID=1"));
+
+        /* Not audit records at all */
+        test_audit_map_record_one(&s, 1300, "", NULL);
+        test_audit_map_record_one(&s, 1300, "foobar", NULL);
+        test_audit_map_record_one(&s, 1300, "audit(1.0:5):", NULL);
+        test_audit_map_record_one(&s, 1300, "audit(1.0:5):   ", NULL);
+        test_audit_map_record_one(&s, 1300, "audit(1.0): pid=1", NULL);
+
+        free(s.audit_iovec);
+        free(s.audit_buffer);
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_DEBUG);
+
+        test_audit_map_record();
+
+        return 0;
+}
@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+/* Measures the cost of looking up the client context of short-lived processes, the way journald does it when a
+ * unit forks lots of helpers that log a line or two each, cron jobs for example. Each process is looked up twice,
+ * as if it logged two lines. This is done for processes that are gone already by the time their messages are
+ * processed, for processes that are still alive, and for live processes of a unit listed in
+ * InheritMetadataUnits=. The last case only shows an effect if this runs in a unit, i.e. not in the root
+ * cgroup. Not run automatically, as the numbers depend on the machine. */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "cgroup-util.h"
+#include "fd-util.h"
+#include "journald-context.h"
+#include "journald-server.h"
+#include "log.h"
+#include "parse-util.h"
+#include "process-util.h"
+#include "strv.h"
+#include "time-util.h"
+#include "util.h"
+
+static void run(const char *what, unsigned n, bool alive, char **inherit_metadata_units) {
+        char buf[FORMAT_TIMESPAN_MAX];
+        Server s = {};
+        usec_t spent = 0;
+        unsigned i;
+
+        (void) cg_get_root_path(&s.cgroup_root);
+        s.inherit_metadata_units = inherit_metadata_units;
+
+        for (i = 0; i < n; i++) {
+                struct ucred ucred = {
+                        .uid = getuid(),
+                        .gid = getgid(),
+                };
+                int pipe_fds[2];
+                ClientContext *c;
+                usec_t start;
+                int r;
+
+                /* The child blocks until the write end of the pipe is closed */
+                assert_se(pipe2(pipe_fds, O_CLOEXEC) >= 0);
+
+                r = safe_fork("(bench)", FORK_DEATHSIG, &ucred.pid);
+                assert_se(r >= 0);
+                if (r == 0) {
+                        char x;
+
+                        safe_close(pipe_fds[1]);
+                        (void) read(pipe_fds[0], &x, 1);
+                        _exit(EXIT_SUCCESS);
+                }
+
+                safe_close(pipe_fds[0]);
+
+                if (!alive) {
+                        pipe_fds[1] = safe_close(pipe_fds[1]);
+                        (void) wait_for_terminate(ucred.pid, NULL);
+                }
+
+                start = now(CLOCK_MONOTONIC);
+                assert_se(client_context_get(&s, ucred.pid, &ucred, NULL, 0, NULL, &c) >= 0);
+                assert_se(client_context_get(&s, ucred.pid, &ucred, NULL, 0, NULL, &c) >= 0);
+                spent += now(CLOCK_MONOTONIC) - start;
+
+                if (alive) {
+                        safe_close(pipe_fds[1]);
+                        (void) wait_for_terminate(ucred.pid, NULL);
+                }
+        }
+
+        log_info("%-40s %s per process", what, format_timespan(buf, sizeof(buf), spent / n, 1));
+
+        client_context_flush_all(&s);
+        free(s.cgroup_root);
+}
+
+int main(int argc, char *argv[]) {
+        unsigned n = 10000;
+
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n) >= 0 && n > 0);
+
+        run("exited before lookup", n, false, NULL);
+        run("alive", n, true, NULL);
+        run("alive, InheritMetadataUnits=*", n, true, STRV_MAKE("*"));
+
+        return EXIT_SUCCESS;
+}
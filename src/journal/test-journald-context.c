@@ -0,0 +1,236 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "audit-util.h"
+#include "cgroup-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "io-util.h"
+#include "journald-context.h"
+#include "journald-server.h"
+#include "log.h"
+#include "process-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "time-util.h"
+#include "user-util.h"
+#include "util.h"
+
+#define TEST_UNIT "test-journald-context.service"
+
+static void context_server_done(Server *s) {
+        client_context_flush_all(s);
+        s->inherit_metadata_units = strv_free(s->inherit_metadata_units);
+        s->cgroup_root = mfree(s->cgroup_root);
+}
+
+static pid_t fork_sleeper(const char *name) {
+        _cleanup_close_pair_ int pipe_fds[2] = { -1, -1 };
+        pid_t pid;
+        char x;
+        int r;
+
+        assert_se(pipe2(pipe_fds, O_CLOEXEC) >= 0);
+
+        r = safe_fork(name, FORK_DEATHSIG|FORK_LOG, &pid);
+        assert_se(r >= 0);
+        if (r == 0) {
+                /* Let the parent know that we are renamed */
+                pipe_fds[0] = safe_close(pipe_fds[0]);
+                (void) loop_write(pipe_fds[1], "x", 1, false);
+
+                (void) pause();
+                _exit(EXIT_SUCCESS);
+        }
+
+        pipe_fds[1] = safe_close(pipe_fds[1]);
+        assert_se(read(pipe_fds[0], &x, 1) == 1);
+
+        return pid;
+}
+
+static void kill_sleeper(pid_t pid) {
+        assert_se(kill(pid, SIGKILL) >= 0);
+        (void) wait_for_terminate(pid, NULL);
+}
+
+static pid_t fork_at(pid_t pid) {
+        char buf[DECIMAL_STR_MAX(pid_t)];
+        pid_t child;
+
+        /* Try to get the specified PID for a new child, by making the kernel hand out the next PID after the
+         * previous one. Returns 0 if that didn't work out. */
+
+        xsprintf(buf, PID_FMT, pid - 1);
+        if (write_string_file("/proc/sys/kernel/ns_last_pid", buf, 0) < 0)
+                return 0;
+
+        child = fork_sleeper("(test-reused)");
+        if (child != pid) {
+                kill_sleeper(child);
+                return 0;
+        }
+
+        return child;
+}
+
+static void test_vanished(void) {
+        Server server = {}, *s = &server;
+        struct ucred ucred = {
+                .uid = getuid(),
+                .gid = getgid(),
+        };
+        ClientContext *c;
+        usec_t timestamp;
+        pid_t reused;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        (void) cg_get_root_path(&s->cgroup_root);
+
+        /* A process that logs and exits before we get to its message */
+        r = safe_fork("(test-vanished)", FORK_DEATHSIG|FORK_LOG, &ucred.pid);
+        assert_se(r >= 0);
+        if (r == 0)
+                _exit(EXIT_SUCCESS);
+        assert_se(wait_for_terminate(ucred.pid, NULL) >= 0);
+
+        assert_se(client_context_get(s, ucred.pid, &ucred, NULL, 0, TEST_UNIT, &c) >= 0);
+        assert_se(c->vanished);
+        assert_se(s->metrics.n_context_vanished == 1);
+
+        /* We know what was passed in and the unit, but we didn't try to read anything else */
+        assert_se(c->uid == ucred.uid);
+        assert_se(c->gid == ucred.gid);
+        assert_se(streq_ptr(c->unit, TEST_UNIT));
+        assert_se(!c->comm);
+        assert_se(!c->exe);
+        assert_se(!c->cmdline);
+        assert_se(!c->capeff);
+        assert_se(c->loginuid == UID_INVALID);
+        assert_se(c->auditid == AUDIT_SESSION_INVALID);
+
+        /* Even once the data is due for a refresh, it is not read again, as long as the PID is not reused */
+        timestamp = c->timestamp;
+        client_context_maybe_refresh(s, c, &ucred, NULL, 0, TEST_UNIT, timestamp + 2 * USEC_PER_SEC);
+        assert_se(c->vanished);
+        assert_se(c->timestamp == timestamp);
+        assert_se(s->metrics.n_context_vanished == 1);
+
+        assert_se(client_context_get(s, ucred.pid, &ucred, NULL, 0, TEST_UNIT, &c) >= 0);
+        assert_se(c->vanished);
+        assert_se(c->timestamp == timestamp);
+
+        /* If it is reused, the cached data is thrown away and read from the new process */
+        reused = fork_at(ucred.pid);
+        if (reused == 0) {
+                log_notice("Cannot reuse PID " PID_FMT ", skipping PID reuse check.", ucred.pid);
+                context_server_done(s);
+                return;
+        }
+
+        client_context_maybe_refresh(s, c, &ucred, NULL, 0, TEST_UNIT, timestamp + 2 * USEC_PER_SEC);
+        assert_se(!c->vanished);
+        assert_se(c->timestamp == timestamp + 2 * USEC_PER_SEC);
+        assert_se(streq_ptr(c->comm, "(test-reused)"));
+        assert_se(s->metrics.n_context_vanished == 1);
+
+        kill_sleeper(reused);
+
+        context_server_done(s);
+}
+
+static void test_inherit(void) {
+        Server server = {}, *s = &server;
+        ClientContext *a, *b, *c;
+        uint32_t auditid;
+        uid_t loginuid;
+        pid_t pid_a, pid_b, pid_c;
+
+        log_info("/* %s */", __func__);
+
+        (void) cg_get_root_path(&s->cgroup_root);
+
+        pid_a = fork_sleeper("(test-a)");
+        pid_b = fork_sleeper("(test-b)");
+        pid_c = fork_sleeper("(test-c)");
+
+        /* The first process of a unit reads everything itself */
+        assert_se(client_context_get(s, pid_a, NULL, NULL, 0, TEST_UNIT, &a) >= 0);
+        assert_se(!a->vanished);
+        assert_se(a->unit);
+        assert_se(streq_ptr(a->comm, "(test-a)"));
+        assert_se(s->metrics.n_context_inherited_unit == 0);
+        assert_se(s->metrics.n_context_inherited_process == 0);
+
+        /* Pretend a different user is behind it, e.g. when it is a cron job */
+        a->loginuid = 4711;
+        a->auditid = 4711;
+        assert_se(free_and_strdup(&a->label, "test_label") >= 0);
+        a->label_size = strlen(a->label);
+
+        /* The next one copies the unit metadata, but reads its own process metadata */
+        assert_se(client_context_get(s, pid_b, NULL, NULL, 0, TEST_UNIT, &b) >= 0);
+        assert_se(s->metrics.n_context_inherited_unit == 1);
+        assert_se(s->metrics.n_context_inherited_process == 0);
+        assert_se(streq_ptr(b->unit, a->unit));
+        assert_se(streq_ptr(b->cgroup, a->cgroup));
+        assert_se(streq_ptr(b->slice, a->slice));
+        assert_se(sd_id128_equal(b->invocation_id, a->invocation_id));
+        assert_se(b->log_level_max == a->log_level_max);
+        assert_se(streq_ptr(b->comm, "(test-b)"));
+
+        /* With InheritMetadataUnits= the process metadata is copied too, except for the fields that identify
+         * who the process acts for */
+        assert_se(strv_extend(&s->inherit_metadata_units, "test-journald-*") >= 0);
+        assert_se(strv_extend(&s->inherit_metadata_units, a->unit) >= 0);
+
+        assert_se(client_context_get(s, pid_c, NULL, NULL, 0, TEST_UNIT, &c) >= 0);
+        assert_se(s->metrics.n_context_inherited_unit == 2);
+        assert_se(s->metrics.n_context_inherited_process == 1);
+        assert_se(streq_ptr(c->unit, a->unit));
+        assert_se(streq_ptr(c->comm, "(test-a)"));
+        assert_se(streq_ptr(c->exe, a->exe));
+        assert_se(streq_ptr(c->cmdline, a->cmdline));
+        assert_se(!c->capeff);
+        assert_se(!streq_ptr(c->label, a->label));
+
+        if (audit_loginuid_from_pid(pid_c, &loginuid) < 0)
+                loginuid = UID_INVALID;
+        if (audit_session_from_pid(pid_c, &auditid) < 0)
+                auditid = AUDIT_SESSION_INVALID;
+
+        assert_se(c->loginuid == loginuid);
+        assert_se(c->auditid == auditid);
+        assert_se(c->loginuid != a->loginuid);
+        assert_se(c->auditid != a->auditid);
+
+        /* Once the source is too old it isn't used anymore */
+        client_context_maybe_refresh(s, b, NULL, NULL, 0, TEST_UNIT, a->timestamp + 2 * USEC_PER_SEC);
+        assert_se(s->metrics.n_context_inherited_unit == 2);
+        assert_se(streq_ptr(b->comm, "(test-b)"));
+
+        kill_sleeper(pid_a);
+        kill_sleeper(pid_b);
+        kill_sleeper(pid_c);
+
+        context_server_done(s);
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        test_vanished();
+        test_inherit();
+
+        return 0;
+}
@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "journald-metrics.h"
+#include "macro.h"
+#include "string-util.h"
+#include "strv.h"
+
+#define EMPTY_BUCKETS                                                   \
+        "1:0 2:0 4:0 8:0 16:0 32:0 64:0 128:0 256:0 512:0 1024:0 2048:0 4096:0 8192:0 16384:0 32768:0 " \
+        "65536:0 131072:0 262144:0 524288:0 1048576:0 2097152:0 4194304:0 inf:0"
+
+static void test_latency_histogram(void) {
+        LatencyHistogram h = {};
+        unsigned i;
+
+        /* Bucket 0 is for durations below 1µs, bucket i for those below 2^i µs */
+        latency_histogram_add(&h, 0);
+        assert_se(h.buckets[0] == 1);
+
+        latency_histogram_add(&h, 1);
+        assert_se(h.buckets[1] == 1);
+
+        latency_histogram_add(&h, 2);
+        latency_histogram_add(&h, 3);
+        assert_se(h.buckets[2] == 2);
+
+        latency_histogram_add(&h, 4);
+        latency_histogram_add(&h, 7);
+        assert_se(h.buckets[3] == 2);
+
+        latency_histogram_add(&h, 1000);
+        assert_se(h.buckets[10] == 1);
+
+        /* The last bucket that has a bound, and everything beyond it */
+        latency_histogram_add(&h, (UINT64_C(1) << (LATENCY_HISTOGRAM_BUCKETS - 2)) - 1);
+        assert_se(h.buckets[LATENCY_HISTOGRAM_BUCKETS - 2] == 1);
+
+        latency_histogram_add(&h, UINT64_C(1) << (LATENCY_HISTOGRAM_BUCKETS - 2));
+        latency_histogram_add(&h, 10 * USEC_PER_MINUTE);
+        assert_se(h.buckets[LATENCY_HISTOGRAM_BUCKETS - 1] == 2);
+
+        for (i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+                if (!IN_SET(i, 0, 1, 2, 3, 10, LATENCY_HISTOGRAM_BUCKETS - 2, LATENCY_HISTOGRAM_BUCKETS - 1))
+                        assert_se(h.buckets[i] == 0);
+
+        assert_se(h.n == 10);
+        assert_se(h.sum == 0 + 1 + 2 + 3 + 4 + 7 + 1000 + 4194303 + 4194304 + 10 * USEC_PER_MINUTE);
+        assert_se(h.max == 10 * USEC_PER_MINUTE);
+}
+
+static void test_server_metrics_dump(void) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *buf = NULL;
+        _cleanup_strv_free_ char **l = NULL;
+        ServerMetrics m = {};
+        size_t sz = 0;
+
+        m.start_usec = now(CLOCK_MONOTONIC);
+
+        server_metrics_received(&m, SERVER_TRANSPORT_JOURNAL, 100);
+        server_metrics_received(&m, SERVER_TRANSPORT_JOURNAL, 50);
+        server_metrics_received(&m, SERVER_TRANSPORT_AUDIT, 7);
+        m.n_rate_limited = 1;
+        m.n_written = 2;
+        m.bytes_written = 3;
+        m.n_write_failed = 4;
+        m.n_rotations = 5;
+        m.n_context_hit = 6;
+        m.n_context_miss = 7;
+        m.n_context_vanished = 8;
+        m.n_context_inherited_unit = 9;
+        m.n_context_inherited_process = 10;
+
+        latency_histogram_add(&m.write_latency, 0);
+        latency_histogram_add(&m.write_latency, 5);
+        latency_histogram_add(&m.write_latency, 5);
+        latency_histogram_add(&m.write_latency, USEC_PER_HOUR);
+        latency_histogram_add(&m.sync_latency, 2000);
+
+        assert_se(f = open_memstream(&buf, &sz));
+        server_metrics_dump(&m, f);
+        assert_se(fflush_and_check(f) >= 0);
+        f = safe_fclose(f);
+
+        puts(buf);
+
+        assert_se(l = strv_split_newlines(buf));
+
+        /* The uptime is the only value that is not under our control */
+        assert_se(startswith(l[0], "UPTIME_USEC="));
+
+        assert_se(strv_equal(l + 1,
+                             STRV_MAKE("RECEIVED_DRIVER=0",
+                                       "RECEIVED_DRIVER_BYTES=0",
+                                       "RECEIVED_SYSLOG=0",
+                                       "RECEIVED_SYSLOG_BYTES=0",
+                                       "RECEIVED_JOURNAL=2",
+                                       "RECEIVED_JOURNAL_BYTES=150",
+                                       "RECEIVED_STDOUT=0",
+                                       "RECEIVED_STDOUT_BYTES=0",
+                                       "RECEIVED_KERNEL=0",
+                                       "RECEIVED_KERNEL_BYTES=0",
+                                       "RECEIVED_AUDIT=1",
+                                       "RECEIVED_AUDIT_BYTES=7",
+                                       "RATE_LIMITED=1",
+                                       "WRITTEN=2",
+                                       "WRITTEN_BYTES=3",
+                                       "WRITE_FAILED=4",
+                                       "ROTATIONS=5",
+                                       "CONTEXT_CACHE_HITS=6",
+                                       "CONTEXT_CACHE_MISSES=7",
+                                       "CONTEXT_VANISHED=8",
+                                       "CONTEXT_INHERITED_UNIT=9",
+                                       "CONTEXT_INHERITED_PROCESS=10",
+                                       "WRITE_LATENCY_COUNT=4",
+                                       "WRITE_LATENCY_SUM_USEC=3600000010",
+                                       "WRITE_LATENCY_MAX_USEC=3600000000",
+                                       "WRITE_LATENCY_BUCKETS_USEC="
+                                       "1:1 2:0 4:0 8:2 16:0 32:0 64:0 128:0 256:0 512:0 1024:0 2048:0 4096:0 8192:0 16384:0 32768:0 "
+                                       "65536:0 131072:0 262144:0 524288:0 1048576:0 2097152:0 4194304:0 inf:1",
+                                       "SYNC_LATENCY_COUNT=1",
+                                       "SYNC_LATENCY_SUM_USEC=2000",
+                                       "SYNC_LATENCY_MAX_USEC=2000",
+                                       "SYNC_LATENCY_BUCKETS_USEC="
+                                       "1:0 2:0 4:0 8:0 16:0 32:0 64:0 128:0 256:0 512:0 1024:0 2048:1 4096:0 8192:0 16384:0 32768:0 "
+                                       "65536:0 131072:0 262144:0 524288:0 1048576:0 2097152:0 4194304:0 inf:0",
+                                       "VACUUM_LATENCY_COUNT=0",
+                                       "VACUUM_LATENCY_SUM_USEC=0",
+                                       "VACUUM_LATENCY_MAX_USEC=0",
+                                       "VACUUM_LATENCY_BUCKETS_USEC=" EMPTY_BUCKETS,
+                                       "CONTEXT_REFRESH_LATENCY_COUNT=0",
+                                       "CONTEXT_REFRESH_LATENCY_SUM_USEC=0",
+                                       "CONTEXT_REFRESH_LATENCY_MAX_USEC=0",
+                                       "CONTEXT_REFRESH_LATENCY_BUCKETS_USEC=" EMPTY_BUCKETS)));
+}
+
+int main(int argc, char *argv[]) {
+        test_latency_histogram();
+        test_server_metrics_dump();
+
+        return 0;
+}
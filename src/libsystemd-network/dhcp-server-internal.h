@@ -11,6 +11,7 @@
 #include "dhcp-internal.h"
 #include "hashmap.h"
 #include "log.h"
+#include "prioq.h"
 #include "util.h"
 
 typedef struct DHCPClientId {
@@ -25,6 +26,7 @@ typedef struct DHCPLease {
         be32_t gateway;
         uint8_t chaddr[16];
         usec_t expiration;
+        unsigned expiration_idx;
 } DHCPLease;
 
 struct sd_dhcp_server {
@@ -53,6 +55,17 @@ struct sd_dhcp_server {
         Hashmap *leases_by_client_id;
         DHCPLease **bound_leases;
         DHCPLease invalid_lease;
+        Prioq *leases_by_expiration;
+
+        /* One bit per pool slot, set when the slot is taken, and one bit per word of used_slots, set when
+         * all slots in that word are taken. Slots past the end of the pool are always marked as taken. */
+        uint64_t *used_slots;
+        uint64_t *full_words;
+        uint32_t n_used;
+
+        char *lease_file;
+        sd_event_source *save_leases;
+        bool leases_dirty;
 
         uint32_t max_lease_time, default_lease_time;
 };
@@ -74,6 +87,8 @@ typedef struct DHCPRequest {
 
 int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                                size_t length);
+int dhcp_server_save_leases(sd_dhcp_server *server);
+int dhcp_server_load_leases(sd_dhcp_server *server);
 int dhcp_server_send_packet(sd_dhcp_server *server,
                             DHCPRequest *req, DHCPPacket *packet,
                             int type, size_t optoffset);
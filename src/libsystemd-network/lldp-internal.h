@@ -9,12 +9,18 @@
 #include "log.h"
 #include "prioq.h"
 
+typedef struct LLDPSharedReceiver LLDPSharedReceiver;
+
 struct sd_lldp {
         unsigned n_ref;
 
         int ifindex;
         int fd;
 
+        /* when set, receive on the socket shared with the other sd_lldp objects of this thread */
+        bool shared;
+        LLDPSharedReceiver *receiver;
+
         sd_event *event;
         int64_t event_priority;
         sd_event_source *io_event_source;
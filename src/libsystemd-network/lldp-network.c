@@ -7,6 +7,34 @@
 #include "lldp-network.h"
 #include "socket-util.h"
 
+int lldp_network_set_membership(int fd, int ifindex, bool add) {
+
+        static const uint8_t addresses[] = { 0x00, 0x03, 0x0E };
+
+        struct packet_mreq mreq = {
+                .mr_ifindex = ifindex,
+                .mr_type = PACKET_MR_MULTICAST,
+                .mr_alen = ETH_ALEN,
+                .mr_address = { 0x01, 0x80, 0xC2, 0x00, 0x00, 0x00 }
+        };
+
+        size_t i;
+
+        assert(fd >= 0);
+        assert(ifindex > 0);
+
+        for (i = 0; i < ELEMENTSOF(addresses); i++) {
+                mreq.mr_address[ETH_ALEN - 1] = addresses[i];
+
+                if (setsockopt(fd, SOL_PACKET, add ? PACKET_ADD_MEMBERSHIP : PACKET_DROP_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+                        return -errno;
+        }
+
+        return 0;
+}
+
+/* With ifindex 0 the socket is not bound to any interface and receives LLDP frames from all of them. In that
+ * case no multicast memberships are set up, call lldp_network_set_membership() for each interface of interest. */
 int lldp_network_bind_raw_socket(int ifindex) {
 
         static const struct sock_filter filter[] = {
@@ -29,13 +57,6 @@ int lldp_network_bind_raw_socket(int ifindex) {
                 .filter = (struct sock_filter*) filter,
         };
 
-        struct packet_mreq mreq = {
-                .mr_ifindex = ifindex,
-                .mr_type = PACKET_MR_MULTICAST,
-                .mr_alen = ETH_ALEN,
-                .mr_address = { 0x01, 0x80, 0xC2, 0x00, 0x00, 0x00 }
-        };
-
         union sockaddr_union saddrll = {
                 .ll.sll_family = AF_PACKET,
                 .ll.sll_ifindex = ifindex,
@@ -44,7 +65,7 @@ int lldp_network_bind_raw_socket(int ifindex) {
         _cleanup_close_ int fd = -1;
         int r;
 
-        assert(ifindex > 0);
+        assert(ifindex >= 0);
 
         fd = socket(PF_PACKET, SOCK_RAW|SOCK_CLOEXEC|SOCK_NONBLOCK,
                     htobe16(ETHERTYPE_LLDP));
@@ -55,19 +76,20 @@ int lldp_network_bind_raw_socket(int ifindex) {
         if (r < 0)
                 return -errno;
 
-        r = setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
-        if (r < 0)
-                return -errno;
+        if (ifindex == 0) {
+                static const int one = 1;
 
-        mreq.mr_address[ETH_ALEN - 1] = 0x03;
-        r = setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
-        if (r < 0)
-                return -errno;
+                /* we need the timestamp of each packet, as they are read in batches */
+                r = setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+                if (r < 0)
+                        return -errno;
+
+                return TAKE_FD(fd);
+        }
 
-        mreq.mr_address[ETH_ALEN - 1] = 0x0E;
-        r = setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+        r = lldp_network_set_membership(fd, ifindex, true);
         if (r < 0)
-                return -errno;
+                return r;
 
         r = bind(fd, &saddrll.sa, sizeof(saddrll.ll));
         if (r < 0)
@@ -2,6 +2,9 @@
 #pragma once
 
 
+#include <stdbool.h>
+
 #include "sd-event.h"
 
 int lldp_network_bind_raw_socket(int ifindex);
+int lldp_network_set_membership(int fd, int ifindex, bool add);
@@ -3,6 +3,8 @@
   Copyright © 2013 Intel Corporation. All rights reserved.
 ***/
 
+#include <arpa/inet.h>
+#include <stdio_ext.h>
 #include <sys/ioctl.h>
 
 #include "sd-dhcp-server.h"
@@ -10,8 +12,12 @@
 #include "alloc-util.h"
 #include "dhcp-internal.h"
 #include "dhcp-server-internal.h"
+#include "extract-word.h"
 #include "fd-util.h"
+#include "fileio.h"
+#include "hexdecoct.h"
 #include "in-addr-util.h"
+#include "parse-util.h"
 #include "sd-id128.h"
 #include "siphash24.h"
 #include "string-util.h"
@@ -20,6 +26,9 @@
 #define DHCP_DEFAULT_LEASE_TIME_USEC USEC_PER_HOUR
 #define DHCP_MAX_LEASE_TIME_USEC (USEC_PER_HOUR*12)
 
+/* how long to collect lease changes before writing them out */
+#define DHCP_SAVE_LEASES_DELAY_USEC USEC_PER_SEC
+
 static void dhcp_lease_free(DHCPLease *lease) {
         if (!lease)
                 return;
@@ -28,6 +37,167 @@ static void dhcp_lease_free(DHCPLease *lease) {
         free(lease);
 }
 
+DEFINE_TRIVIAL_CLEANUP_FUNC(DHCPLease*, dhcp_lease_free);
+
+static int lease_compare_expiration(const void *a, const void *b) {
+        const DHCPLease *x = a, *y = b;
+
+        if (x->expiration < y->expiration)
+                return -1;
+        if (x->expiration > y->expiration)
+                return 1;
+
+        return 0;
+}
+
+/* Returns the index of the first clear bit at or after 'start', wrapping around at the end of the bitmap,
+ * or -1 if all bits are set */
+static int64_t bitmap_find_next_clear(const uint64_t *bits, size_t n_words, size_t start) {
+        size_t i;
+
+        for (i = 0; i <= n_words; i++) {
+                size_t w = (start / 64 + i) % n_words;
+                uint64_t clear = ~bits[w];
+
+                /* the first word is looked at twice: its upper part first, and its lower part after
+                 * wrapping around */
+                if (i == 0)
+                        clear &= UINT64_MAX << (start % 64);
+
+                if (clear != 0)
+                        return (int64_t) w * 64 + __builtin_ctzll(clear);
+        }
+
+        return -1;
+}
+
+static void pool_slot_take(sd_dhcp_server *server, uint32_t slot, DHCPLease *lease) {
+        uint32_t w = slot / 64;
+
+        assert(server);
+        assert(slot < server->pool_size);
+        assert(!server->bound_leases[slot]);
+        assert(lease);
+
+        server->bound_leases[slot] = lease;
+        server->used_slots[w] |= UINT64_C(1) << (slot % 64);
+        if (server->used_slots[w] == UINT64_MAX)
+                server->full_words[w / 64] |= UINT64_C(1) << (w % 64);
+        server->n_used++;
+}
+
+static void pool_slot_release(sd_dhcp_server *server, uint32_t slot) {
+        uint32_t w = slot / 64;
+
+        assert(server);
+        assert(slot < server->pool_size);
+        assert(server->bound_leases[slot]);
+
+        server->bound_leases[slot] = NULL;
+        server->used_slots[w] &= ~(UINT64_C(1) << (slot % 64));
+        server->full_words[w / 64] &= ~(UINT64_C(1) << (w % 64));
+        server->n_used--;
+}
+
+/* Finds the first free slot in the pool at or after 'start', wrapping around at the end of the pool.
+ * We first look at the rest of the word 'start' is in, and then use the bitmap of full words to find
+ * the next word with a free slot, so that even large pools are never scanned slot by slot. */
+static int pool_find_free_slot(sd_dhcp_server *server, uint32_t start) {
+        size_t n_words;
+        uint64_t clear;
+        int64_t w;
+        uint32_t s;
+
+        assert(server);
+        assert(start < server->pool_size);
+
+        if (server->n_used >= server->pool_size)
+                return -ENOSPC;
+
+        s = start / 64;
+        clear = ~server->used_slots[s] & (UINT64_MAX << (start % 64));
+        if (clear != 0)
+                return s * 64 + __builtin_ctzll(clear);
+
+        n_words = DIV_ROUND_UP(server->pool_size, 64);
+
+        w = bitmap_find_next_clear(server->full_words, DIV_ROUND_UP(n_words, 64), (s + 1) % n_words);
+        if (w < 0)
+                return -ENOSPC;
+
+        clear = ~server->used_slots[w];
+        assert(clear != 0);
+
+        return w * 64 + __builtin_ctzll(clear);
+}
+
+static void dhcp_server_drop_leases(sd_dhcp_server *server) {
+        DHCPLease *lease;
+
+        assert(server);
+
+        while ((lease = prioq_pop(server->leases_by_expiration)))
+                lease->expiration_idx = PRIOQ_IDX_NULL;
+
+        hashmap_clear_with_destructor(server->leases_by_client_id, dhcp_lease_free);
+}
+
+static int server_save_leases_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        sd_dhcp_server *server = userdata;
+
+        assert(server);
+
+        server->save_leases = sd_event_source_unref(server->save_leases);
+        (void) dhcp_server_save_leases(server);
+
+        return 0;
+}
+
+static void dhcp_server_leases_changed(sd_dhcp_server *server) {
+        usec_t time_now;
+        int r;
+
+        assert(server);
+
+        if (!server->lease_file)
+                return;
+
+        server->leases_dirty = true;
+
+        if (server->save_leases)
+                /* already scheduled */
+                return;
+
+        if (!server->event) {
+                (void) dhcp_server_save_leases(server);
+                return;
+        }
+
+        /* When many clients come up at once we get a burst of changes, write them all out in one go */
+        r = sd_event_now(server->event, clock_boottime_or_monotonic(), &time_now);
+        if (r >= 0)
+                r = sd_event_add_time(server->event, &server->save_leases, clock_boottime_or_monotonic(),
+                                      time_now + DHCP_SAVE_LEASES_DELAY_USEC, 0,
+                                      server_save_leases_handler, server);
+        if (r < 0) {
+                log_dhcp_server_errno(server, r, "Failed to schedule saving of leases, saving now: %m");
+                (void) dhcp_server_save_leases(server);
+                return;
+        }
+
+        (void) sd_event_source_set_priority(server->save_leases, server->event_priority);
+        (void) sd_event_source_set_description(server->save_leases, "dhcp-server-save-leases");
+}
+
+static void dhcp_server_flush_leases(sd_dhcp_server *server) {
+        assert(server);
+
+        server->save_leases = sd_event_source_unref(server->save_leases);
+
+        if (server->leases_dirty)
+                (void) dhcp_server_save_leases(server);
+}
+
 /* configures the server's address and subnet, and optionally the pool's size and offset into the subnet
  * the whole pool must fit into the subnet, and may not contain the first (any) nor last (broadcast) address
  * moreover, the server's own address may be in the pool, and is in that case reserved in order not to
@@ -72,12 +242,36 @@ int sd_dhcp_server_configure_pool(sd_dhcp_server *server, struct in_addr *addres
                 size = size_max;
 
         if (server->address != address->s_addr || server->netmask != netmask || server->pool_size != size || server->pool_offset != offset) {
+                _cleanup_free_ DHCPLease **bound_leases = NULL;
+                _cleanup_free_ uint64_t *used_slots = NULL, *full_words = NULL;
+                size_t n_words, n_full_words;
 
-                free(server->bound_leases);
-                server->bound_leases = new0(DHCPLease*, size);
-                if (!server->bound_leases)
+                n_words = DIV_ROUND_UP(size, 64);
+                n_full_words = DIV_ROUND_UP(n_words, 64);
+
+                bound_leases = new0(DHCPLease*, size);
+                used_slots = new0(uint64_t, n_words);
+                full_words = new0(uint64_t, n_full_words);
+                if (!bound_leases || !used_slots || !full_words)
                         return -ENOMEM;
 
+                /* mark the bits past the end of the pool as taken, so that they are never handed out */
+                if (size % 64 != 0)
+                        used_slots[n_words - 1] = UINT64_MAX << (size % 64);
+                if (n_words % 64 != 0)
+                        full_words[n_full_words - 1] = UINT64_MAX << (n_words % 64);
+
+                /* Drop any leases associated with the old address range */
+                if (!hashmap_isempty(server->leases_by_client_id)) {
+                        dhcp_server_drop_leases(server);
+                        dhcp_server_leases_changed(server);
+                }
+
+                free_and_replace(server->bound_leases, bound_leases);
+                free_and_replace(server->used_slots, used_slots);
+                free_and_replace(server->full_words, full_words);
+                server->n_used = 0;
+
                 server->pool_offset = offset;
                 server->pool_size = size;
 
@@ -86,10 +280,7 @@ int sd_dhcp_server_configure_pool(sd_dhcp_server *server, struct in_addr *addres
                 server->subnet = address->s_addr & netmask;
 
                 if (server_off >= offset && server_off - offset < size)
-                        server->bound_leases[server_off - offset] = &server->invalid_lease;
-
-                /* Drop any leases associated with the old address range */
-                hashmap_clear_with_destructor(server->leases_by_client_id, dhcp_lease_free);
+                        pool_slot_take(server, server_off - offset, &server->invalid_lease);
         }
 
         return 0;
@@ -164,12 +355,17 @@ sd_dhcp_server *sd_dhcp_server_unref(sd_dhcp_server *server) {
         free(server->timezone);
         free(server->dns);
         free(server->ntp);
+        free(server->lease_file);
+
+        prioq_free(server->leases_by_expiration);
 
         while ((lease = hashmap_steal_first(server->leases_by_client_id)))
                 dhcp_lease_free(lease);
         hashmap_free(server->leases_by_client_id);
 
         free(server->bound_leases);
+        free(server->used_slots);
+        free(server->full_words);
         return mfree(server);
 }
 
@@ -194,6 +390,10 @@ int sd_dhcp_server_new(sd_dhcp_server **ret, int ifindex) {
         if (!server->leases_by_client_id)
                 return -ENOMEM;
 
+        server->leases_by_expiration = prioq_new(lease_compare_expiration);
+        if (!server->leases_by_expiration)
+                return -ENOMEM;
+
         server->default_lease_time = DIV_ROUND_UP(DHCP_DEFAULT_LEASE_TIME_USEC, USEC_PER_SEC);
         server->max_lease_time = DIV_ROUND_UP(DHCP_MAX_LEASE_TIME_USEC, USEC_PER_SEC);
 
@@ -224,6 +424,8 @@ int sd_dhcp_server_attach_event(sd_dhcp_server *server, sd_event *event, int64_t
 int sd_dhcp_server_detach_event(sd_dhcp_server *server) {
         assert_return(server, -EINVAL);
 
+        dhcp_server_flush_leases(server);
+
         server->event = sd_event_unref(server->event);
 
         return 0;
@@ -244,6 +446,8 @@ int sd_dhcp_server_stop(sd_dhcp_server *server) {
         server->fd_raw = safe_close(server->fd_raw);
         server->fd = safe_close(server->fd);
 
+        dhcp_server_flush_leases(server);
+
         log_dhcp_server(server, "STOPPED");
 
         return 0;
@@ -690,6 +894,204 @@ static int get_pool_offset(sd_dhcp_server *server, be32_t requested_ip) {
         return be32toh(requested_ip & ~server->netmask) - server->pool_offset;
 }
 
+static int dhcp_server_bind_lease(sd_dhcp_server *server, uint32_t slot, DHCPLease *lease) {
+        int r;
+
+        assert(server);
+        assert(lease);
+
+        r = hashmap_put(server->leases_by_client_id, &lease->client_id, lease);
+        if (r < 0)
+                return r;
+
+        r = prioq_put(server->leases_by_expiration, lease, &lease->expiration_idx);
+        if (r < 0) {
+                hashmap_remove(server->leases_by_client_id, &lease->client_id);
+                return r;
+        }
+
+        pool_slot_take(server, slot, lease);
+
+        return 0;
+}
+
+static void dhcp_server_unbind_lease(sd_dhcp_server *server, DHCPLease *lease) {
+        int pool_offset;
+
+        assert(server);
+        assert(lease);
+
+        pool_offset = get_pool_offset(server, lease->address);
+        if (pool_offset >= 0 && server->bound_leases[pool_offset] == lease)
+                pool_slot_release(server, pool_offset);
+
+        hashmap_remove(server->leases_by_client_id, &lease->client_id);
+        prioq_remove(server->leases_by_expiration, lease, &lease->expiration_idx);
+        dhcp_lease_free(lease);
+
+        dhcp_server_leases_changed(server);
+}
+
+static void dhcp_server_expire_leases(sd_dhcp_server *server, usec_t time_now) {
+        DHCPLease *lease;
+
+        assert(server);
+
+        while ((lease = prioq_peek(server->leases_by_expiration)) &&
+               lease->expiration <= time_now) {
+                log_dhcp_server(server, "EXPIRED %s", inet_ntoa((struct in_addr) { .s_addr = lease->address }));
+                dhcp_server_unbind_lease(server, lease);
+        }
+}
+
+/* Bound leases are written to the lease file one per line, as
+ *
+ *     ADDRESS GATEWAY EXPIRATION CHADDR CLIENT-ID
+ *
+ * with the expiration time in CLOCK_BOOTTIME, which is fine as the file is meant to be kept in /run and
+ * hence doesn't survive a reboot. */
+int dhcp_server_save_leases(sd_dhcp_server *server) {
+        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        DHCPLease *lease;
+        Iterator i;
+        int r;
+
+        assert(server);
+
+        if (!server->lease_file)
+                return 0;
+
+        r = fopen_temporary(server->lease_file, &f, &temp_path);
+        if (r < 0)
+                goto fail;
+
+        (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
+        (void) fchmod(fileno(f), 0644);
+
+        fputs("# This is private data. Do not parse.\n", f);
+
+        HASHMAP_FOREACH(lease, server->leases_by_client_id, i) {
+                _cleanup_free_ char *chaddr = NULL, *client_id = NULL;
+
+                if (lease->client_id.length == 0)
+                        continue;
+
+                chaddr = hexmem(lease->chaddr, ETH_ALEN);
+                client_id = hexmem(lease->client_id.data, lease->client_id.length);
+                if (!chaddr || !client_id) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                fprintf(f, "%s ", inet_ntoa((struct in_addr) { .s_addr = lease->address }));
+                fprintf(f, "%s " USEC_FMT " %s %s\n",
+                        inet_ntoa((struct in_addr) { .s_addr = lease->gateway }),
+                        lease->expiration, chaddr, client_id);
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(temp_path, server->lease_file) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        server->leases_dirty = false;
+
+        return 0;
+
+fail:
+        if (temp_path)
+                (void) unlink(temp_path);
+
+        return log_error_errno(r, "Failed to save DHCP server leases %s: %m", server->lease_file);
+}
+
+int dhcp_server_load_leases(sd_dhcp_server *server) {
+        _cleanup_fclose_ FILE *f = NULL;
+        usec_t time_now;
+        unsigned n = 0;
+        int r;
+
+        assert(server);
+
+        if (!server->lease_file || server->pool_size == 0)
+                return 0;
+
+        f = fopen(server->lease_file, "re");
+        if (!f)
+                return errno == ENOENT ? 0 : -errno;
+
+        (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
+
+        if (!server->event || sd_event_now(server->event, clock_boottime_or_monotonic(), &time_now) < 0)
+                time_now = now(clock_boottime_or_monotonic());
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL, *address = NULL, *gateway = NULL, *expiration = NULL, *chaddr = NULL, *client_id = NULL;
+                _cleanup_(dhcp_lease_freep) DHCPLease *lease = NULL;
+                _cleanup_free_ void *chaddr_data = NULL;
+                size_t chaddr_len;
+                const char *p;
+                int pool_offset;
+
+                r = read_line(f, LINE_MAX, &line);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                p = strstrip(line);
+                if (IN_SET(*p, 0, '#'))
+                        continue;
+
+                lease = new0(DHCPLease, 1);
+                if (!lease)
+                        return -ENOMEM;
+
+                r = extract_many_words(&p, NULL, 0, &address, &gateway, &expiration, &chaddr, &client_id, NULL);
+                if (r == -ENOMEM)
+                        return r;
+                if (r != 5 ||
+                    inet_pton(AF_INET, address, &lease->address) <= 0 ||
+                    inet_pton(AF_INET, gateway, &lease->gateway) <= 0 ||
+                    safe_atou64(expiration, &lease->expiration) < 0 ||
+                    unhexmem(chaddr, strlen(chaddr), &chaddr_data, &chaddr_len) < 0 ||
+                    chaddr_len != ETH_ALEN ||
+                    unhexmem(client_id, strlen(client_id), &lease->client_id.data, &lease->client_id.length) < 0 ||
+                    lease->client_id.length == 0) {
+                        log_dhcp_server(server, "Ignoring invalid line in %s: %s", server->lease_file, line);
+                        continue;
+                }
+
+                memcpy(lease->chaddr, chaddr_data, ETH_ALEN);
+
+                if (lease->expiration <= time_now)
+                        continue;
+
+                /* The pool might have changed since the file was written */
+                pool_offset = get_pool_offset(server, lease->address);
+                if (pool_offset < 0 ||
+                    server->bound_leases[pool_offset] ||
+                    hashmap_contains(server->leases_by_client_id, &lease->client_id))
+                        continue;
+
+                r = dhcp_server_bind_lease(server, pool_offset, lease);
+                if (r < 0)
+                        return r;
+
+                lease = NULL;
+                n++;
+        }
+
+        log_dhcp_server(server, "Loaded %u leases from %s", n, server->lease_file);
+
+        return n;
+}
+
 #define HASH_KEY SD_ID128_MAKE(0d,1d,fe,bd,f1,24,bd,b3,47,f1,dd,6e,73,21,93,30)
 
 int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
@@ -697,6 +1099,7 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
         _cleanup_(dhcp_request_freep) DHCPRequest *req = NULL;
         _cleanup_free_ char *error_message = NULL;
         DHCPLease *existing_lease;
+        usec_t time_now = 0;
         int type, r;
 
         assert(server);
@@ -720,6 +1123,10 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                 /* this only fails on critical errors */
                 return r;
 
+        if (server->event &&
+            sd_event_now(server->event, clock_boottime_or_monotonic(), &time_now) >= 0)
+                dhcp_server_expire_leases(server, time_now);
+
         existing_lease = hashmap_get(server->leases_by_client_id,
                                      &req->client_id);
 
@@ -727,7 +1134,6 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
 
         case DHCP_DISCOVER: {
                 be32_t address = INADDR_ANY;
-                unsigned i;
 
                 log_dhcp_server(server, "DISCOVER (0x%x)",
                                 be32toh(req->message->xid));
@@ -742,7 +1148,7 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                 else {
                         struct siphash state;
                         uint64_t hash;
-                        uint32_t next_offer;
+                        int next_offer;
 
                         /* even with no persistence of leases, we try to offer the same client
                            the same IP address. we do this by using the hash of the client id
@@ -751,16 +1157,9 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                         siphash24_init(&state, HASH_KEY.bytes);
                         client_id_hash_func(&req->client_id, &state);
                         hash = htole64(siphash24_finalize(&state));
-                        next_offer = hash % server->pool_size;
-
-                        for (i = 0; i < server->pool_size; i++) {
-                                if (!server->bound_leases[next_offer]) {
-                                        address = server->subnet | htobe32(server->pool_offset + next_offer);
-                                        break;
-                                }
-
-                                next_offer = (next_offer + 1) % server->pool_size;
-                        }
+                        next_offer = pool_find_free_slot(server, hash % server->pool_size);
+                        if (next_offer >= 0)
+                                address = server->subnet | htobe32(server->pool_offset + next_offer);
                 }
 
                 if (address == INADDR_ANY)
@@ -839,7 +1238,6 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                 if (pool_offset >= 0 &&
                     server->bound_leases[pool_offset] == existing_lease) {
                         DHCPLease *lease;
-                        usec_t time_now = 0;
 
                         if (!existing_lease) {
                                 lease = new0(DHCPLease, 1);
@@ -883,9 +1281,17 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                                 log_dhcp_server(server, "ACK (0x%x)",
                                                 be32toh(req->message->xid));
 
-                                server->bound_leases[pool_offset] = lease;
-                                hashmap_put(server->leases_by_client_id,
-                                            &lease->client_id, lease);
+                                if (existing_lease)
+                                        prioq_reshuffle(server->leases_by_expiration, lease, &lease->expiration_idx);
+                                else {
+                                        r = dhcp_server_bind_lease(server, pool_offset, lease);
+                                        if (r < 0) {
+                                                dhcp_lease_free(lease);
+                                                return r;
+                                        }
+                                }
+
+                                dhcp_server_leases_changed(server);
 
                                 return DHCP_ACK;
                         }
@@ -919,11 +1325,8 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                 if (pool_offset < 0)
                         return 0;
 
-                if (server->bound_leases[pool_offset] == existing_lease) {
-                        server->bound_leases[pool_offset] = NULL;
-                        hashmap_remove(server->leases_by_client_id, existing_lease);
-                        dhcp_lease_free(existing_lease);
-                }
+                if (server->bound_leases[pool_offset] == existing_lease)
+                        dhcp_server_unbind_lease(server, existing_lease);
 
                 return 0;
         }}
@@ -1032,24 +1435,25 @@ int sd_dhcp_server_start(sd_dhcp_server *server) {
                 return r;
         }
 
+        if (hashmap_isempty(server->leases_by_client_id)) {
+                r = dhcp_server_load_leases(server);
+                if (r < 0)
+                        log_dhcp_server_errno(server, r, "Failed to load leases from %s, ignoring: %m", server->lease_file);
+        }
+
         log_dhcp_server(server, "STARTED");
 
         return 0;
 }
 
 int sd_dhcp_server_forcerenew(sd_dhcp_server *server) {
-        unsigned i;
+        DHCPLease *lease;
+        Iterator i;
         int r = 0;
 
         assert_return(server, -EINVAL);
-        assert(server->bound_leases);
-
-        for (i = 0; i < server->pool_size; i++) {
-                DHCPLease *lease = server->bound_leases[i];
-
-                if (!lease || lease == &server->invalid_lease)
-                        continue;
 
+        HASHMAP_FOREACH(lease, server->leases_by_client_id, i) {
                 r = server_send_forcerenew(server, lease->address,
                                            lease->gateway,
                                            lease->chaddr);
@@ -1160,3 +1564,21 @@ int sd_dhcp_server_set_emit_router(sd_dhcp_server *server, int enabled) {
 
         return 1;
 }
+
+int sd_dhcp_server_set_lease_file(sd_dhcp_server *server, const char *path) {
+        int r;
+
+        assert_return(server, -EINVAL);
+
+        r = free_and_strdup(&server->lease_file, path);
+        if (r <= 0)
+                return r;
+
+        server->save_leases = sd_event_source_unref(server->save_leases);
+        server->leases_dirty = false;
+
+        if (!hashmap_isempty(server->leases_by_client_id))
+                dhcp_server_leases_changed(server);
+
+        return 1;
+}
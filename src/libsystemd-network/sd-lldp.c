@@ -2,11 +2,13 @@
 
 #include <arpa/inet.h>
 #include <linux/sockios.h>
+#include <netinet/if_ether.h>
 
 #include "sd-lldp.h"
 
 #include "alloc-util.h"
 #include "fd-util.h"
+#include "io-util.h"
 #include "lldp-internal.h"
 #include "lldp-neighbor.h"
 #include "lldp-network.h"
@@ -15,6 +17,33 @@
 
 #define LLDP_DEFAULT_NEIGHBORS_MAX 128U
 
+/* how many frames to read from the shared socket with one recvmmsg() call */
+#define LLDP_SHARED_BATCH 16U
+
+/* LLDP frames are never larger than a regular Ethernet frame */
+#define LLDP_FRAME_MAX (ETH_HLEN + ETH_DATA_LEN)
+
+struct LLDPSharedReceiver {
+        unsigned n_ref;
+
+        sd_event *event;
+        int fd;
+        sd_event_source *io_event_source;
+
+        Hashmap *lldp_by_ifindex;
+
+        uint8_t buffers[LLDP_SHARED_BATCH][LLDP_FRAME_MAX];
+};
+
+/* Hosts with many links would otherwise need one socket and one event source for each of them. Instead, all
+ * sd_lldp objects of a thread that ask for it subscribe to one socket receiving LLDP frames from all
+ * interfaces, and the frames are dispatched by interface index. */
+static thread_local LLDPSharedReceiver *shared_receiver = NULL;
+
+static bool lldp_running(sd_lldp *lldp) {
+        return lldp->fd >= 0 || lldp->receiver;
+}
+
 static void lldp_flush_neighbors(sd_lldp *lldp) {
         sd_lldp_neighbor *n;
 
@@ -220,9 +249,196 @@ static int lldp_receive_datagram(sd_event_source *s, int fd, uint32_t revents, v
         return lldp_handle_datagram(lldp, n);
 }
 
+static LLDPSharedReceiver *lldp_shared_receiver_ref(LLDPSharedReceiver *rx) {
+        assert(rx);
+        assert(rx->n_ref > 0);
+
+        rx->n_ref++;
+        return rx;
+}
+
+static LLDPSharedReceiver *lldp_shared_receiver_unref(LLDPSharedReceiver *rx) {
+        if (!rx)
+                return NULL;
+
+        assert(rx->n_ref > 0);
+        rx->n_ref--;
+
+        if (rx->n_ref > 0)
+                return NULL;
+
+        if (shared_receiver == rx)
+                shared_receiver = NULL;
+
+        sd_event_source_unref(rx->io_event_source);
+        safe_close(rx->fd);
+        sd_event_unref(rx->event);
+        hashmap_free(rx->lldp_by_ifindex);
+
+        return mfree(rx);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(LLDPSharedReceiver*, lldp_shared_receiver_unref);
+
+static int lldp_shared_receive_datagrams(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        _cleanup_(lldp_shared_receiver_unrefp) LLDPSharedReceiver *rx = NULL;
+        struct mmsghdr msgs[LLDP_SHARED_BATCH] = {};
+        struct iovec iovs[LLDP_SHARED_BATCH];
+        union sockaddr_union sas[LLDP_SHARED_BATCH];
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(struct timespec))];
+        } controls[LLDP_SHARED_BATCH];
+        unsigned i;
+        int n, r;
+
+        assert(fd >= 0);
+        assert(userdata);
+
+        /* The callbacks might stop the last sd_lldp object using the receiver, keep it around until we are done */
+        rx = lldp_shared_receiver_ref(userdata);
+
+        for (i = 0; i < LLDP_SHARED_BATCH; i++) {
+                iovs[i] = IOVEC_MAKE(rx->buffers[i], sizeof(rx->buffers[i]));
+                msgs[i].msg_hdr = (struct msghdr) {
+                        .msg_name = &sas[i],
+                        .msg_namelen = sizeof(sas[i]),
+                        .msg_iov = &iovs[i],
+                        .msg_iovlen = 1,
+                        .msg_control = &controls[i],
+                        .msg_controllen = sizeof(controls[i]),
+                };
+        }
+
+        n = recvmmsg(fd, msgs, LLDP_SHARED_BATCH, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+                if (IN_SET(errno, EAGAIN, EINTR))
+                        return 0;
+
+                /* Returning an error would disable the source, and stop reception on all links */
+                log_lldp_errno(errno, "Failed to read LLDP datagrams, ignoring: %m");
+                return 0;
+        }
+
+        for (i = 0; i < (unsigned) n; i++) {
+                _cleanup_(sd_lldp_neighbor_unrefp) sd_lldp_neighbor *neighbor = NULL;
+                struct cmsghdr *cmsg;
+                sd_lldp *lldp;
+
+                if (msgs[i].msg_hdr.msg_namelen < sizeof(struct sockaddr_ll))
+                        continue;
+
+                lldp = hashmap_get(rx->lldp_by_ifindex, INT_TO_PTR(sas[i].ll.sll_ifindex));
+                if (!lldp)
+                        /* nobody is interested in this interface */
+                        continue;
+
+                if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                        log_lldp("Ignoring oversized LLDP datagram.");
+                        continue;
+                }
+
+                neighbor = lldp_neighbor_new(msgs[i].msg_len);
+                if (!neighbor) {
+                        log_lldp_errno(ENOMEM, "Failed to allocate LLDP neighbor, ignoring datagram: %m");
+                        continue;
+                }
+
+                memcpy(LLDP_NEIGHBOR_RAW(neighbor), rx->buffers[i], msgs[i].msg_len);
+
+                cmsg = cmsg_find(&msgs[i].msg_hdr, SOL_SOCKET, SCM_TIMESTAMPNS, CMSG_LEN(sizeof(struct timespec)));
+                if (cmsg)
+                        triple_timestamp_from_realtime(&neighbor->timestamp, timespec_load((struct timespec*) CMSG_DATA(cmsg)));
+                else
+                        triple_timestamp_get(&neighbor->timestamp);
+
+                /* Don't let one failing link stop reception on all the others */
+                r = lldp_handle_datagram(lldp, neighbor);
+                if (r < 0)
+                        log_lldp_errno(r, "Failed to process LLDP datagram, ignoring: %m");
+        }
+
+        return 0;
+}
+
+static int lldp_shared_receiver_add(sd_lldp *lldp) {
+        _cleanup_(lldp_shared_receiver_unrefp) LLDPSharedReceiver *rx = NULL;
+        int r;
+
+        assert(lldp);
+        assert(lldp->event);
+        assert(!lldp->receiver);
+
+        if (shared_receiver) {
+                /* the socket is watched by one event loop only */
+                if (shared_receiver->event != lldp->event)
+                        return -EXDEV;
+
+                rx = lldp_shared_receiver_ref(shared_receiver);
+        } else {
+                rx = new0(LLDPSharedReceiver, 1);
+                if (!rx)
+                        return -ENOMEM;
+
+                rx->n_ref = 1;
+                rx->event = sd_event_ref(lldp->event);
+
+                rx->fd = lldp_network_bind_raw_socket(0);
+                if (rx->fd < 0)
+                        return rx->fd;
+
+                r = sd_event_add_io(rx->event, &rx->io_event_source, rx->fd, EPOLLIN, lldp_shared_receive_datagrams, rx);
+                if (r < 0)
+                        return r;
+
+                r = sd_event_source_set_priority(rx->io_event_source, lldp->event_priority);
+                if (r < 0)
+                        return r;
+
+                (void) sd_event_source_set_description(rx->io_event_source, "lldp-shared-io");
+
+                shared_receiver = rx;
+        }
+
+        r = hashmap_ensure_allocated(&rx->lldp_by_ifindex, NULL);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(rx->lldp_by_ifindex, INT_TO_PTR(lldp->ifindex), lldp);
+        if (r < 0)
+                return r;
+
+        r = lldp_network_set_membership(rx->fd, lldp->ifindex, true);
+        if (r < 0) {
+                hashmap_remove(rx->lldp_by_ifindex, INT_TO_PTR(lldp->ifindex));
+                return r;
+        }
+
+        lldp->receiver = TAKE_PTR(rx);
+
+        return 0;
+}
+
+static void lldp_shared_receiver_remove(sd_lldp *lldp) {
+        LLDPSharedReceiver *rx;
+
+        assert(lldp);
+
+        rx = lldp->receiver;
+        if (!rx)
+                return;
+
+        (void) lldp_network_set_membership(rx->fd, lldp->ifindex, false);
+        hashmap_remove_value(rx->lldp_by_ifindex, INT_TO_PTR(lldp->ifindex), lldp);
+
+        lldp->receiver = lldp_shared_receiver_unref(rx);
+}
+
 static void lldp_reset(sd_lldp *lldp) {
         assert(lldp);
 
+        lldp_shared_receiver_remove(lldp);
+
         lldp->timer_event_source = sd_event_source_unref(lldp->timer_event_source);
         lldp->io_event_source = sd_event_source_unref(lldp->io_event_source);
         lldp->fd = safe_close(lldp->fd);
@@ -235,11 +451,21 @@ _public_ int sd_lldp_start(sd_lldp *lldp) {
         assert_return(lldp->event, -EINVAL);
         assert_return(lldp->ifindex > 0, -EINVAL);
 
-        if (lldp->fd >= 0)
+        if (lldp_running(lldp))
                 return 0;
 
         assert(!lldp->io_event_source);
 
+        if (lldp->shared) {
+                r = lldp_shared_receiver_add(lldp);
+                if (r >= 0) {
+                        log_lldp("Started LLDP client on shared socket");
+                        return 1;
+                }
+
+                log_lldp_errno(r, "Failed to subscribe to shared LLDP socket, using a separate one: %m");
+        }
+
         lldp->fd = lldp_network_bind_raw_socket(lldp->ifindex);
         if (lldp->fd < 0)
                 return lldp->fd;
@@ -265,7 +491,7 @@ fail:
 _public_ int sd_lldp_stop(sd_lldp *lldp) {
         assert_return(lldp, -EINVAL);
 
-        if (lldp->fd < 0)
+        if (!lldp_running(lldp))
                 return 0;
 
         log_lldp("Stopping LLDP client");
@@ -280,7 +506,7 @@ _public_ int sd_lldp_attach_event(sd_lldp *lldp, sd_event *event, int64_t priori
         int r;
 
         assert_return(lldp, -EINVAL);
-        assert_return(lldp->fd < 0, -EBUSY);
+        assert_return(!lldp_running(lldp), -EBUSY);
         assert_return(!lldp->event, -EBUSY);
 
         if (event)
@@ -299,7 +525,7 @@ _public_ int sd_lldp_attach_event(sd_lldp *lldp, sd_event *event, int64_t priori
 _public_ int sd_lldp_detach_event(sd_lldp *lldp) {
 
         assert_return(lldp, -EINVAL);
-        assert_return(lldp->fd < 0, -EBUSY);
+        assert_return(!lldp_running(lldp), -EBUSY);
 
         lldp->event = sd_event_unref(lldp->event);
         return 0;
@@ -323,12 +549,20 @@ _public_ int sd_lldp_set_callback(sd_lldp *lldp, sd_lldp_callback_t cb, void *us
 _public_ int sd_lldp_set_ifindex(sd_lldp *lldp, int ifindex) {
         assert_return(lldp, -EINVAL);
         assert_return(ifindex > 0, -EINVAL);
-        assert_return(lldp->fd < 0, -EBUSY);
+        assert_return(!lldp_running(lldp), -EBUSY);
 
         lldp->ifindex = ifindex;
         return 0;
 }
 
+_public_ int sd_lldp_set_shared_socket(sd_lldp *lldp, int b) {
+        assert_return(lldp, -EINVAL);
+        assert_return(!lldp_running(lldp), -EBUSY);
+
+        lldp->shared = b;
+        return 0;
+}
+
 _public_ sd_lldp* sd_lldp_ref(sd_lldp *lldp) {
 
         if (!lldp)
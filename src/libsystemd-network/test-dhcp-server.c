@@ -9,6 +9,11 @@
 #include "sd-event.h"
 
 #include "dhcp-server-internal.h"
+#include "env-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "time-util.h"
 
 static void test_pool(struct in_addr *address, unsigned size, int ret) {
         _cleanup_(sd_dhcp_server_unrefp) sd_dhcp_server *server = NULL;
@@ -180,6 +185,152 @@ static void test_message_handler(void) {
         assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == 0);
 }
 
+struct test_exchange {
+        DHCPMessage message;
+        struct {
+                uint8_t code;
+                uint8_t length;
+                uint8_t type;
+        } _packed_ option_type;
+        struct {
+                uint8_t code;
+                uint8_t length;
+                be32_t address;
+        } _packed_ option_requested_ip;
+        struct {
+                uint8_t code;
+                uint8_t length;
+                be32_t address;
+        } _packed_ option_server_id;
+        uint8_t end;
+} _packed_;
+
+static int test_exchange(sd_dhcp_server *server, uint32_t client, be32_t address) {
+        struct test_exchange test = {
+                .message.op = BOOTREQUEST,
+                .message.htype = ARPHRD_ETHER,
+                .message.hlen = ETHER_ADDR_LEN,
+                .message.xid = htobe32(client),
+                .message.chaddr = { 'A', 'B', client >> 24, client >> 16, client >> 8, client },
+                .option_type.code = SD_DHCP_OPTION_MESSAGE_TYPE,
+                .option_type.length = 1,
+                .option_type.type = DHCP_DISCOVER,
+                .end = SD_DHCP_OPTION_END,
+        };
+        int r;
+
+        r = dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test));
+        if (r != DHCP_OFFER)
+                return r;
+
+        test.option_type.type = DHCP_REQUEST;
+        test.option_requested_ip.code = SD_DHCP_OPTION_REQUESTED_IP_ADDRESS;
+        test.option_requested_ip.length = 4;
+        test.option_requested_ip.address = address;
+        test.option_server_id.code = SD_DHCP_OPTION_SERVER_IDENTIFIER;
+        test.option_server_id.length = 4;
+        test.option_server_id.address = htobe32(INADDR_LOOPBACK);
+
+        return dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test));
+}
+
+static void test_leases(void) {
+        _cleanup_(sd_dhcp_server_unrefp) sd_dhcp_server *server = NULL, *server2 = NULL;
+        char lease_file[] = "/tmp/test-dhcp-server-leases.XXXXXX";
+        struct in_addr address_lo = {
+                .s_addr = htonl(INADDR_LOOPBACK),
+        };
+        DHCPLease *lease;
+        uint32_t i;
+        int fd;
+
+        fd = mkostemp_safe(lease_file);
+        assert_se(fd >= 0);
+        safe_close(fd);
+
+        assert_se(sd_dhcp_server_new(&server, 1) >= 0);
+        assert_se(sd_dhcp_server_configure_pool(server, &address_lo, 24, 0, 0) >= 0);
+        assert_se(sd_dhcp_server_attach_event(server, NULL, 0) >= 0);
+        assert_se(sd_dhcp_server_set_lease_file(server, lease_file) > 0);
+        assert_se(sd_dhcp_server_start(server) >= 0);
+
+        /* the server's own address is reserved */
+        assert_se(server->n_used == 1);
+
+        for (i = 0; i < 10; i++)
+                assert_se(test_exchange(server, i, htobe32(INADDR_LOOPBACK + 2 + i)) == DHCP_ACK);
+        assert_se(hashmap_size(server->leases_by_client_id) == 10);
+        assert_se(server->n_used == 11);
+
+        /* an address that is already taken is not handed out to somebody else */
+        assert_se(test_exchange(server, 100, htobe32(INADDR_LOOPBACK + 2)) == 0);
+
+        /* let the first lease expire, the next message drops it */
+        lease = server->bound_leases[2];
+        assert_se(lease && lease->address == htobe32(INADDR_LOOPBACK + 2));
+        lease->expiration = 1;
+        assert_se(prioq_reshuffle(server->leases_by_expiration, lease, &lease->expiration_idx) > 0);
+        assert_se(test_exchange(server, 100, htobe32(INADDR_LOOPBACK + 2)) == DHCP_ACK);
+        assert_se(hashmap_size(server->leases_by_client_id) == 10);
+        assert_se(server->n_used == 11);
+
+        assert_se(server->leases_dirty);
+        assert_se(sd_dhcp_server_stop(server) >= 0);
+        assert_se(!server->leases_dirty);
+
+        /* a new instance picks up where the old one left off */
+        assert_se(sd_dhcp_server_new(&server2, 1) >= 0);
+        assert_se(sd_dhcp_server_configure_pool(server2, &address_lo, 24, 0, 0) >= 0);
+        assert_se(sd_dhcp_server_attach_event(server2, NULL, 0) >= 0);
+        assert_se(sd_dhcp_server_set_lease_file(server2, lease_file) > 0);
+        assert_se(dhcp_server_load_leases(server2) == 10);
+        assert_se(server2->n_used == 11);
+
+        for (i = 1; i < 10; i++) {
+                lease = server2->bound_leases[2 + i];
+                assert_se(lease);
+                assert_se(lease->address == htobe32(INADDR_LOOPBACK + 2 + i));
+                assert_se(lease->chaddr[5] == i);
+        }
+
+        /* and leases outside of a changed pool are ignored */
+        assert_se(sd_dhcp_server_configure_pool(server2, &address_lo, 24, 5, 0) >= 0);
+        assert_se(hashmap_isempty(server2->leases_by_client_id));
+        assert_se(dhcp_server_load_leases(server2) == 8);
+
+        assert_se(sd_dhcp_server_set_lease_file(server2, NULL) > 0);
+        unlink_noerrno(lease_file);
+}
+
+static void test_pool_throughput(bool slow) {
+        _cleanup_(sd_dhcp_server_unrefp) sd_dhcp_server *server = NULL;
+        struct in_addr address_lo = {
+                .s_addr = htonl(INADDR_LOOPBACK),
+        };
+        char buf[FORMAT_TIMESPAN_MAX], buf2[FORMAT_TIMESPAN_MAX];
+        uint32_t i, n = slow ? 60000 : 2000;
+        usec_t t;
+
+        log_info("/* %s (%s) */", __func__, slow ? "slow" : "fast");
+
+        /* a /16 pool, as used on VM host bridges */
+        assert_se(sd_dhcp_server_new(&server, 1) >= 0);
+        assert_se(sd_dhcp_server_configure_pool(server, &address_lo, 16, 0, 0) >= 0);
+        assert_se(sd_dhcp_server_attach_event(server, NULL, 0) >= 0);
+        assert_se(sd_dhcp_server_start(server) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++)
+                assert_se(test_exchange(server, i, htobe32(INADDR_LOOPBACK + 2 + i)) == DHCP_ACK);
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("%" PRIu32 " DISCOVER/REQUEST exchanges in %s (%s per exchange)",
+                 n, format_timespan(buf, sizeof(buf), t, 1), format_timespan(buf2, sizeof(buf2), t / n, 1));
+
+        assert_se(hashmap_size(server->leases_by_client_id) == n);
+        assert_se(server->n_used == n + 1);
+}
+
 static uint64_t client_id_hash_helper(DHCPClientId *id, uint8_t key[HASH_KEY_SIZE]) {
         struct siphash state;
 
@@ -227,6 +378,7 @@ static void test_client_id_hash(void) {
 
 int main(int argc, char *argv[]) {
         _cleanup_(sd_event_unrefp) sd_event *e;
+        bool slow;
         int r;
 
         log_set_max_level(LOG_DEBUG);
@@ -239,7 +391,12 @@ int main(int argc, char *argv[]) {
         if (r != 0)
                 return r;
 
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+
         test_message_handler();
+        test_leases();
+        test_pool_throughput(slow);
         test_client_id_hash();
 
         return 0;
@@ -15,6 +15,7 @@
 #include "lldp-network.h"
 #include "macro.h"
 #include "string-util.h"
+#include "time-util.h"
 
 #define TEST_LLDP_PORT "em1"
 #define TEST_LLDP_TYPE_SYSTEM_NAME "systemd-lldp"
@@ -30,6 +31,10 @@ int lldp_network_bind_raw_socket(int ifindex) {
         return test_fd[0];
 }
 
+int lldp_network_set_membership(int fd, int ifindex, bool add) {
+        return 0;
+}
+
 static void lldp_handler(sd_lldp *lldp, sd_lldp_event event, sd_lldp_neighbor *n, void *userdata) {
         lldp_handler_calls++;
 }
@@ -229,6 +234,67 @@ static void test_receive_oui_packet(sd_event *e) {
         assert_se(stop_lldp(lldp) == 0);
 }
 
+static void lldp_count_handler(sd_lldp *lldp, sd_lldp_event event, sd_lldp_neighbor *n, void *userdata) {
+        unsigned *counters = userdata;
+
+        counters[(uint8_t) event]++;
+}
+
+static void test_receive_refreshes(sd_event *e) {
+        uint8_t frame[] = {
+                /* Ethernet header */
+                0x01, 0x80, 0xc2, 0x00, 0x00, 0x03,     /* Destination MAC */
+                0x01, 0x02, 0x03, 0x04, 0x05, 0x06,     /* Source MAC */
+                0x88, 0xcc,                             /* Ethertype */
+                /* LLDP mandatory TLVs */
+                0x02, 0x07, 0x04, 0x00, 0x01, 0x02,     /* Chassis: MAC, 00:01:02:03:04:xx */
+                0x03, 0x04, 0x00,
+                0x04, 0x04, 0x05, 0x31, 0x2f, 0x33,     /* Port: interface name, "1/3" */
+                0x06, 0x02, 0x00, 0x78,                 /* TTL: 120 seconds */
+                0x00, 0x00                              /* End Of LLDPDU */
+        };
+        unsigned counters[UINT8_MAX + 1] = {}, i, k, n_neighbors = 64, n_rounds = 100;
+        char buf[FORMAT_TIMESPAN_MAX];
+        sd_lldp *lldp;
+        usec_t t;
+
+        /* Neighbors resending the same data at a high rate must only restart their TTL, so that users can
+         * tell that nothing changed */
+
+        assert_se(start_lldp(&lldp, e, lldp_count_handler, counters) == 0);
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n_rounds; i++) {
+                for (k = 0; k < n_neighbors; k++) {
+                        frame[22] = k;
+                        assert_se(write(test_fd[1], frame, sizeof(frame)) == sizeof(frame));
+                }
+
+                while (sd_event_run(e, 0) > 0)
+                        ;
+        }
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("%u frames from %u neighbors processed in %s",
+                 n_rounds * n_neighbors, n_neighbors, format_timespan(buf, sizeof(buf), t, 1));
+
+        assert_se(counters[SD_LLDP_EVENT_ADDED] == n_neighbors);
+        assert_se(counters[SD_LLDP_EVENT_REFRESHED] == n_neighbors * (n_rounds - 1));
+        assert_se(counters[SD_LLDP_EVENT_UPDATED] == 0);
+        assert_se(counters[SD_LLDP_EVENT_REMOVED] == 0);
+
+        /* Anything else changing, even just the advertised TTL, is an update */
+        frame[22] = 0;
+        frame[32] = 0x79;
+        assert_se(write(test_fd[1], frame, sizeof(frame)) == sizeof(frame));
+        while (sd_event_run(e, 0) > 0)
+                ;
+
+        assert_se(counters[SD_LLDP_EVENT_UPDATED] == 1);
+
+        assert_se(stop_lldp(lldp) == 0);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(sd_event_unrefp) sd_event *e = NULL;
 
@@ -239,6 +305,7 @@ int main(int argc, char *argv[]) {
         test_receive_basic_packet(e);
         test_receive_incomplete_packet(e);
         test_receive_oui_packet(e);
+        test_receive_refreshes(e);
 
         return 0;
 }
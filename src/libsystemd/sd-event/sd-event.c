@@ -236,6 +236,11 @@ struct inotify_data {
          * the events locally if they can't be coalesced). */
         unsigned n_pending;
 
+        /* If this counter is non-zero, don't GC the inotify data object even if not used to watch any inode
+         * anymore. This is useful to pin the object for a bit longer, after the last event source needing it is
+         * gone. */
+        unsigned n_busy;
+
         /* A linked list of all inotify objects with data already read, that still need processing. We keep this list
          * to make it efficient to figure out what inotify objects to process data on next. */
         LIST_FIELDS(struct inotify_data, buffered);
@@ -1692,6 +1697,26 @@ static void event_free_inode_data(
         free(d);
 }
 
+static void event_gc_inotify_data(
+                sd_event *e,
+                struct inotify_data *d) {
+
+        assert(e);
+
+        /* Collects the inotify object if no inode object is left anymore and nobody is still using it */
+
+        if (!d)
+                return;
+
+        if (!hashmap_isempty(d->inodes))
+                return;
+
+        if (d->n_busy > 0)
+                return;
+
+        event_free_inotify_data(e, d);
+}
+
 static void event_gc_inode_data(
                 sd_event *e,
                 struct inode_data *d) {
@@ -1709,8 +1734,7 @@ static void event_gc_inode_data(
         inotify_data = d->inotify_data;
         event_free_inode_data(e, d);
 
-        if (inotify_data && hashmap_isempty(inotify_data->inodes))
-                event_free_inotify_data(e, inotify_data);
+        event_gc_inotify_data(e, inotify_data);
 }
 
 static int event_make_inode_data(
@@ -1793,6 +1817,22 @@ static uint32_t inode_data_determine_mask(struct inode_data *d) {
         return (combined & ~(IN_ONESHOT|IN_DONT_FOLLOW|IN_ONLYDIR|IN_EXCL_UNLINK)) | (excl_unlink ? IN_EXCL_UNLINK : 0);
 }
 
+static bool inode_data_covers_mask(struct inode_data *d, uint32_t mask) {
+        assert(d);
+
+        /* Checks whether the watch we already have on the inode includes everything the specified mask asks for. In
+         * that case adding an event source with this mask doesn't require recalculating the combined mask of all
+         * event sources on the inode, which gets expensive if there are many of them. */
+
+        if (d->wd < 0)
+                return false;
+
+        if ((d->combined_mask & IN_EXCL_UNLINK) && !(mask & IN_EXCL_UNLINK))
+                return false;
+
+        return (mask & ~(IN_ONESHOT|IN_DONT_FOLLOW|IN_ONLYDIR|IN_EXCL_UNLINK) & ~d->combined_mask) == 0;
+}
+
 static int inode_data_realize_watch(sd_event *e, struct inode_data *d) {
         uint32_t combined_mask;
         int wd, r;
@@ -1904,10 +1944,12 @@ _public_ int sd_event_add_inotify(
 
         rm_inode = rm_inotify = false;
 
-        /* Actually realize the watch now */
-        r = inode_data_realize_watch(e, inode_data);
-        if (r < 0)
-                goto fail;
+        /* Actually realize the watch now, unless the inode is watched with a suitable mask already */
+        if (!inode_data_covers_mask(inode_data, mask)) {
+                r = inode_data_realize_watch(e, inode_data);
+                if (r < 0)
+                        goto fail;
+        }
 
         (void) sd_event_source_set_description(s, path);
 
@@ -3153,13 +3195,21 @@ static int source_dispatch(sd_event_source *s) {
                 sz = offsetof(struct inotify_event, name) + d->buffer.ev.len;
                 assert(d->buffer_filled >= sz);
 
+                /* If the callback destroys the event source, it likely doesn't need the inode watched anymore,
+                 * and hence the inotify object might not be needed anymore either. But if it was freed right
+                 * away we couldn't drop the event from its buffer below anymore. Hence pin it while the
+                 * callback runs, and collect it afterwards. */
+                d->n_busy++;
                 r = s->inotify.callback(s, &d->buffer.ev, s->userdata);
+                d->n_busy--;
 
                 /* When no event is pending anymore on this inotify object, then let's drop the event from the
                  * buffer. */
                 if (d->n_pending == 0)
                         event_inotify_data_drop(e, d, sz);
 
+                /* Now we don't access 'd' anymore, it's OK to collect it */
+                event_gc_inotify_data(e, d);
                 break;
         }
 
@@ -482,6 +482,43 @@ static void test_inotify(unsigned n_create_events) {
         sd_event_unref(e);
 }
 
+static int inotify_self_destroy_handler(sd_event_source *s, const struct inotify_event *ev, void *userdata) {
+        sd_event_source **p = userdata;
+
+        assert_se(ev);
+        assert_se(p);
+        assert_se(*p == s);
+
+        assert_se(FLAGS_SET(ev->mask, IN_ATTRIB));
+
+        assert_se(sd_event_exit(sd_event_source_get_event(s), 0) >= 0);
+
+        *p = sd_event_source_unref(*p); /* here's what we actually intend to test: we destroy the event
+                                         * source from inside the event source handler */
+        return 1;
+}
+
+static void test_inotify_self_destroy(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *p = NULL;
+        sd_event_source *s = NULL;
+        sd_event *e = NULL;
+
+        /* Make sure that an inotify event source can be destroyed from its own handler, even if it is the last
+         * one using the inotify object */
+
+        assert_se(sd_event_default(&e) >= 0);
+
+        assert_se(mkdtemp_malloc("/tmp/test-inotify-XXXXXX", &p) >= 0);
+
+        assert_se(sd_event_add_inotify(e, &s, p, IN_ATTRIB, inotify_self_destroy_handler, &s) >= 0);
+        assert_se(chmod(p, 0700) >= 0);
+
+        assert_se(sd_event_loop(e) >= 0);
+        assert_se(!s);
+
+        sd_event_unref(e);
+}
+
 int main(int argc, char *argv[]) {
 
         log_set_max_level(LOG_DEBUG);
@@ -494,5 +531,7 @@ int main(int argc, char *argv[]) {
         test_inotify(100); /* should work without overflow */
         test_inotify(33000); /* should trigger a q overflow */
 
+        test_inotify_self_destroy();
+
         return 0;
 }
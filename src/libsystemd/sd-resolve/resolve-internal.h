@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include "sd-resolve.h"
+
+#include "time-util.h"
+
+/* Answer getaddrinfo() queries from a small cache of earlier successful responses for at most the specified
+ * time. Zero disables and flushes the cache, which is the default. */
+int resolve_set_cache_timeout(sd_resolve *resolve, usec_t usec);
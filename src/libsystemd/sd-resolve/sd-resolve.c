@@ -19,10 +19,15 @@
 #include "alloc-util.h"
 #include "dns-domain.h"
 #include "fd-util.h"
+#include "hashmap.h"
 #include "io-util.h"
 #include "list.h"
+#include "log.h"
 #include "missing.h"
+#include "resolve-internal.h"
 #include "socket-util.h"
+#include "string-util.h"
+#include "time-util.h"
 #include "util.h"
 #include "process-util.h"
 
@@ -30,6 +35,7 @@
 #define WORKERS_MAX 16U
 #define QUERIES_MAX 256U
 #define BUFSIZE 10240U
+#define CACHE_MAX 64U
 
 typedef enum {
         REQUEST_ADDRINFO,
@@ -37,7 +43,8 @@ typedef enum {
         REQUEST_NAMEINFO,
         RESPONSE_NAMEINFO,
         REQUEST_TERMINATE,
-        RESPONSE_DIED
+        RESPONSE_DIED,
+        RESPONSE_ADDRINFO_CACHED,
 } QueryType;
 
 enum {
@@ -72,6 +79,14 @@ struct sd_resolve {
         pid_t tid;
 
         LIST_HEAD(sd_resolve_query, queries);
+
+        /* Successful getaddrinfo() responses, keyed by request, in insertion order. Disabled if the
+         * timeout is zero. */
+        OrderedHashmap *cache;
+        usec_t cache_timeout;
+
+        unsigned n_completed, n_cache_hits;
+        usec_t latency_total, latency_max;
 };
 
 struct sd_resolve_query {
@@ -90,6 +105,9 @@ struct sd_resolve_query {
         struct addrinfo *addrinfo;
         char *serv, *host;
 
+        usec_t submitted;
+        char *cache_key;
+
         union {
                 sd_resolve_getaddrinfo_handler_t getaddrinfo_handler;
                 sd_resolve_getnameinfo_handler_t getnameinfo_handler;
@@ -149,6 +167,13 @@ typedef struct NameInfoResponse {
         int _h_errno;
 } NameInfoResponse;
 
+typedef struct CacheEntry {
+        char *key;
+        usec_t until;
+        size_t length;
+        uint8_t packet[]; /* AddrInfoResponse followed by addrinfo_serialization[] */
+} CacheEntry;
+
 typedef union Packet {
         RHeader rheader;
         AddrInfoRequest addrinfo_request;
@@ -543,6 +568,35 @@ _public_ int sd_resolve_get_tid(sd_resolve *resolve, pid_t *tid) {
         return -ENXIO;
 }
 
+static CacheEntry *cache_entry_free(CacheEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->key);
+        return mfree(e);
+}
+
+static void resolve_cache_flush(sd_resolve *resolve) {
+        CacheEntry *e;
+
+        assert(resolve);
+
+        while ((e = ordered_hashmap_steal_first(resolve->cache)))
+                cache_entry_free(e);
+}
+
+int resolve_set_cache_timeout(sd_resolve *resolve, usec_t usec) {
+        assert_return(resolve, -EINVAL);
+        assert_return(!resolve_pid_changed(resolve), -ECHILD);
+
+        resolve->cache_timeout = usec;
+
+        if (usec == 0)
+                resolve_cache_flush(resolve);
+
+        return 0;
+}
+
 static void resolve_free(sd_resolve *resolve) {
         PROTECT_ERRNO;
         sd_resolve_query *q;
@@ -582,6 +636,18 @@ static void resolve_free(sd_resolve *resolve) {
 
         /* Close all communication channels */
         close_many(resolve->fds, _FD_MAX);
+
+        resolve_cache_flush(resolve);
+        ordered_hashmap_free(resolve->cache);
+
+        if (resolve->n_completed > 0)
+                log_debug("sd-resolve: %u queries completed, %u answered from cache, latency average %s, maximum %s.",
+                          resolve->n_completed, resolve->n_cache_hits,
+                          format_timespan((char[FORMAT_TIMESPAN_MAX]) {}, FORMAT_TIMESPAN_MAX,
+                                          resolve->latency_total / resolve->n_completed, USEC_PER_MSEC),
+                          format_timespan((char[FORMAT_TIMESPAN_MAX]) {}, FORMAT_TIMESPAN_MAX,
+                                          resolve->latency_max, USEC_PER_MSEC));
+
         free(resolve);
 }
 
@@ -653,6 +719,15 @@ static int complete_query(sd_resolve *resolve, sd_resolve_query *q) {
         q->done = true;
         resolve->n_done++;
 
+        if (q->submitted > 0) {
+                usec_t latency;
+
+                latency = usec_sub_unsigned(now(CLOCK_MONOTONIC), q->submitted);
+                resolve->n_completed++;
+                resolve->latency_total += latency;
+                resolve->latency_max = MAX(resolve->latency_max, latency);
+        }
+
         resolve->current = sd_resolve_query_ref(q);
 
         switch (q->type) {
@@ -734,6 +809,101 @@ static int unserialize_addrinfo(const void **p, size_t *length, struct addrinfo
         return 0;
 }
 
+static char *addrinfo_cache_key(const char *node, const char *service, const struct addrinfo *hints) {
+        char *k;
+
+        /* Length-prefix the strings, so that no combination of node and service can collide with another. A
+         * NULL string gets length -1, so that it is distinct from the empty string. */
+        if (asprintf(&k, "%i:%i:%i:%i:%i:%zi:%s:%zi:%s",
+                     !!hints,
+                     hints ? hints->ai_flags : 0,
+                     hints ? hints->ai_family : 0,
+                     hints ? hints->ai_socktype : 0,
+                     hints ? hints->ai_protocol : 0,
+                     node ? (ssize_t) strlen(node) : -1, strempty(node),
+                     service ? (ssize_t) strlen(service) : -1, strempty(service)) < 0)
+                return NULL;
+
+        return k;
+}
+
+static void resolve_cache_add(sd_resolve *resolve, const char *key, const Packet *packet, size_t length) {
+        CacheEntry *e;
+
+        assert(resolve);
+        assert(key);
+        assert(packet);
+        assert(length >= sizeof(AddrInfoResponse));
+
+        /* The cache is purely an optimization, hence failing to add something to it is not an error. */
+
+        if (resolve->cache_timeout == 0)
+                return;
+
+        if (ordered_hashmap_ensure_allocated(&resolve->cache, &string_hash_ops) < 0)
+                return;
+
+        /* Drop a previous entry for the same request, and then the oldest entries until there's room */
+        cache_entry_free(ordered_hashmap_remove(resolve->cache, key));
+        while (ordered_hashmap_size(resolve->cache) >= CACHE_MAX)
+                cache_entry_free(ordered_hashmap_steal_first(resolve->cache));
+
+        e = malloc(offsetof(CacheEntry, packet) + length);
+        if (!e)
+                return;
+
+        e->key = strdup(key);
+        if (!e->key) {
+                free(e);
+                return;
+        }
+
+        e->until = usec_add(now(CLOCK_MONOTONIC), resolve->cache_timeout);
+        e->length = length;
+        memcpy(e->packet, packet, length);
+
+        if (ordered_hashmap_put(resolve->cache, e->key, e) < 0)
+                cache_entry_free(e);
+}
+
+static int resolve_cache_reply(sd_resolve *resolve, sd_resolve_query *q) {
+        AddrInfoResponse resp;
+        struct iovec iov[2];
+        struct msghdr mh;
+        CacheEntry *e;
+
+        assert(resolve);
+        assert(q);
+        assert(q->cache_key);
+
+        e = ordered_hashmap_get(resolve->cache, q->cache_key);
+        if (!e)
+                return 0;
+
+        if (e->until <= now(CLOCK_MONOTONIC)) {
+                cache_entry_free(ordered_hashmap_remove(resolve->cache, q->cache_key));
+                return 0;
+        }
+
+        /* Queue the cached response under the new query's id, so that it is dispatched through
+         * sd_resolve_process() like any other, and the callback is never invoked from within
+         * sd_resolve_getaddrinfo() itself. We are the only reader of the other end, hence never block
+         * here: if the socket is full of responses from the workers, let a worker answer this one. */
+        memcpy(&resp, e->packet, sizeof(resp));
+        resp.header.type = RESPONSE_ADDRINFO_CACHED;
+        resp.header.id = q->id;
+
+        iov[0] = IOVEC_MAKE(&resp, sizeof(resp));
+        iov[1] = IOVEC_MAKE(e->packet + sizeof(resp), e->length - sizeof(resp));
+        mh = (struct msghdr) { .msg_iov = iov, .msg_iovlen = ELEMENTSOF(iov) };
+
+        if (sendmsg(resolve->fds[RESPONSE_SEND_FD], &mh, MSG_NOSIGNAL|MSG_DONTWAIT) < 0)
+                return errno == EAGAIN ? 0 : -errno;
+
+        resolve->n_cache_hits++;
+        return 1;
+}
+
 static int handle_response(sd_resolve *resolve, const Packet *packet, size_t length) {
         const RHeader *resp;
         sd_resolve_query *q;
@@ -751,8 +921,11 @@ static int handle_response(sd_resolve *resolve, const Packet *packet, size_t len
                 return 0;
         }
 
-        assert(resolve->n_outstanding > 0);
-        resolve->n_outstanding--;
+        /* Replies from the cache were never handed to a worker */
+        if (resp->type != RESPONSE_ADDRINFO_CACHED) {
+                assert(resolve->n_outstanding > 0);
+                resolve->n_outstanding--;
+        }
 
         q = lookup_query(resolve, resp->id);
         if (!q)
@@ -760,7 +933,8 @@ static int handle_response(sd_resolve *resolve, const Packet *packet, size_t len
 
         switch (resp->type) {
 
-        case RESPONSE_ADDRINFO: {
+        case RESPONSE_ADDRINFO:
+        case RESPONSE_ADDRINFO_CACHED: {
                 const AddrInfoResponse *ai_resp = &packet->addrinfo_response;
                 const void *p;
                 size_t l;
@@ -793,6 +967,9 @@ static int handle_response(sd_resolve *resolve, const Packet *packet, size_t len
                         prev = ai;
                 }
 
+                if (resp->type == RESPONSE_ADDRINFO && q->cache_key && q->ret == 0)
+                        resolve_cache_add(resolve, q->cache_key, packet, length);
+
                 return complete_query(resolve, q);
         }
 
@@ -888,7 +1065,6 @@ _public_ int sd_resolve_wait(sd_resolve *resolve, uint64_t timeout_usec) {
 
 static int alloc_query(sd_resolve *resolve, bool floating, sd_resolve_query **_q) {
         sd_resolve_query *q;
-        int r;
 
         assert(resolve);
         assert(_q);
@@ -896,10 +1072,6 @@ static int alloc_query(sd_resolve *resolve, bool floating, sd_resolve_query **_q
         if (resolve->n_queries >= QUERIES_MAX)
                 return -ENOBUFS;
 
-        r = start_threads(resolve, 1);
-        if (r < 0)
-                return r;
-
         while (resolve->query_array[resolve->current_id % QUERIES_MAX])
                 resolve->current_id++;
 
@@ -911,6 +1083,7 @@ static int alloc_query(sd_resolve *resolve, bool floating, sd_resolve_query **_q
         q->resolve = resolve;
         q->floating = floating;
         q->id = resolve->current_id++;
+        q->submitted = now(CLOCK_MONOTONIC);
 
         if (!floating)
                 sd_resolve_ref(resolve);
@@ -949,6 +1122,23 @@ _public_ int sd_resolve_getaddrinfo(
         q->getaddrinfo_handler = callback;
         q->userdata = userdata;
 
+        if (resolve->cache_timeout > 0) {
+                q->cache_key = addrinfo_cache_key(node, service, hints);
+                if (!q->cache_key)
+                        return -ENOMEM;
+
+                r = resolve_cache_reply(resolve, q);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        goto finish;
+        }
+
+        /* Only size up the worker pool for queries that actually need one */
+        r = start_threads(resolve, 1);
+        if (r < 0)
+                return r;
+
         node_len = node ? strlen(node) + 1 : 0;
         service_len = service ? strlen(service) + 1 : 0;
 
@@ -979,6 +1169,7 @@ _public_ int sd_resolve_getaddrinfo(
 
         resolve->n_outstanding++;
 
+finish:
         if (_q)
                 *_q = q;
         TAKE_PTR(q);
@@ -1028,6 +1219,10 @@ _public_ int sd_resolve_getnameinfo(
         q->getnameinfo_handler = callback;
         q->userdata = userdata;
 
+        r = start_threads(resolve, 1);
+        if (r < 0)
+                return r;
+
         req = (NameInfoRequest) {
                 .header.id = q->id,
                 .header.type = REQUEST_NAMEINFO,
@@ -1124,6 +1319,7 @@ static void resolve_query_free(sd_resolve_query *q) {
         resolve_freeaddrinfo(q->addrinfo);
         free(q->host);
         free(q->serv);
+        free(q->cache_key);
         free(q);
 }
 
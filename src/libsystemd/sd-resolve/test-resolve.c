@@ -15,8 +15,10 @@
 
 #include "alloc-util.h"
 #include "macro.h"
+#include "resolve-internal.h"
 #include "socket-util.h"
 #include "string-util.h"
+#include "time-util.h"
 
 #define TEST_TIMEOUT_USEC (20*USEC_PER_SEC)
 
@@ -54,6 +56,88 @@ static int getnameinfo_handler(sd_resolve_query *q, int ret, const char *host, c
         return 0;
 }
 
+static int counting_handler(sd_resolve_query *q, int ret, const struct addrinfo *ai, void *userdata) {
+        unsigned *n = userdata;
+
+        assert_se(ret == 0);
+        assert_se(ai);
+        assert_se(IN_SET(ai->ai_family, AF_INET, AF_INET6));
+
+        (*n)++;
+        return 0;
+}
+
+static usec_t resolve_localhost_many(unsigned n, usec_t cache_timeout) {
+        _cleanup_(sd_resolve_unrefp) sd_resolve *resolve = NULL;
+        struct addrinfo hints = {
+                .ai_family = AF_INET,
+                .ai_socktype = SOCK_STREAM,
+        };
+        unsigned i, n_done = 0;
+        usec_t start;
+
+        assert_se(sd_resolve_new(&resolve) >= 0);
+        assert_se(resolve_set_cache_timeout(resolve, cache_timeout) >= 0);
+
+        /* "localhost" is answered locally by NSS, hence this measures the overhead of the resolver itself */
+        start = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++) {
+                assert_se(sd_resolve_getaddrinfo(resolve, NULL, "localhost", "http", &hints, counting_handler, &n_done) >= 0);
+
+                while (n_done <= i)
+                        assert_se(sd_resolve_wait(resolve, TEST_TIMEOUT_USEC) >= 0);
+        }
+
+        assert_se(n_done == n);
+        return usec_sub_unsigned(now(CLOCK_MONOTONIC), start);
+}
+
+static int result_handler(sd_resolve_query *q, int ret, const struct addrinfo *ai, void *userdata) {
+        int *result = userdata;
+
+        *result = ret;
+        return 0;
+}
+
+static int resolve_one(sd_resolve *resolve, const char *node, const char *service, const struct addrinfo *hints) {
+        int result = INT_MAX;
+
+        assert_se(sd_resolve_getaddrinfo(resolve, NULL, node, service, hints, result_handler, &result) >= 0);
+        while (result == INT_MAX)
+                assert_se(sd_resolve_wait(resolve, TEST_TIMEOUT_USEC) >= 0);
+
+        return result;
+}
+
+static void test_cache_key(void) {
+        _cleanup_(sd_resolve_unrefp) sd_resolve *resolve = NULL;
+        struct addrinfo hints = {
+                .ai_flags = AI_PASSIVE,
+                .ai_family = AF_INET,
+                .ai_socktype = SOCK_STREAM,
+        };
+
+        assert_se(sd_resolve_new(&resolve) >= 0);
+        assert_se(resolve_set_cache_timeout(resolve, USEC_PER_MINUTE) >= 0);
+
+        /* Without a node the wildcard address is returned, while an empty node is an error. Hence the latter
+         * must not be answered from the cached response to the former. */
+        assert_se(resolve_one(resolve, NULL, "http", &hints) == 0);
+        assert_se(resolve_one(resolve, "", "http", &hints) != 0);
+        assert_se(resolve_one(resolve, NULL, "http", &hints) == 0);
+}
+
+static void test_cache(void) {
+        char buf[FORMAT_TIMESPAN_MAX];
+        usec_t t;
+
+        t = resolve_localhost_many(1000, 0);
+        log_info("1000 lookups without cache: %s", format_timespan(buf, sizeof buf, t, USEC_PER_MSEC));
+
+        t = resolve_localhost_many(1000, USEC_PER_MINUTE);
+        log_info("1000 lookups with cache: %s", format_timespan(buf, sizeof buf, t, USEC_PER_MSEC));
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(sd_resolve_query_unrefp) sd_resolve_query *q1 = NULL, *q2 = NULL;
         _cleanup_(sd_resolve_unrefp) sd_resolve *resolve = NULL;
@@ -70,6 +154,9 @@ int main(int argc, char *argv[]) {
                 .sin_port = htons(80)
         };
 
+        test_cache();
+        test_cache_key();
+
         assert_se(sd_resolve_default(&resolve) >= 0);
 
         /* Test a floating resolver query */
@@ -469,6 +469,9 @@ static int link_new(Manager *manager, sd_netlink_message *message, Link **ret) {
         if (asprintf(&link->lease_file, "/run/systemd/netif/leases/%d", link->ifindex) < 0)
                 return -ENOMEM;
 
+        if (asprintf(&link->dhcp_server_lease_file, "/run/systemd/netif/dhcp-server-leases/%d", link->ifindex) < 0)
+                return -ENOMEM;
+
         if (asprintf(&link->lldp_file, "/run/systemd/netif/lldp/%d", link->ifindex) < 0)
                 return -ENOMEM;
 
@@ -519,9 +522,11 @@ static void link_free(Link *link) {
         link_lldp_emit_stop(link);
 
         free(link->lease_file);
+        free(link->dhcp_server_lease_file);
 
         sd_lldp_unref(link->lldp);
         free(link->lldp_file);
+        free(link->lldp_saved);
 
         ndisc_flush(link);
 
@@ -1533,10 +1538,19 @@ static int link_bond_set(Link *link) {
         return r;
 }
 
+static void link_lldp_forget_saved(Link *link) {
+        assert(link);
+
+        link->lldp_saved = mfree(link->lldp_saved);
+        link->lldp_saved_size = 0;
+        link->lldp_saved_valid = false;
+}
+
 static int link_lldp_save(Link *link) {
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *temp_path = NULL, *buf = NULL;
         _cleanup_fclose_ FILE *f = NULL;
         sd_lldp_neighbor **l = NULL;
+        size_t size = 0;
         int n = 0, r, i;
 
         assert(link);
@@ -1544,24 +1558,24 @@ static int link_lldp_save(Link *link) {
 
         if (!link->lldp) {
                 (void) unlink(link->lldp_file);
+                link_lldp_forget_saved(link);
                 return 0;
         }
 
         r = sd_lldp_get_neighbors(link->lldp, &l);
         if (r < 0)
                 goto finish;
-        if (r == 0) {
-                (void) unlink(link->lldp_file);
-                goto finish;
-        }
 
         n = r;
 
-        r = fopen_temporary(link->lldp_file, &f, &temp_path);
-        if (r < 0)
+        /* Serialize into memory first, and only touch the file if that differs from what we wrote last
+         * time. Neighbors are sorted by their ID, hence the result is stable as long as none of them
+         * changed. */
+        f = open_memstream(&buf, &size);
+        if (!f) {
+                r = -ENOMEM;
                 goto finish;
-
-        fchmod(fileno(f), 0644);
+        }
 
         for (i = 0; i < n; i++) {
                 const void *p;
@@ -1581,17 +1595,48 @@ static int link_lldp_save(Link *link) {
         if (r < 0)
                 goto finish;
 
-        if (rename(temp_path, link->lldp_file) < 0) {
-                r = -errno;
+        f = safe_fclose(f);
+
+        if (link->lldp_saved_valid &&
+            link->lldp_saved_size == size &&
+            memcmp_safe(link->lldp_saved, buf, size) == 0) {
+                r = 0;
                 goto finish;
         }
 
+        if (n == 0)
+                (void) unlink(link->lldp_file);
+        else {
+                r = fopen_temporary(link->lldp_file, &f, &temp_path);
+                if (r < 0)
+                        goto finish;
+
+                fchmod(fileno(f), 0644);
+
+                (void) fwrite(buf, 1, size, f);
+
+                r = fflush_and_check(f);
+                if (r < 0)
+                        goto finish;
+
+                if (rename(temp_path, link->lldp_file) < 0) {
+                        r = -errno;
+                        goto finish;
+                }
+        }
+
+        free_and_replace(link->lldp_saved, buf);
+        link->lldp_saved_size = size;
+        link->lldp_saved_valid = true;
+
 finish:
         if (r < 0) {
                 (void) unlink(link->lldp_file);
                 if (temp_path)
                         (void) unlink(temp_path);
 
+                link_lldp_forget_saved(link);
+
                 log_link_error_errno(link, r, "Failed to save LLDP data to %s: %m", link->lldp_file);
         }
 
@@ -1610,7 +1655,10 @@ static void lldp_handler(sd_lldp *lldp, sd_lldp_event event, sd_lldp_neighbor *n
 
         assert(link);
 
-        (void) link_lldp_save(link);
+        /* A neighbor that just sent the same data again only had its TTL restarted, which doesn't show in
+         * the file. */
+        if (event != SD_LLDP_EVENT_REFRESHED)
+                (void) link_lldp_save(link);
 
         if (link_lldp_emit_enabled(link) && event == SD_LLDP_EVENT_ADDED) {
                 /* If we received information about a new neighbor, restart the LLDP "fast" logic */
@@ -2258,6 +2306,12 @@ void link_drop(Link *link) {
         log_link_debug(link, "Link removed");
 
         (void)unlink(link->state_file);
+
+        /* The interface is gone, so are the clients our DHCP server handed out leases to */
+        if (link->dhcp_server) {
+                (void) sd_dhcp_server_set_lease_file(link->dhcp_server, NULL);
+                (void) unlink(link->dhcp_server_lease_file);
+        }
         link_unref(link);
 
         return;
@@ -2808,6 +2862,10 @@ static int link_configure(Link *link) {
                 r = sd_dhcp_server_attach_event(link->dhcp_server, NULL, 0);
                 if (r < 0)
                         return r;
+
+                r = sd_dhcp_server_set_lease_file(link->dhcp_server, link->dhcp_server_lease_file);
+                if (r < 0)
+                        return r;
         }
 
         if (link_dhcp6_enabled(link) ||
@@ -2838,6 +2896,10 @@ static int link_configure(Link *link) {
                 if (r < 0)
                         return r;
 
+                r = sd_lldp_set_shared_socket(link->lldp, true);
+                if (r < 0)
+                        return r;
+
                 r = sd_lldp_match_capabilities(link->lldp,
                                                link->network->lldp_mode == LLDP_MODE_ROUTERS_ONLY ?
                                                SD_LLDP_SYSTEM_CAPABILITIES_ALL_ROUTERS :
@@ -83,6 +83,7 @@ typedef struct Link {
         sd_dhcp_client *dhcp_client;
         sd_dhcp_lease *dhcp_lease;
         char *lease_file;
+        char *dhcp_server_lease_file;
         uint32_t original_mtu;
         unsigned dhcp4_messages;
         bool dhcp4_configured;
@@ -115,6 +116,9 @@ typedef struct Link {
         /* This is about LLDP reception */
         sd_lldp *lldp;
         char *lldp_file;
+        char *lldp_saved; /* what was last written to lldp_file */
+        size_t lldp_saved_size;
+        bool lldp_saved_valid;
 
         /* This is about LLDP transmission */
         unsigned lldp_tx_fast; /* The LLDP txFast counter (See 802.1ab-2009, section 9.2.5.18) */
@@ -14,6 +14,7 @@
 #include "nspawn-mount.h"
 #include "parse-util.h"
 #include "path-util.h"
+#include "process-util.h"
 #include "rm-rf.h"
 #include "set.h"
 #include "stat-util.h"
@@ -1385,6 +1386,119 @@ fail:
         return r;
 }
 
+int overlayfs_supported(void) {
+        _cleanup_fclose_ FILE *f = NULL;
+        int r;
+
+        /* Checks whether overlayfs is available. Note that we don't try to load the module here, hence this might
+         * return false if the kernel would in fact load it on first use. */
+
+        f = fopen("/proc/filesystems", "re");
+        if (!f)
+                return -errno;
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL;
+                const char *p;
+
+                r = read_line(f, LONG_LINE_MAX, &line);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return false;
+
+                p = strchr(line, '\t');
+                if (p && streq(p + 1, "overlay"))
+                        return true;
+        }
+}
+
+int setup_ephemeral_overlay(const char *directory, const char *scratch) {
+        const char *upper, *work;
+        struct stat st;
+
+        assert(directory);
+        assert(scratch);
+
+        /* Prepares the upper and work directories for an overlayfs based ephemeral container in the scratch
+         * directory. The root directory of an overlayfs mount inherits ownership and access mode from the upper
+         * directory, hence copy them from the original root directory. */
+
+        if (stat(directory, &st) < 0)
+                return log_error_errno(errno, "Failed to stat %s: %m", directory);
+
+        if (mkdir(scratch, 0700) < 0)
+                return log_error_errno(errno, "Failed to create %s: %m", scratch);
+
+        upper = prefix_roota(scratch, "/upper");
+        if (mkdir(upper, 0755) < 0)
+                return log_error_errno(errno, "Failed to create %s: %m", upper);
+
+        if (chown(upper, st.st_uid, st.st_gid) < 0)
+                return log_error_errno(errno, "Failed to change ownership of %s: %m", upper);
+
+        if (chmod(upper, st.st_mode & 07777) < 0)
+                return log_error_errno(errno, "Failed to change access mode of %s: %m", upper);
+
+        work = prefix_roota(scratch, "/work");
+        if (mkdir(work, 0700) < 0)
+                return log_error_errno(errno, "Failed to create %s: %m", work);
+
+        return 0;
+}
+
+static int mount_ephemeral_overlay_full(int level, const char *directory, const char *scratch) {
+        _cleanup_free_ char *escaped_lower = NULL, *escaped_upper = NULL, *escaped_work = NULL;
+        const char *options;
+
+        assert(directory);
+        assert(scratch);
+
+        /* Mounts an overlayfs on top of the root directory, with the original tree as the read-only lower layer and
+         * the upper layer in the scratch directory, so that all changes made by the container are discarded together
+         * with the scratch directory. This is much cheaper than copying the whole tree on file systems that cannot do
+         * snapshots. */
+
+        escaped_lower = shell_escape(directory, ",:");
+        escaped_upper = shell_escape(prefix_roota(scratch, "/upper"), ",:");
+        escaped_work = shell_escape(prefix_roota(scratch, "/work"), ",:");
+        if (!escaped_lower || !escaped_upper || !escaped_work)
+                return log_oom();
+
+        options = strjoina("lowerdir=", escaped_lower, ",upperdir=", escaped_upper, ",workdir=", escaped_work);
+
+        return mount_verbose(level, "overlay", directory, "overlay", 0, options);
+}
+
+int mount_ephemeral_overlay(const char *directory, const char *scratch) {
+        return mount_ephemeral_overlay_full(LOG_ERR, directory, scratch);
+}
+
+int probe_ephemeral_overlay(const char *directory, const char *scratch) {
+        int r;
+
+        assert(directory);
+        assert(scratch);
+
+        /* Checks whether mount_ephemeral_overlay() will work, by trying it in a throw-away mount namespace. Whether
+         * overlayfs accepts the upper and work directories depends on the file system they are on (it doesn't
+         * for example on overlayfs itself, or on XFS without d_type support), and once the container is being
+         * set up it is too late to fall back to copying the tree. */
+
+        r = safe_fork("(sd-overlay)", FORK_RESET_SIGNALS|FORK_DEATHSIG|FORK_WAIT|FORK_NEW_MOUNTNS|FORK_MOUNTNS_SLAVE, NULL);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                /* Child */
+                if (mount_ephemeral_overlay_full(LOG_DEBUG, directory, scratch) < 0)
+                        _exit(EXIT_FAILURE);
+
+                _exit(EXIT_SUCCESS);
+        }
+
+        return 0;
+}
+
 /* Expects *pivot_root_new and *pivot_root_old to be initialised to allocated memory or NULL. */
 int pivot_root_parse(char **pivot_root_new, char **pivot_root_old, const char *s) {
         _cleanup_free_ char *root_new = NULL, *root_old = NULL;
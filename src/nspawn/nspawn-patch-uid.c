@@ -2,18 +2,23 @@
 
 #include <fcntl.h>
 #include <linux/magic.h>
+#include <pthread.h>
 #if HAVE_ACL
 #include <sys/acl.h>
 #endif
 #include <sys/stat.h>
 #include <sys/statvfs.h>
 #include <sys/vfs.h>
+#include <sys/xattr.h>
 #include <unistd.h>
 
 #include "acl-util.h"
+#include "alloc-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
+#include "format-util.h"
 #include "fs-util.h"
+#include "list.h"
 #include "missing.h"
 #include "nspawn-def.h"
 #include "nspawn-patch-uid.h"
@@ -22,6 +27,7 @@
 #include "string-util.h"
 #include "strv.h"
 #include "user-util.h"
+#include "xattr-util.h"
 
 #if HAVE_ACL
 
@@ -162,21 +168,28 @@ static int shift_acl(acl_t acl, uid_t shift, acl_t *ret) {
         return !!*ret;
 }
 
-static int patch_acls(int fd, const char *name, const struct stat *st, uid_t shift) {
+static int patch_acls(int fd, const char *name, const struct stat *st, uid_t shift, bool *acls) {
         _cleanup_(acl_freep) acl_t acl = NULL, shifted = NULL;
         bool changed = false;
         int r;
 
         assert(fd >= 0);
         assert(st);
+        assert(acls);
 
         /* ACLs are not supported on symlinks, there's no point in trying */
         if (S_ISLNK(st->st_mode))
                 return 0;
 
+        /* If we already learnt that the file system doesn't do ACLs, don't bother with the syscalls */
+        if (!*acls)
+                return 0;
+
         r = get_acl(fd, name, ACL_TYPE_ACCESS, &acl);
-        if (r == -EOPNOTSUPP)
+        if (r == -EOPNOTSUPP) {
+                *acls = false;
                 return 0;
+        }
         if (r < 0)
                 return r;
 
@@ -218,13 +231,13 @@ static int patch_acls(int fd, const char *name, const struct stat *st, uid_t shi
 
 #else
 
-static int patch_acls(int fd, const char *name, const struct stat *st, uid_t shift) {
+static int patch_acls(int fd, const char *name, const struct stat *st, uid_t shift, bool *acls) {
         return 0;
 }
 
 #endif
 
-static int patch_fd(int fd, const char *name, const struct stat *st, uid_t shift) {
+static int patch_fd(int fd, const char *name, const struct stat *st, uid_t shift, bool *acls) {
         uid_t new_uid;
         gid_t new_gid;
         bool changed = false;
@@ -261,7 +274,7 @@ static int patch_fd(int fd, const char *name, const struct stat *st, uid_t shift
                 changed = true;
         }
 
-        r = patch_acls(fd, name, st, shift);
+        r = patch_acls(fd, name, st, shift, acls);
         if (r < 0)
                 return r;
 
@@ -296,125 +309,433 @@ static int is_fs_fully_userns_compatible(const struct statfs *sfs) {
                F_TYPE_EQUAL(sfs->f_type, SYSFS_MAGIC);
 }
 
-static int recurse_fd(int fd, bool donate_fd, const struct stat *st, uid_t shift, bool is_toplevel) {
-        _cleanup_closedir_ DIR *d = NULL;
+
+/* The maximum number of threads we use to walk the tree, including the calling thread */
+#define PATCH_WORKERS_MAX 16U
+
+/* How many directories we queue per thread before we descend into them directly from the thread that found them. This
+ * bounds the number of directory fds we keep open at the same time. */
+#define PATCH_QUEUE_PER_WORKER 8U
+
+/* Recorded on the top-level directory: the UID/GID base the tree has been (or is being) shifted to */
+#define PATCH_MARKER_XATTR "trusted.nspawn.uid-shift"
+
+typedef struct PatchDir PatchDir;
+
+struct PatchDir {
+        PatchDir *parent;
+        LIST_FIELDS(PatchDir, queue);
+
+        int fd;
+        struct stat st;
+
+        /* One reference for the enumeration of the directory itself, plus one for each subdirectory that is not
+         * completely patched yet */
+        unsigned n_ref;
+
+        bool is_toplevel;
+        bool acls;
+        bool skip;
+        bool changed;
+};
+
+typedef struct PatchContext {
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        LIST_HEAD(PatchDir, queue);
+        unsigned n_queued;
+        unsigned n_queued_max;
+        unsigned n_running;
+
+        uid_t shift;
+        bool resume;
+
+        int error;
+        bool changed;
+} PatchContext;
+
+static PatchDir* patch_dir_new(PatchDir *parent, int fd, const struct stat *st) {
+        PatchDir *d;
+
+        assert(fd >= 0);
+        assert(st);
+
+        d = new0(PatchDir, 1);
+        if (!d)
+                return NULL;
+
+        d->parent = parent;
+        d->fd = fd;
+        d->st = *st;
+        d->n_ref = 1;
+        d->is_toplevel = !parent;
+
+        /* Assume ACLs are supported, unless we already learnt otherwise for the same file system */
+        d->acls = !parent || parent->acls || parent->st.st_dev != st->st_dev;
+
+        return d;
+}
+
+static void patch_dir_log_read_only(int fd) {
+        _cleanup_free_ char *name = NULL;
+
+        /* When we hit a ready-only subtree we simply skip it, but log about it. */
+        (void) fd_get_path(fd, &name);
+        log_debug("Skippping read-only file or directory %s.", strna(name));
+}
+
+static void patch_dir_unref(PatchContext *c, PatchDir *d) {
+        assert(c);
+
+        while (d) {
+                PatchDir *parent;
+                unsigned n_ref;
+                bool skip;
+                int r = 0;
+
+                assert_se(pthread_mutex_lock(&c->mutex) == 0);
+                assert(d->n_ref > 0);
+                n_ref = --d->n_ref;
+                skip = d->skip || c->error < 0;
+                assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+
+                if (n_ref > 0)
+                        return;
+
+                /* All subdirectories are done, hence patch the directory itself now. It's key to do this in this
+                 * order so that the top-level directory is patched as very last object in the tree, so that we can
+                 * use it as quick indicator whether the tree is properly chown()ed already. */
+                if (!skip) {
+                        r = patch_fd(d->fd, NULL, &d->st, c->shift, &d->acls);
+                        if (r == -EROFS && !d->is_toplevel) {
+                                patch_dir_log_read_only(d->fd);
+                                r = 0;
+                        }
+                }
+
+                parent = d->parent;
+
+                assert_se(pthread_mutex_lock(&c->mutex) == 0);
+                if (r < 0) {
+                        if (c->error == 0)
+                                c->error = r;
+                } else if (r > 0)
+                        d->changed = true;
+
+                if (parent)
+                        parent->changed = parent->changed || d->changed;
+                else
+                        c->changed = d->changed;
+                assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+
+                safe_close(d->fd);
+                free(d);
+
+                d = parent;
+        }
+}
+
+static int patch_dir_enumerate(PatchContext *c, PatchDir *d);
+
+static int patch_dir_process(PatchContext *c, PatchDir *d) {
+        int r;
+
+        assert(c);
+        assert(d);
+
+        r = patch_dir_enumerate(c, d);
+        if (r < 0) {
+                assert_se(pthread_mutex_lock(&c->mutex) == 0);
+                if (c->error == 0)
+                        c->error = r;
+                assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+        }
+
+        patch_dir_unref(c, d);
+        return r;
+}
+
+static int patch_dir_add(PatchContext *c, PatchDir *parent, int dfd, const char *name, const struct stat *st) {
+        bool queued = false;
+        PatchDir *d;
+        int fd, r;
+
+        assert(c);
+        assert(parent);
+        assert(dfd >= 0);
+        assert(name);
+        assert(st);
+
+        fd = openat(dfd, name, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW|O_NOATIME);
+        if (fd < 0)
+                return -errno;
+
+        d = patch_dir_new(parent, fd, st);
+        if (!d) {
+                safe_close(fd);
+                return -ENOMEM;
+        }
+
+        assert_se(pthread_mutex_lock(&c->mutex) == 0);
+        parent->n_ref++;
+        r = c->error;
+        if (r == 0 && c->n_queued < c->n_queued_max) {
+                LIST_PREPEND(queue, c->queue, d);
+                c->n_queued++;
+                queued = true;
+
+                assert_se(pthread_cond_signal(&c->cond) == 0);
+        }
+        assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+
+        if (queued)
+                return 0;
+        if (r < 0) {
+                /* Somebody else failed, let's not bother */
+                patch_dir_unref(c, d);
+                return r;
+        }
+
+        /* The queue is full, descend into the directory from this thread */
+        return patch_dir_process(c, d);
+}
+
+static int patch_dir_enumerate(PatchContext *c, PatchDir *d) {
+        _cleanup_closedir_ DIR *dir = NULL;
         bool changed = false;
         struct statfs sfs;
-        int r;
+        struct dirent *de;
+        int fd, r;
 
-        assert(fd >= 0);
+        assert(c);
+        assert(d);
 
-        if (fstatfs(fd, &sfs) < 0)
+        if (fstatfs(d->fd, &sfs) < 0)
                 return -errno;
 
         /* We generally want to permit crossing of mount boundaries when patching the UIDs/GIDs. However, we probably
          * shouldn't do this for /proc and /sys if that is already mounted into place. Hence, let's stop the recursion
          * when we hit procfs, sysfs or some other special file systems. */
-
-        r = is_fs_fully_userns_compatible(&sfs);
-        if (r < 0)
-                goto finish;
-        if (r > 0) {
-                r = 0; /* don't recurse */
-                goto finish;
+        if (is_fs_fully_userns_compatible(&sfs)) {
+                d->skip = true;
+                return 0;
         }
 
         /* Also, if we hit a read-only file system, then don't bother, skip the whole subtree */
         if ((sfs.f_flags & ST_RDONLY) ||
-            access_fd(fd, W_OK) == -EROFS)
-                goto read_only;
+            access_fd(d->fd, W_OK) == -EROFS) {
+                if (!d->is_toplevel)
+                        patch_dir_log_read_only(d->fd);
 
-        if (S_ISDIR(st->st_mode)) {
-                struct dirent *de;
+                d->skip = true;
+                return 0;
+        }
 
-                if (!donate_fd) {
-                        int copy;
+        if (!S_ISDIR(d->st.st_mode))
+                return 0;
 
-                        copy = fcntl(fd, F_DUPFD_CLOEXEC, 3);
-                        if (copy < 0) {
-                                r = -errno;
-                                goto finish;
-                        }
+        /* Keep the original fd around, we need it for patching the directory itself once all children are done */
+        fd = fcntl(d->fd, F_DUPFD_CLOEXEC, 3);
+        if (fd < 0)
+                return -errno;
 
-                        fd = copy;
-                        donate_fd = true;
-                }
+        dir = fdopendir(fd);
+        if (!dir) {
+                safe_close(fd);
+                return -errno;
+        }
 
-                d = fdopendir(fd);
-                if (!d) {
-                        r = -errno;
-                        goto finish;
-                }
-                fd = -1;
+        FOREACH_DIRENT_ALL(de, dir, return -errno) {
+                struct stat fst;
+
+                if (dot_or_dot_dot(de->d_name))
+                        continue;
 
-                FOREACH_DIRENT_ALL(de, d, r = -errno; goto finish) {
-                        struct stat fst;
+                if (fstatat(dirfd(dir), de->d_name, &fst, AT_SYMLINK_NOFOLLOW) < 0)
+                        return -errno;
 
-                        if (dot_or_dot_dot(de->d_name))
+                if (S_ISDIR(fst.st_mode)) {
+
+                        /* If we resume an interrupted run, then any directory already owned by the target range has
+                         * been completely patched before, as directories are patched only after everything below
+                         * them. */
+                        if (c->resume &&
+                            ((uint32_t) (fst.st_uid ^ c->shift) >> 16) == 0 &&
+                            ((uint32_t) (fst.st_gid ^ c->shift) >> 16) == 0)
                                 continue;
 
-                        if (fstatat(dirfd(d), de->d_name, &fst, AT_SYMLINK_NOFOLLOW) < 0) {
-                                r = -errno;
-                                goto finish;
-                        }
+                        r = patch_dir_add(c, d, dirfd(dir), de->d_name, &fst);
+                } else
+                        r = patch_fd(dirfd(dir), de->d_name, &fst, c->shift, &d->acls);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        changed = true;
+        }
 
-                        if (S_ISDIR(fst.st_mode)) {
-                                int subdir_fd;
+        if (changed) {
+                assert_se(pthread_mutex_lock(&c->mutex) == 0);
+                d->changed = true;
+                assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+        }
 
-                                subdir_fd = openat(dirfd(d), de->d_name, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW|O_NOATIME);
-                                if (subdir_fd < 0) {
-                                        r = -errno;
-                                        goto finish;
+        return 0;
+}
 
-                                }
+static void* patch_worker(void *p) {
+        PatchContext *c = p;
 
-                                r = recurse_fd(subdir_fd, true, &fst, shift, false);
-                                if (r < 0)
-                                        goto finish;
-                                if (r > 0)
-                                        changed = true;
+        assert(c);
 
-                        } else {
-                                r = patch_fd(dirfd(d), de->d_name, &fst, shift);
-                                if (r < 0)
-                                        goto finish;
-                                if (r > 0)
-                                        changed = true;
+        assert_se(pthread_mutex_lock(&c->mutex) == 0);
+
+        for (;;) {
+                PatchDir *d;
+
+                while (c->error == 0 && !c->queue && c->n_running > 0)
+                        assert_se(pthread_cond_wait(&c->cond, &c->mutex) == 0);
+
+                /* Stop if something failed, or if there's nothing queued and nobody left who could queue more */
+                if (c->error < 0 || !c->queue)
+                        break;
+
+                d = c->queue;
+                LIST_REMOVE(queue, c->queue, d);
+                c->n_queued--;
+                c->n_running++;
+                assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+
+                (void) patch_dir_process(c, d);
+
+                assert_se(pthread_mutex_lock(&c->mutex) == 0);
+                c->n_running--;
+                if (c->n_running == 0 || c->error < 0)
+                        assert_se(pthread_cond_broadcast(&c->cond) == 0);
+        }
+
+        assert_se(pthread_cond_broadcast(&c->cond) == 0);
+        assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+
+        return NULL;
+}
+
+static void* patch_worker_thread(void *p) {
+
+        /* Assign a pretty name to this thread */
+        (void) pthread_setname_np(pthread_self(), "nspawn-patch");
+
+        return patch_worker(p);
+}
+
+static unsigned patch_n_workers(void) {
+        long n;
+
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n <= 0)
+                return 1;
+
+        return MIN((unsigned) n, PATCH_WORKERS_MAX);
+}
+
+static int patch_tree(int fd, const struct stat *st, uid_t shift, bool resume) {
+        pthread_t workers[PATCH_WORKERS_MAX - 1];
+        unsigned n_workers, n_started = 0, i;
+        sigset_t ss, saved_ss;
+        PatchContext c = {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .cond = PTHREAD_COND_INITIALIZER,
+                .shift = shift,
+                .resume = resume,
+        };
+        PatchDir *d;
+        int r;
+
+        assert(fd >= 0);
+        assert(st);
+
+        d = patch_dir_new(NULL, fd, st);
+        if (!d) {
+                safe_close(fd);
+                return -ENOMEM;
+        }
+
+        n_workers = patch_n_workers();
+        c.n_queued_max = n_workers * PATCH_QUEUE_PER_WORKER;
+
+        LIST_PREPEND(queue, c.queue, d);
+        c.n_queued = 1;
+
+        /* No signals in forked off threads please. We set the mask before forking, so that the threads never exist
+         * with a different mask than a fully blocked one. If that doesn't work, we'll just do the work on our own. */
+        if (n_workers > 1 &&
+            sigfillset(&ss) >= 0 &&
+            pthread_sigmask(SIG_BLOCK, &ss, &saved_ss) == 0) {
+
+                for (; n_started < n_workers - 1; n_started++) {
+                        r = pthread_create(workers + n_started, NULL, patch_worker_thread, &c);
+                        if (r > 0) {
+                                /* Not fatal, we'll just make do with fewer threads */
+                                log_debug_errno(r, "Failed to start worker thread, continuing with %u threads: %m", n_started + 1);
+                                break;
                         }
                 }
-        }
 
-        /* After we descended, also patch the directory itself. It's key to do this in this order so that the top-level
-         * directory is patched as very last object in the tree, so that we can use it as quick indicator whether the
-         * tree is properly chown()ed already. */
-        r = patch_fd(d ? dirfd(d) : fd, NULL, st, shift);
-        if (r == -EROFS)
-                goto read_only;
-        if (r > 0)
-                changed = true;
+                r = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+                if (r > 0)
+                        log_debug_errno(r, "Failed to restore signal mask, ignoring: %m");
+        }
 
-        r = changed;
-        goto finish;
+        /* The calling thread does its share of the work too */
+        (void) patch_worker(&c);
 
-read_only:
-        if (!is_toplevel) {
-                _cleanup_free_ char *name = NULL;
+        for (i = 0; i < n_started; i++)
+                (void) pthread_join(workers[i], NULL);
 
-                /* When we hit a ready-only subtree we simply skip it, but log about it. */
-                (void) fd_get_path(fd, &name);
-                log_debug("Skippping read-only file or directory %s.", strna(name));
-                r = changed;
+        /* If something failed, release whatever is still queued. Since all threads are gone this also releases all
+         * directories waiting for their subdirectories. */
+        while ((d = c.queue)) {
+                LIST_REMOVE(queue, c.queue, d);
+                patch_dir_unref(&c, d);
         }
 
-finish:
-        if (donate_fd)
-                safe_close(fd);
+        assert_se(pthread_cond_destroy(&c.cond) == 0);
+        assert_se(pthread_mutex_destroy(&c.mutex) == 0);
 
-        return r;
+        if (c.error < 0)
+                return c.error;
+
+        return c.changed;
+}
+
+static int read_marker(int fd, uid_t *ret) {
+        _cleanup_free_ char *value = NULL;
+        int r;
+
+        assert(fd >= 0);
+        assert(ret);
+
+        r = fgetxattr_malloc(fd, PATCH_MARKER_XATTR, &value);
+        if (r < 0)
+                return r;
+
+        return parse_uid(value, ret);
+}
+
+static void write_marker(int fd, uid_t shift) {
+        char value[DECIMAL_STR_MAX(uid_t)];
+
+        assert(fd >= 0);
+
+        xsprintf(value, UID_FMT, shift);
+        if (fsetxattr(fd, PATCH_MARKER_XATTR, value, strlen(value), 0) < 0)
+                log_debug_errno(errno, "Failed to set " PATCH_MARKER_XATTR " extended attribute, ignoring: %m");
 }
 
 static int fd_patch_uid_internal(int fd, bool donate_fd, uid_t shift, uid_t range) {
+        bool resume = false;
         struct stat st;
+        uid_t marker;
         int r;
 
         assert(fd >= 0);
@@ -454,14 +775,22 @@ static int fd_patch_uid_internal(int fd, bool donate_fd, uid_t shift, uid_t rang
 
         /* Try to detect if the range is already right. Of course, this a pretty drastic optimization, as we assume
          * that if the top-level dir has the right upper 16bit assigned, then everything below will have too... */
-        if (((uint32_t) (st.st_uid ^ shift) >> 16) == 0)
-                return 0;
-
-        /* Before we start recursively chowning, mark the top-level dir as "busy" by chowning it to the "busy"
-         * range. Should we be interrupted in the middle of our work, we'll see it owned by this user and will start
-         * chown()ing it again, unconditionally, as the busy UID is not a valid UID we'd everpick for ourselves. */
+        if (((uint32_t) (st.st_uid ^ shift) >> 16) == 0) {
+                r = 0;
+                goto finish;
+        }
 
-        if ((st.st_uid & UID_BUSY_MASK) != UID_BUSY_BASE) {
+        if ((st.st_uid & UID_BUSY_MASK) == UID_BUSY_BASE) {
+                /* A previous run was interrupted. If it was shifting to the same range we can skip all subtrees it
+                 * completed, otherwise we have to start from scratch. */
+                resume = read_marker(fd, &marker) >= 0 && marker == shift;
+                if (resume)
+                        log_debug("Resuming interrupted UID/GID shift to " UID_FMT ".", shift);
+        } else {
+                /* Before we start recursively chowning, mark the top-level dir as "busy" by chowning it to the "busy"
+                 * range. Should we be interrupted in the middle of our work, we'll see it owned by this user and will
+                 * start chown()ing it again, unconditionally, as the busy UID is not a valid UID we'd ever pick for
+                 * ourselves. */
                 if (fchown(fd,
                            UID_BUSY_BASE | (st.st_uid & ~UID_BUSY_MASK),
                            (gid_t) UID_BUSY_BASE | (st.st_gid & ~(gid_t) UID_BUSY_MASK)) < 0) {
@@ -470,7 +799,22 @@ static int fd_patch_uid_internal(int fd, bool donate_fd, uid_t shift, uid_t rang
                 }
         }
 
-        return recurse_fd(fd, donate_fd, &st, shift, true);
+        /* Record which range we are shifting to, so that an interrupted run may be resumed. Once the top-level dir is
+         * patched this marker records the range the tree has been shifted to. */
+        if (!resume)
+                write_marker(fd, shift);
+
+        if (!donate_fd) {
+                int copy;
+
+                copy = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+                if (copy < 0)
+                        return -errno;
+
+                fd = copy;
+        }
+
+        return patch_tree(fd, &st, shift, resume);
 
 finish:
         if (donate_fd)
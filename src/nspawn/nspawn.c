@@ -130,6 +130,7 @@ static bool arg_private_network = false;
 static bool arg_read_only = false;
 static StartMode arg_start_mode = START_PID1;
 static bool arg_ephemeral = false;
+static char *arg_ephemeral_overlay = NULL;
 static LinkJournal arg_link_journal = LINK_AUTO;
 static bool arg_link_journal_try = false;
 static uint64_t arg_caps_retain =
@@ -203,6 +204,10 @@ static cpu_set_t *arg_cpuset = NULL;
 static unsigned arg_cpuset_ncpus = 0;
 static ResolvConfMode arg_resolv_conf = RESOLV_CONF_AUTO;
 static TimezoneMode arg_timezone = TIMEZONE_AUTO;
+static bool arg_debug_timing = false;
+
+static const char *setup_context = NULL;
+static usec_t setup_begin = USEC_INFINITY, setup_last = USEC_INFINITY;
 
 static void help(void) {
         (void) pager_open(false, false);
@@ -299,9 +304,34 @@ static void help(void) {
                "     --volatile[=MODE]      Run the system in volatile mode\n"
                "     --settings=BOOLEAN     Load additional settings from .nspawn file\n"
                "     --notify-ready=BOOLEAN Receive notifications from the child init process\n"
+               "     --debug-timing         Show how long each container setup step takes\n"
                , program_invocation_short_name);
 }
 
+static void log_setup_begin(const char *context) {
+        if (!arg_debug_timing)
+                return;
+
+        setup_context = context;
+        setup_begin = setup_last = now(CLOCK_MONOTONIC);
+}
+
+static void log_setup_step(const char *step) {
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        usec_t n;
+
+        if (!arg_debug_timing || setup_begin == USEC_INFINITY)
+                return;
+
+        n = now(CLOCK_MONOTONIC);
+        log_info("%s: %s took %s (%s total).",
+                 setup_context, step,
+                 format_timespan(a, sizeof a, n - setup_last, 1),
+                 format_timespan(b, sizeof b, n - setup_begin, 1));
+
+        setup_last = n;
+}
+
 static int custom_mount_check_all(void) {
         size_t i;
 
@@ -457,6 +487,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_CPU_AFFINITY,
                 ARG_RESOLV_CONF,
                 ARG_TIMEZONE,
+                ARG_DEBUG_TIMING,
         };
 
         static const struct option options[] = {
@@ -517,6 +548,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "cpu-affinity",           required_argument, NULL, ARG_CPU_AFFINITY           },
                 { "resolv-conf",            required_argument, NULL, ARG_RESOLV_CONF            },
                 { "timezone",               required_argument, NULL, ARG_TIMEZONE               },
+                { "debug-timing",           no_argument,       NULL, ARG_DEBUG_TIMING           },
                 {}
         };
 
@@ -1231,6 +1263,10 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_settings_mask |= SETTING_TIMEZONE;
                         break;
 
+                case ARG_DEBUG_TIMING:
+                        arg_debug_timing = true;
+                        break;
+
                 case '?':
                         return -EINVAL;
 
@@ -2224,6 +2260,34 @@ static int setup_machine_id(const char *directory) {
         return 0;
 }
 
+static bool use_ephemeral_overlay(const char *directory, bool *ret_explicit) {
+        int r;
+
+        assert(directory);
+        assert(ret_explicit);
+
+        r = getenv_bool("SYSTEMD_NSPAWN_EPHEMERAL_OVERLAY");
+        *ret_explicit = r >= 0;
+        if (r >= 0)
+                return r;
+        if (r != -ENXIO)
+                log_warning_errno(r, "Failed to parse $SYSTEMD_NSPAWN_EPHEMERAL_OVERLAY, ignoring: %m");
+
+        /* Snapshots are cheap on btrfs, hence prefer them there */
+        if (btrfs_is_subvol(directory) > 0)
+                return false;
+
+        /* Shifting the UIDs of the tree would copy up every single file, we are better off with a copy then */
+        if (arg_userns_mode != USER_NAMESPACE_NO && arg_userns_chown)
+                return false;
+
+        r = overlayfs_supported();
+        if (r < 0)
+                log_debug_errno(r, "Failed to determine whether overlayfs is supported, assuming it is not: %m");
+
+        return r > 0;
+}
+
 static int recursive_chown(const char *directory, uid_t shift, uid_t range) {
         int r;
 
@@ -2540,6 +2604,8 @@ static int inner_child(
         assert(directory);
         assert(kmsg_socket >= 0);
 
+        log_setup_begin("inner child");
+
         if (arg_userns_mode != USER_NAMESPACE_NO) {
                 /* Tell the parent, that it now can write the UID map. */
                 (void) barrier_place(barrier); /* #1 */
@@ -2549,11 +2615,14 @@ static int inner_child(
                         log_error("Parent died too early");
                         return -ESRCH;
                 }
+
+                log_setup_step("waiting for UID map");
         }
 
         r = reset_uid_gid();
         if (r < 0)
                 return log_error_errno(r, "Couldn't become new root: %m");
+        log_setup_step("reset_uid_gid");
 
         r = mount_all(NULL,
                       arg_mount_settings | MOUNT_IN_USERNS,
@@ -2562,6 +2631,7 @@ static int inner_child(
                       arg_selinux_apifs_context);
         if (r < 0)
                 return r;
+        log_setup_step("mount_all");
 
         if (!arg_network_namespace_path && arg_private_network) {
                 r = unshare(CLONE_NEWNET);
@@ -2575,6 +2645,7 @@ static int inner_child(
         r = mount_sysfs(NULL, arg_mount_settings);
         if (r < 0)
                 return r;
+        log_setup_step("mount_sysfs");
 
         /* Wait until we are cgroup-ified, so that we
          * can mount the right cgroup path writable */
@@ -2582,6 +2653,7 @@ static int inner_child(
                 log_error("Parent died too early");
                 return -ESRCH;
         }
+        log_setup_step("waiting for parent");
 
         if (arg_use_cgns && cg_ns_supported()) {
                 r = unshare(CLONE_NEWCGROUP);
@@ -2602,15 +2674,18 @@ static int inner_child(
                 if (r < 0)
                         return r;
         }
+        log_setup_step("mount_cgroups");
 
         r = setup_boot_id();
         if (r < 0)
                 return r;
+        log_setup_step("setup_boot_id");
 
         r = setup_kmsg(kmsg_socket);
         if (r < 0)
                 return r;
         kmsg_socket = safe_close(kmsg_socket);
+        log_setup_step("setup_kmsg");
 
         if (setsid() < 0)
                 return log_error_errno(errno, "setsid() failed: %m");
@@ -2638,6 +2713,7 @@ static int inner_child(
         r = drop_capabilities();
         if (r < 0)
                 return log_error_errno(r, "drop_capabilities() failed: %m");
+        log_setup_step("drop_capabilities");
 
         (void) setup_hostname();
 
@@ -2660,6 +2736,7 @@ static int inner_child(
         r = change_uid_gid(arg_user, &home);
         if (r < 0)
                 return r;
+        log_setup_step("change_uid_gid");
 
         if (arg_no_new_privileges)
                 if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0)
@@ -2705,6 +2782,7 @@ static int inner_child(
                 log_error("Parent died too early");
                 return -ESRCH;
         }
+        log_setup_step("waiting for parent");
 
         if (arg_chdir)
                 if (chdir(arg_chdir) < 0)
@@ -2829,6 +2907,8 @@ static int outer_child(
         assert(notify_socket >= 0);
         assert(kmsg_socket >= 0);
 
+        log_setup_begin("outer child");
+
         if (prctl(PR_SET_PDEATHSIG, SIGKILL) < 0)
                 return log_error_errno(errno, "PR_SET_PDEATHSIG failed: %m");
 
@@ -2860,6 +2940,12 @@ static int outer_child(
         if (r < 0)
                 return r;
 
+        if (arg_ephemeral_overlay) {
+                r = mount_ephemeral_overlay(directory, arg_ephemeral_overlay);
+                if (r < 0)
+                        return r;
+        }
+
         if (dissected_image) {
                 /* If we are operating on a disk image, then mount its root directory now, but leave out the rest. We
                  * can read the UID shift from it if we need to. Further down we'll mount the rest, but then with the
@@ -2877,6 +2963,7 @@ static int outer_child(
         r = determine_uid_shift(directory);
         if (r < 0)
                 return r;
+        log_setup_step("determine_uid_shift");
 
         if (arg_userns_mode != USER_NAMESPACE_NO) {
                 /* Let the parent know which UID shift we read from the image */
@@ -2942,6 +3029,7 @@ static int outer_child(
                         arg_pivot_root_old);
         if (r < 0)
                 return r;
+        log_setup_step("setup_pivot_root");
 
         r = setup_volatile(
                         directory,
@@ -2952,6 +3040,7 @@ static int outer_child(
                         arg_selinux_context);
         if (r < 0)
                 return r;
+        log_setup_step("setup_volatile");
 
         r = setup_volatile_state(
                         directory,
@@ -2962,6 +3051,7 @@ static int outer_child(
                         arg_selinux_context);
         if (r < 0)
                 return r;
+        log_setup_step("setup_volatile_state");
 
         /* Mark everything as shared so our mounts get propagated down. This is
          * required to make new bind mounts available in systemd services
@@ -2976,10 +3066,12 @@ static int outer_child(
         r = recursive_chown(directory, arg_uid_shift, arg_uid_range);
         if (r < 0)
                 return r;
+        log_setup_step("recursive_chown");
 
         r = base_filesystem_create(directory, arg_uid_shift, (gid_t) arg_uid_shift);
         if (r < 0)
                 return r;
+        log_setup_step("base_filesystem_create");
 
         if (arg_read_only) {
                 r = bind_remount_recursive(directory, true, NULL);
@@ -2994,48 +3086,59 @@ static int outer_child(
                       arg_selinux_apifs_context);
         if (r < 0)
                 return r;
+        log_setup_step("mount_all");
 
         r = copy_devnodes(directory);
         if (r < 0)
                 return r;
+        log_setup_step("copy_devnodes");
 
         dev_setup(directory, arg_uid_shift, arg_uid_shift);
 
         r = setup_pts(directory);
         if (r < 0)
                 return r;
+        log_setup_step("setup_pts");
 
         r = setup_propagate(directory);
         if (r < 0)
                 return r;
+        log_setup_step("setup_propagate");
 
         r = setup_dev_console(directory, console);
         if (r < 0)
                 return r;
+        log_setup_step("setup_dev_console");
 
         r = setup_keyring();
         if (r < 0)
                 return r;
+        log_setup_step("setup_keyring");
 
         r = setup_seccomp(arg_caps_retain, arg_syscall_whitelist, arg_syscall_blacklist);
         if (r < 0)
                 return r;
+        log_setup_step("setup_seccomp");
 
         r = setup_timezone(directory);
         if (r < 0)
                 return r;
+        log_setup_step("setup_timezone");
 
         r = setup_resolv_conf(directory);
         if (r < 0)
                 return r;
+        log_setup_step("setup_resolv_conf");
 
         r = setup_machine_id(directory);
         if (r < 0)
                 return r;
+        log_setup_step("setup_machine_id");
 
         r = setup_journal(directory);
         if (r < 0)
                 return r;
+        log_setup_step("setup_journal");
 
         r = mount_custom(
                         directory,
@@ -3047,6 +3150,7 @@ static int outer_child(
                         arg_selinux_apifs_context);
         if (r < 0)
                 return r;
+        log_setup_step("mount_custom");
 
         if (!arg_use_cgns || !cg_ns_supported()) {
                 r = mount_cgroups(
@@ -3059,11 +3163,13 @@ static int outer_child(
                                 false);
                 if (r < 0)
                         return r;
+                log_setup_step("mount_cgroups");
         }
 
         r = mount_move_root(directory);
         if (r < 0)
                 return log_error_errno(r, "Failed to move root directory: %m");
+        log_setup_step("mount_move_root");
 
         fd = setup_sd_notify_child();
         if (fd < 0)
@@ -4203,6 +4309,8 @@ int main(int argc, char *argv[]) {
         if (r <= 0)
                 goto finish;
 
+        log_setup_begin("parent");
+
         r = must_be_root();
         if (r < 0)
                 goto finish;
@@ -4252,6 +4360,7 @@ int main(int argc, char *argv[]) {
 
                 if (arg_ephemeral) {
                         _cleanup_free_ char *np = NULL;
+                        bool overlay, overlay_explicit = false;
 
                         r = chase_symlinks_and_update(&arg_directory, 0);
                         if (r < 0)
@@ -4268,6 +4377,12 @@ int main(int argc, char *argv[]) {
                                 log_error_errno(r, "Failed to determine whether directory %s is mount point: %m", arg_directory);
                                 goto finish;
                         }
+
+                        /* Instead of a snapshot we may use an overlayfs with the upper layer next to the original
+                         * tree. This doesn't work if the tree is a mount point, as the upper layer would end up
+                         * inside the lower one. */
+                        overlay = r == 0 && use_ephemeral_overlay(arg_directory, &overlay_explicit);
+
                         if (r > 0)
                                 r = tempfn_random_child(arg_directory, "machine.", &np);
                         else
@@ -4277,26 +4392,69 @@ int main(int argc, char *argv[]) {
                                 goto finish;
                         }
 
-                        r = image_path_lock(np, (arg_read_only ? LOCK_SH : LOCK_EX) | LOCK_NB, &tree_global_lock, &tree_local_lock);
-                        if (r < 0) {
-                                log_error_errno(r, "Failed to lock %s: %m", np);
-                                goto finish;
-                        }
+                        if (overlay) {
+                                /* The original tree becomes the lower layer of the overlay, hence it must not
+                                 * change while we run, but may be shared with other ephemeral containers. */
+                                r = image_path_lock(arg_directory, LOCK_SH|LOCK_NB, &tree_global_lock, &tree_local_lock);
+                                if (r == -EBUSY) {
+                                        log_error_errno(r, "Directory tree %s is currently busy.", arg_directory);
+                                        goto finish;
+                                }
+                                if (r < 0) {
+                                        log_error_errno(r, "Failed to lock %s: %m", arg_directory);
+                                        goto finish;
+                                }
 
-                        r = btrfs_subvol_snapshot(arg_directory, np,
-                                                  (arg_read_only ? BTRFS_SNAPSHOT_READ_ONLY : 0) |
-                                                  BTRFS_SNAPSHOT_FALLBACK_COPY |
-                                                  BTRFS_SNAPSHOT_FALLBACK_DIRECTORY |
-                                                  BTRFS_SNAPSHOT_RECURSIVE |
-                                                  BTRFS_SNAPSHOT_QUOTA);
-                        if (r < 0) {
-                                log_error_errno(r, "Failed to create snapshot %s from %s: %m", np, arg_directory);
-                                goto finish;
+                                r = setup_ephemeral_overlay(arg_directory, np);
+                                if (r < 0) {
+                                        (void) rm_rf(np, REMOVE_ROOT|REMOVE_PHYSICAL);
+                                        goto finish;
+                                }
+
+                                r = probe_ephemeral_overlay(arg_directory, np);
+                                if (r < 0) {
+                                        (void) rm_rf(np, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+                                        if (overlay_explicit) {
+                                                log_error_errno(r, "Failed to mount overlayfs on top of %s: %m", arg_directory);
+                                                goto finish;
+                                        }
+
+                                        /* We only picked overlayfs because it is cheaper, hence don't fail because
+                                         * of it, but do what we would have done without it */
+                                        log_debug_errno(r, "Failed to mount overlayfs on top of %s, falling back to a snapshot: %m", arg_directory);
+
+                                        release_lock_file(&tree_global_lock);
+                                        release_lock_file(&tree_local_lock);
+                                        overlay = false;
+                                } else {
+                                        log_debug("Running ephemeral container on overlay of %s, upper layer in %s.", arg_directory, np);
+                                        arg_ephemeral_overlay = TAKE_PTR(np);
+                                }
                         }
 
-                        free_and_replace(arg_directory, np);
+                        if (!overlay) {
+                                r = image_path_lock(np, (arg_read_only ? LOCK_SH : LOCK_EX) | LOCK_NB, &tree_global_lock, &tree_local_lock);
+                                if (r < 0) {
+                                        log_error_errno(r, "Failed to lock %s: %m", np);
+                                        goto finish;
+                                }
+
+                                r = btrfs_subvol_snapshot(arg_directory, np,
+                                                          (arg_read_only ? BTRFS_SNAPSHOT_READ_ONLY : 0) |
+                                                          BTRFS_SNAPSHOT_FALLBACK_COPY |
+                                                          BTRFS_SNAPSHOT_FALLBACK_DIRECTORY |
+                                                          BTRFS_SNAPSHOT_RECURSIVE |
+                                                          BTRFS_SNAPSHOT_QUOTA);
+                                if (r < 0) {
+                                        log_error_errno(r, "Failed to create snapshot %s from %s: %m", np, arg_directory);
+                                        goto finish;
+                                }
+
+                                free_and_replace(arg_directory, np);
 
-                        remove_directory = true;
+                                remove_directory = true;
+                        }
 
                 } else {
                         r = chase_symlinks_and_update(&arg_directory, arg_template ? CHASE_NONEXISTENT : 0);
@@ -4512,6 +4670,8 @@ int main(int argc, char *argv[]) {
                 goto finish;
         }
 
+        log_setup_step("preparing container");
+
         for (;;) {
                 r = run(master,
                         console,
@@ -4552,6 +4712,14 @@ finish:
                         log_warning_errno(k, "Cannot remove '%s', ignoring: %m", arg_directory);
         }
 
+        if (arg_ephemeral_overlay) {
+                int k;
+
+                k = rm_rf(arg_ephemeral_overlay, REMOVE_ROOT|REMOVE_PHYSICAL);
+                if (k < 0)
+                        log_warning_errno(k, "Cannot remove '%s', ignoring: %m", arg_ephemeral_overlay);
+        }
+
         if (remove_image && arg_image) {
                 if (unlink(arg_image) < 0)
                         log_warning_errno(errno, "Can't remove image file '%s', ignoring: %m", arg_image);
@@ -4576,6 +4744,7 @@ finish:
         (void) remove_bridge(arg_network_zone);
 
         free(arg_directory);
+        free(arg_ephemeral_overlay);
         free(arg_template);
         free(arg_image);
         free(arg_machine);
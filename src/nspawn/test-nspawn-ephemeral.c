@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "copy.h"
+#include "fileio.h"
+#include "log.h"
+#include "nspawn-mount.h"
+#include "parse-util.h"
+#include "process-util.h"
+#include "rm-rf.h"
+#include "time-util.h"
+#include "user-util.h"
+#include "util.h"
+
+static int start_copy(const char *path) {
+        _cleanup_free_ char *np = NULL;
+        int r;
+
+        r = tempfn_random(path, "machine.", &np);
+        if (r < 0)
+                return log_error_errno(r, "Failed to generate name for directory copy: %m");
+
+        r = copy_tree(path, np, UID_INVALID, GID_INVALID, COPY_REFLINK);
+        if (r < 0)
+                log_error_errno(r, "Failed to copy %s: %m", path);
+
+        (void) rm_rf(np, REMOVE_ROOT|REMOVE_PHYSICAL);
+        return r;
+}
+
+static int start_overlay(const char *path) {
+        _cleanup_free_ char *np = NULL;
+        int r;
+
+        r = tempfn_random(path, "machine.", &np);
+        if (r < 0)
+                return log_error_errno(r, "Failed to generate name for scratch directory: %m");
+
+        r = setup_ephemeral_overlay(path, np);
+        if (r < 0)
+                goto finish;
+
+        r = safe_fork("(overlay)", FORK_DEATHSIG|FORK_LOG|FORK_WAIT|FORK_NEW_MOUNTNS|FORK_MOUNTNS_SLAVE, NULL);
+        if (r < 0)
+                goto finish;
+        if (r == 0) {
+                /* child */
+                if (mount_ephemeral_overlay(path, np) < 0)
+                        _exit(EXIT_FAILURE);
+
+                _exit(access(path, W_OK) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+
+finish:
+        (void) rm_rf(np, REMOVE_ROOT|REMOVE_PHYSICAL);
+        return r;
+}
+
+static int measure(const char *name, int (*func)(const char *path), const char *path, unsigned n) {
+        char buf[FORMAT_TIMESPAN_MAX];
+        usec_t t;
+        unsigned i;
+        int r;
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < n; i++) {
+                r = func(path);
+                if (r < 0)
+                        return r;
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+        log_info("%s: %u runs, %s per run", name, n, format_timespan(buf, sizeof buf, t / n, 1));
+
+        return 0;
+}
+
+int main(int argc, char *argv[]) {
+        unsigned n = 10;
+        int r;
+
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        if (argc < 2 || argc > 3) {
+                log_error("Expected PATH [ITERATIONS] parameters.");
+                return EXIT_FAILURE;
+        }
+
+        if (argc > 2) {
+                r = safe_atou(argv[2], &n);
+                if (r < 0 || n == 0) {
+                        log_error("Failed to parse number of iterations %s.", argv[2]);
+                        return EXIT_FAILURE;
+                }
+        }
+
+        if (geteuid() != 0) {
+                log_notice("Not running as root, skipping.");
+                return EXIT_TEST_SKIP;
+        }
+
+        r = overlayfs_supported();
+        if (r <= 0) {
+                log_notice("overlayfs not available, skipping.");
+                return EXIT_TEST_SKIP;
+        }
+
+        /* Compare the setup cost of an ephemeral container based on a full copy of the tree with one based on an
+         * overlayfs on top of it */
+        if (measure("copy", start_copy, argv[1], n) < 0)
+                return EXIT_FAILURE;
+
+        if (measure("overlay", start_overlay, argv[1], n) < 0)
+                return EXIT_FAILURE;
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdlib.h>
+#include <sys/mount.h>
+#include <unistd.h>
+
+#include "fileio.h"
+#include "log.h"
+#include "mount-util.h"
+#include "nspawn-mount.h"
+#include "process-util.h"
+#include "rm-rf.h"
+#include "stat-util.h"
+#include "string-util.h"
+#include "util.h"
+
+int main(int argc, char *argv[]) {
+        char template[] = "/tmp/test-nspawn-overlay.XXXXXX";
+        const char *tree, *scratch, *work;
+        int r;
+
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        if (geteuid() != 0) {
+                log_notice("Not running as root, skipping.");
+                return EXIT_TEST_SKIP;
+        }
+
+        if (overlayfs_supported() <= 0) {
+                log_notice("overlayfs not available, skipping.");
+                return EXIT_TEST_SKIP;
+        }
+
+        assert_se(mkdtemp(template));
+
+        tree = strjoina(template, "/tree");
+        assert_se(mkdir(tree, 0755) >= 0);
+        assert_se(write_string_file(strjoina(tree, "/file"), "foo", WRITE_STRING_FILE_CREATE) >= 0);
+
+        scratch = strjoina(template, "/scratch");
+        work = strjoina(scratch, "/work");
+        assert_se(setup_ephemeral_overlay(tree, scratch) >= 0);
+
+        r = probe_ephemeral_overlay(tree, scratch);
+        if (r < 0) {
+                log_notice_errno(r, "Cannot mount overlayfs in this environment, skipping: %m");
+                (void) rm_rf(template, REMOVE_ROOT|REMOVE_PHYSICAL);
+                return EXIT_TEST_SKIP;
+        }
+
+        /* The probe happens in its own mount namespace, nothing may be left mounted */
+        assert_se(path_is_mount_point(tree, NULL, 0) == 0);
+
+        /* overlayfs refuses upper and work directories on different file systems. nspawn has to notice that
+         * before it sets up the container, so that it can fall back to a copy of the tree. */
+        r = safe_fork("(test-probe)", FORK_DEATHSIG|FORK_LOG|FORK_WAIT|FORK_NEW_MOUNTNS|FORK_MOUNTNS_SLAVE, NULL);
+        assert_se(r >= 0);
+        if (r == 0) {
+                if (mount("tmpfs", work, "tmpfs", 0, NULL) < 0) {
+                        log_error_errno(errno, "Failed to mount tmpfs on %s: %m", work);
+                        _exit(EXIT_FAILURE);
+                }
+
+                _exit(probe_ephemeral_overlay(tree, scratch) < 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+
+        /* Neither probe changed the original tree */
+        assert_se(access(strjoina(tree, "/file"), F_OK) >= 0);
+        assert_se(dir_is_empty(strjoina(scratch, "/upper")) > 0);
+
+        assert_se(rm_rf(template, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        return EXIT_SUCCESS;
+}
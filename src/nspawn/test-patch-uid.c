@@ -4,11 +4,14 @@
 
 #include "log.h"
 #include "nspawn-patch-uid.h"
+#include "time-util.h"
 #include "user-util.h"
 #include "util.h"
 
 int main(int argc, char *argv[]) {
+        char buf[FORMAT_TIMESPAN_MAX];
         uid_t shift, range;
+        usec_t t;
         int r;
 
         log_set_max_level(LOG_DEBUG);
@@ -32,13 +35,28 @@ int main(int argc, char *argv[]) {
                 return EXIT_FAILURE;
         }
 
+        t = now(CLOCK_MONOTONIC);
         r = path_patch_uid(argv[1], shift, range);
         if (r < 0) {
                 log_error_errno(r, "Failed to patch directory tree: %m");
                 return EXIT_FAILURE;
         }
 
-        log_info("Changed: %s", yes_no(r));
+        log_info("Changed: %s, took %s", yes_no(r), format_timespan(buf, sizeof buf, now(CLOCK_MONOTONIC) - t, 1));
+
+        /* A second run over the same tree should be short-circuited */
+        t = now(CLOCK_MONOTONIC);
+        r = path_patch_uid(argv[1], shift, range);
+        if (r < 0) {
+                log_error_errno(r, "Failed to patch directory tree again: %m");
+                return EXIT_FAILURE;
+        }
+        if (r > 0) {
+                log_error("Tree changed when patching it a second time.");
+                return EXIT_FAILURE;
+        }
+
+        log_info("Repeated run took %s", format_timespan(buf, sizeof buf, now(CLOCK_MONOTONIC) - t, 1));
 
         return EXIT_SUCCESS;
 }
@@ -46,9 +46,17 @@ typedef enum SearchFlags {
         SEARCH_DROPIN                 = 1 << 2,
 } SearchFlags;
 
+typedef struct UnitFileIndex {
+        /* Maps search path directories to the set of entries in them, so that we don't have to probe each
+         * directory for each unit we look at. Directories we might modify ourselves are never indexed. Each
+         * directory is read the first time it is needed, a NULL set means the directory doesn't exist. */
+        Hashmap *dirs;
+} UnitFileIndex;
+
 typedef struct {
         OrderedHashmap *will_process;
         OrderedHashmap *have_processed;
+        UnitFileIndex *index; /* not owned, may be NULL */
 } InstallContext;
 
 typedef enum {
@@ -966,6 +974,88 @@ static void install_info_free(UnitFileInstallInfo *i) {
         free(i);
 }
 
+static void unit_file_index_done(UnitFileIndex *idx) {
+        Iterator i;
+        char *dir;
+        Set *s;
+
+        assert(idx);
+
+        HASHMAP_FOREACH_KEY(s, dir, idx->dirs, i) {
+                set_free_free(s);
+                free(dir);
+        }
+
+        idx->dirs = hashmap_free(idx->dirs);
+}
+
+static int unit_file_index_load(UnitFileIndex *idx, const char *dir) {
+        _cleanup_set_free_free_ Set *entries = NULL;
+        _cleanup_closedir_ DIR *d = NULL;
+        _cleanup_free_ char *key = NULL;
+        struct dirent *de;
+        int r;
+
+        assert(idx);
+        assert(dir);
+
+        r = hashmap_ensure_allocated(&idx->dirs, &path_hash_ops);
+        if (r < 0)
+                return r;
+
+        key = strdup(dir);
+        if (!key)
+                return -ENOMEM;
+
+        d = opendir(dir);
+        if (!d) {
+                if (!IN_SET(errno, ENOENT, ENOTDIR))
+                        return -errno;
+        } else {
+                entries = set_new(&string_hash_ops);
+                if (!entries)
+                        return -ENOMEM;
+
+                FOREACH_DIRENT_ALL(de, d, return -errno) {
+                        if (dot_or_dot_dot(de->d_name))
+                                continue;
+
+                        r = set_put_strdup(entries, de->d_name);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        r = hashmap_put(idx->dirs, key, entries);
+        if (r < 0)
+                return r;
+
+        key = NULL;
+        entries = NULL;
+        return 0;
+}
+
+/* Returns false if the index knows that the specified entry does not exist in the directory, true otherwise */
+static bool unit_file_index_may_exist(UnitFileIndex *idx, const LookupPaths *paths, const char *dir, const char *name) {
+        assert(paths);
+        assert(dir);
+        assert(name);
+
+        if (!idx)
+                return true;
+
+        /* We create and remove symlinks in these, don't cache anything about them */
+        if (path_equal_ptr(dir, paths->persistent_config) ||
+            path_equal_ptr(dir, paths->runtime_config))
+                return true;
+
+        if (!hashmap_contains(idx->dirs, dir) &&
+            unit_file_index_load(idx, dir) < 0)
+                return true;
+
+        return set_contains(hashmap_get(idx->dirs, dir), name);
+}
+
 static void install_context_done(InstallContext *c) {
         assert(c);
 
@@ -1407,6 +1497,9 @@ static int unit_file_search(
         STRV_FOREACH(p, paths->search_path) {
                 _cleanup_free_ char *path = NULL;
 
+                if (!unit_file_index_may_exist(c ? c->index : NULL, paths, *p, info->name))
+                        continue;
+
                 path = strjoin(*p, "/", info->name);
                 if (!path)
                         return -ENOMEM;
@@ -1430,6 +1523,9 @@ static int unit_file_search(
                 STRV_FOREACH(p, paths->search_path) {
                         _cleanup_free_ char *path = NULL;
 
+                        if (!unit_file_index_may_exist(c ? c->index : NULL, paths, *p, template))
+                                continue;
+
                         path = strjoin(*p, "/", template);
                         if (!path)
                                 return -ENOMEM;
@@ -1459,6 +1555,9 @@ static int unit_file_search(
         STRV_FOREACH(p, paths->search_path) {
                 char *path;
 
+                if (!unit_file_index_may_exist(c ? c->index : NULL, paths, *p, dropin_dir_name))
+                        continue;
+
                 path = path_join(NULL, *p, dropin_dir_name);
                 if (!path)
                         return -ENOMEM;
@@ -1473,6 +1572,9 @@ static int unit_file_search(
                 STRV_FOREACH(p, paths->search_path) {
                         char *path;
 
+                        if (!unit_file_index_may_exist(c ? c->index : NULL, paths, *p, dropin_template_dir_name))
+                                continue;
+
                         path = path_join(NULL, *p, dropin_template_dir_name);
                         if (!path)
                                 return -ENOMEM;
@@ -2446,7 +2548,8 @@ int unit_file_enable(
                 size_t *n_changes) {
 
         _cleanup_(lookup_paths_free) LookupPaths paths = {};
-        _cleanup_(install_context_done) InstallContext c = {};
+        _cleanup_(unit_file_index_done) UnitFileIndex index = {};
+        _cleanup_(install_context_done) InstallContext c = { .index = &index };
         const char *config_path;
         UnitFileInstallInfo *i;
         char **f;
@@ -2492,7 +2595,8 @@ int unit_file_disable(
                 size_t *n_changes) {
 
         _cleanup_(lookup_paths_free) LookupPaths paths = {};
-        _cleanup_(install_context_done) InstallContext c = {};
+        _cleanup_(unit_file_index_done) UnitFileIndex index = {};
+        _cleanup_(install_context_done) InstallContext c = { .index = &index };
         _cleanup_set_free_free_ Set *remove_symlinks_to = NULL;
         bool dry_run = !!(flags & UNIT_FILE_DRY_RUN);
         const char *config_path;
@@ -2963,7 +3067,7 @@ static int preset_prepare_one(
                 UnitFileChange **changes,
                 size_t *n_changes) {
 
-        _cleanup_(install_context_done) InstallContext tmp = {};
+        _cleanup_(install_context_done) InstallContext tmp = { .index = plus->index };
         UnitFileInstallInfo *i;
         int r;
 
@@ -3008,7 +3112,8 @@ int unit_file_preset(
                 UnitFileChange **changes,
                 size_t *n_changes) {
 
-        _cleanup_(install_context_done) InstallContext plus = {}, minus = {};
+        _cleanup_(unit_file_index_done) UnitFileIndex index = {};
+        _cleanup_(install_context_done) InstallContext plus = { .index = &index }, minus = { .index = &index };
         _cleanup_(lookup_paths_free) LookupPaths paths = {};
         _cleanup_(presets_freep) Presets presets = {};
         char **i;
@@ -3043,7 +3148,8 @@ int unit_file_preset_all(
                 UnitFileChange **changes,
                 size_t *n_changes) {
 
-        _cleanup_(install_context_done) InstallContext plus = {}, minus = {};
+        _cleanup_(unit_file_index_done) UnitFileIndex index = {};
+        _cleanup_(install_context_done) InstallContext plus = { .index = &index }, minus = { .index = &index };
         _cleanup_(lookup_paths_free) LookupPaths paths = {};
         _cleanup_(presets_freep) Presets presets = {};
         char **i;
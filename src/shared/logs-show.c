@@ -1402,8 +1402,9 @@ int add_match_this_boot(sd_journal *j, const char *machine) {
         return 0;
 }
 
-int show_journal_by_unit(
+int show_journal_by_unit_full(
                 FILE *f,
+                sd_journal **journal,
                 const char *unit,
                 OutputMode mode,
                 unsigned n_columns,
@@ -1415,9 +1416,10 @@ int show_journal_by_unit(
                 bool system_unit,
                 bool *ellipsized) {
 
-        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        sd_journal *j;
         int r;
 
+        assert(journal);
         assert(mode >= 0);
         assert(mode < _OUTPUT_MODE_MAX);
         assert(unit);
@@ -1425,9 +1427,19 @@ int show_journal_by_unit(
         if (how_many <= 0)
                 return 0;
 
-        r = sd_journal_open(&j, journal_open_flags);
-        if (r < 0)
-                return log_error_errno(r, "Failed to open journal: %m");
+        /* Opening the journal means finding, opening and mapping all journal files, which is by far the
+         * most expensive part of this. Hence, if the caller passes in a journal we opened earlier, just
+         * replace the matches and seek again. */
+        if (*journal) {
+                j = *journal;
+                sd_journal_flush_matches(j);
+        } else {
+                r = sd_journal_open(journal, journal_open_flags);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to open journal: %m");
+
+                j = *journal;
+        }
 
         r = add_match_this_boot(j, NULL);
         if (r < 0)
@@ -1452,3 +1464,22 @@ int show_journal_by_unit(
 
         return show_journal(f, j, mode, n_columns, not_before, how_many, flags, ellipsized);
 }
+
+int show_journal_by_unit(
+                FILE *f,
+                const char *unit,
+                OutputMode mode,
+                unsigned n_columns,
+                usec_t not_before,
+                unsigned how_many,
+                uid_t uid,
+                OutputFlags flags,
+                int journal_open_flags,
+                bool system_unit,
+                bool *ellipsized) {
+
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+
+        return show_journal_by_unit_full(f, &j, unit, mode, n_columns, not_before, how_many, uid, flags,
+                                         journal_open_flags, system_unit, ellipsized);
+}
@@ -18,6 +18,7 @@
 
 #include "sd-bus.h"
 #include "sd-daemon.h"
+#include "sd-journal.h"
 #include "sd-login.h"
 
 #include "alloc-util.h"
@@ -185,6 +186,14 @@ typedef enum BusFocus {
 
 static sd_bus *busses[_BUS_FOCUS_MAX] = {};
 
+/* When showing many units, we issue the GetAll() calls for a batch of them at once rather than waiting for each
+ * reply in turn, and open the journal only once. */
+#define PROPERTIES_PREFETCH_MAX 64U
+
+static Hashmap *prefetched_properties = NULL; /* unit object path → GetAll() reply, or NULL if not received */
+static unsigned n_prefetch_pending = 0;
+static sd_journal *status_journal = NULL;
+
 static UnitFileFlags args_to_flags(void) {
         return (arg_runtime ? UNIT_FILE_RUNTIME : 0) |
                (arg_force   ? UNIT_FILE_FORCE   : 0);
@@ -229,6 +238,21 @@ static void release_busses(void) {
                 busses[w] = sd_bus_flush_close_unref(busses[w]);
 }
 
+static void release_prefetched_properties(void) {
+        sd_bus_message *m;
+        Iterator i;
+        char *path;
+
+        /* Only call this after the busses are closed, as pending calls reference the paths */
+
+        HASHMAP_FOREACH_KEY(m, path, prefetched_properties, i) {
+                sd_bus_message_unref(m);
+                free(path);
+        }
+
+        prefetched_properties = hashmap_free(prefetched_properties);
+}
+
 static void ask_password_agent_open_if_enabled(void) {
         /* Open the password agent as a child process if necessary */
 
@@ -4351,8 +4375,9 @@ static void print_status_info(
         }
 
         if (i->id && arg_transport == BUS_TRANSPORT_LOCAL)
-                show_journal_by_unit(
+                show_journal_by_unit_full(
                                 stdout,
+                                &status_journal,
                                 i->id,
                                 arg_output,
                                 0,
@@ -4901,6 +4926,87 @@ static const char* const systemctl_show_mode_table[] = {
 
 DEFINE_PRIVATE_STRING_TABLE_LOOKUP_FROM_STRING(systemctl_show_mode, SystemctlShowMode);
 
+static int prefetch_properties_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        const char *path = userdata;
+
+        assert(n_prefetch_pending > 0);
+        n_prefetch_pending--;
+
+        /* Leave errors for show_one() to report, it will do a synchronous call for this unit */
+        if (sd_bus_message_is_method_error(m, NULL))
+                return 0;
+
+        if (hashmap_update(prefetched_properties, path, m) >= 0)
+                sd_bus_message_ref(m);
+
+        return 0;
+}
+
+static int prefetch_properties(sd_bus *bus, const char* const *names, size_t n) {
+        size_t k;
+        int r;
+
+        assert(bus);
+
+        /* Sends out GetAll() for the specified units in one go, and collects the replies. This way we pay
+         * the round trip to the manager once per batch instead of once per unit. Failures are not fatal,
+         * show_one() will query the properties itself if they are missing. */
+
+        if (n <= 1)
+                return 0;
+
+        r = hashmap_ensure_allocated(&prefetched_properties, &string_hash_ops);
+        if (r < 0)
+                return log_oom();
+
+        for (k = 0; k < n; k++) {
+                _cleanup_free_ char *path = NULL;
+
+                path = unit_dbus_path_from_name(names[k]);
+                if (!path)
+                        return log_oom();
+
+                if (hashmap_contains(prefetched_properties, path))
+                        continue;
+
+                r = hashmap_put(prefetched_properties, path, NULL);
+                if (r < 0)
+                        return log_oom();
+
+                r = sd_bus_call_method_async(
+                                bus,
+                                NULL,
+                                "org.freedesktop.systemd1",
+                                path,
+                                "org.freedesktop.DBus.Properties",
+                                "GetAll",
+                                prefetch_properties_reply,
+                                path,
+                                "s", "");
+                path = NULL;
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to issue GetAll() call, not prefetching properties: %m");
+                        break;
+                }
+
+                n_prefetch_pending++;
+        }
+
+        while (n_prefetch_pending > 0) {
+                r = sd_bus_process(bus, NULL);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to process bus: %m");
+                if (r > 0)
+                        continue;
+
+                r = sd_bus_wait(bus, (uint64_t) -1);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to wait for bus: %m");
+        }
+
+        return 0;
+}
+
 static int show_one(
                 sd_bus *bus,
                 const char *path,
@@ -5007,15 +5113,27 @@ static int show_one(
 
         log_debug("Showing one %s", path);
 
-        r = bus_map_all_properties(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
-                        show_mode == SYSTEMCTL_SHOW_STATUS ? status_map : property_map,
-                        BUS_MAP_BOOLEAN_AS_BOOL,
-                        &error,
-                        &reply,
-                        &info);
+        reply = hashmap_get(prefetched_properties, path);
+        if (reply) {
+                /* Take the reply out of the cache, but leave the key in place, the GetAll() call is done */
+                (void) hashmap_update(prefetched_properties, path, NULL);
+
+                r = bus_message_map_all_properties(
+                                reply,
+                                show_mode == SYSTEMCTL_SHOW_STATUS ? status_map : property_map,
+                                BUS_MAP_BOOLEAN_AS_BOOL,
+                                &error,
+                                &info);
+        } else
+                r = bus_map_all_properties(
+                                bus,
+                                "org.freedesktop.systemd1",
+                                path,
+                                show_mode == SYSTEMCTL_SHOW_STATUS ? status_map : property_map,
+                                BUS_MAP_BOOLEAN_AS_BOOL,
+                                &error,
+                                &reply,
+                                &info);
         if (r < 0)
                 return log_error_errno(r, "Failed to get properties: %s", bus_error_message(&error, r));
 
@@ -5120,6 +5238,17 @@ static int show_all(
         for (u = unit_infos; u < unit_infos + c; u++) {
                 _cleanup_free_ char *p = NULL;
 
+                if ((u - unit_infos) % PROPERTIES_PREFETCH_MAX == 0) {
+                        const char *ids[PROPERTIES_PREFETCH_MAX];
+                        size_t k, n;
+
+                        n = MIN((size_t) (unit_infos + c - u), PROPERTIES_PREFETCH_MAX);
+                        for (k = 0; k < n; k++)
+                                ids[k] = u[k].id;
+
+                        (void) prefetch_properties(bus, ids, n);
+                }
+
                 p = unit_dbus_path_from_name(u->id);
                 if (!p)
                         return log_oom();
@@ -5290,6 +5419,9 @@ static int show(int argc, char *argv[], void *userdata) {
                         STRV_FOREACH(name, names) {
                                 _cleanup_free_ char *path;
 
+                                if ((name - names) % PROPERTIES_PREFETCH_MAX == 0)
+                                        (void) prefetch_properties(bus, (const char* const*) name, MIN(strv_length(name), PROPERTIES_PREFETCH_MAX));
+
                                 path = unit_dbus_path_from_name(*name);
                                 if (!path)
                                         return log_oom();
@@ -8577,6 +8709,8 @@ int main(int argc, char*argv[]) {
 
 finish:
         release_busses();
+        release_prefetched_properties();
+        sd_journal_close(status_journal);
 
         pager_close();
         ask_password_agent_close();
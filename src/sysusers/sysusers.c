@@ -4,6 +4,7 @@
 #include <utmp.h>
 
 #include "alloc-util.h"
+#include "bitmap.h"
 #include "conf-files.h"
 #include "copy.h"
 #include "def.h"
@@ -75,6 +76,14 @@ static uid_t search_uid = UID_INVALID;
 static UidRange *uid_range = NULL;
 static unsigned n_uid_range = 0;
 
+/* IDs in the allocation range that are taken by a user or a group, either in the files or by an entry we are about to
+ * add. This is built once, and lets us skip over used IDs quickly when looking for a free one. IDs that are not marked
+ * still get the full checks of uid_is_ok() and gid_is_ok(). */
+static Bitmap *used_ids = NULL;
+
+/* Don't let the bitmap grow beyond 2 MiB, IDs above this are simply not marked */
+#define USED_IDS_MAX (UINT32_C(1) << 24)
+
 static int load_user_database(void) {
         _cleanup_fclose_ FILE *f = NULL;
         const char *passwd_path;
@@ -173,6 +182,42 @@ static int load_group_database(void) {
         return 0;
 }
 
+static int mark_id_used(uid_t id) {
+
+        if (id == 0 || id >= USED_IDS_MAX)
+                return 0;
+
+        if (!uid_range_contains(uid_range, n_uid_range, id))
+                return 0;
+
+        return bitmap_set(used_ids, id);
+}
+
+static int load_used_ids(void) {
+        Iterator iterator;
+        const void *k;
+        char *n;
+        int r;
+
+        r = bitmap_ensure_allocated(&used_ids);
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH_KEY(n, k, database_uid, iterator) {
+                r = mark_id_used(PTR_TO_UID(k));
+                if (r < 0)
+                        return r;
+        }
+
+        HASHMAP_FOREACH_KEY(n, k, database_gid, iterator) {
+                r = mark_id_used(PTR_TO_GID(k));
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
 static int make_backup(const char *target, const char *x) {
         _cleanup_close_ int src = -1;
         _cleanup_fclose_ FILE *dst = NULL;
@@ -1010,6 +1055,11 @@ static int add_user(Item *i) {
                                 return r;
                         }
 
+                        /* A used ID would only be acceptable if it belongs to the group of the same name, and
+                         * that one we tried above already */
+                        if (bitmap_isset(used_ids, search_uid))
+                                continue;
+
                         r = uid_is_ok(search_uid, i->name, true);
                         if (r < 0)
                                 return log_error_errno(r, "Failed to verify uid " UID_FMT ": %m", i->uid);
@@ -1029,6 +1079,10 @@ static int add_user(Item *i) {
         if (r < 0)
                 return log_oom();
 
+        r = mark_id_used(i->uid);
+        if (r < 0)
+                return log_oom();
+
         i->todo_user = true;
         log_info("Creating user %s (%s) with uid " UID_FMT " and gid " GID_FMT ".", i->name, strna(i->description), i->uid, i->gid);
 
@@ -1167,6 +1221,9 @@ static int add_group(Item *i) {
                                 return r;
                         }
 
+                        if (bitmap_isset(used_ids, search_uid))
+                                continue;
+
                         r = gid_is_ok(search_uid);
                         if (r < 0)
                                 return log_error_errno(r, "Failed to verify gid " GID_FMT ": %m", i->gid);
@@ -1186,6 +1243,10 @@ static int add_group(Item *i) {
         if (r < 0)
                 return log_oom();
 
+        r = mark_id_used(i->gid);
+        if (r < 0)
+                return log_oom();
+
         i->todo_group = true;
         log_info("Creating group %s with gid " GID_FMT ".", i->name, i->gid);
 
@@ -1987,6 +2048,12 @@ int main(int argc, char *argv[]) {
                 goto finish;
         }
 
+        r = load_used_ids();
+        if (r < 0) {
+                log_oom();
+                goto finish;
+        }
+
         ORDERED_HASHMAP_FOREACH(i, groups, iterator)
                 (void) process_item(i);
 
@@ -2016,6 +2083,7 @@ finish:
         free_database(database_group, database_gid);
 
         free(uid_range);
+        bitmap_free(used_ids);
 
         free(arg_root);
 
@@ -191,6 +191,68 @@ static void test_execution_order(void) {
         (void) rm_rf(template_hi, REMOVE_ROOT|REMOVE_PHYSICAL);
 }
 
+static void test_execute_strv(void) {
+        char template[] = "/tmp/test-exec-util-strv.XXXXXXX";
+        const char *fast, *slow, *fail, *masked, *t;
+        char *argv_fast[] = { NULL, (char*) "one", NULL };
+        char *argv_slow[] = { NULL, (char*) "two", NULL };
+        char **argvs[4] = { argv_slow, argv_fast, NULL, NULL };
+        ExecutorResult results[4];
+        _cleanup_free_ char *contents = NULL;
+        char *paths[5];
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp(template));
+
+        fast = strjoina(template, "/fast");
+        slow = strjoina(template, "/slow");
+        fail = strjoina(template, "/fail");
+        masked = strjoina(template, "/masked");
+
+        t = strjoina("#!/bin/sh\necho $1 >", template, "/fast.out");
+        assert_se(write_string_file(fast, t, WRITE_STRING_FILE_CREATE) == 0);
+
+        t = strjoina("#!/bin/sh\nsleep 0.2\necho $1 >", template, "/slow.out");
+        assert_se(write_string_file(slow, t, WRITE_STRING_FILE_CREATE) == 0);
+
+        assert_se(write_string_file(fail, "#!/bin/sh\nexit 3", WRITE_STRING_FILE_CREATE) == 0);
+
+        assert_se(symlink("/dev/null", masked) == 0);
+
+        assert_se(chmod(fast, 0755) == 0);
+        assert_se(chmod(slow, 0755) == 0);
+        assert_se(chmod(fail, 0755) == 0);
+
+        /* The slow one goes first, so that its runtime is only measured correctly if children are
+         * reaped in the order they finish */
+        paths[0] = (char*) slow;
+        paths[1] = (char*) fast;
+        paths[2] = (char*) fail;
+        paths[3] = (char*) masked;
+        paths[4] = NULL;
+
+        assert_se(execute_strv("test-exec-util", paths, DEFAULT_TIMEOUT_USEC, NULL, NULL, argvs, results) >= 0);
+
+        assert_se(results[0].status == 0);
+        assert_se(results[0].duration >= 200 * USEC_PER_MSEC);
+        assert_se(results[1].status == 0);
+        assert_se(results[1].duration < results[0].duration);
+        assert_se(results[2].status == 3);
+        assert_se(results[2].duration != USEC_INFINITY);
+        assert_se(results[3].status == 0);
+        assert_se(results[3].duration == USEC_INFINITY);
+
+        assert_se(read_full_file(strjoina(template, "/fast.out"), &contents, NULL) >= 0);
+        assert_se(streq(contents, "one\n"));
+        contents = mfree(contents);
+
+        assert_se(read_full_file(strjoina(template, "/slow.out"), &contents, NULL) >= 0);
+        assert_se(streq(contents, "two\n"));
+
+        (void) rm_rf(template, REMOVE_ROOT|REMOVE_PHYSICAL);
+}
+
 static int gather_stdout_one(int fd, void *arg) {
         char ***s = arg, *t;
         char buf[128] = {};
@@ -341,6 +403,7 @@ int main(int argc, char *argv[]) {
         test_execute_directory(true);
         test_execute_directory(false);
         test_execution_order();
+        test_execute_strv();
         test_stdout_gathering();
         test_environment_gathering();
 
@@ -0,0 +1,210 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "generator-cache.h"
+#include "log.h"
+#include "mkdir.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
+
+static const char *root;
+static LookupPaths lp;
+
+static void write_generator(const char *name, const char *script, const char *inputs) {
+        const char *p;
+
+        p = strjoina(root, "/bin/", name);
+        assert_se(write_string_file(p, script, WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(chmod(p, 0755) == 0);
+
+        if (inputs) {
+                p = strjoina(p, ".inputs");
+                assert_se(write_string_file(p, inputs, WRITE_STRING_FILE_CREATE) == 0);
+        }
+}
+
+static unsigned count_runs(const char *name) {
+        _cleanup_free_ char *contents = NULL;
+        const char *p;
+
+        p = strjoina(root, "/", name, ".count");
+        if (read_full_file(p, &contents, NULL) < 0)
+                return 0;
+
+        return strlen(contents);
+}
+
+static void check_output(const char *dir, const char *name, const char *expected) {
+        _cleanup_free_ char *contents = NULL;
+
+        assert_se(read_full_file(strjoina(dir, "/", name), &contents, NULL) >= 0);
+        assert_se(streq(contents, expected));
+}
+
+static void check_symlink(const char *dir, const char *name, const char *expected) {
+        _cleanup_free_ char *target = NULL;
+
+        assert_se(readlink_malloc(strjoina(dir, "/", name), &target) >= 0);
+        assert_se(streq(target, expected));
+}
+
+static void check_symlinks(void) {
+        /* Absolute links into the private output directories must point to the real ones after the merge,
+         * relative ones are copied as they are, and links of uncached generators are not touched */
+        check_symlink(lp.generator, "multi-user.target.wants/cached.service", strjoina(lp.generator, "/cached.service"));
+        check_symlink(lp.generator_late, "cached-alias.service", strjoina(lp.generator, "/cached.service"));
+        check_symlink(lp.generator_late, "normal", lp.generator);
+        check_symlink(lp.generator, "cached-relative.service", "cached.service");
+        check_symlink(lp.generator, "plain-alias.service", "/dev/null");
+}
+
+static void reload(Hashmap **generators, char **binaries) {
+        /* Like the manager does on daemon-reload: flush the output directories, then run the
+         * generators again */
+        (void) rm_rf(lp.generator, REMOVE_ROOT|REMOVE_PHYSICAL);
+        (void) rm_rf(lp.generator_early, REMOVE_ROOT|REMOVE_PHYSICAL);
+        (void) rm_rf(lp.generator_late, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        assert_se(mkdir_p(lp.generator, 0755) >= 0);
+        assert_se(mkdir_p(lp.generator_early, 0755) >= 0);
+        assert_se(mkdir_p(lp.generator_late, 0755) >= 0);
+
+        assert_se(generators_run(generators, binaries, &lp, 10 * USEC_PER_SEC) >= 0);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(generators_freep) Hashmap *generators = NULL;
+        _cleanup_strv_free_ char **binaries = NULL;
+        char template[] = "/tmp/test-generator-cache.XXXXXX";
+        const char *input, *t;
+        Generator *g;
+
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        assert_se(unsetenv("TEST_GENERATOR_CACHE") == 0);
+
+        assert_se(mkdtemp(template));
+        root = template;
+
+        assert_se(mkdir_p(strjoina(root, "/bin"), 0755) >= 0);
+        lp.generator = strjoina(root, "/generator");
+        lp.generator_early = strjoina(root, "/generator.early");
+        lp.generator_late = strjoina(root, "/generator.late");
+
+        input = strjoina(root, "/input");
+        assert_se(write_string_file(input, "foo", WRITE_STRING_FILE_CREATE) == 0);
+
+        /* Doesn't declare its inputs, hence is always run */
+        t = strjoina("#!/bin/sh\n"
+                     "echo -n x >>", root, "/plain.count\n"
+                     "echo plain >$1/plain.service\n"
+                     "ln -s /dev/null $1/plain-alias.service\n");
+        write_generator("plain", t, NULL);
+
+        /* Declares its inputs, writes to the normal and late directories, and conflicts with the
+         * output of the plain one */
+        t = strjoina("#!/bin/sh\n"
+                     "echo -n x >>", root, "/cached.count\n"
+                     "cat ", input, " >$1/cached.service\n"
+                     "echo $TEST_GENERATOR_CACHE >$3/cached-late.service\n"
+                     "echo cached >$1/plain.service\n"
+                     "mkdir $1/multi-user.target.wants\n"
+                     "ln -s $1/cached.service $1/multi-user.target.wants/cached.service\n"
+                     "ln -s $1/cached.service $3/cached-alias.service\n"
+                     "ln -s $1 $3/normal\n"
+                     "ln -s cached.service $1/cached-relative.service\n"
+                     "ln -s $1/cached.service $1/plain-alias.service\n");
+        write_generator("cached", t,
+                        strjoina("[Inputs]\n"
+                                 "Paths=", input, " /no/such/path\n"
+                                 "Environment=TEST_GENERATOR_CACHE\n"));
+
+        /* Declares its inputs, but fails, hence its output must not be reused */
+        t = strjoina("#!/bin/sh\n"
+                     "echo -n x >>", root, "/failing.count\n"
+                     "echo failing >$1/failing.service\n"
+                     "exit 1\n");
+        write_generator("failing", t, "[Inputs]\nKernelCommandLine=yes\n");
+
+        assert_se(binaries = strv_new(strjoina(root, "/bin/cached"),
+                                      strjoina(root, "/bin/cached.inputs"),
+                                      strjoina(root, "/bin/failing"),
+                                      strjoina(root, "/bin/plain"),
+                                      NULL));
+
+        log_info("/* initial run */");
+        reload(&generators, binaries);
+        assert_se(hashmap_size(generators) == 3);
+        assert_se(count_runs("plain") == 1);
+        assert_se(count_runs("cached") == 1);
+        assert_se(count_runs("failing") == 1);
+        check_output(lp.generator, "cached.service", "foo\n");
+        check_output(lp.generator_late, "cached-late.service", "\n");
+        check_output(lp.generator, "failing.service", "failing\n");
+        check_output(lp.generator, "plain.service", "plain\n");
+        check_symlinks();
+
+        assert_se(g = hashmap_get(generators, "cached"));
+        assert_se(g->inputs);
+        assert_se(!g->cached);
+        assert_se(g->runtime != USEC_INFINITY);
+        assert_se(g = hashmap_get(generators, "failing"));
+        assert_se(!g->inputs);
+        assert_se(g = hashmap_get(generators, "plain"));
+        assert_se(!g->inputs);
+
+        log_info("/* nothing changed */");
+        reload(&generators, binaries);
+        assert_se(count_runs("plain") == 2);
+        assert_se(count_runs("cached") == 1);
+        assert_se(count_runs("failing") == 2);
+        check_output(lp.generator, "cached.service", "foo\n");
+        check_output(lp.generator_late, "cached-late.service", "\n");
+        check_output(lp.generator, "plain.service", "plain\n");
+        check_symlinks();
+        assert_se(g = hashmap_get(generators, "cached"));
+        assert_se(g->cached);
+        assert_se(g->runtime != USEC_INFINITY);
+
+        log_info("/* input file changed */");
+        assert_se(write_string_file(input, "bar", WRITE_STRING_FILE_CREATE) == 0);
+        reload(&generators, binaries);
+        assert_se(count_runs("cached") == 2);
+        check_output(lp.generator, "cached.service", "bar\n");
+        assert_se(g = hashmap_get(generators, "cached"));
+        assert_se(!g->cached);
+
+        log_info("/* environment changed */");
+        assert_se(setenv("TEST_GENERATOR_CACHE", "1", 1) == 0);
+        reload(&generators, binaries);
+        assert_se(count_runs("cached") == 3);
+        check_output(lp.generator_late, "cached-late.service", "1\n");
+
+        reload(&generators, binaries);
+        assert_se(count_runs("cached") == 3);
+        check_output(lp.generator_late, "cached-late.service", "1\n");
+
+        log_info("/* generator removed */");
+        strv_remove(binaries, strjoina(root, "/bin/cached"));
+        reload(&generators, binaries);
+        assert_se(hashmap_size(generators) == 2);
+        assert_se(!hashmap_get(generators, "cached"));
+        assert_se(access(strjoina(root, "/generator.cache/cached"), F_OK) < 0);
+        assert_se(access(strjoina(lp.generator, "/cached.service"), F_OK) < 0);
+
+        generators_flush_cache(&lp);
+        assert_se(access(strjoina(root, "/generator.cache"), F_OK) < 0);
+
+        (void) rm_rf(template, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        return 0;
+}
@@ -1,12 +1,16 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include "alloc-util.h"
+#include "env-util.h"
 #include "fileio.h"
 #include "install.h"
+#include "log.h"
 #include "mkdir.h"
 #include "rm-rf.h"
 #include "special.h"
+#include "stdio-util.h"
 #include "string-util.h"
+#include "time-util.h"
 
 static void test_basic_mask_and_enable(const char *root) {
         const char *p;
@@ -983,9 +987,56 @@ static void test_with_dropin_template(const char *root) {
         assert_se(unit_file_get_state(UNIT_FILE_SYSTEM, root, "with-dropin-3@instance-2.service", &state) >= 0 && state == UNIT_FILE_ENABLED);
 }
 
+static void test_preset_all_many(const char *root, bool slow) {
+        UnitFileChange *changes = NULL;
+        size_t n_changes = 0;
+        unsigned i, n = slow ? 3000 : 200;
+        char buf[FORMAT_TIMESPAN_MAX];
+        UnitFileState state;
+        usec_t t;
+        const char *p;
+
+        for (i = 0; i < n; i++) {
+                char name[STRLEN("many-.service") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "many-%u.service", i);
+                p = strjoina(root, "/usr/lib/systemd/system/", name);
+                assert_se(write_string_file(p,
+                                            "[Install]\n"
+                                            "WantedBy=multi-user.target\n", WRITE_STRING_FILE_CREATE) >= 0);
+        }
+
+        p = strjoina(root, "/usr/lib/systemd/system-preset/many.preset");
+        assert_se(write_string_file(p, "enable many-*.service\n", WRITE_STRING_FILE_CREATE) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(unit_file_preset_all(UNIT_FILE_SYSTEM, 0, root, UNIT_FILE_PRESET_ENABLE_ONLY, &changes, &n_changes) >= 0);
+        log_info("preset-all over %u units: %s", n, format_timespan(buf, sizeof(buf), now(CLOCK_MONOTONIC) - t, USEC_PER_MSEC));
+        assert_se(n_changes >= n);
+        unit_file_changes_free(changes, n_changes);
+        changes = NULL; n_changes = 0;
+
+        assert_se(unit_file_get_state(UNIT_FILE_SYSTEM, root, "many-0.service", &state) >= 0 && state == UNIT_FILE_ENABLED);
+        assert_se(unit_file_get_state(UNIT_FILE_SYSTEM, root, "many-1.service", &state) >= 0 && state == UNIT_FILE_ENABLED);
+
+        /* A second pass has nothing left to do */
+        t = now(CLOCK_MONOTONIC);
+        assert_se(unit_file_preset_all(UNIT_FILE_SYSTEM, 0, root, UNIT_FILE_PRESET_ENABLE_ONLY, &changes, &n_changes) >= 0);
+        log_info("preset-all over %u units, nothing to do: %s", n, format_timespan(buf, sizeof(buf), now(CLOCK_MONOTONIC) - t, USEC_PER_MSEC));
+        unit_file_changes_free(changes, n_changes);
+}
+
 int main(int argc, char *argv[]) {
         char root[] = "/tmp/rootXXXXXX";
         const char *p;
+        bool slow;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
 
         assert_se(mkdtemp(root));
 
@@ -1016,6 +1067,7 @@ int main(int argc, char *argv[]) {
         test_static_instance(root);
         test_with_dropin(root);
         test_with_dropin_template(root);
+        test_preset_all_many(root, slow);
 
         assert_se(rm_rf(root, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
 
@@ -1,11 +1,19 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <stddef.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
+#include "alloc-util.h"
+#include "fd-util.h"
 #include "format-util.h"
+#include "io-util.h"
 #include "log.h"
 #include "process-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "time-util.h"
 #include "util.h"
 
 assert_cc(LOG_REALM_REMOVE_LEVEL(LOG_REALM_PLUS_LEVEL(LOG_REALM_SYSTEMD, LOG_FTP | LOG_DEBUG))
@@ -52,6 +60,181 @@ static void test_long_lines(void) {
                             "asdfasdf %s asdfasdfa", "foobar");
 }
 
+#define DUMMY "MESSAGE=Dummy\n"
+
+static void fill_socket(int fd) {
+        /* Make the socket look like journald is busy */
+        while (send(fd, DUMMY, STRLEN(DUMMY), MSG_DONTWAIT|MSG_NOSIGNAL) >= 0)
+                ;
+
+        assert_se(errno == EAGAIN);
+}
+
+static void receive_messages(int fd, char ***l) {
+        static char buf[64 * 1024 + 1];
+
+        for (;;) {
+                const char *m;
+                ssize_t n;
+
+                n = recv(fd, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+                if (n < 0) {
+                        assert_se(errno == EAGAIN);
+                        return;
+                }
+                buf[n] = 0;
+
+                if (streq(buf, DUMMY))
+                        continue;
+
+                m = strstr(buf, "\nMESSAGE=");
+                assert_se(m);
+                m += STRLEN("\nMESSAGE=");
+
+                assert_se(strv_extend(l, strndupa(m, strcspn(m, "\n"))) >= 0);
+        }
+}
+
+static void flush_and_receive(int fd, char ***l) {
+        int r;
+
+        do {
+                r = log_async_flush(false);
+                assert_se(r >= 0);
+                receive_messages(fd, l);
+        } while (r > 0);
+
+        /* The warning about dropped messages is only queued once everything before it was sent */
+        assert_se(log_async_flush(false) == 0);
+        receive_messages(fd, l);
+}
+
+static void log_queued(unsigned i) {
+        char message[STRLEN("MESSAGE=Queued ") + DECIMAL_STR_MAX(unsigned)];
+        _cleanup_free_ char *padding = NULL;
+        struct iovec iovec[2];
+
+        /* About 60K, so that 17 of these fit into the 1M buffer, but not 18 */
+        assert_se(padding = malloc(60000));
+        memcpy(padding, "PADDING=", STRLEN("PADDING="));
+        memset(padding + STRLEN("PADDING="), 'x', 60000 - STRLEN("PADDING="));
+
+        xsprintf(message, "MESSAGE=Queued %u", i);
+        iovec[0] = IOVEC_MAKE_STRING(message);
+        iovec[1] = IOVEC_MAKE(padding, 60000);
+
+        log_struct_iovec(LOG_INFO, iovec, ELEMENTSOF(iovec));
+}
+
+static void expect_queued(char ***l, unsigned from, unsigned to) {
+        unsigned i;
+
+        for (i = from; i < to; i++)
+                assert_se(strv_extendf(l, "Queued %u", i) >= 0);
+}
+
+static void start_async(int fds[2]) {
+        assert_se(socketpair(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC, 0, fds) >= 0);
+
+        log_set_target(LOG_TARGET_JOURNAL);
+        log_set_journal_fd(fds[0]);
+        log_set_async(true);
+}
+
+static void stop_async(int fds[2]) {
+        log_set_async(false);
+        log_set_journal_fd(-1);
+        safe_close(fds[1]);
+}
+
+static void test_log_async_wrap(void) {
+        _cleanup_strv_free_ char **l = NULL, **expected = NULL;
+        unsigned i, n;
+        int fds[2];
+
+        start_async(fds);
+        fill_socket(fds[0]);
+
+        /* Fill the buffer up to its end */
+        for (i = 0; i < 17; i++)
+                log_queued(i);
+
+        /* Let journald take a few of them */
+        receive_messages(fds[1], &l);
+        assert_se(strv_isempty(l));
+        assert_se(log_async_flush(false) >= 0);
+        receive_messages(fds[1], &l);
+        n = strv_length(l);
+        assert_se(n >= 2);
+
+        /* Anything else only fits if it is put at the beginning of the buffer again */
+        for (i = 17; i < 17 + n - 1; i++)
+                log_queued(i);
+
+        flush_and_receive(fds[1], &l);
+        expect_queued(&expected, 0, 17 + n - 1);
+        assert_se(strv_equal(l, expected));
+
+        stop_async(fds);
+}
+
+static void test_log_async_overflow(void) {
+        _cleanup_strv_free_ char **l = NULL, **expected = NULL;
+        unsigned i;
+        int fds[2];
+
+        start_async(fds);
+        fill_socket(fds[0]);
+
+        /* The last three don't fit anymore, and only go to kmsg */
+        for (i = 0; i < 20; i++)
+                log_queued(i);
+
+        flush_and_receive(fds[1], &l);
+        expect_queued(&expected, 0, 17);
+        assert_se(strv_extend(&expected, "Log buffer was full, 3 messages were only written to the kernel log buffer.") >= 0);
+        assert_se(strv_equal(l, expected));
+
+        stop_async(fds);
+}
+
+static void test_log_async_crit(void) {
+        _cleanup_strv_free_ char **l = NULL, **expected = NULL;
+        struct timeval tv;
+        int fds[2];
+
+        start_async(fds);
+
+        /* Critical messages are sent right away, but after whatever was queued before */
+        log_info("Queued 0");
+        log_info("Queued 1");
+        log_full(LOG_CRIT, "Critical");
+
+        receive_messages(fds[1], &l);
+        expect_queued(&expected, 0, 2);
+        assert_se(strv_extend(&expected, "Critical") >= 0);
+        assert_se(strv_equal(l, expected));
+
+        l = strv_free(l);
+        expected = strv_free(expected);
+
+        /* If journald doesn't take the queue in time, it is kept, and the critical message goes elsewhere, like
+         * for PID 1 */
+        timeval_store(&tv, 10 * USEC_PER_MSEC);
+        assert_se(setsockopt(fds[0], SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) >= 0);
+        fill_socket(fds[0]);
+
+        log_info("Queued 0");
+        log_info("Queued 1");
+        log_full(LOG_CRIT, "Critical, not sent to the journal");
+
+        flush_and_receive(fds[1], &l);
+        expect_queued(&expected, 0, 2);
+        assert_se(strv_equal(l, expected));
+
+        stop_async(fds);
+}
+
 int main(int argc, char* argv[]) {
         int target;
 
@@ -64,5 +247,9 @@ int main(int argc, char* argv[]) {
                 test_long_lines();
         }
 
+        test_log_async_wrap();
+        test_log_async_overflow();
+        test_log_async_crit();
+
         return 0;
 }
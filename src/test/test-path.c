@@ -2,17 +2,23 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <sys/types.h>
 
 #include "alloc-util.h"
 #include "all-units.h"
+#include "dirent-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "fs-util.h"
+#include "load-fragment.h"
 #include "macro.h"
 #include "manager.h"
 #include "mkdir.h"
 #include "rm-rf.h"
+#include "stdio-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "test-helper.h"
@@ -24,7 +30,7 @@ typedef void (*test_function_t)(Manager *m);
 
 static int setup_test(Manager **m) {
         char **tests_path = STRV_MAKE("exists", "existsglobFOOBAR", "changed", "modified", "unit",
-                                      "directorynotempty", "makedirectory");
+                                      "directorynotempty", "makedirectory", "many", "many_shared");
         char **test_path;
         Manager *tmp = NULL;
         int r;
@@ -234,6 +240,205 @@ static void test_path_makedirectory_directorymode(Manager *m) {
         (void) rm_rf(test_path, REMOVE_ROOT|REMOVE_PHYSICAL);
 }
 
+static unsigned count_fds(void) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        unsigned n = 0;
+
+        assert_se(d = opendir("/proc/self/fd"));
+
+        FOREACH_DIRENT(de, d, assert_not_reached("Failed to read /proc/self/fd"))
+                n++;
+
+        return n;
+}
+
+static void log_rss(const char *prefix) {
+        _cleanup_free_ char *rss = NULL;
+
+        if (get_proc_field("/proc/self/status", "VmRSS", NEWLINE, &rss) >= 0)
+                log_info("%s: VmRSS %s", prefix, rss);
+}
+
+static int inotify_watch_mask(const char *path, uint32_t *ret) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        struct stat st;
+
+        /* Looks for the watch on the inode of the path among the inotify objects of this process, and returns
+         * the mask the kernel has for it. */
+
+        if (stat(path, &st) < 0)
+                return -errno;
+
+        d = opendir("/proc/self/fdinfo");
+        if (!d)
+                return -errno;
+
+        FOREACH_DIRENT(de, d, return -errno) {
+                _cleanup_fclose_ FILE *f = NULL;
+                char line[LINE_MAX];
+
+                f = fopen(strjoina("/proc/self/fdinfo/", de->d_name), "re");
+                if (!f)
+                        continue;
+
+                FOREACH_LINE(line, f, return -errno) {
+                        unsigned long ino;
+                        unsigned dev;
+                        uint32_t mask;
+
+                        /* The kernel shows the device number in its internal encoding */
+                        if (sscanf(line, "inotify wd:%*x ino:%lx sdev:%x mask:%" SCNx32, &ino, &dev, &mask) != 3)
+                                continue;
+
+                        if (ino == st.st_ino && dev == (major(st.st_dev) << 20 | minor(st.st_dev))) {
+                                *ret = mask;
+                                return 0;
+                        }
+                }
+        }
+
+        return -ENOENT;
+}
+
+static Unit *start_path_exists_unit(Manager *m, Unit *service, const char *name, const char *path) {
+        Unit *u;
+
+        assert_se(u = unit_new(m, sizeof(Path)));
+        assert_se(unit_add_name(u, name) == 0);
+        assert_se(config_parse_path_spec(u->id, "filename", 1, "Path", 1, "PathExists", 0, path, PATH(u), u) == 0);
+        assert_se(unit_add_two_dependencies(u, UNIT_BEFORE, UNIT_TRIGGERS, service, true, UNIT_DEPENDENCY_IMPLICIT) >= 0);
+        u->load_state = UNIT_LOADED;
+
+        assert_se(UNIT_VTABLE(u)->start(u) >= 0);
+        assert_se(PATH(u)->state == PATH_WAITING);
+
+        return u;
+}
+
+#define N_PATH_UNITS 3000U
+
+static void test_path_many(Manager *m) {
+        const char *test_path = "/tmp/test-path_many";
+        char buf[FORMAT_TIMESPAN_MAX];
+        unsigned i, n_fds;
+        Unit *service;
+        Service *ss;
+        usec_t ts;
+
+        assert_se(m);
+
+        /* The watches of all path units are multiplexed over the event loop's inotify object, hence
+         * lots of path units must neither need lots of file descriptors nor lots of inotify instances. */
+
+        assert_se(mkdir_p(test_path, 0755) >= 0);
+        assert_se(manager_load_unit(m, "path-mycustomunit.service", NULL, NULL, &service) >= 0);
+        ss = SERVICE(service);
+
+        n_fds = count_fds();
+        log_rss("Before starting path units");
+
+        ts = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < N_PATH_UNITS; i++) {
+                char name[STRLEN("path-many-.path") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "path-many-%u.path", i);
+                (void) start_path_exists_unit(m, service, name, strjoina(test_path, "/", name));
+        }
+
+        log_info("Starting %u path units took %s", N_PATH_UNITS, format_timespan(buf, sizeof(buf), now(CLOCK_MONOTONIC) - ts, USEC_PER_MSEC));
+
+        /* One iteration, so that the event loop gets rid of the fds it keeps around for newly added watches */
+        assert_se(sd_event_run(m->event, 0) >= 0);
+
+        log_info("File descriptors in use: %u before, %u after", n_fds, count_fds());
+        log_rss("After starting path units");
+        assert_se(count_fds() <= n_fds + 1);
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(touch(strjoina(test_path, "/path-many-1234.path")) >= 0);
+
+        while (ss->result != SERVICE_SUCCESS || ss->state != SERVICE_START) {
+                assert_se(sd_event_run(m->event, 100 * USEC_PER_MSEC) >= 0);
+                assert_se(now(CLOCK_MONOTONIC) < ts + 2 * USEC_PER_SEC);
+        }
+
+        log_info("Trigger latency: %s", format_timespan(buf, sizeof(buf), now(CLOCK_MONOTONIC) - ts, 1));
+
+        assert_se(PATH(manager_get_unit(m, "path-many-1234.path"))->state == PATH_RUNNING);
+        assert_se(PATH(manager_get_unit(m, "path-many-1235.path"))->state == PATH_WAITING);
+
+        (void) rm_rf(test_path, REMOVE_ROOT|REMOVE_PHYSICAL);
+}
+
+#define N_PATH_UNITS_SHARED 100U
+
+static void test_path_many_shared(Manager *m) {
+        const char *test_path = "/tmp/test-path_many_shared", *shared, *late;
+        Unit *service, *u;
+        uint32_t mask;
+        unsigned i;
+        usec_t ts;
+
+        assert_se(m);
+
+        /* The paths of lots of units share the directories on the way. As long as the next component exists,
+         * these directories must only be watched for being moved away. A broader watch would stay on them,
+         * even if only one unit needed it at some point, and every file created in them would wake us up. */
+
+        shared = strjoina(test_path, "/shared");
+        assert_se(manager_load_unit(m, "path-mycustomunit.service", NULL, NULL, &service) >= 0);
+
+        for (i = 0; i < N_PATH_UNITS_SHARED; i++) {
+                char name[STRLEN("path-many-shared-.path") + DECIMAL_STR_MAX(unsigned)];
+                const char *d;
+
+                xsprintf(name, "path-many-shared-%u.path", i);
+                d = strjoina(shared, "/", name);
+                assert_se(mkdir_p(d, 0755) >= 0);
+
+                (void) start_path_exists_unit(m, service, name, strjoina(d, "/file"));
+        }
+
+        assert_se(sd_event_run(m->event, 0) >= 0);
+
+        assert_se(inotify_watch_mask(test_path, &mask) >= 0);
+        assert_se(mask & IN_MOVE_SELF);
+        assert_se(!(mask & (IN_CREATE|IN_MOVED_TO|IN_ATTRIB|IN_DELETE_SELF)));
+
+        assert_se(inotify_watch_mask(shared, &mask) >= 0);
+        assert_se(mask & IN_MOVE_SELF);
+        assert_se(!(mask & (IN_CREATE|IN_MOVED_TO|IN_ATTRIB|IN_DELETE_SELF)));
+
+        /* The directory the path is supposed to show up in is watched for that, of course */
+        assert_se(inotify_watch_mask(strjoina(shared, "/path-many-shared-0.path"), &mask) >= 0);
+        assert_se((mask & (IN_CREATE|IN_MOVED_TO)) == (IN_CREATE|IN_MOVED_TO));
+
+        /* A unit whose path is missing more than the last component needs to see the missing directory being
+         * created, and the ones after that. */
+        late = strjoina(shared, "/late");
+        u = start_path_exists_unit(m, service, "path-many-shared-late.path", strjoina(late, "/dir/file"));
+
+        assert_se(inotify_watch_mask(shared, &mask) >= 0);
+        assert_se(mask & IN_CREATE);
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(mkdir(late, 0755) >= 0);
+        assert_se(mkdir(strjoina(late, "/dir"), 0755) >= 0);
+        assert_se(touch(strjoina(late, "/dir/file")) >= 0);
+
+        while (PATH(u)->state != PATH_RUNNING) {
+                assert_se(sd_event_run(m->event, 100 * USEC_PER_MSEC) >= 0);
+                assert_se(now(CLOCK_MONOTONIC) < ts + 2 * USEC_PER_SEC);
+        }
+
+        assert_se(PATH(manager_get_unit(m, "path-many-shared-0.path"))->state == PATH_WAITING);
+
+        (void) rm_rf(test_path, REMOVE_ROOT|REMOVE_PHYSICAL);
+}
+
 int main(int argc, char *argv[]) {
         static const test_function_t tests[] = {
                 test_path_exists,
@@ -243,6 +448,8 @@ int main(int argc, char *argv[]) {
                 test_path_unit,
                 test_path_directorynotempty,
                 test_path_makedirectory_directorymode,
+                test_path_many,
+                test_path_many_shared,
                 NULL,
         };
 
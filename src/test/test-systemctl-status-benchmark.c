@@ -0,0 +1,205 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+/* Measures the per-unit cost of the two expensive parts of "systemctl status": fetching the unit's properties
+ * from the manager, and showing its journal. Each is done the old way (one blocking GetAll() call and one newly
+ * opened journal per unit) and the way systemctl does it now (GetAll() calls sent in batches, one journal handle
+ * reused for all units). This needs a running system manager, hence it is not run automatically. */
+
+#include <stdio.h>
+
+#include "sd-bus.h"
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "bus-error.h"
+#include "bus-unit-util.h"
+#include "bus-util.h"
+#include "fd-util.h"
+#include "log.h"
+#include "logs-show.h"
+#include "parse-util.h"
+#include "strv.h"
+#include "time-util.h"
+#include "unit-name.h"
+#include "util.h"
+
+/* Same as PROPERTIES_PREFETCH_MAX in systemctl */
+#define BATCH 64U
+
+static int list_units(sd_bus *bus, unsigned max, char ***ret) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_strv_free_ char **l = NULL;
+        UnitInfo u;
+        int r;
+
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "ListUnits",
+                        &error,
+                        &reply,
+                        NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to list units: %s", bus_error_message(&error, r));
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(ssssssouso)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = bus_parse_unit_info(reply, &u)) > 0) {
+                if (strv_length(l) >= max)
+                        continue;
+
+                r = strv_extend(&l, u.id);
+                if (r < 0)
+                        return log_oom();
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        *ret = TAKE_PTR(l);
+        return 0;
+}
+
+static int get_all_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        unsigned *n_pending = userdata;
+
+        assert_se(*n_pending > 0);
+        (*n_pending)--;
+
+        return 0;
+}
+
+static void get_all_sequential(sd_bus *bus, char **units) {
+        char **i;
+
+        STRV_FOREACH(i, units) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+                _cleanup_free_ char *path = NULL;
+
+                assert_se(path = unit_dbus_path_from_name(*i));
+                assert_se(sd_bus_call_method(
+                                          bus,
+                                          "org.freedesktop.systemd1",
+                                          path,
+                                          "org.freedesktop.DBus.Properties",
+                                          "GetAll",
+                                          NULL,
+                                          &reply,
+                                          "s", "") >= 0);
+        }
+}
+
+static void get_all_batched(sd_bus *bus, char **units) {
+        unsigned n_pending = 0;
+        char **i;
+
+        STRV_FOREACH(i, units) {
+                _cleanup_free_ char *path = NULL;
+
+                assert_se(path = unit_dbus_path_from_name(*i));
+                assert_se(sd_bus_call_method_async(
+                                          bus,
+                                          NULL,
+                                          "org.freedesktop.systemd1",
+                                          path,
+                                          "org.freedesktop.DBus.Properties",
+                                          "GetAll",
+                                          get_all_reply,
+                                          &n_pending,
+                                          "s", "") >= 0);
+                n_pending++;
+
+                if (n_pending < BATCH && i[1])
+                        continue;
+
+                while (n_pending > 0) {
+                        int r;
+
+                        r = sd_bus_process(bus, NULL);
+                        assert_se(r >= 0);
+                        if (r == 0)
+                                assert_se(sd_bus_wait(bus, USEC_INFINITY) >= 0);
+                }
+        }
+}
+
+static void show_journal_separately(FILE *f, char **units) {
+        bool ellipsized = false;
+        char **i;
+
+        STRV_FOREACH(i, units)
+                assert_se(show_journal_by_unit(f, *i, OUTPUT_SHORT, 0, 0, 10, 0, 0,
+                                               SD_JOURNAL_LOCAL_ONLY, true, &ellipsized) >= 0);
+}
+
+static void show_journal_shared(FILE *f, char **units) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        bool ellipsized = false;
+        char **i;
+
+        STRV_FOREACH(i, units)
+                assert_se(show_journal_by_unit_full(f, &j, *i, OUTPUT_SHORT, 0, 0, 10, 0, 0,
+                                                    SD_JOURNAL_LOCAL_ONLY, true, &ellipsized) >= 0);
+}
+
+static void report(const char *what, usec_t start, size_t n) {
+        char buf[FORMAT_TIMESPAN_MAX];
+
+        log_info("%-32s %s per unit", what,
+                 format_timespan(buf, sizeof(buf), (now(CLOCK_MONOTONIC) - start) / n, 1));
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_strv_free_ char **units = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        unsigned max = UINT_MAX;
+        usec_t start;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &max) >= 0);
+
+        r = sd_bus_open_system(&bus);
+        if (r < 0) {
+                log_notice_errno(r, "Failed to connect to system bus, skipping: %m");
+                return EXIT_TEST_SKIP;
+        }
+
+        r = list_units(bus, max, &units);
+        if (r < 0)
+                return EXIT_TEST_SKIP;
+        if (strv_isempty(units)) {
+                log_notice("No units loaded, skipping.");
+                return EXIT_TEST_SKIP;
+        }
+
+        assert_se(f = fopen("/dev/null", "we"));
+
+        log_info("Showing %zu units:", strv_length(units));
+
+        start = now(CLOCK_MONOTONIC);
+        get_all_sequential(bus, units);
+        report("GetAll(), one call at a time", start, strv_length(units));
+
+        start = now(CLOCK_MONOTONIC);
+        get_all_batched(bus, units);
+        report("GetAll(), batched", start, strv_length(units));
+
+        start = now(CLOCK_MONOTONIC);
+        show_journal_separately(f, units);
+        report("journal, opened for each unit", start, strv_length(units));
+
+        start = now(CLOCK_MONOTONIC);
+        show_journal_shared(f, units);
+        report("journal, shared", start, strv_length(units));
+
+        return EXIT_SUCCESS;
+}
@@ -2,9 +2,22 @@
 
 /* Some unit tests for the helper functions in timesyncd. */
 
+#include <math.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "capability-util.h"
+#include "fd-util.h"
 #include "log.h"
 #include "macro.h"
+#include "process-util.h"
 #include "timesyncd-conf.h"
+#include "timesyncd-manager.h"
+#include "timesyncd-ntp-message.h"
+#include "timesyncd-select.h"
+#include "timesyncd-server.h"
+#include "user-util.h"
 
 static void test_manager_parse_string(void) {
         /* Make sure that NTP_SERVERS is configured to something
@@ -24,11 +37,279 @@ static void test_manager_parse_string(void) {
         assert_se(manager_parse_server_string(m, SERVER_LINK, "time1.foobar.com time2.foobar.com axrfav.,avf..ra 12345..123") == 0);
 }
 
+static void test_samples_select(void) {
+        NTPSample samples[] = {
+                { .offset = 0.001, .delay = 0.010, .root_distance = 0.001 },
+                { .offset = -0.002, .delay = 0.008, .root_distance = 0.002 },
+                { .offset = 0.000, .delay = 0.020, .root_distance = 0.001 },
+                { .offset = 1.000, .delay = 0.004, .root_distance = 0.001 },
+        };
+        bool truechimers[ELEMENTSOF(samples)];
+        NTPSample combined;
+
+        /* One sample is trivially agreed on */
+        assert_se(ntp_samples_select(samples, 1, truechimers) == 1);
+        assert_se(truechimers[0]);
+        assert_se(ntp_samples_combine(samples, 1, &combined) == 1);
+        assert_se(combined.offset == samples[0].offset);
+
+        /* The odd one out is a falseticker, the rest agree */
+        assert_se(ntp_samples_select(samples, ELEMENTSOF(samples), truechimers) == 3);
+        assert_se(truechimers[0] && truechimers[1] && truechimers[2] && !truechimers[3]);
+        assert_se(ntp_samples_combine(samples, ELEMENTSOF(samples), &combined) == 3);
+        assert_se(fabs(combined.offset) < 0.002);
+        assert_se(combined.delay == samples[0].delay);
+
+        /* Two that disagree can't be told apart */
+        assert_se(ntp_samples_select(samples + 2, 2, truechimers) == -ENOENT);
+        assert_se(ntp_samples_combine(samples + 2, 2, &combined) == -ENOENT);
+
+        assert_se(ntp_samples_select(NULL, 0, NULL) == -ENOENT);
+}
+
+static double random_uniform(uint64_t *state) {
+        /* splitmix64, so that the simulation is the same on every run */
+        uint64_t z = (*state += UINT64_C(0x9E3779B97F4A7C15));
+
+        z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+        z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+        z ^= z >> 31;
+
+        return (double) (z >> 11) / (double) (UINT64_C(1) << 53);
+}
+
+static double random_exponential(uint64_t *state, double mean) {
+        return -mean * log(1 - random_uniform(state));
+}
+
+typedef struct FakeServer {
+        double error;         /* how far the server's clock is off */
+        double base_delay;    /* one-way network delay without queueing */
+        double jitter;        /* mean of the additional queueing delay in each direction */
+        double root_distance; /* what the server claims about itself */
+} FakeServer;
+
+static NTPSample fake_server_exchange(const FakeServer *s, double now, double client_offset, uint64_t *state) {
+        double t1, t2, t3, t4, out, back;
+
+        /* Timestamps as in RFC 5905, with randomly asymmetric paths */
+        out = s->base_delay + random_exponential(state, s->jitter);
+        back = s->base_delay + random_exponential(state, s->jitter);
+
+        t1 = now + client_offset;
+        t2 = now + out + s->error;
+        t3 = t2 + 0.00001;
+        t4 = now + out + 0.00001 + back + client_offset;
+
+        return (NTPSample) {
+                .offset = ((t2 - t1) + (t3 - t4)) / 2,
+                .delay = (t4 - t1) - (t3 - t2),
+                .root_distance = s->root_distance,
+        };
+}
+
+static void test_samples_simulation(void) {
+        static const FakeServer servers[] = {
+                { .error =  0.00005, .base_delay = 0.002, .jitter = 0.004, .root_distance = 0.001 },
+                { .error = -0.00010, .base_delay = 0.010, .jitter = 0.002, .root_distance = 0.002 },
+                { .error =  0.00002, .base_delay = 0.005, .jitter = 0.003, .root_distance = 0.001 },
+                { .error = -0.00003, .base_delay = 0.020, .jitter = 0.006, .root_distance = 0.003 },
+                /* a falseticker, and a convincing one */
+                { .error =  0.25000, .base_delay = 0.001, .jitter = 0.001, .root_distance = 0.0005 },
+        };
+        double client_offset = 0.1, error_single = 0, error_combined = 0, error_max_combined = 0;
+        uint64_t state = 4711;
+        unsigned i, k, rounds = 2000;
+
+        /* A fake set of servers with jittery network paths to them, the local clock 100ms ahead: compare
+         * the error of the offset measured against a single server with the combined one. */
+        for (i = 0; i < rounds; i++) {
+                NTPSample samples[ELEMENTSOF(servers)], combined;
+                bool truechimers[ELEMENTSOF(servers)];
+                double now = i * 64.0;
+
+                for (k = 0; k < ELEMENTSOF(servers); k++)
+                        samples[k] = fake_server_exchange(servers + k, now, client_offset, &state);
+
+                assert_se(ntp_samples_select(samples, ELEMENTSOF(samples), truechimers) >= 3);
+                assert_se(!truechimers[ELEMENTSOF(servers) - 1]);
+                assert_se(ntp_samples_combine(samples, ELEMENTSOF(samples), &combined) >= 3);
+
+                error_single += fabs(samples[0].offset + client_offset);
+                error_combined += fabs(combined.offset + client_offset);
+                error_max_combined = MAX(error_max_combined, fabs(combined.offset + client_offset));
+        }
+
+        log_info("Mean offset error over %u rounds: single server %.1f us, combined %.1f us (max %.1f us)",
+                 rounds, error_single / rounds * 1e6, error_combined / rounds * 1e6, error_max_combined * 1e6);
+
+        assert_se(error_combined < error_single);
+}
+
+typedef struct FakeNTPServer {
+        int fd;
+        sd_event_source *event_source;
+        union sockaddr_union sockaddr;
+        bool silent;
+        unsigned n_requests;
+} FakeNTPServer;
+
+static void ntp_ts_from_timespec(struct ntp_ts *ntp, const struct timespec *ts) {
+        ntp->sec = htobe32(ts->tv_sec + OFFSET_1900_1970);
+        ntp->frac = htobe32((uint32_t) ((double) ts->tv_nsec / NSEC_PER_SEC * UINT32_MAX));
+}
+
+static int fake_ntp_server_handler(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        FakeNTPServer *f = userdata;
+        struct ntp_msg request, reply;
+        union sockaddr_union sa;
+        socklen_t salen = sizeof(sa);
+        struct timespec ts;
+        ssize_t n;
+
+        n = recvfrom(fd, &request, sizeof(request), MSG_DONTWAIT, &sa.sa, &salen);
+        if (n < 0)
+                return errno == EAGAIN ? 0 : -errno;
+
+        assert_se(n == sizeof(request));
+        assert_se(NTP_FIELD_MODE(request.field) == NTP_MODE_CLIENT);
+        f->n_requests++;
+
+        if (f->silent)
+                return 0;
+
+        /* A stratum 1 server whose clock agrees with ours, claiming a root distance of about 1ms */
+        assert_se(clock_gettime(CLOCK_REALTIME, &ts) >= 0);
+        reply = (struct ntp_msg) {
+                .field = NTP_FIELD(0, 4, NTP_MODE_SERVER),
+                .stratum = 1,
+                .precision = -20,
+                .root_dispersion.frac = htobe16(65),
+                .refid = "FAKE",
+                .origin_time = request.trans_time,
+        };
+        ntp_ts_from_timespec(&reply.reference_time, &ts);
+        ntp_ts_from_timespec(&reply.recv_time, &ts);
+        ntp_ts_from_timespec(&reply.trans_time, &ts);
+
+        assert_se(sendto(fd, &reply, sizeof(reply), MSG_DONTWAIT, &sa.sa, salen) == sizeof(reply));
+        return 0;
+}
+
+static void fake_ntp_server_start(sd_event *e, FakeNTPServer *f, uint8_t host) {
+        socklen_t salen = sizeof(f->sockaddr.in);
+
+        /* All of 127.0.0.0/8 is local, and timesyncd tells its servers apart by their address only */
+        f->sockaddr = (union sockaddr_union) {
+                .in.sin_family = AF_INET,
+                .in.sin_addr.s_addr = htobe32(INADDR_LOOPBACK + host - 1),
+        };
+
+        assert_se((f->fd = socket(AF_INET, SOCK_DGRAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0)) >= 0);
+        assert_se(bind(f->fd, &f->sockaddr.sa, salen) >= 0);
+        assert_se(getsockname(f->fd, &f->sockaddr.sa, &salen) >= 0);
+
+        assert_se(sd_event_add_io(e, &f->event_source, f->fd, EPOLLIN, fake_ntp_server_handler, f) >= 0);
+}
+
+static void fake_ntp_server_stop(FakeNTPServer *f) {
+        f->event_source = sd_event_source_unref(f->event_source);
+        f->fd = safe_close(f->fd);
+}
+
+static void test_fake_servers_one(void) {
+        FakeNTPServer servers[] = {
+                {},
+                {},
+                /* never replies, so that the round ends with the round timeout */
+                { .silent = true },
+        };
+        ServerAddress *addresses[ELEMENTSOF(servers)];
+        Manager *m = NULL;
+        ServerName *n;
+        usec_t start;
+        unsigned i;
+
+        assert_se(manager_new(&m) >= 0);
+        m->concurrent_servers = ELEMENTSOF(servers);
+
+        assert_se(server_name_new(m, &n, SERVER_SYSTEM, "fake.example.com") >= 0);
+        for (i = 0; i < ELEMENTSOF(servers); i++) {
+                fake_ntp_server_start(m->event, servers + i, i + 1);
+                assert_se(server_address_new(n, addresses + i, &servers[i].sockaddr, sizeof(servers[i].sockaddr.in)) >= 0);
+        }
+
+        manager_set_server_address(m, addresses[0]);
+        assert_se(manager_begin(m) >= 0);
+
+        start = now(CLOCK_MONOTONIC);
+        while (m->packet_count == 0) {
+                assert_se(now(CLOCK_MONOTONIC) < start + 10 * USEC_PER_SEC);
+                assert_se(sd_event_run(m->event, USEC_PER_SEC) >= 0);
+        }
+
+        /* Everybody got asked, but the round only completed once the silent server timed out */
+        for (i = 0; i < ELEMENTSOF(servers); i++)
+                assert_se(servers[i].n_requests == 1);
+        assert_se(now(CLOCK_MONOTONIC) >= start + USEC_PER_SEC);
+        assert_se(m->n_peers == ELEMENTSOF(servers));
+        assert_se(m->n_peers_pending == 1);
+        assert_se(addresses[0]->have_sample && addresses[1]->have_sample);
+        assert_se(!addresses[2]->have_sample && addresses[2]->pending);
+        assert_se(m->good && !m->spike);
+
+        /* The socket is closed until the next poll */
+        assert_se(m->server_socket < 0);
+        assert_se(m->event_timer);
+
+        /* With SO_TIMESTAMPING the loopback device timestamps outgoing packets in software, and those are
+         * used instead of the time the request was put together */
+        log_info("Loopback server: offset %+.6f sec, delay %.6f sec, kernel transmit timestamp: %s",
+                 addresses[0]->sample.offset, addresses[0]->sample.delay,
+                 yes_no(addresses[0]->have_trans_time_kernel));
+        if (m->timestamping)
+                assert_se(addresses[0]->have_trans_time_kernel && addresses[1]->have_trans_time_kernel);
+
+        for (i = 0; i < 2; i++) {
+                assert_se(fabs(addresses[i]->sample.offset) < 0.1);
+                assert_se(addresses[i]->sample.delay > -0.001 && addresses[i]->sample.delay < 0.1);
+                assert_se(fabs(addresses[i]->sample.root_distance - 65.0 / 65536) < 1e-9);
+        }
+
+        for (i = 0; i < ELEMENTSOF(servers); i++)
+                fake_ntp_server_stop(servers + i);
+
+        manager_free(m);
+}
+
+static void test_fake_servers(void) {
+        int r;
+
+        /* Don't touch the system clock: as root, do the test as nobody, so that clock_adjtime() fails */
+        if (geteuid() != 0) {
+                test_fake_servers_one();
+                return;
+        }
+
+        r = safe_fork("(test-fake-servers)", FORK_DEATHSIG|FORK_LOG|FORK_WAIT, NULL);
+        assert_se(r >= 0);
+        if (r == 0) {
+                if (drop_privileges(UID_NOBODY, GID_NOBODY, 0) < 0)
+                        _exit(EXIT_FAILURE);
+
+                test_fake_servers_one();
+                _exit(EXIT_SUCCESS);
+        }
+}
+
 int main(int argc, char **argv) {
         log_set_max_level(LOG_DEBUG);
         log_parse_environment();
 
         test_manager_parse_string();
+        test_samples_select();
+        test_samples_simulation();
+        test_fake_servers();
 
         return 0;
 }
@@ -120,5 +120,10 @@ int manager_parse_config_file(Manager *m) {
                 m->poll_interval_max_usec = MAX(NTP_POLL_INTERVAL_MAX_USEC, m->poll_interval_min_usec * 32);
         }
 
+        if (m->concurrent_servers < 1 || m->concurrent_servers > NTP_CONCURRENT_SERVERS_MAX) {
+                log_warning("ConcurrentServers= must be between 1 and %u. Using %u.", NTP_CONCURRENT_SERVERS_MAX, NTP_CONCURRENT_SERVERS_MAX);
+                m->concurrent_servers = CLAMP(m->concurrent_servers, 1U, NTP_CONCURRENT_SERVERS_MAX);
+        }
+
         return r;
 }
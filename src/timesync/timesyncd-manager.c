@@ -1,6 +1,9 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
+#include <fcntl.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
 #include <math.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
@@ -23,12 +26,14 @@
 #include "missing.h"
 #include "network-util.h"
 #include "ratelimit.h"
+#include "resolve-internal.h"
 #include "socket-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "time-util.h"
 #include "timesyncd-conf.h"
 #include "timesyncd-manager.h"
+#include "timesyncd-select.h"
 #include "util.h"
 
 #ifndef ADJ_SETOFFSET
@@ -57,10 +62,18 @@
 
 #define TIMEOUT_USEC (10*USEC_PER_SEC)
 
+/* How long to wait for the other servers once the current one replied */
+#define ROUND_TIMEOUT_USEC (1*USEC_PER_SEC)
+
+/* How long to reuse a resolved server name. A name that was resolved to find more servers to poll is resolved
+ * again once it becomes the current server, and names are cycled through quickly if servers don't reply. */
+#define RESOLVE_CACHE_USEC (1*USEC_PER_MINUTE)
+
 static int manager_arm_timer(Manager *m, usec_t next);
 static int manager_clock_watch_setup(Manager *m);
 static int manager_listen_setup(Manager *m);
 static void manager_listen_stop(Manager *m);
+static int manager_complete_round(Manager *m);
 
 static double ntp_ts_short_to_d(const struct ntp_ts_short *ts) {
         return be16toh(ts->sec) + (be16toh(ts->frac) / 65536.0);
@@ -88,7 +101,84 @@ static int manager_timeout(sd_event_source *source, usec_t usec, void *userdata)
         return manager_connect(m);
 }
 
-static int manager_send_request(Manager *m) {
+static void manager_resolve_peer_names(Manager *m);
+
+static ServerName *manager_first_server_name(Manager *m, ServerType t) {
+        assert(m);
+
+        if (t == SERVER_SYSTEM)
+                return m->system_servers;
+        if (t == SERVER_LINK)
+                return m->link_servers;
+
+        return m->fallback_servers;
+}
+
+static void manager_pick_peers(Manager *m) {
+        ServerName *n;
+        ServerAddress *a;
+
+        assert(m);
+        assert(m->current_server_address);
+
+        /* The current server always comes first, its replies drive the state machine. The others are the
+         * remaining addresses of the current name and of the other names in the same list, as far as they
+         * have been resolved already. They share the socket, hence need to be of the same family. */
+        m->peers[0] = m->current_server_address;
+        m->n_peers = 1;
+
+        if (m->concurrent_servers <= 1)
+                return;
+
+        for (n = manager_first_server_name(m, m->current_server_name->type); n && m->n_peers < m->concurrent_servers; n = n->names_next)
+                LIST_FOREACH(addresses, a, n->addresses) {
+                        if (m->n_peers >= m->concurrent_servers)
+                                break;
+
+                        if (a == m->current_server_address ||
+                            a->sockaddr.sa.sa_family != m->current_server_address->sockaddr.sa.sa_family)
+                                continue;
+
+                        m->peers[m->n_peers++] = a;
+                }
+
+        manager_resolve_peer_names(m);
+}
+
+static ServerAddress *manager_find_peer(Manager *m, const union sockaddr_union *sa) {
+        unsigned i;
+
+        assert(m);
+        assert(sa);
+
+        for (i = 0; i < m->n_peers; i++)
+                if (sockaddr_equal(sa, &m->peers[i]->sockaddr))
+                        return m->peers[i];
+
+        return NULL;
+}
+
+void manager_remove_peer(Manager *m, ServerAddress *a) {
+        unsigned i;
+
+        assert(m);
+        assert(a);
+
+        /* The current server is taken care of by manager_set_server_address() */
+        for (i = 1; i < m->n_peers; i++)
+                if (m->peers[i] == a) {
+                        if (a->pending) {
+                                assert(m->n_peers_pending > 0);
+                                m->n_peers_pending--;
+                        }
+
+                        memmove(m->peers + i, m->peers + i + 1, (m->n_peers - i - 1) * sizeof(ServerAddress*));
+                        m->n_peers--;
+                        return;
+                }
+}
+
+static int manager_send_ntp_request(Manager *m, ServerAddress *a) {
         _cleanup_free_ char *pretty = NULL;
         struct ntp_msg ntpmsg = {
                 /*
@@ -101,17 +191,11 @@ static int manager_send_request(Manager *m) {
                 .field = NTP_FIELD(0, 4, NTP_MODE_CLIENT),
         };
         ssize_t len;
-        int r;
 
         assert(m);
-        assert(m->current_server_name);
-        assert(m->current_server_address);
+        assert(a);
 
-        m->event_timeout = sd_event_source_unref(m->event_timeout);
-
-        r = manager_listen_setup(m);
-        if (r < 0)
-                return log_warning_errno(r, "Failed to setup connection socket: %m");
+        a->pending = a->have_trans_time_kernel = a->have_sample = false;
 
         /*
          * Set transmit timestamp, remember it; the server will send that back
@@ -121,21 +205,55 @@ static int manager_send_request(Manager *m) {
          * The actual value does not matter, We do not care about the correct
          * NTP UINT_MAX fraction; we just pass the plain nanosecond value.
          */
-        assert_se(clock_gettime(clock_boottime_or_monotonic(), &m->trans_time_mon) >= 0);
-        assert_se(clock_gettime(CLOCK_REALTIME, &m->trans_time) >= 0);
-        ntpmsg.trans_time.sec = htobe32(m->trans_time.tv_sec + OFFSET_1900_1970);
-        ntpmsg.trans_time.frac = htobe32(m->trans_time.tv_nsec);
+        assert_se(clock_gettime(CLOCK_REALTIME, &a->trans_time) >= 0);
+        ntpmsg.trans_time.sec = htobe32(a->trans_time.tv_sec + OFFSET_1900_1970);
+        ntpmsg.trans_time.frac = htobe32(a->trans_time.tv_nsec);
 
-        server_address_pretty(m->current_server_address, &pretty);
+        server_address_pretty(a, &pretty);
 
-        len = sendto(m->server_socket, &ntpmsg, sizeof(ntpmsg), MSG_DONTWAIT, &m->current_server_address->sockaddr.sa, m->current_server_address->socklen);
-        if (len == sizeof(ntpmsg)) {
-                m->pending = true;
-                log_debug("Sent NTP request to %s (%s).", strna(pretty), m->current_server_name->string);
-        } else {
-                log_debug_errno(errno, "Sending NTP request to %s (%s) failed: %m", strna(pretty), m->current_server_name->string);
+        len = sendto(m->server_socket, &ntpmsg, sizeof(ntpmsg), MSG_DONTWAIT, &a->sockaddr.sa, a->socklen);
+        if (len != sizeof(ntpmsg))
+                return log_debug_errno(errno, "Sending NTP request to %s (%s) failed: %m", strna(pretty), a->name->string);
+
+        /* The kernel numbers transmit timestamps by the packets sent on the socket */
+        a->tx_id = m->n_sent++;
+        a->pending = true;
+
+        log_debug("Sent NTP request to %s (%s).", strna(pretty), a->name->string);
+        return 0;
+}
+
+static int manager_send_request(Manager *m) {
+        unsigned i;
+        int r;
+
+        assert(m);
+        assert(m->current_server_name);
+        assert(m->current_server_address);
+
+        m->event_timeout = sd_event_source_unref(m->event_timeout);
+
+        r = manager_listen_setup(m);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to setup connection socket: %m");
+
+        /* Start a new round, replies to earlier requests no longer match */
+        m->event_round = sd_event_source_unref(m->event_round);
+        manager_pick_peers(m);
+
+        assert_se(clock_gettime(clock_boottime_or_monotonic(), &m->trans_time_mon) >= 0);
+
+        r = manager_send_ntp_request(m, m->current_server_address);
+        if (r < 0)
                 return manager_connect(m);
-        }
+
+        m->trans_time = m->current_server_address->trans_time;
+        m->pending = true;
+        m->n_peers_pending = 1;
+
+        for (i = 1; i < m->n_peers; i++)
+                if (manager_send_ntp_request(m, m->peers[i]) >= 0)
+                        m->n_peers_pending++;
 
         /* re-arm timer with increasing timeout, in case the packets never arrive back */
         if (m->retry_interval > 0) {
@@ -400,6 +518,137 @@ static void manager_adjust_poll(Manager *m, double offset, bool spike) {
         }
 }
 
+static int manager_receive_tx_timestamps(Manager *m, int fd) {
+        assert(m);
+        assert(fd >= 0);
+
+        /* Pick up the kernel's transmit timestamps from the error queue, and match them to the requests
+         * by the packet counter. Anything else on the error queue is an actual error. */
+        for (;;) {
+                union {
+                        struct cmsghdr cmsghdr;
+                        uint8_t buf[CMSG_SPACE(sizeof(struct scm_timestamping)) +
+                                    CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(union sockaddr_union))];
+                } control;
+                struct msghdr msghdr = {
+                        .msg_control = &control,
+                        .msg_controllen = sizeof(control),
+                };
+                const struct sock_extended_err *ee = NULL;
+                const struct scm_timestamping *ts = NULL;
+                struct cmsghdr *cmsg;
+                unsigned i;
+
+                if (recvmsg(fd, &msghdr, MSG_ERRQUEUE|MSG_DONTWAIT) < 0) {
+                        if (errno == EAGAIN)
+                                return 0;
+
+                        return -errno;
+                }
+
+                CMSG_FOREACH(cmsg, &msghdr) {
+                        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING)
+                                ts = (const struct scm_timestamping*) CMSG_DATA(cmsg);
+                        else if ((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                                 (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+                                ee = (const struct sock_extended_err*) CMSG_DATA(cmsg);
+                }
+
+                if (!ee)
+                        continue;
+                if (ee->ee_origin != SO_EE_ORIGIN_TIMESTAMPING)
+                        return -ee->ee_errno ?: -EIO;
+                if (!ts || timespec_load_nsec(&ts->ts[0]) == 0)
+                        continue;
+
+                for (i = 0; i < m->n_peers; i++)
+                        if (m->peers[i]->pending && m->peers[i]->tx_id == ee->ee_data) {
+                                m->peers[i]->trans_time_kernel = ts->ts[0];
+                                m->peers[i]->have_trans_time_kernel = true;
+                                break;
+                        }
+        }
+}
+
+static bool manager_check_response(Manager *m, ServerAddress *a, const struct ntp_msg *ntpmsg, double *ret_root_distance) {
+        double root_distance;
+
+        assert(m);
+        assert(a);
+        assert(ntpmsg);
+        assert(ret_root_distance);
+
+        if (be32toh(ntpmsg->recv_time.sec) < TIME_EPOCH + OFFSET_1900_1970 ||
+            be32toh(ntpmsg->trans_time.sec) < TIME_EPOCH + OFFSET_1900_1970) {
+                log_debug("Invalid reply from %s, returned times before epoch.", a->name->string);
+                return false;
+        }
+
+        if (NTP_FIELD_LEAP(ntpmsg->field) == NTP_LEAP_NOTINSYNC ||
+            ntpmsg->stratum == 0 || ntpmsg->stratum >= 16) {
+                log_debug("Server %s is not synchronized.", a->name->string);
+                return false;
+        }
+
+        if (!IN_SET(NTP_FIELD_VERSION(ntpmsg->field), 3, 4)) {
+                log_debug("Response NTPv%d from %s.", NTP_FIELD_VERSION(ntpmsg->field), a->name->string);
+                return false;
+        }
+
+        if (NTP_FIELD_MODE(ntpmsg->field) != NTP_MODE_SERVER) {
+                log_debug("Unsupported mode %d from %s.", NTP_FIELD_MODE(ntpmsg->field), a->name->string);
+                return false;
+        }
+
+        root_distance = ntp_ts_short_to_d(&ntpmsg->root_delay) / 2 + ntp_ts_short_to_d(&ntpmsg->root_dispersion);
+        if (root_distance > (double) m->max_root_distance_usec / (double) USEC_PER_SEC) {
+                log_debug("Server %s has too large root distance.", a->name->string);
+                return false;
+        }
+
+        *ret_root_distance = root_distance;
+        return true;
+}
+
+static int manager_round_timeout(sd_event_source *source, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        log_debug("%u of %u servers did not reply in time.", m->n_peers_pending, m->n_peers);
+
+        return manager_complete_round(m);
+}
+
+static int manager_round_progress(Manager *m) {
+        int r;
+
+        assert(m);
+
+        /* The current server decides when a round ends: once it replied, give the others a moment */
+        if (m->pending)
+                return 0;
+
+        if (m->n_peers_pending == 0)
+                return manager_complete_round(m);
+
+        if (m->event_round)
+                return 0;
+
+        r = sd_event_add_time(
+                        m->event,
+                        &m->event_round,
+                        clock_boottime_or_monotonic(),
+                        now(clock_boottime_or_monotonic()) + ROUND_TIMEOUT_USEC, 0,
+                        manager_round_timeout, m);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to arm round timer, not waiting for other servers: %m");
+                return manager_complete_round(m);
+        }
+
+        return 0;
+}
+
 static int manager_receive_response(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
         Manager *m = userdata;
         struct ntp_msg ntpmsg;
@@ -410,7 +659,7 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
         };
         union {
                 struct cmsghdr cmsghdr;
-                uint8_t buf[CMSG_SPACE(sizeof(struct timeval))];
+                uint8_t buf[CMSG_SPACE(sizeof(struct scm_timestamping))];
         } control;
         union sockaddr_union server_addr;
         struct msghdr msghdr = {
@@ -422,23 +671,32 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
                 .msg_namelen = sizeof(server_addr),
         };
         struct cmsghdr *cmsg;
-        struct timespec *recv_time = NULL;
+        struct timespec recv_time = {};
+        const char *timestamp_source = NULL;
+        ServerAddress *a;
+        bool current;
         ssize_t len;
         double origin, receive, trans, dest;
         double delay, offset;
         double root_distance;
-        bool spike;
-        int leap_sec;
         int r;
 
         assert(source);
         assert(m);
 
-        if (revents & (EPOLLHUP|EPOLLERR)) {
+        if ((revents & EPOLLHUP) || ((revents & EPOLLERR) && !m->timestamping)) {
                 log_warning("Server connection returned error.");
                 return manager_connect(m);
         }
 
+        if (m->timestamping) {
+                r = manager_receive_tx_timestamps(m, fd);
+                if (r < 0) {
+                        log_warning_errno(r, "Server connection returned error: %m");
+                        return manager_connect(m);
+                }
+        }
+
         len = recvmsg(fd, &msghdr, MSG_DONTWAIT);
         if (len < 0) {
                 if (errno == EAGAIN)
@@ -454,87 +712,65 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
                 return manager_connect(m);
         }
 
-        if (!m->current_server_name ||
-            !m->current_server_address ||
-            !sockaddr_equal(&server_addr, &m->current_server_address->sockaddr)) {
+        a = manager_find_peer(m, &server_addr);
+        if (!a) {
                 log_debug("Response from unknown server.");
                 return 0;
         }
 
+        current = a == m->current_server_address;
+
         CMSG_FOREACH(cmsg, &msghdr) {
-                if (cmsg->cmsg_level != SOL_SOCKET)
-                        continue;
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                        recv_time = *(struct timespec *) CMSG_DATA(cmsg);
+                        timestamp_source = "software";
+
+                } else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+                        const struct scm_timestamping *ts = (const struct scm_timestamping*) CMSG_DATA(cmsg);
 
-                switch (cmsg->cmsg_type) {
-                case SCM_TIMESTAMPNS:
-                        recv_time = (struct timespec *) CMSG_DATA(cmsg);
-                        break;
+                        if (timespec_load_nsec(&ts->ts[0]) > 0) {
+                                recv_time = ts->ts[0];
+                                timestamp_source = "kernel";
+                        }
                 }
         }
-        if (!recv_time) {
+
+        if (!timestamp_source) {
                 log_error("Invalid packet timestamp.");
                 return -EINVAL;
         }
 
-        if (!m->pending) {
+        if (!a->pending) {
                 log_debug("Unexpected reply. Ignoring.");
                 return 0;
         }
 
-        m->missed_replies = 0;
+        if (current)
+                m->missed_replies = 0;
 
         /* check our "time cookie" (we just stored nanoseconds in the fraction field) */
-        if (be32toh(ntpmsg.origin_time.sec) != m->trans_time.tv_sec + OFFSET_1900_1970 ||
-            be32toh(ntpmsg.origin_time.frac) != (unsigned long) m->trans_time.tv_nsec) {
+        if (be32toh(ntpmsg.origin_time.sec) != a->trans_time.tv_sec + OFFSET_1900_1970 ||
+            be32toh(ntpmsg.origin_time.frac) != (unsigned long) a->trans_time.tv_nsec) {
                 log_debug("Invalid reply; not our transmit time. Ignoring.");
                 return 0;
         }
 
-        m->event_timeout = sd_event_source_unref(m->event_timeout);
-
-        if (be32toh(ntpmsg.recv_time.sec) < TIME_EPOCH + OFFSET_1900_1970 ||
-            be32toh(ntpmsg.trans_time.sec) < TIME_EPOCH + OFFSET_1900_1970) {
-                log_debug("Invalid reply, returned times before epoch. Ignoring.");
-                return manager_connect(m);
-        }
+        a->pending = false;
+        assert(m->n_peers_pending > 0);
+        m->n_peers_pending--;
 
-        if (NTP_FIELD_LEAP(ntpmsg.field) == NTP_LEAP_NOTINSYNC ||
-            ntpmsg.stratum == 0 || ntpmsg.stratum >= 16) {
-                log_debug("Server is not synchronized. Disconnecting.");
-                return manager_connect(m);
-        }
-
-        if (!IN_SET(NTP_FIELD_VERSION(ntpmsg.field), 3, 4)) {
-                log_debug("Response NTPv%d. Disconnecting.", NTP_FIELD_VERSION(ntpmsg.field));
-                return manager_connect(m);
-        }
+        if (current)
+                m->event_timeout = sd_event_source_unref(m->event_timeout);
 
-        if (NTP_FIELD_MODE(ntpmsg.field) != NTP_MODE_SERVER) {
-                log_debug("Unsupported mode %d. Disconnecting.", NTP_FIELD_MODE(ntpmsg.field));
-                return manager_connect(m);
-        }
+        if (!manager_check_response(m, a, &ntpmsg, &root_distance)) {
+                if (current) {
+                        log_debug("Disconnecting.");
+                        return manager_connect(m);
+                }
 
-        root_distance = ntp_ts_short_to_d(&ntpmsg.root_delay) / 2 + ntp_ts_short_to_d(&ntpmsg.root_dispersion);
-        if (root_distance > (double) m->max_root_distance_usec / (double) USEC_PER_SEC) {
-                log_debug("Server has too large root distance. Disconnecting.");
-                return manager_connect(m);
+                return manager_round_progress(m);
         }
 
-        /* valid packet */
-        m->pending = false;
-        m->retry_interval = 0;
-
-        /* Stop listening */
-        manager_listen_stop(m);
-
-        /* announce leap seconds */
-        if (NTP_FIELD_LEAP(ntpmsg.field) & NTP_LEAP_PLUSSEC)
-                leap_sec = 1;
-        else if (NTP_FIELD_LEAP(ntpmsg.field) & NTP_LEAP_MINUSSEC)
-                leap_sec = -1;
-        else
-                leap_sec = 0;
-
         /*
          * "Timestamp Name          ID   When Generated
          *  ------------------------------------------------------------
@@ -545,20 +781,26 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
          *
          *  The round-trip delay, d, and system clock offset, t, are defined as:
          *  d = (T4 - T1) - (T3 - T2)     t = ((T2 - T1) + (T3 - T4)) / 2"
+         *
+         * If the kernel told us when the request actually left, use that rather than the time we put into
+         * it right before sending.
          */
-        origin = ts_to_d(&m->trans_time) + OFFSET_1900_1970;
+        origin = ts_to_d(a->have_trans_time_kernel ? &a->trans_time_kernel : &a->trans_time) + OFFSET_1900_1970;
         receive = ntp_ts_to_d(&ntpmsg.recv_time);
         trans = ntp_ts_to_d(&ntpmsg.trans_time);
-        dest = ts_to_d(recv_time) + OFFSET_1900_1970;
+        dest = ts_to_d(&recv_time) + OFFSET_1900_1970;
 
         offset = ((receive - origin) + (trans - dest)) / 2;
         delay = (dest - origin) - (trans - receive);
 
-        spike = manager_sample_spike_detection(m, offset, delay);
-
-        manager_adjust_poll(m, offset, spike);
+        a->sample = (NTPSample) {
+                .offset = offset,
+                .delay = delay,
+                .root_distance = root_distance,
+        };
+        a->have_sample = true;
 
-        log_debug("NTP response:\n"
+        log_debug("NTP response from %s:\n"
                   "  leap         : %u\n"
                   "  version      : %u\n"
                   "  mode         : %u\n"
@@ -566,15 +808,13 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
                   "  precision    : %.6f sec (%d)\n"
                   "  root distance: %.6f sec\n"
                   "  reference    : %.4s\n"
-                  "  origin       : %.3f\n"
+                  "  origin       : %.3f%s\n"
                   "  receive      : %.3f\n"
                   "  transmit     : %.3f\n"
-                  "  dest         : %.3f\n"
+                  "  dest         : %.3f (%s)\n"
                   "  offset       : %+.3f sec\n"
-                  "  delay        : %+.3f sec\n"
-                  "  packet count : %"PRIu64"\n"
-                  "  jitter       : %.3f%s\n"
-                  "  poll interval: " USEC_FMT "\n",
+                  "  delay        : %+.3f sec\n",
+                  a->name->string,
                   NTP_FIELD_LEAP(ntpmsg.field),
                   NTP_FIELD_VERSION(ntpmsg.field),
                   NTP_FIELD_MODE(ntpmsg.field),
@@ -582,30 +822,92 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
                   exp2(ntpmsg.precision), ntpmsg.precision,
                   root_distance,
                   ntpmsg.stratum == 1 ? ntpmsg.refid : "n/a",
-                  origin - OFFSET_1900_1970,
+                  origin - OFFSET_1900_1970, a->have_trans_time_kernel ? " (kernel)" : "",
                   receive - OFFSET_1900_1970,
                   trans - OFFSET_1900_1970,
-                  dest - OFFSET_1900_1970,
-                  offset, delay,
+                  dest - OFFSET_1900_1970, timestamp_source,
+                  offset, delay);
+
+        if (current) {
+                /* valid packet */
+                m->pending = false;
+                m->retry_interval = 0;
+
+                /* Save NTP response */
+                m->ntpmsg = ntpmsg;
+                m->origin_time = m->trans_time;
+                m->dest_time = recv_time;
+        }
+
+        return manager_round_progress(m);
+}
+
+static int manager_complete_round(Manager *m) {
+        NTPSample samples[NTP_CONCURRENT_SERVERS_MAX], combined;
+        unsigned i, n = 0;
+        bool spike;
+        int leap_sec;
+        int r;
+
+        assert(m);
+        assert(!m->pending);
+
+        m->event_round = sd_event_source_unref(m->event_round);
+
+        /* Stop listening */
+        manager_listen_stop(m);
+
+        for (i = 0; i < m->n_peers; i++)
+                if (m->peers[i]->have_sample)
+                        samples[n++] = m->peers[i]->sample;
+
+        assert(n > 0);
+        assert(m->current_server_address->have_sample);
+        combined = m->current_server_address->sample;
+
+        if (n > 1) {
+                r = ntp_samples_combine(samples, n, &combined);
+                if (r == -ENOENT)
+                        log_debug("No majority among the replies of %u servers, using %s only.", n, m->current_server_name->string);
+                else if (r < 0)
+                        log_warning_errno(r, "Failed to combine samples of %u servers, using %s only: %m", n, m->current_server_name->string);
+                else
+                        log_debug("Combined samples of %i out of %u servers: offset %+.6f sec, delay %.6f sec.", r, n, combined.offset, combined.delay);
+
+                if (r < 0)
+                        combined = m->current_server_address->sample;
+        }
+
+        /* announce leap seconds */
+        if (NTP_FIELD_LEAP(m->ntpmsg.field) & NTP_LEAP_PLUSSEC)
+                leap_sec = 1;
+        else if (NTP_FIELD_LEAP(m->ntpmsg.field) & NTP_LEAP_MINUSSEC)
+                leap_sec = -1;
+        else
+                leap_sec = 0;
+
+        spike = manager_sample_spike_detection(m, combined.offset, combined.delay);
+
+        manager_adjust_poll(m, combined.offset, spike);
+
+        log_debug("  packet count : %"PRIu64"\n"
+                  "  jitter       : %.3f%s\n"
+                  "  poll interval: " USEC_FMT "\n",
                   m->packet_count,
                   m->samples_jitter, spike ? " spike" : "",
                   m->poll_interval_usec / USEC_PER_SEC);
 
         if (!spike) {
                 m->sync = true;
-                r = manager_adjust_clock(m, offset, leap_sec);
+                r = manager_adjust_clock(m, combined.offset, leap_sec);
                 if (r < 0)
                         log_error_errno(r, "Failed to call clock_adjtime(): %m");
         }
 
-        /* Save NTP response */
-        m->ntpmsg = ntpmsg;
-        m->origin_time = m->trans_time;
-        m->dest_time = *recv_time;
         m->spike = spike;
 
         log_debug("interval/delta/delay/jitter/drift " USEC_FMT "s/%+.3fs/%.3fs/%.3fs/%+"PRI_TIMEX"ppm%s",
-                  m->poll_interval_usec / USEC_PER_SEC, offset, delay, m->samples_jitter, m->drift_freq / 65536,
+                  m->poll_interval_usec / USEC_PER_SEC, combined.offset, combined.delay, m->samples_jitter, m->drift_freq / 65536,
                   spike ? " (ignored)" : "");
 
         (void) sd_bus_emit_properties_changed(m->bus, "/org/freedesktop/timesync1", "org.freedesktop.timesync1.Manager", "NTPMessage", NULL);
@@ -631,6 +933,12 @@ static int manager_listen_setup(Manager *m) {
         union sockaddr_union addr = {};
         static const int tos = IPTOS_LOWDELAY;
         static const int on = 1;
+        static const int timestamping =
+                SOF_TIMESTAMPING_SOFTWARE |
+                SOF_TIMESTAMPING_RX_SOFTWARE |
+                SOF_TIMESTAMPING_TX_SOFTWARE |
+                SOF_TIMESTAMPING_OPT_ID |
+                SOF_TIMESTAMPING_OPT_TSONLY;
         int r;
 
         assert(m);
@@ -651,9 +959,16 @@ static int manager_listen_setup(Manager *m) {
         if (r < 0)
                 return -errno;
 
-        r = setsockopt(m->server_socket, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
-        if (r < 0)
-                return -errno;
+        /* Let the kernel timestamp requests when they leave and replies when they arrive. Older kernels only
+         * provide the latter. */
+        m->timestamping = setsockopt(m->server_socket, SOL_SOCKET, SO_TIMESTAMPING, &timestamping, sizeof(timestamping)) >= 0;
+        if (!m->timestamping) {
+                r = setsockopt(m->server_socket, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+                if (r < 0)
+                        return -errno;
+        }
+
+        m->n_sent = 0;
 
         (void) setsockopt(m->server_socket, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
 
@@ -667,7 +982,7 @@ static void manager_listen_stop(Manager *m) {
         m->server_socket = safe_close(m->server_socket);
 }
 
-static int manager_begin(Manager *m) {
+int manager_begin(Manager *m) {
         _cleanup_free_ char *pretty = NULL;
         int r;
 
@@ -776,6 +1091,73 @@ static int manager_resolve_handler(sd_resolve_query *q, int ret, const struct ad
         return manager_begin(m);
 }
 
+static int manager_peer_resolve_handler(sd_resolve_query *q, int ret, const struct addrinfo *ai, void *userdata) {
+        ServerName *n = userdata;
+        int r;
+
+        assert(q);
+        assert(n);
+
+        n->resolve_query = sd_resolve_query_unref(n->resolve_query);
+
+        if (ret != 0) {
+                log_debug("Failed to resolve %s: %s", n->string, gai_strerror(ret));
+                return 0;
+        }
+
+        /* The addresses are picked up with the next request */
+        for (; ai; ai = ai->ai_next) {
+                _cleanup_free_ char *pretty = NULL;
+                ServerAddress *a;
+
+                assert(ai->ai_addr);
+                assert(ai->ai_addrlen >= offsetof(struct sockaddr, sa_data));
+
+                if (!IN_SET(ai->ai_addr->sa_family, AF_INET, AF_INET6))
+                        continue;
+
+                r = server_address_new(n, &a, (const union sockaddr_union*) ai->ai_addr, ai->ai_addrlen);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to add server address: %m");
+
+                server_address_pretty(a, &pretty);
+                log_debug("Resolved address %s for %s.", pretty, n->string);
+        }
+
+        return 0;
+}
+
+static void manager_resolve_peer_names(Manager *m) {
+        static const struct addrinfo hints = {
+                .ai_flags = AI_NUMERICSERV|AI_ADDRCONFIG,
+                .ai_socktype = SOCK_DGRAM,
+        };
+        ServerName *n;
+        unsigned k;
+        int r;
+
+        assert(m);
+        assert(m->current_server_name);
+
+        /* Resolve as many of the other names in the list as might be needed to fill up the set of servers
+         * polled, so that they can join in from one of the next requests on. */
+        k = m->n_peers;
+        for (n = manager_first_server_name(m, m->current_server_name->type); n && k < m->concurrent_servers; n = n->names_next) {
+                if (n == m->current_server_name || n->addresses)
+                        continue;
+
+                if (!n->resolve_query) {
+                        r = sd_resolve_getaddrinfo(m->resolve, &n->resolve_query, n->string, "123", &hints, manager_peer_resolve_handler, n);
+                        if (r < 0) {
+                                log_debug_errno(r, "Failed to resolve %s: %m", n->string);
+                                return;
+                        }
+                }
+
+                k++;
+        }
+}
+
 static int manager_retry_connect(sd_event_source *source, usec_t usec, void *userdata) {
         Manager *m = userdata;
 
@@ -873,6 +1255,7 @@ int manager_connect(Manager *m) {
 
                 /* Flush out any previously resolved addresses */
                 server_name_flush_addresses(m->current_server_name);
+                m->current_server_name->resolve_query = sd_resolve_query_unref(m->current_server_name->resolve_query);
 
                 log_debug("Resolving %s...", m->current_server_name->string);
 
@@ -904,6 +1287,9 @@ void manager_disconnect(Manager *m) {
 
         m->event_timeout = sd_event_source_unref(m->event_timeout);
 
+        m->event_round = sd_event_source_unref(m->event_round);
+        m->n_peers = m->n_peers_pending = 0;
+
         sd_notifyf(false, "STATUS=Idle.");
 }
 
@@ -940,6 +1326,7 @@ void manager_free(Manager *m) {
         sd_resolve_unref(m->resolve);
         sd_event_unref(m->event);
 
+
         sd_bus_unref(m->bus);
 
         free(m);
@@ -1093,6 +1480,8 @@ int manager_new(Manager **ret) {
         m->poll_interval_min_usec = NTP_POLL_INTERVAL_MIN_USEC;
         m->poll_interval_max_usec = NTP_POLL_INTERVAL_MAX_USEC;
 
+        m->concurrent_servers = 1;
+
         m->server_socket = m->clock_watch_fd = -1;
 
         RATELIMIT_INIT(m->ratelimit, RATELIMIT_INTERVAL_USEC, RATELIMIT_BURST);
@@ -1114,6 +1503,10 @@ int manager_new(Manager **ret) {
         if (r < 0)
                 return r;
 
+        r = resolve_set_cache_timeout(m->resolve, RESOLVE_CACHE_USEC);
+        if (r < 0)
+                return r;
+
         r = manager_network_monitor_listen(m);
         if (r < 0)
                 return r;
@@ -25,6 +25,9 @@ typedef struct Manager Manager;
 #define NTP_POLL_INTERVAL_MIN_USEC      (32 * USEC_PER_SEC)
 #define NTP_POLL_INTERVAL_MAX_USEC      (2048 * USEC_PER_SEC)
 
+/* Maximum number of servers polled at the same time */
+#define NTP_CONCURRENT_SERVERS_MAX      8U
+
 struct Manager {
         sd_bus *bus;
         sd_event *event;
@@ -49,6 +52,8 @@ struct Manager {
         ServerName *current_server_name;
         ServerAddress *current_server_address;
         int server_socket;
+        bool timestamping;
+        uint32_t n_sent;
         int missed_replies;
         uint64_t packet_count;
         sd_event_source *event_timeout;
@@ -60,6 +65,12 @@ struct Manager {
         usec_t retry_interval;
         bool pending;
 
+        /* other servers polled along with the current one, which comes first */
+        ServerAddress *peers[NTP_CONCURRENT_SERVERS_MAX];
+        unsigned n_peers, n_peers_pending;
+        unsigned concurrent_servers;
+        sd_event_source *event_round;
+
         /* poll timer */
         sd_event_source *event_timer;
         usec_t poll_interval_usec;
@@ -105,6 +116,9 @@ DEFINE_TRIVIAL_CLEANUP_FUNC(Manager*, manager_free);
 void manager_set_server_name(Manager *m, ServerName *n);
 void manager_set_server_address(Manager *m, ServerAddress *a);
 void manager_flush_server_names(Manager *m, ServerType t);
+void manager_remove_peer(Manager *m, ServerAddress *a);
 
 int manager_connect(Manager *m);
+int manager_begin(Manager *m);
 void manager_disconnect(Manager *m);
+
@@ -0,0 +1,170 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "alloc-util.h"
+#include "macro.h"
+#include "timesyncd-select.h"
+
+/* Below this, all distances are considered equally good, so that the weights stay finite */
+#define NTP_DISTANCE_MIN 1e-6
+
+typedef struct Edge {
+        double value;
+        int type; /* -1: lower end, 0: offset, +1: upper end */
+} Edge;
+
+double ntp_sample_distance(const NTPSample *s) {
+        assert(s);
+
+        /* The true offset is within this distance of the measured one, unless the server lies: half of
+         * the round trip plus whatever the server itself may be off from its reference clock. */
+        return MAX(fabs(s->delay) / 2 + s->root_distance, NTP_DISTANCE_MIN);
+}
+
+static int edge_compare(const void *a, const void *b) {
+        const Edge *x = a, *y = b;
+
+        if (x->value < y->value)
+                return -1;
+        if (x->value > y->value)
+                return 1;
+
+        /* Let touching intervals overlap */
+        return CMP(x->type, y->type);
+}
+
+int ntp_samples_select(const NTPSample *samples, size_t n, bool *ret_truechimers) {
+        _cleanup_free_ Edge *edges = NULL;
+        double low = 0, high = 0;
+        size_t allow, i, n_true = 0;
+
+        assert(samples || n == 0);
+        assert(ret_truechimers || n == 0);
+
+        /* Marzullo's intersection algorithm as used by NTP (RFC 5905, section 11.2.1): find the smallest
+         * interval which contains the correctness intervals of a majority of the servers, allowing for as
+         * few falsetickers as possible. Returns the number of truechimers, i.e. servers whose interval
+         * overlaps with the intersection, or -ENOENT if no majority agrees. */
+
+        if (n == 0)
+                return -ENOENT;
+
+        edges = new(Edge, n * 3);
+        if (!edges)
+                return -ENOMEM;
+
+        for (i = 0; i < n; i++) {
+                double d = ntp_sample_distance(samples + i);
+
+                edges[i * 3 + 0] = (Edge) { samples[i].offset - d, -1 };
+                edges[i * 3 + 1] = (Edge) { samples[i].offset, 0 };
+                edges[i * 3 + 2] = (Edge) { samples[i].offset + d, +1 };
+        }
+
+        qsort(edges, n * 3, sizeof(Edge), edge_compare);
+
+        for (allow = 0; 2 * allow < n; allow++) {
+                size_t found = 0, chime = 0;
+                ssize_t j;
+
+                low = INFINITY;
+                for (j = 0; j < (ssize_t) n * 3; j++) {
+                        if (edges[j].type < 0)
+                                chime++;
+                        else if (edges[j].type > 0)
+                                chime--;
+                        else
+                                found++;
+
+                        if (chime >= n - allow) {
+                                low = edges[j].value;
+                                break;
+                        }
+                }
+
+                chime = 0;
+                high = -INFINITY;
+                for (j = (ssize_t) n * 3 - 1; j >= 0; j--) {
+                        if (edges[j].type > 0)
+                                chime++;
+                        else if (edges[j].type < 0)
+                                chime--;
+                        else
+                                found++;
+
+                        if (chime >= n - allow) {
+                                high = edges[j].value;
+                                break;
+                        }
+                }
+
+                /* Offsets outside of the intersection belong to falsetickers, more than we allowed for? */
+                if (found > allow)
+                        continue;
+
+                if (low <= high)
+                        break;
+        }
+
+        if (2 * allow >= n)
+                return -ENOENT;
+
+        for (i = 0; i < n; i++) {
+                double d = ntp_sample_distance(samples + i);
+
+                ret_truechimers[i] = samples[i].offset - d <= high && samples[i].offset + d >= low;
+                if (ret_truechimers[i])
+                        n_true++;
+        }
+
+        return (int) n_true;
+}
+
+int ntp_samples_combine(const NTPSample *samples, size_t n, NTPSample *ret) {
+        _cleanup_free_ bool *truechimers = NULL;
+        double sum = 0, weights = 0, best = INFINITY;
+        size_t i, best_idx = 0;
+        int r;
+
+        assert(samples || n == 0);
+        assert(ret);
+
+        truechimers = new(bool, MAX(n, 1U));
+        if (!truechimers)
+                return -ENOMEM;
+
+        r = ntp_samples_select(samples, n, truechimers);
+        if (r < 0)
+                return r;
+
+        /* Average the offsets of the truechimers weighted by the inverse of their distance, i.e. half the
+         * round-trip delay plus the root distance. Delay and root distance are taken from the closest one
+         * among them, which is what the poll interval and spike detection are then based on. */
+        for (i = 0; i < n; i++) {
+                double d;
+
+                if (!truechimers[i])
+                        continue;
+
+                d = ntp_sample_distance(samples + i);
+
+                sum += samples[i].offset / d;
+                weights += 1 / d;
+
+                if (d < best) {
+                        best = d;
+                        best_idx = i;
+                }
+        }
+
+        *ret = (NTPSample) {
+                .offset = sum / weights,
+                .delay = samples[best_idx].delay,
+                .root_distance = samples[best_idx].root_distance,
+        };
+
+        return r;
+}
@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* One measurement against one server, all values in seconds */
+typedef struct NTPSample {
+        double offset;
+        double delay;
+        double root_distance;
+} NTPSample;
+
+double ntp_sample_distance(const NTPSample *s);
+
+int ntp_samples_select(const NTPSample *samples, size_t n, bool *ret_truechimers);
+int ntp_samples_combine(const NTPSample *samples, size_t n, NTPSample *ret);
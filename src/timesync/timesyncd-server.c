@@ -40,6 +40,9 @@ ServerAddress* server_address_free(ServerAddress *a) {
         if (a->name) {
                 LIST_REMOVE(addresses, a->name->addresses, a);
 
+                if (a->name->manager)
+                        manager_remove_peer(a->name->manager, a);
+
                 if (a->name->manager && a->name->manager->current_server_address == a)
                         manager_set_server_address(a->name->manager, NULL);
         }
@@ -118,6 +121,7 @@ ServerName *server_name_free(ServerName *n) {
 
         log_debug("Removed server %s.", n->string);
 
+        sd_resolve_query_unref(n->resolve_query);
         free(n->string);
         return mfree(n);
 }
@@ -2,8 +2,11 @@
 #pragma once
 
 
+#include "sd-resolve.h"
+
 #include "list.h"
 #include "socket-util.h"
+#include "timesyncd-select.h"
 
 typedef struct ServerAddress ServerAddress;
 typedef struct ServerName ServerName;
@@ -22,6 +25,15 @@ struct ServerAddress {
         union sockaddr_union sockaddr;
         socklen_t socklen;
 
+        /* the request last sent to this address */
+        struct timespec trans_time;
+        struct timespec trans_time_kernel;
+        uint32_t tx_id;
+        bool pending:1;
+        bool have_trans_time_kernel:1;
+        bool have_sample:1;
+        NTPSample sample;
+
         LIST_FIELDS(ServerAddress, addresses);
 };
 
@@ -33,6 +45,9 @@ struct ServerName {
 
         bool marked:1;
 
+        /* resolving in the background, when polling several servers */
+        sd_resolve_query *resolve_query;
+
         LIST_HEAD(ServerAddress, addresses);
         LIST_FIELDS(ServerName, names);
 };
@@ -7,12 +7,15 @@
 #include <glob.h>
 #include <limits.h>
 #include <linux/fs.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <sys/xattr.h>
 #include <sysexits.h>
 #include <time.h>
@@ -37,6 +40,7 @@
 #include "glob-util.h"
 #include "io-util.h"
 #include "label.h"
+#include "list.h"
 #include "log.h"
 #include "macro.h"
 #include "missing.h"
@@ -145,6 +149,65 @@ typedef enum DirectoryType {
         _DIRECTORY_TYPE_MAX,
 } DirectoryType;
 
+typedef struct CleanupStats {
+        uint64_t n_scanned;
+        uint64_t n_removed;
+        uint64_t bytes_freed;
+} CleanupStats;
+
+typedef struct CleanupInstance {
+        int r;
+        bool done;
+} CleanupInstance;
+
+typedef struct CleanupDir CleanupDir;
+
+struct CleanupDir {
+        CleanupInstance *instance;
+        CleanupDir *parent;
+        LIST_FIELDS(CleanupDir, queue);
+
+        Item *item;
+        char *path;
+        const char *name;
+        DIR *dir;
+        struct stat st; /* as it was before we started cleaning up */
+        usec_t cutoff;
+        int maxdepth;
+
+        /* One reference for the enumeration of the directory itself, plus one for each subdirectory that is not
+         * completely cleaned up yet */
+        unsigned n_ref;
+
+        bool mountpoint;
+        bool keep_this_level;
+        bool deleted;
+        bool skip;
+};
+
+typedef struct CleanupItem {
+        Item *item;
+        bool started;
+        bool done;
+} CleanupItem;
+
+typedef struct CleanupContext {
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        LIST_HEAD(CleanupDir, queue);
+        unsigned n_queued;
+        unsigned n_queued_max;
+
+        /* Items with a clean action, in the order they were processed in */
+        CleanupItem *items;
+        size_t n_items, n_allocated;
+        size_t n_done;
+
+        int error;
+        CleanupStats stats;
+} CleanupContext;
+
 static bool arg_cat_config = false;
 static bool arg_user = false;
 static bool arg_create = false;
@@ -152,6 +215,7 @@ static bool arg_clean = false;
 static bool arg_remove = false;
 static bool arg_boot = false;
 static bool arg_no_pager = false;
+static bool arg_stats = false;
 
 static char **arg_include_prefixes = NULL;
 static char **arg_exclude_prefixes = NULL;
@@ -160,8 +224,28 @@ static char *arg_replace = NULL;
 
 #define MAX_DEPTH 256
 
+/* The maximum number of threads we use for cleaning up, including the main thread */
+#define CLEANUP_WORKERS_MAX 16U
+
+/* How many directories we queue per thread before we descend into them directly from the thread that found them */
+#define CLEANUP_QUEUE_PER_WORKER 8U
+
+/* Only subdirectories on the topmost levels below a cleaned up directory are distributed among threads, further down we
+ * simply recurse. A directory stays open until all its subdirectories are done, hence this bounds the number of
+ * directory fds we keep open at the same time. */
+#define CLEANUP_PARALLEL_DEPTH 4
+
 static OrderedHashmap *items = NULL, *globs = NULL;
 static Set *unix_sockets = NULL;
+static bool unix_sockets_loaded = false;
+
+static CleanupContext cleanup = {
+        .mutex = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+};
+
+/* Counted by each thread on its own, and added to cleanup.stats when it is done */
+static thread_local CleanupStats cleanup_stats = {};
 
 static int specifier_machine_id_safe(char specifier, void *data, void *userdata, char **ret);
 static int specifier_directory(char specifier, void *data, void *userdata, char **ret);
@@ -365,9 +449,11 @@ static void load_unix_sockets(void) {
         _cleanup_fclose_ FILE *f = NULL;
         int r;
 
-        if (unix_sockets)
+        if (unix_sockets_loaded)
                 return;
 
+        unix_sockets_loaded = true;
+
         /* We maintain a cache of the sockets we found in /proc/net/unix to speed things up a little. */
 
         unix_sockets = set_new(&path_hash_ops);
@@ -454,14 +540,20 @@ static bool unix_socket_alive(const char *fn) {
         return true;
 }
 
-static int dir_is_mount_point(DIR *d, const char *subdir) {
+static int dir_is_mount_point(DIR *d, int *r_parent, int *mount_id_parent, const char *subdir) {
 
-        int mount_id_parent, mount_id;
+        int mount_id;
         int r_p, r;
 
-        r_p = name_to_handle_at_loop(dirfd(d), ".", NULL, &mount_id_parent, 0);
-        if (r_p < 0)
-                r_p = -errno;
+        /* The mount ID of the directory itself is the same for all its entries, hence we only look it up for the
+         * first one. *r_parent is positive until then. */
+        if (*r_parent > 0) {
+                *r_parent = name_to_handle_at_loop(dirfd(d), ".", NULL, mount_id_parent, 0);
+                if (*r_parent < 0)
+                        *r_parent = -errno;
+        }
+
+        r_p = *r_parent;
 
         r = name_to_handle_at_loop(dirfd(d), subdir, NULL, &mount_id, 0);
         if (r < 0)
@@ -473,7 +565,7 @@ static int dir_is_mount_point(DIR *d, const char *subdir) {
 
         /* got both handles; if they differ, it is a mount point */
         if (r_p >= 0 && r >= 0)
-                return mount_id_parent != mount_id;
+                return *mount_id_parent != mount_id;
 
         /* got only one handle; assume different mount points if one
          * of both queries was not supported by the filesystem */
@@ -508,6 +600,123 @@ static DIR* opendir_nomod(const char *path) {
         return xopendirat_nomod(AT_FDCWD, path);
 }
 
+/* Only what we need to decide whether to remove something */
+#define CLEANUP_STATX_MASK (STATX_TYPE|STATX_MODE|STATX_NLINK|STATX_UID|STATX_ATIME|STATX_MTIME|STATX_CTIME|STATX_BLOCKS)
+
+static int dir_cleanup_stat(DIR *d, const char *name, struct stat *ret, int *ret_mountpoint) {
+        struct_statx sx;
+
+        /* Where statx() is available we ask only for the fields we need, which is cheaper on some file systems, and
+         * also learn whether the entry is a mount point. In that case *ret_mountpoint is set to 0 or 1, otherwise to
+         * -1, and the caller has to find out on its own. */
+
+        if (statx(dirfd(d), name, AT_SYMLINK_NOFOLLOW|AT_STATX_DONT_SYNC, CLEANUP_STATX_MASK, &sx) >= 0 &&
+            FLAGS_SET(sx.stx_mask, CLEANUP_STATX_MASK)) {
+
+                *ret = (struct stat) {
+                        .st_dev = makedev(sx.stx_dev_major, sx.stx_dev_minor),
+                        .st_mode = sx.stx_mode,
+                        .st_nlink = sx.stx_nlink,
+                        .st_uid = sx.stx_uid,
+                        .st_blocks = sx.stx_blocks,
+                        .st_atim = { sx.stx_atime.tv_sec, sx.stx_atime.tv_nsec },
+                        .st_mtim = { sx.stx_mtime.tv_sec, sx.stx_mtime.tv_nsec },
+                        .st_ctim = { sx.stx_ctime.tv_sec, sx.stx_ctime.tv_nsec },
+                };
+
+                *ret_mountpoint = FLAGS_SET(sx.stx_attributes_mask, STATX_ATTR_MOUNT_ROOT) ?
+                        FLAGS_SET(sx.stx_attributes, STATX_ATTR_MOUNT_ROOT) : -1;
+                return 0;
+        }
+
+        if (errno == ENOENT)
+                return -ENOENT;
+
+        /* statx() is not supported, or some of the fields were not returned */
+        if (fstatat(dirfd(d), name, ret, AT_SYMLINK_NOFOLLOW) < 0)
+                return -errno;
+
+        *ret_mountpoint = -1;
+        return 0;
+}
+
+static void dir_restore_times(const char *p, DIR *d, const struct stat *ds) {
+        struct timespec times[2];
+        usec_t age1, age2;
+        char a[FORMAT_TIMESTAMP_MAX], b[FORMAT_TIMESTAMP_MAX];
+
+        /* Restore original directory timestamps */
+        times[0] = ds->st_atim;
+        times[1] = ds->st_mtim;
+
+        age1 = timespec_load(&ds->st_atim);
+        age2 = timespec_load(&ds->st_mtim);
+        log_debug("Restoring access and modification time on \"%s\": %s, %s",
+                  p,
+                  format_timestamp_us(a, sizeof(a), age1),
+                  format_timestamp_us(b, sizeof(b), age2));
+        if (futimens(dirfd(d), times) < 0)
+                log_error_errno(errno, "utimensat(%s): %m", p);
+}
+
+static int dir_cleanup_subdir(
+                DIR *d,
+                const char *name,
+                const char *sub_path,
+                const struct stat *s,
+                usec_t cutoff,
+                bool keep_this_level) {
+
+        usec_t age;
+
+        /* Note: if you are wondering why we don't
+         * support the sticky bit for excluding
+         * directories from cleaning like we do it for
+         * other file system objects: well, the sticky
+         * bit already has a meaning for directories,
+         * so we don't want to overload that. */
+
+        if (keep_this_level) {
+                log_debug("Keeping \"%s\".", sub_path);
+                return 0;
+        }
+
+        /* Ignore ctime, we change it when deleting */
+        age = timespec_load(&s->st_mtim);
+        if (age >= cutoff) {
+                char a[FORMAT_TIMESTAMP_MAX];
+                /* Follows spelling in stat(1). */
+                log_debug("Directory \"%s\": modify time %s is too new.",
+                          sub_path,
+                          format_timestamp_us(a, sizeof(a), age));
+                return 0;
+        }
+
+        age = timespec_load(&s->st_atim);
+        if (age >= cutoff) {
+                char a[FORMAT_TIMESTAMP_MAX];
+                log_debug("Directory \"%s\": access time %s is too new.",
+                          sub_path,
+                          format_timestamp_us(a, sizeof(a), age));
+                return 0;
+        }
+
+        log_debug("Removing directory \"%s\".", sub_path);
+        if (unlinkat(dirfd(d), name, AT_REMOVEDIR) < 0) {
+                if (!IN_SET(errno, ENOENT, ENOTEMPTY))
+                        return log_error_errno(errno, "rmdir(%s): %m", sub_path);
+
+                return 0;
+        }
+
+        cleanup_stats.n_removed++;
+        cleanup_stats.bytes_freed += (uint64_t) s->st_blocks * 512U;
+
+        return 0;
+}
+
+static int cleanup_dir_add(CleanupDir *parent, char *path, const struct stat *st, int maxdepth);
+
 static int dir_cleanup(
                 Item *i,
                 const char *p,
@@ -517,27 +726,31 @@ static int dir_cleanup(
                 dev_t rootdev,
                 bool mountpoint,
                 int maxdepth,
-                bool keep_this_level) {
+                bool keep_this_level,
+                CleanupDir *node) {
 
         struct dirent *dent;
-        struct timespec times[2];
         bool deleted = false;
-        int r = 0;
+        int r = 0, r_parent = 1, mount_id_parent = -1;
 
         FOREACH_DIRENT_ALL(dent, d, break) {
                 struct stat s;
                 usec_t age;
                 _cleanup_free_ char *sub_path = NULL;
+                int q, is_mountpoint;
 
                 if (dot_or_dot_dot(dent->d_name))
                         continue;
 
-                if (fstatat(dirfd(d), dent->d_name, &s, AT_SYMLINK_NOFOLLOW) < 0) {
-                        if (errno == ENOENT)
+                cleanup_stats.n_scanned++;
+
+                q = dir_cleanup_stat(d, dent->d_name, &s, &is_mountpoint);
+                if (q < 0) {
+                        if (q == -ENOENT)
                                 continue;
 
                         /* FUSE, NFS mounts, SELinux might return EACCES */
-                        r = log_full_errno(errno == EACCES ? LOG_DEBUG : LOG_ERR, errno,
+                        r = log_full_errno(q == -EACCES ? LOG_DEBUG : LOG_ERR, q,
                                            "stat(%s/%s) failed: %m", p, dent->d_name);
                         continue;
                 }
@@ -551,7 +764,9 @@ static int dir_cleanup(
                 /* Try to detect bind mounts of the same filesystem instance; they
                  * do not differ in device major/minors. This type of query is not
                  * supported on all kernels or filesystem types though. */
-                if (S_ISDIR(s.st_mode) && dir_is_mount_point(d, dent->d_name) > 0) {
+                if (S_ISDIR(s.st_mode) && is_mountpoint < 0)
+                        is_mountpoint = dir_is_mount_point(d, &r_parent, &mount_id_parent, dent->d_name);
+                if (S_ISDIR(s.st_mode) && is_mountpoint > 0) {
                         log_debug("Ignoring \"%s/%s\": different mount of the same filesystem.",
                                   p, dent->d_name);
                         continue;
@@ -585,9 +800,16 @@ static int dir_cleanup(
 
                         if (maxdepth <= 0)
                                 log_warning("Reached max depth on \"%s\".", sub_path);
-                        else {
+                        else if (node && maxdepth > MAX_DEPTH - CLEANUP_PARALLEL_DEPTH) {
+                                /* Leave the subdirectory to whichever thread is free. Whether to remove it is
+                                 * decided once it is cleaned up, see cleanup_dir_unref(). */
+                                q = cleanup_dir_add(node, TAKE_PTR(sub_path), &s, maxdepth-1);
+                                if (q < 0)
+                                        r = q;
+
+                                continue;
+                        } else {
                                 _cleanup_closedir_ DIR *sub_dir;
-                                int q;
 
                                 sub_dir = xopendirat_nomod(dirfd(d), dent->d_name);
                                 if (!sub_dir) {
@@ -597,47 +819,14 @@ static int dir_cleanup(
                                         continue;
                                 }
 
-                                q = dir_cleanup(i, sub_path, sub_dir, &s, cutoff, rootdev, false, maxdepth-1, false);
+                                q = dir_cleanup(i, sub_path, sub_dir, &s, cutoff, rootdev, false, maxdepth-1, false, NULL);
                                 if (q < 0)
                                         r = q;
                         }
 
-                        /* Note: if you are wondering why we don't
-                         * support the sticky bit for excluding
-                         * directories from cleaning like we do it for
-                         * other file system objects: well, the sticky
-                         * bit already has a meaning for directories,
-                         * so we don't want to overload that. */
-
-                        if (keep_this_level) {
-                                log_debug("Keeping \"%s\".", sub_path);
-                                continue;
-                        }
-
-                        /* Ignore ctime, we change it when deleting */
-                        age = timespec_load(&s.st_mtim);
-                        if (age >= cutoff) {
-                                char a[FORMAT_TIMESTAMP_MAX];
-                                /* Follows spelling in stat(1). */
-                                log_debug("Directory \"%s\": modify time %s is too new.",
-                                          sub_path,
-                                          format_timestamp_us(a, sizeof(a), age));
-                                continue;
-                        }
-
-                        age = timespec_load(&s.st_atim);
-                        if (age >= cutoff) {
-                                char a[FORMAT_TIMESTAMP_MAX];
-                                log_debug("Directory \"%s\": access time %s is too new.",
-                                          sub_path,
-                                          format_timestamp_us(a, sizeof(a), age));
-                                continue;
-                        }
-
-                        log_debug("Removing directory \"%s\".", sub_path);
-                        if (unlinkat(dirfd(d), dent->d_name, AT_REMOVEDIR) < 0)
-                                if (!IN_SET(errno, ENOENT, ENOTEMPTY))
-                                        r = log_error_errno(errno, "rmdir(%s): %m", sub_path);
+                        q = dir_cleanup_subdir(d, dent->d_name, sub_path, &s, cutoff, keep_this_level);
+                        if (q < 0)
+                                r = q;
 
                 } else {
                         /* Skip files for which the sticky bit is
@@ -707,34 +896,194 @@ static int dir_cleanup(
 
                         log_debug("unlink \"%s\"", sub_path);
 
-                        if (unlinkat(dirfd(d), dent->d_name, 0) < 0)
+                        if (unlinkat(dirfd(d), dent->d_name, 0) < 0) {
                                 if (errno != ENOENT)
                                         r = log_error_errno(errno, "unlink(%s): %m", sub_path);
+                        } else {
+                                cleanup_stats.n_removed++;
+
+                                /* Hard links to the file elsewhere keep its data around */
+                                if (s.st_nlink <= 1)
+                                        cleanup_stats.bytes_freed += (uint64_t) s.st_blocks * 512U;
+                        }
 
                         deleted = true;
                 }
         }
 
 finish:
-        if (deleted) {
-                usec_t age1, age2;
-                char a[FORMAT_TIMESTAMP_MAX], b[FORMAT_TIMESTAMP_MAX];
+        if (node)
+                node->deleted = deleted; /* Restored once the subdirectories are done too, see cleanup_dir_unref() */
+        else if (deleted)
+                dir_restore_times(p, d, ds);
+
+        return r;
+}
+
+static void cleanup_dir_unref(CleanupDir *d, int r) {
+
+        while (d) {
+                CleanupDir *parent;
+                unsigned n_ref;
+
+                assert_se(pthread_mutex_lock(&cleanup.mutex) == 0);
+                if (r < 0 && d->instance->r == 0)
+                        d->instance->r = r;
+                assert(d->n_ref > 0);
+                n_ref = --d->n_ref;
+                assert_se(pthread_mutex_unlock(&cleanup.mutex) == 0);
+
+                if (n_ref > 0)
+                        return;
+
+                /* All subdirectories are done, and removed if they were old enough. Only now we may restore the
+                 * timestamps of this directory and decide whether to remove it, like the serial walk does. */
+                if (d->dir && d->deleted)
+                        dir_restore_times(d->path, d->dir, &d->st);
 
-                /* Restore original directory timestamps */
-                times[0] = ds->st_atim;
-                times[1] = ds->st_mtim;
+                d->dir = safe_closedir(d->dir);
 
-                age1 = timespec_load(&ds->st_atim);
-                age2 = timespec_load(&ds->st_mtim);
-                log_debug("Restoring access and modification time on \"%s\": %s, %s",
-                          p,
-                          format_timestamp_us(a, sizeof(a), age1),
-                          format_timestamp_us(b, sizeof(b), age2));
-                if (futimens(dirfd(d), times) < 0)
-                        log_error_errno(errno, "utimensat(%s): %m", p);
+                parent = d->parent;
+                r = 0;
+
+                if (parent) {
+                        if (!d->skip)
+                                r = dir_cleanup_subdir(parent->dir, d->name, d->path, &d->st, d->cutoff,
+                                                       parent->keep_this_level);
+                } else {
+                        assert_se(pthread_mutex_lock(&cleanup.mutex) == 0);
+                        d->instance->done = true;
+                        assert_se(pthread_cond_broadcast(&cleanup.cond) == 0);
+                        assert_se(pthread_mutex_unlock(&cleanup.mutex) == 0);
+                }
+
+                free(d->path);
+                free(d);
+
+                d = parent;
         }
+}
 
-        return r;
+static void cleanup_dir_process(CleanupDir *d) {
+        int r = 0;
+
+        assert(d);
+
+        if (!d->dir) {
+                d->dir = xopendirat_nomod(dirfd(d->parent->dir), d->name);
+                if (!d->dir) {
+                        if (errno != ENOENT)
+                                r = log_error_errno(errno, "opendir(%s) failed: %m", d->path);
+
+                        d->skip = true;
+                }
+        }
+
+        if (d->dir)
+                r = dir_cleanup(d->item, d->path, d->dir, &d->st, d->cutoff, d->st.st_dev, d->mountpoint,
+                                d->maxdepth, d->keep_this_level, d);
+
+        cleanup_dir_unref(d, r);
+}
+
+static int cleanup_dir_add(CleanupDir *parent, char *path, const struct stat *st, int maxdepth) {
+        bool queued = false;
+        CleanupDir *d;
+
+        assert(parent);
+        assert(path);
+        assert(st);
+
+        d = new(CleanupDir, 1);
+        if (!d) {
+                free(path);
+                return log_oom();
+        }
+
+        *d = (CleanupDir) {
+                .instance = parent->instance,
+                .parent = parent,
+                .item = parent->item,
+                .path = path,
+                .name = strrchr(path, '/') + 1,
+                .st = *st,
+                .cutoff = parent->cutoff,
+                .maxdepth = maxdepth,
+                .n_ref = 1,
+        };
+
+        assert_se(pthread_mutex_lock(&cleanup.mutex) == 0);
+        parent->n_ref++;
+        if (cleanup.n_queued < cleanup.n_queued_max) {
+                LIST_PREPEND(queue, cleanup.queue, d);
+                cleanup.n_queued++;
+                queued = true;
+
+                assert_se(pthread_cond_signal(&cleanup.cond) == 0);
+        }
+        assert_se(pthread_mutex_unlock(&cleanup.mutex) == 0);
+
+        /* The queue is full, descend into the directory from this thread */
+        if (!queued)
+                cleanup_dir_process(d);
+
+        return 0;
+}
+
+/* Must be called with the mutex held, which is released while the directory is processed */
+static void cleanup_dir_process_queued(void) {
+        CleanupDir *d;
+
+        d = cleanup.queue;
+        LIST_REMOVE(queue, cleanup.queue, d);
+        cleanup.n_queued--;
+
+        assert_se(pthread_mutex_unlock(&cleanup.mutex) == 0);
+        cleanup_dir_process(d);
+        assert_se(pthread_mutex_lock(&cleanup.mutex) == 0);
+}
+
+static int cleanup_dir_run(Item *i, const char *instance, DIR *dir, const struct stat *st, usec_t cutoff, bool mountpoint) {
+        CleanupInstance ci = {};
+        CleanupDir *d;
+        char *path;
+
+        path = strdup(instance);
+        d = new(CleanupDir, 1);
+        if (!path || !d) {
+                free(path);
+                free(d);
+                closedir(dir);
+                return log_oom();
+        }
+
+        *d = (CleanupDir) {
+                .instance = &ci,
+                .item = i,
+                .path = path,
+                .name = path,
+                .dir = dir,
+                .st = *st,
+                .cutoff = cutoff,
+                .maxdepth = MAX_DEPTH,
+                .n_ref = 1,
+                .mountpoint = mountpoint,
+                .keep_this_level = i->keep_first_level,
+        };
+
+        cleanup_dir_process(d);
+
+        /* Subdirectories might still be in the works in other threads, help out until all of them are done */
+        assert_se(pthread_mutex_lock(&cleanup.mutex) == 0);
+        while (!ci.done) {
+                if (cleanup.queue)
+                        cleanup_dir_process_queued();
+                else
+                        assert_se(pthread_cond_wait(&cleanup.cond, &cleanup.mutex) == 0);
+        }
+        assert_se(pthread_mutex_unlock(&cleanup.mutex) == 0);
+
+        return ci.r;
 }
 
 static bool dangerous_hardlinks(void) {
@@ -1890,8 +2239,7 @@ static int clean_item_instance(Item *i, const char* instance) {
                   instance,
                   format_timestamp_us(timestamp, sizeof(timestamp), cutoff));
 
-        return dir_cleanup(i, instance, d, &s, cutoff, s.st_dev, mountpoint,
-                           MAX_DEPTH, i->keep_first_level);
+        return cleanup_dir_run(i, instance, TAKE_PTR(d), &s, cutoff, mountpoint);
 }
 
 static int clean_item(Item *i) {
@@ -1917,6 +2265,197 @@ static int clean_item(Item *i) {
         }
 }
 
+static size_t path_glob_free_prefix(const char *p) {
+        const char *e;
+
+        /* Returns the length of the leading directories of a path that do not contain any globbing */
+
+        e = strpbrk(p, GLOB_CHARS);
+        if (!e)
+                return strlen(p);
+
+        e = memrchr(p, '/', e - p);
+        return e ? (size_t) (e - p) : 0;
+}
+
+static bool clean_items_overlap(Item *a, Item *b) {
+        size_t la, lb;
+
+        la = path_glob_free_prefix(a->path);
+        lb = path_glob_free_prefix(b->path);
+        if (la > lb) {
+                SWAP_TWO(a, b);
+                SWAP_TWO(la, lb);
+        }
+
+        if (strncmp(a->path, b->path, la) != 0)
+                return false;
+
+        /* Only match whole path components */
+        return la == 0 || la == lb || a->path[la-1] == '/' || b->path[la] == '/';
+}
+
+static int cleanup_add_item(Item *i) {
+        assert(i);
+
+        if (!i->age_set)
+                return 0;
+
+        /* Cleaning up is left until everything is created and removed, see cleanup_run() */
+        if (!GREEDY_REALLOC(cleanup.items, cleanup.n_allocated, cleanup.n_items + 1))
+                return log_oom();
+
+        cleanup.items[cleanup.n_items++] = (CleanupItem) {
+                .item = i,
+        };
+
+        return 0;
+}
+
+/* Must be called with the mutex held */
+static CleanupItem* cleanup_next_item(void) {
+        size_t k, j;
+
+        /* Returns the first item not started yet whose path does not overlap with any earlier item that is not done
+         * yet. This way items whose paths are prefixes of one another are cleaned up one after the other, in the
+         * order they were processed in, while unrelated items are cleaned up in parallel. */
+
+        for (k = 0; k < cleanup.n_items; k++) {
+                if (cleanup.items[k].started)
+                        continue;
+
+                for (j = 0; j < k; j++)
+                        if (!cleanup.items[j].done &&
+                            clean_items_overlap(cleanup.items[j].item, cleanup.items[k].item))
+                                break;
+
+                if (j >= k)
+                        return cleanup.items + k;
+        }
+
+        return NULL;
+}
+
+static void* cleanup_worker(void *p) {
+
+        assert_se(pthread_mutex_lock(&cleanup.mutex) == 0);
+
+        for (;;) {
+                CleanupItem *ci;
+                int r;
+
+                /* Directories first, so that those waiting for them are done as early as possible */
+                if (cleanup.queue) {
+                        cleanup_dir_process_queued();
+                        continue;
+                }
+
+                if (cleanup.n_done >= cleanup.n_items)
+                        break;
+
+                ci = cleanup_next_item();
+                if (!ci) {
+                        assert_se(pthread_cond_wait(&cleanup.cond, &cleanup.mutex) == 0);
+                        continue;
+                }
+
+                ci->started = true;
+                assert_se(pthread_mutex_unlock(&cleanup.mutex) == 0);
+
+                r = clean_item(ci->item);
+
+                assert_se(pthread_mutex_lock(&cleanup.mutex) == 0);
+                ci->done = true;
+                cleanup.n_done++;
+                if (r < 0 && cleanup.error == 0)
+                        cleanup.error = r;
+
+                /* Items waiting for this one might be ready now */
+                assert_se(pthread_cond_broadcast(&cleanup.cond) == 0);
+        }
+
+        cleanup.stats.n_scanned += cleanup_stats.n_scanned;
+        cleanup.stats.n_removed += cleanup_stats.n_removed;
+        cleanup.stats.bytes_freed += cleanup_stats.bytes_freed;
+        cleanup_stats = (CleanupStats) {};
+
+        assert_se(pthread_mutex_unlock(&cleanup.mutex) == 0);
+
+        return NULL;
+}
+
+static void* cleanup_worker_thread(void *p) {
+
+        /* Assign a pretty name to this thread */
+        (void) pthread_setname_np(pthread_self(), "tmpfiles-clean");
+
+        return cleanup_worker(p);
+}
+
+static unsigned cleanup_n_workers(void) {
+        const char *e;
+        unsigned n;
+        long k;
+
+        e = getenv("SYSTEMD_TMPFILES_CLEAN_THREADS");
+        if (e) {
+                if (safe_atou(e, &n) >= 0 && n > 0)
+                        return MIN(n, CLEANUP_WORKERS_MAX);
+
+                log_warning("Failed to parse $SYSTEMD_TMPFILES_CLEAN_THREADS, ignoring: %s", e);
+        }
+
+        k = sysconf(_SC_NPROCESSORS_ONLN);
+        if (k <= 0)
+                return 1;
+
+        return MIN((unsigned) k, CLEANUP_WORKERS_MAX);
+}
+
+static int cleanup_run(void) {
+        pthread_t workers[CLEANUP_WORKERS_MAX - 1];
+        unsigned n_workers, n_started = 0, k;
+        sigset_t ss, saved_ss;
+        int r;
+
+        if (cleanup.n_items == 0)
+                return 0;
+
+        /* The list of live sockets is consulted from all threads, hence load it before starting any */
+        load_unix_sockets();
+
+        n_workers = cleanup_n_workers();
+        cleanup.n_queued_max = (n_workers - 1) * CLEANUP_QUEUE_PER_WORKER;
+
+        /* No signals in forked off threads please. We set the mask before forking, so that the threads never exist
+         * with a different mask than a fully blocked one. If that doesn't work, we'll just do the work on our own. */
+        if (n_workers > 1 &&
+            sigfillset(&ss) >= 0 &&
+            pthread_sigmask(SIG_BLOCK, &ss, &saved_ss) == 0) {
+
+                for (; n_started < n_workers - 1; n_started++) {
+                        r = pthread_create(workers + n_started, NULL, cleanup_worker_thread, NULL);
+                        if (r > 0) {
+                                /* Not fatal, we'll just make do with fewer threads */
+                                log_debug_errno(r, "Failed to start worker thread, continuing with %u threads: %m", n_started + 1);
+                                break;
+                        }
+                }
+
+                r = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+                if (r > 0)
+                        log_debug_errno(r, "Failed to restore signal mask, ignoring: %m");
+        }
+
+        /* The main thread does its share of the work too */
+        (void) cleanup_worker(NULL);
+
+        for (k = 0; k < n_started; k++)
+                (void) pthread_join(workers[k], NULL);
+
+        return cleanup.error;
+}
+
 static int process_item_array(ItemArray *array);
 
 static int process_item(Item *i) {
@@ -1952,7 +2491,7 @@ static int process_item(Item *i) {
 
         r = arg_create ? create_item(i) : 0;
         q = arg_remove ? remove_item(i) : 0;
-        p = arg_clean ? clean_item(i) : 0;
+        p = arg_clean ? cleanup_add_item(i) : 0;
 
         return t < 0 ? t :
                 r < 0 ? r :
@@ -2502,6 +3041,7 @@ static void help(void) {
                "     --create               Create marked files/directories\n"
                "     --clean                Clean up marked directories\n"
                "     --remove               Remove marked files/directories\n"
+               "     --stats                Show statistics after cleaning up\n"
                "     --boot                 Execute actions only safe at boot\n"
                "     --prefix=PATH          Only apply rules with the specified prefix\n"
                "     --exclude-prefix=PATH  Ignore rules with the specified prefix\n"
@@ -2526,6 +3066,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_ROOT,
                 ARG_REPLACE,
                 ARG_NO_PAGER,
+                ARG_STATS,
         };
 
         static const struct option options[] = {
@@ -2542,6 +3083,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "root",           required_argument,   NULL, ARG_ROOT           },
                 { "replace",        required_argument,   NULL, ARG_REPLACE        },
                 { "no-pager",       no_argument,         NULL, ARG_NO_PAGER       },
+                { "stats",          no_argument,         NULL, ARG_STATS          },
                 {}
         };
 
@@ -2615,6 +3157,10 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_no_pager = true;
                         break;
 
+                case ARG_STATS:
+                        arg_stats = true;
+                        break;
+
                 case '?':
                         return -EINVAL;
 
@@ -2627,6 +3173,11 @@ static int parse_argv(int argc, char *argv[]) {
                 return -EINVAL;
         }
 
+        if (arg_stats && !arg_clean) {
+                log_error("Option --stats requires --clean.");
+                return -EINVAL;
+        }
+
         if (arg_replace && arg_cat_config) {
                 log_error("Option --replace= is not supported with --cat-config");
                 return -EINVAL;
@@ -2851,6 +3402,21 @@ int main(int argc, char *argv[]) {
                         r_process = k;
         }
 
+        /* Cleaning up is done last, and in parallel for items which don't
+         * depend on each other. */
+        k = cleanup_run();
+        if (k < 0 && r_process == 0)
+                r_process = k;
+
+        if (arg_stats) {
+                char buf[FORMAT_BYTES_MAX];
+
+                printf("Scanned %" PRIu64 " files and directories, removed %" PRIu64 ", freed %s.\n",
+                       cleanup.stats.n_scanned,
+                       cleanup.stats.n_removed,
+                       format_bytes(buf, sizeof(buf), cleanup.stats.bytes_freed));
+        }
+
 finish:
         pager_close();
 
@@ -2862,6 +3428,7 @@ finish:
         free(arg_root);
 
         set_free_free(unix_sockets);
+        free(cleanup.items);
 
         mac_selinux_finish();
 
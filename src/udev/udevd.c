@@ -62,6 +62,7 @@ static unsigned arg_children_max;
 static int arg_exec_delay;
 static usec_t arg_event_timeout_usec = 180 * USEC_PER_SEC;
 static usec_t arg_event_timeout_warn_usec = 180 * USEC_PER_SEC / 3;
+static bool arg_trace = false;
 
 typedef struct Manager {
         struct udev *udev;
@@ -78,6 +79,7 @@ typedef struct Manager {
         struct udev_ctrl *ctrl;
         struct udev_ctrl_connection *ctrl_conn_blocking;
         int fd_inotify;
+        int fd_trace;
         int worker_watch[2];
 
         sd_event_source *ctrl_event;
@@ -112,6 +114,8 @@ struct event {
         dev_t devnum;
         int ifindex;
         bool is_block;
+        usec_t queued_usec;
+        usec_t started_usec;
         sd_event_source *timeout_warning;
         sd_event_source *timeout;
 };
@@ -268,6 +272,8 @@ static void worker_attach_event(struct worker *worker, struct event *event) {
 
         assert_se(sd_event_now(e, CLOCK_MONOTONIC, &usec) >= 0);
 
+        event->started_usec = usec;
+
         (void) sd_event_add_time(e, &event->timeout_warning, CLOCK_MONOTONIC,
                                  usec + arg_event_timeout_warn_usec, USEC_PER_SEC, on_event_timeout_warning, event);
 
@@ -298,6 +304,7 @@ static void manager_free(Manager *manager) {
         udev_rules_unref(manager->rules);
 
         safe_close(manager->fd_inotify);
+        safe_close(manager->fd_trace);
         safe_close_pair(manager->worker_watch);
 
         free(manager);
@@ -604,6 +611,7 @@ static int event_queue_insert(Manager *manager, struct udev_device *dev) {
         event->devnum = udev_device_get_devnum(dev);
         event->is_block = streq("block", udev_device_get_subsystem(dev));
         event->ifindex = udev_device_get_ifindex(dev);
+        event->queued_usec = now(CLOCK_MONOTONIC);
 
         log_debug("seq %llu queued, '%s' '%s'", udev_device_get_seqnum(dev),
              udev_device_get_action(dev), udev_device_get_subsystem(dev));
@@ -822,6 +830,24 @@ static void event_queue_cleanup(Manager *manager, enum event_state match_type) {
         }
 }
 
+static void event_trace(Manager *manager, struct event *event, pid_t pid) {
+        assert(manager);
+
+        /* Record when the event was queued, when it was handed to a worker, and when the worker finished it,
+         * so that "systemd-analyze trace" can show udev event processing next to the unit activations. All
+         * timestamps are CLOCK_MONOTONIC. */
+
+        if (manager->fd_trace < 0 || !event)
+                return;
+
+        if (dprintf(manager->fd_trace, "%llu "USEC_FMT" "USEC_FMT" "USEC_FMT" "PID_FMT" %s %s\n",
+                    event->seqnum, event->queued_usec, event->started_usec, now(CLOCK_MONOTONIC), pid,
+                    strna(udev_device_get_action(event->dev)), event->devpath) < 0) {
+                log_warning_errno(errno, "Failed to write event trace, disabling: %m");
+                manager->fd_trace = safe_close(manager->fd_trace);
+        }
+}
+
 static int on_worker(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         Manager *manager = userdata;
 
@@ -885,6 +911,7 @@ static int on_worker(sd_event_source *s, int fd, uint32_t revents, void *userdat
                         worker->state = WORKER_IDLE;
 
                 /* worker returned */
+                event_trace(manager, worker->event, worker->pid);
                 event_free(worker->event);
         }
 
@@ -1346,12 +1373,22 @@ static int listen_fds(int *rctrl, int *rnetlink) {
  *   udev.children_max=<number of workers>     events are fully serialized if set to 1
  *   udev.exec_delay=<number of seconds>       delay execution of every executed program
  *   udev.event_timeout=<number of seconds>    seconds to wait before terminating an event
+ *   udev.trace=<boolean>                      record event processing times in /run/udev/trace
  */
 static int parse_proc_cmdline_item(const char *key, const char *value, void *data) {
         int r = 0;
 
         assert(key);
 
+        if (proc_cmdline_key_streq(key, "udev.trace")) {
+
+                r = value ? parse_boolean(value) : true;
+                if (r >= 0)
+                        arg_trace = r;
+
+                goto finish;
+        }
+
         if (!value)
                 return 0;
 
@@ -1392,6 +1429,7 @@ static int parse_proc_cmdline_item(const char *key, const char *value, void *dat
         } else if (startswith(key, "udev."))
                 log_warning("Unknown udev kernel command line option \"%s\"", key);
 
+finish:
         if (r < 0)
                 log_warning_errno(r, "Failed to parse \"%s=%s\", ignoring: %m", key, value);
 
@@ -1410,10 +1448,15 @@ static void help(void) {
                "  -t --event-timeout=SECONDS  Seconds to wait before terminating an event\n"
                "  -N --resolve-names=early|late|never\n"
                "                              When to resolve users and groups\n"
+               "     --trace                 Record event processing times in /run/udev/trace\n"
                , program_invocation_short_name);
 }
 
 static int parse_argv(int argc, char *argv[]) {
+        enum {
+                ARG_TRACE = 0x100,
+        };
+
         static const struct option options[] = {
                 { "daemon",             no_argument,            NULL, 'd' },
                 { "debug",              no_argument,            NULL, 'D' },
@@ -1421,6 +1464,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "exec-delay",         required_argument,      NULL, 'e' },
                 { "event-timeout",      required_argument,      NULL, 't' },
                 { "resolve-names",      required_argument,      NULL, 'N' },
+                { "trace",              no_argument,            NULL, ARG_TRACE },
                 { "help",               no_argument,            NULL, 'h' },
                 { "version",            no_argument,            NULL, 'V' },
                 {}
@@ -1461,6 +1505,9 @@ static int parse_argv(int argc, char *argv[]) {
                 case 'D':
                         arg_debug = true;
                         break;
+                case ARG_TRACE:
+                        arg_trace = true;
+                        break;
                 case 'N':
                         if (streq(optarg, "early")) {
                                 arg_resolve_names = 1;
@@ -1503,6 +1550,7 @@ static int manager_new(Manager **ret, int fd_ctrl, int fd_uevent, const char *cg
                 return log_oom();
 
         manager->fd_inotify = -1;
+        manager->fd_trace = -1;
         manager->worker_watch[WRITE_END] = -1;
         manager->worker_watch[READ_END] = -1;
 
@@ -1546,6 +1594,13 @@ static int manager_new(Manager **ret, int fd_ctrl, int fd_uevent, const char *cg
 
         udev_watch_restore(manager->udev);
 
+        if (arg_trace) {
+                /* Append, so that the events processed in the initrd are kept */
+                manager->fd_trace = open("/run/udev/trace", O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC|O_NOCTTY, 0644);
+                if (manager->fd_trace < 0)
+                        log_warning_errno(errno, "Failed to open /run/udev/trace, ignoring: %m");
+        }
+
         /* block and listen to all signals on signalfd */
         assert_se(sigprocmask_many(SIG_BLOCK, NULL, SIGTERM, SIGINT, SIGHUP, SIGCHLD, -1) >= 0);
 
@@ -87,6 +87,20 @@ function check_notification_socket {
     systemd-nspawn --register=no -D /nc-container -U /bin/sh -x -c "$_cmd"
 }
 
+function check_startup_timing {
+    # Start a trivial container repeatedly, and show where the time goes
+    local _root="/var/lib/machines/startup-timing"
+    local _n=10 _i _start _end
+    /create-busybox-container "$_root"
+    systemd-nspawn --register=no -D "$_root" --debug-timing /bin/sh -c :
+    _start=$(date +%s%N)
+    for ((_i = 0; _i < _n; _i++)); do
+        SYSTEMD_LOG_LEVEL=info systemd-nspawn --quiet --register=no -D "$_root" /bin/sh -c :
+    done
+    _end=$(date +%s%N)
+    printf "Started trivial container %d times, %d ms per start\n" $_n $(( (_end - _start) / _n / 1000000 ))
+}
+
 function run {
     if [[ "$1" = "yes" && "$is_v2_supported" = "no" ]]; then
         printf "Unified cgroup hierarchy is not supported. Skipping.\n" >&2
@@ -167,6 +181,8 @@ check_bind_tmp_path
 
 check_notification_socket
 
+check_startup_timing
+
 for api_vfs_writable in yes no network; do
     run no no $api_vfs_writable
     run yes no $api_vfs_writable
@@ -102,6 +102,30 @@ test_run() {
 
         rm -f $TESTDIR/etc/sysusers.d/* $TESTDIR/usr/lib/sysusers.d/*
 
+        # a large configuration, like when provisioning images with many service accounts
+        echo "*** Testing a large configuration"
+        prepare_testdir
+        for i in $(seq 0 2999); do
+                echo "old$i:x:$((10000 + i * 3)):$((10000 + i * 3))::/:/sbin/nologin"
+        done >$TESTDIR/etc/passwd
+        for i in $(seq 0 2999); do
+                echo "old$i:x:$((10000 + i * 3)):"
+        done >$TESTDIR/etc/group
+        echo "r - 10000-29999" >$TESTDIR/usr/lib/sysusers.d/test.conf
+        for i in $(seq 0 4999); do
+                echo "u svc$i - \"Service $i\""
+        done >>$TESTDIR/usr/lib/sysusers.d/test.conf
+        start=$(date +%s%N)
+        systemd-sysusers --root=$TESTDIR
+        end=$(date +%s%N)
+        echo "*** Creating 5000 users took $(( (end - start) / 1000000 ))ms"
+        test $(grep -c '^svc' $TESTDIR/etc/passwd) -eq 5000
+        test $(grep -c '^svc' $TESTDIR/etc/group) -eq 5000
+        test -z "$(cut -d: -f3 $TESTDIR/etc/passwd | sort | uniq -d)"
+        test -z "$(cut -d: -f3 $TESTDIR/etc/group | sort | uniq -d)"
+
+        rm -f $TESTDIR/etc/sysusers.d/* $TESTDIR/usr/lib/sysusers.d/*
+
         # tests for error conditions
         for f in unhappy-*.input; do
                 echo "*** Running test $f"
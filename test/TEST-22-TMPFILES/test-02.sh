@@ -0,0 +1,56 @@
+#! /bin/bash
+#
+# Clean up a synthetic tree with a single thread and with several threads,
+# make sure both leave the same files behind, and report how long
+# each run took.
+#
+
+set -e
+
+populate() {
+        rm -fr /tmp/clean
+        for a in $(seq 1 20); do
+                mkdir -p /tmp/clean/$a/keep
+                for b in $(seq 1 20); do
+                        mkdir /tmp/clean/$a/$b
+                        touch $(seq -f "/tmp/clean/$a/$b/%g" 1 20)
+                done
+        done
+
+        touch /tmp/clean/3/keep/sticky
+        chmod +t /tmp/clean/3/keep/sticky
+
+        # The change time can't be faked, hence let everything age a bit,
+        # except for a few files which get a timestamp in the future
+        find /tmp/clean -mindepth 1 -print0 | xargs -0 touch -h -d "-1 day"
+        touch -d "+1 day" /tmp/clean/1/1/1 /tmp/clean/2/3/4
+        sleep 2
+}
+
+run() {
+        local start end
+
+        populate
+        start=$(date +%s%N)
+        SYSTEMD_TMPFILES_CLEAN_THREADS=$1 systemd-tmpfiles --clean --stats - <<EOF2
+d /tmp/clean - - - 1s
+d /tmp/clean/5/keep - - - 1s
+e /tmp/clean/*/keep - - - 1s
+EOF2
+        end=$(date +%s%N)
+        echo "Cleaning up with $1 threads took $(( (end - start) / 1000000 ))ms"
+
+        find /tmp/clean | sort >/tmp/clean-$2
+}
+
+run 1 serial
+run 16 parallel
+
+cmp /tmp/clean-serial /tmp/clean-parallel
+test -e /tmp/clean/1/1/1
+test -e /tmp/clean/2/3/4
+test -e /tmp/clean/3/keep/sticky
+test -d /tmp/clean/5/keep
+test ! -e /tmp/clean/6/6
+
+rm -fr /tmp/clean /tmp/clean-serial /tmp/clean-parallel
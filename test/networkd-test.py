@@ -1031,6 +1031,177 @@ class UnmanagedClientTest(unittest.TestCase, NetworkdTestingUtilities):
                                 m0unm='managed')
 
 
+class LLDPScaleTest(unittest.TestCase, NetworkdTestingUtilities):
+    """Receive LLDP on many links at once.
+
+    This runs networkd in its own network namespace, so that the many test
+    links don't show up on the host. Its configuration and state directories
+    are private and it has no bus access, so that it doesn't get in the way of
+    the host's networkd.
+    """
+
+    NETNS = 'networkd-test-lldp'
+    UNIT = 'networkd-test-lldp.service'
+
+    # LLDP frame with chassis MAC 00:01:02:03:04:05, port "1/3", TTL 120s
+    FRAME = bytes([0x01, 0x80, 0xc2, 0x00, 0x00, 0x0e,
+                   0x02, 0x00, 0x00, 0x00, 0x00, 0x01,
+                   0x88, 0xcc,
+                   0x02, 0x07, 0x04, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05,
+                   0x04, 0x04, 0x05, 0x31, 0x2f, 0x33,
+                   0x06, 0x02, 0x00, 0x78,
+                   0x00, 0x00])
+
+    # sends frames given as "iface:count:hex" arguments from inside the namespace
+    SEND_FRAMES = """\
+import socket, sys
+for arg in sys.argv[1:]:
+    iface, count, frame = arg.split(':')
+    with socket.socket(socket.AF_PACKET, socket.SOCK_RAW) as s:
+        s.bind((iface, 0))
+        for i in range(int(count)):
+            s.send(bytes.fromhex(frame))
+"""
+
+    def setUp(self):
+        self.n_links = int(os.environ.get('NETWORKD_TEST_LLDP_LINKS', '200'))
+        self.networkd_pid = None
+
+        # only networkd inside the namespace sees this
+        self.config_dir = tempfile.mkdtemp(prefix='networkd-test-lldp.')
+        self.addCleanup(shutil.rmtree, self.config_dir)
+        with open(os.path.join(self.config_dir, 'lldp-scale.network'), 'w') as f:
+            f.write("[Match]\nName=lldpa*\n[Network]\nLLDP=yes\nLinkLocalAddressing=no\nIPv6AcceptRA=no\n")
+
+        subprocess.check_call(['ip', 'netns', 'add', self.NETNS])
+        # removing the namespace removes the links in it too
+        self.addCleanup(subprocess.call, ['ip', 'netns', 'del', self.NETNS])
+
+    def tearDown(self):
+        """Stop networkd."""
+        subprocess.call(['systemctl', 'stop', self.UNIT])
+        subprocess.call(['systemctl', 'reset-failed', self.UNIT])
+
+    def netns_exec(self, *args):
+        """Command line to run something in the network and mount namespaces of networkd."""
+        return ['nsenter', '-t', self.networkd_pid, '-m', '-n'] + list(args)
+
+    def add_netns_veth_pair(self, veth, peer):
+        """Add a veth interface pair inside the namespace, and bring the peer up."""
+        subprocess.check_call(['ip', '-n', self.NETNS, 'link', 'add', 'name', veth,
+                               'type', 'veth', 'peer', 'name', peer])
+        subprocess.check_call(['ip', '-n', self.NETNS, 'link', 'set', peer, 'up'])
+
+    def start_networkd(self, links):
+        """Run networkd as in systemd-networkd.service, but inside the namespace.
+
+        Like the router side of NetworkdClientTest, it gets its own
+        /run/systemd/network and /run/systemd/netif, and no bus. Link indexes
+        are per network namespace, hence its state files would otherwise
+        clash with those of the host's networkd.
+        """
+        os.makedirs('/run/systemd/netif', exist_ok=True)
+
+        out = subprocess.check_output(['systemctl', 'cat', 'systemd-networkd.service'],
+                                      universal_newlines=True)
+        exe = [l.split('=', 1)[1].lstrip('@+-!') for l in out.splitlines() if l.startswith('ExecStart=')][0]
+        subprocess.check_call(['systemd-run', '--unit=' + self.UNIT, '--service-type=notify',
+                               '-p', 'InaccessibleDirectories=-/etc/systemd/network',
+                               '-p', 'InaccessibleDirectories=-/run/dbus',
+                               '-p', 'BindReadOnlyPaths={}:{}'.format(self.config_dir, NETWORK_UNITDIR),
+                               '-p', 'TemporaryFileSystem=/run/systemd/netif',
+                               'ip', 'netns', 'exec', self.NETNS] + exe.split())
+
+        self.networkd_pid = subprocess.check_output(['systemctl', 'show', '--value', '--property', 'MainPID',
+                                                     self.UNIT], universal_newlines=True).strip()
+
+        # wait until all links are configured
+        for timeout in range(100):
+            out = subprocess.check_output(self.netns_exec('networkctl', '--no-legend'),
+                                          universal_newlines=True)
+            states = {f[1]: f[-1] for f in (l.split() for l in out.splitlines()) if len(f) >= 5}
+            if all(states.get(l) not in (None, 'pending', 'configuring') for l in links):
+                break
+            time.sleep(0.1)
+        else:
+            self.fail('Links were not configured: {}'.format(links))
+
+    def send_frames(self, *frames):
+        """Send (interface, frame, count) tuples from inside the namespace."""
+        subprocess.check_call(self.netns_exec(sys.executable, '-c', self.SEND_FRAMES) +
+                              ['{}:{}:{}'.format(iface, count, frame.hex()) for iface, frame, count in frames])
+
+    def networkd_stats(self):
+        """Return the number of open fds and the CPU time in clock ticks of networkd."""
+        fds = len(os.listdir('/proc/{}/fd'.format(self.networkd_pid)))
+        with open('/proc/{}/stat'.format(self.networkd_pid)) as f:
+            fields = f.read().rsplit(')', 1)[1].split()
+        return fds, int(fields[11]) + int(fields[12])
+
+    def test_lldp_many_links(self):
+        """Receive LLDP on many links, with a bounded number of fds."""
+        links = ['lldpa{}'.format(i) for i in range(self.n_links)]
+        for i in range(self.n_links):
+            self.add_netns_veth_pair('lldpa{}'.format(i), 'lldpb{}'.format(i))
+
+        self.start_networkd(links)
+
+        fds, cpu = self.networkd_stats()
+
+        self.send_frames(*[('lldpb{}'.format(i), self.FRAME, 1) for i in range(self.n_links)])
+
+        for timeout in range(50):
+            out = subprocess.check_output(self.netns_exec('networkctl', 'lldp', '--no-legend'),
+                                          universal_newlines=True)
+            n = len([l for l in out.splitlines() if l.startswith('lldpa')])
+            if n >= self.n_links:
+                break
+            time.sleep(0.2)
+
+        fds_after, cpu_after = self.networkd_stats()
+        print('{} links: {} fds, {} ticks to receive one LLDP frame on each'.format(
+            self.n_links, fds_after, cpu_after - cpu))
+
+        self.assertEqual(n, self.n_links)
+        # the receive path is shared, we don't need a socket per link
+        self.assertLess(fds_after, self.n_links)
+
+    def test_lldp_refresh_keeps_file(self):
+        """Neighbors resending the same data don't cause the LLDP file to be rewritten."""
+        self.add_netns_veth_pair('lldpa0', 'lldpb0')
+        self.start_networkd(['lldpa0'])
+
+        ifindex = subprocess.check_output(self.netns_exec('cat', '/sys/class/net/lldpa0/ifindex'),
+                                          universal_newlines=True).strip()
+        # the file is only visible in networkd's mount namespace
+        path = '/proc/{}/root/run/systemd/netif/lldp/{}'.format(self.networkd_pid, ifindex)
+
+        def wait_for_inode(old):
+            for timeout in range(50):
+                try:
+                    st = os.stat(path)
+                    if st.st_ino != old:
+                        return st.st_ino
+                except FileNotFoundError:
+                    pass
+                time.sleep(0.1)
+            self.fail('{} was not (re)written'.format(path))
+
+        self.send_frames(('lldpb0', self.FRAME, 1))
+        ino = wait_for_inode(None)
+
+        # files are replaced by rename(), so a rewrite shows up as a new inode
+        self.send_frames(('lldpb0', self.FRAME, 500))
+        time.sleep(1)
+        self.assertEqual(os.stat(path).st_ino, ino)
+
+        # a different TTL is a change though
+        changed = bytearray(self.FRAME)
+        changed[32] = 0x79
+        self.send_frames(('lldpb0', bytes(changed), 1))
+        wait_for_inode(ino)
+
+
 if __name__ == '__main__':
     unittest.main(testRunner=unittest.TextTestRunner(stream=sys.stdout,
                                                      verbosity=2))